@@ -8,6 +8,9 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CSimpleArraysTask.h"
 #include "CMatrixRotateTask.h"
 
+#include "../Common/CBenchmarkSweep.h"
+#include "../Common/CLUtil.h"
+
 #include <iostream>
 
 using namespace std;
@@ -20,23 +23,19 @@ bool CAssignment1::DoCompute() {
   cout << "Running vector addition example..." << endl
        << endl;
 
-
-  //size_t locsize[] = {16, 32, 64, 128, 256, 512, 1024};
-  //size_t vecsize[] = {10000, 100000, 1000000, 10000000, 100000000};
-
-  //for (int i = 0; i < 7; ++i) {
-  //  for (int j = 0; j < 5; ++j) {
-  //    size_t LocalWorkSize[3] = {locsize[i], 1, 1};
-  //    CSimpleArraysTask task(vecsize[j]);
-  //    RunComputeTask(task, LocalWorkSize);
-  //  }
-  //}
-
   {
     size_t LocalWorkSize[3] = {256, 1, 1};
     CSimpleArraysTask task(1564320);
     RunComputeTask(task, LocalWorkSize);
   }
+  {
+    // one round trip with and without overlapping transfers, each timed on its own
+    size_t LocalWorkSize[3] = {256, 1, 1};
+    CSimpleArraysTask serialized(1564320, CTransferPipeline::Serialized);
+    RunComputeTask(serialized, LocalWorkSize);
+    CSimpleArraysTask pipelined(1564320, CTransferPipeline::Pipelined);
+    RunComputeTask(pipelined, LocalWorkSize);
+  }
 
 
 	// Task 2: matrix rotation.
@@ -61,7 +60,35 @@ bool CAssignment1::DoCompute() {
 		CMatrixRotateTask task(6001, 4000);
 		RunComputeTask(task, LocalWorkSize);
 	}
+	{
+		// one round trip with and without overlapping transfers, each timed on its own
+		size_t LocalWorkSize[3] = {32, 16, 1};
+		CMatrixRotateTask serialized(6001, 4000, CTransferPipeline::Serialized);
+		RunComputeTask(serialized, LocalWorkSize);
+		CMatrixRotateTask pipelined(6001, 4000, CTransferPipeline::Pipelined);
+		RunComputeTask(pipelined, LocalWorkSize);
+	}
 
 	return true;
 }
 
+bool CAssignment1::DoBenchmarkSweep() {
+  // ComputeGPU() uploads A and B, runs the kernel 100 times and reads back C
+  CBenchmarkSweep sweep("VecAdd", [](const CBenchmarkSweep::Configuration& Config, size_t& Elements, size_t& Bytes) -> IComputeTask* {
+    Elements = 100 * Config.ProblemSize;
+    Bytes = (100 * 3 + 3) * Config.ProblemSize * sizeof(int);
+    return new CSimpleArraysTask(Config.ProblemSize);
+  });
+
+  size_t locsize[] = {16, 32, 64, 128, 256, 512, 1024};
+  size_t vecsize[] = {10000, 100000, 1000000, 10000000, 100000000};
+  for (size_t i = 0; i < ARRAYLEN(locsize); ++i) sweep.AddLocalWorkSize(locsize[i]);
+  // 0 runs the tuned local work size next to the fixed ones
+  sweep.AddLocalWorkSize(0);
+  for (size_t j = 0; j < ARRAYLEN(vecsize); ++j) sweep.AddProblemSize(vecsize[j]);
+  sweep.SetIterations(1, 3);
+
+  if (!RunBenchmarkSweep(sweep)) return false;
+  return sweep.WriteCSV("VecAddSweep.csv") && sweep.WriteJSON("VecAddSweep.json");
+}
+
@@ -30,6 +30,8 @@ public:
 
 	//! This overloaded method contains the specific solution of A1
 	virtual bool DoCompute();
+
+	virtual bool DoBenchmarkSweep();
 };
 
 #endif // _CASSIGNMENT1_H
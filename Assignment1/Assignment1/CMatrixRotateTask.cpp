@@ -5,8 +5,17 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CMatrixRotateTask.h"
 
+#include "../Common/CBufferPool.h"
+#include "../Common/CCounterRNG.h"
 #include "../Common/CLUtil.h"
-
+#include "../Common/CMultiDevice.h"
+#include "../Common/CResultValidator.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CTimer.h"
+#include "../Common/CWorkGroupTuner.h"
+
+#include <algorithm>
 #include <string.h>
 
 using namespace std;
@@ -14,8 +23,8 @@ using namespace std;
 ///////////////////////////////////////////////////////////////////////////////
 // CMatrixRotateTask
 
-CMatrixRotateTask::CMatrixRotateTask(size_t SizeX, size_t SizeY)
-	:m_SizeX(SizeX), m_SizeY(SizeY), m_hM(NULL), m_hMR(NULL), m_dM(NULL),
+CMatrixRotateTask::CMatrixRotateTask(size_t SizeX, size_t SizeY, CTransferPipeline::Mode Mode)
+	:m_SizeX(SizeX), m_SizeY(SizeY), m_Mode(Mode), m_hM(NULL), m_hMR(NULL), m_dM(NULL),
 	m_dMR(NULL), m_hGPUResultNaive(NULL), m_hGPUResultOpt(NULL), m_Program(NULL),
 	m_NaiveKernel(NULL), m_OptimizedKernel(NULL)
 {
@@ -35,17 +44,14 @@ bool CMatrixRotateTask::InitResources(cl_device_id Device, cl_context Context)
 	m_hGPUResultOpt = new float[m_SizeX * m_SizeY];
 
 	//fill the matrix with random floats
-	for(unsigned int i = 0; i < m_SizeX * m_SizeY; i++)
-	{
-		m_hM[i] = float(rand()) / float(RAND_MAX);
-	}
+	CCounterRNG().FillFloat(m_hM, m_SizeX * m_SizeY);
 
   // Allocate buffers for in and output
   cl_int clError;
-  m_dM = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_float) * m_SizeX * m_SizeY, NULL, &clError);
+  m_dM = CBufferPool::GetInstance().Create(Context, CL_MEM_READ_ONLY, sizeof(cl_float) * m_SizeX * m_SizeY, &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create buffer input matrix.");
 
-  m_dMR = clCreateBuffer(Context, CL_MEM_WRITE_ONLY, sizeof(cl_float) * m_SizeX * m_SizeY, NULL, &clError);
+  m_dMR = CBufferPool::GetInstance().Create(Context, CL_MEM_WRITE_ONLY, sizeof(cl_float) * m_SizeX * m_SizeY, &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create buffer output matrix.");
 	
 
@@ -71,6 +77,10 @@ bool CMatrixRotateTask::InitResources(cl_device_id Device, cl_context Context)
   m_OptimizedKernel = clCreateKernel(m_Program, "MatrixRotOptimized", &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create kernel for \"MatrixRotOptimized\".");
 
+  // both move one float per work-item without arithmetic, a pure bandwidth test
+  CRoofline::SetKernelCost(m_NaiveKernel, {4, 4, 0}, (double)m_SizeX * m_SizeY);
+  CRoofline::SetKernelCost(m_OptimizedKernel, {4, 4, 0}, (double)m_SizeX * m_SizeY);
+
   clError = clSetKernelArg( m_OptimizedKernel, 0, sizeof(cl_mem), (void*)&m_dM);
   clError |= clSetKernelArg(m_OptimizedKernel, 1, sizeof(cl_mem), (void*)&m_dMR);
   clError |= clSetKernelArg(m_OptimizedKernel, 2, sizeof(cl_int), (void*)&m_SizeX);
@@ -89,8 +99,11 @@ void CMatrixRotateTask::ReleaseResources()
 	SAFE_DELETE_ARRAY(m_hGPUResultOpt);
 
 
-  SAFE_RELEASE_MEMOBJECT(m_dM);
-  SAFE_RELEASE_MEMOBJECT(m_dMR);
+  SAFE_RELEASE_POOLED(m_dM);
+  SAFE_RELEASE_POOLED(m_dMR);
+
+  for (size_t i = 0; i < m_DeviceKernels.size(); i++) SAFE_RELEASE_KERNEL(m_DeviceKernels[i]);
+  m_DeviceKernels.clear();
 
   if (m_NaiveKernel != nullptr) {
     clReleaseKernel(m_NaiveKernel);
@@ -102,8 +115,32 @@ void CMatrixRotateTask::ReleaseResources()
   }
 }
 
+void CMatrixRotateTask::PrepareComputeGPU(cl_command_queue CommandQueue, const size_t LocalWorkSize[3], bool TuneLocalWorkSize) {
+  // tuning launches the kernels, so it is done here instead of in the timed ComputeGPU()
+  m_TunedNaiveLocalWorkSize[0] = m_TunedOptimizedLocalWorkSize[0] = 0;
+  if (LocalWorkSize[0] != 0 && !TuneLocalWorkSize) return;
+
+  size_t problemSize[2] = {m_SizeX, m_SizeY};
+  if (!CWorkGroupTuner::Tune(CommandQueue, m_NaiveKernel, 2, problemSize, m_TunedNaiveLocalWorkSize))
+    cerr << "Error: failed to tune the local work size of the naive kernel." << endl;
+  // the optimized kernel stages one float per work-item in its local buffer (argument 4)
+  if (m_Mode == CTransferPipeline::ProfileKernels &&
+      !CWorkGroupTuner::Tune(CommandQueue, m_OptimizedKernel, 2, problemSize, m_TunedOptimizedLocalWorkSize, 4, sizeof(float)))
+    cerr << "Error: failed to tune the local work size of the optimized kernel." << endl;
+}
+
 void CMatrixRotateTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
+  // The local work sizes tuned by PrepareComputeGPU() take precedence, a failed tuning keeps the given one
+  const size_t* naiveLocalWorkSize = m_TunedNaiveLocalWorkSize[0] != 0 ? m_TunedNaiveLocalWorkSize : LocalWorkSize;
+  const size_t* optimizedLocalWorkSize = m_TunedOptimizedLocalWorkSize[0] != 0 ? m_TunedOptimizedLocalWorkSize : LocalWorkSize;
+  if (naiveLocalWorkSize[0] == 0 || optimizedLocalWorkSize[0] == 0) return;
+
+  if (m_Mode != CTransferPipeline::ProfileKernels) {
+    ComputeRoundTrip(CommandQueue, naiveLocalWorkSize);
+    return;
+  }
+
   cl_int clError;
   clError = clEnqueueWriteBuffer(CommandQueue, m_dM, CL_FALSE, 0, m_SizeX * m_SizeY * sizeof(float), m_hM, 0, NULL, NULL);
   V_RETURN_CL(clError, "Failed to enqueue buffer write operation.");
@@ -114,26 +151,29 @@ void CMatrixRotateTask::ComputeGPU(cl_context Context, cl_command_queue CommandQ
   size_t globalWorkSize[2];
   size_t nGroups[2];
 
-  globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_SizeX, LocalWorkSize[0]);
-  globalWorkSize[1] = CLUtil::GetGlobalWorkSize(m_SizeY, LocalWorkSize[1]);
+  globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_SizeX, naiveLocalWorkSize[0]);
+  globalWorkSize[1] = CLUtil::GetGlobalWorkSize(m_SizeY, naiveLocalWorkSize[1]);
 
-  nGroups[0] = globalWorkSize[0] / LocalWorkSize[0];
-  nGroups[1] = globalWorkSize[1] / LocalWorkSize[1];
+  nGroups[0] = globalWorkSize[0] / naiveLocalWorkSize[0];
+  nGroups[1] = globalWorkSize[1] / naiveLocalWorkSize[1];
   cout << "Executing (" << globalWorkSize[0] << " x " << globalWorkSize[1] << ") threads "
-       << "  in (" << nGroups[0] << " x " << nGroups[1] << ") groups of size (" << LocalWorkSize[0] << " x " << LocalWorkSize[1] << "). " << endl;
+       << "  in (" << nGroups[0] << " x " << nGroups[1] << ") groups of size (" << naiveLocalWorkSize[0] << " x " << naiveLocalWorkSize[1] << "). " << endl;
 
   // Exec naive kernel and read back results
   int NIterations = 100;
-  double time = CLUtil::ProfileKernel(CommandQueue, m_NaiveKernel, 2, globalWorkSize, LocalWorkSize, NIterations);
+  double time = CLUtil::ProfileKernel(CommandQueue, m_NaiveKernel, 2, globalWorkSize, naiveLocalWorkSize, NIterations);
   cout << "Executed naive kernel in " << time << " ms." << endl;
 
   clError = clEnqueueReadBuffer(CommandQueue, m_dMR, CL_TRUE, 0, m_SizeX * m_SizeY * sizeof(float), m_hGPUResultNaive, 0, NULL, NULL);
   V_RETURN_CL(clError, "Failed to enqueue buffer read operation for naive.");
 
-  // optimized kernel
-  clError = clSetKernelArg(m_OptimizedKernel, 4, LocalWorkSize[0] * LocalWorkSize[1] * sizeof(float), NULL);
+  // optimized kernel, with its own local work size
+  clError = clSetKernelArg(m_OptimizedKernel, 4, optimizedLocalWorkSize[0] * optimizedLocalWorkSize[1] * sizeof(float), NULL);
+  globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_SizeX, optimizedLocalWorkSize[0]);
+  globalWorkSize[1] = CLUtil::GetGlobalWorkSize(m_SizeY, optimizedLocalWorkSize[1]);
+  cout << "Optimized kernel groups of size (" << optimizedLocalWorkSize[0] << " x " << optimizedLocalWorkSize[1] << "). " << endl;
 
-  time = CLUtil::ProfileKernel(CommandQueue, m_OptimizedKernel, 2, globalWorkSize, LocalWorkSize, NIterations);
+  time = CLUtil::ProfileKernel(CommandQueue, m_OptimizedKernel, 2, globalWorkSize, optimizedLocalWorkSize, NIterations);
 
   cout << "Executed optimized kernel in " << time << " ms." << endl;
 
@@ -169,21 +209,163 @@ void CMatrixRotateTask::ComputeGPU(cl_context Context, cl_command_queue CommandQ
   //}
 }
 
+void CMatrixRotateTask::ComputeRoundTrip(cl_command_queue CommandQueue, const size_t LocalWorkSize[3]) {
+  const size_t nChunks = 8;
+  size_t localWorkSize[2] = {LocalWorkSize[0], LocalWorkSize[1]};
+  CTimer timer;
+
+  if (m_Mode == CTransferPipeline::Serialized) {
+    size_t globalWorkSize[2] = {CLUtil::GetGlobalWorkSize(m_SizeX, localWorkSize[0]), CLUtil::GetGlobalWorkSize(m_SizeY, localWorkSize[1])};
+    size_t bytes = m_SizeX * m_SizeY * sizeof(float);
+    timer.Start();
+    cl_int clError = clEnqueueWriteBuffer(CommandQueue, m_dM, CL_FALSE, 0, bytes, m_hM, 0, NULL, NULL);
+    clError |= clEnqueueNDRangeKernel(CommandQueue, m_NaiveKernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+    clError |= clEnqueueReadBuffer(CommandQueue, m_dMR, CL_TRUE, 0, bytes, m_hGPUResultNaive, 0, NULL, NULL);
+    timer.Stop();
+    V_RETURN_CL(clError, "Failed to execute the serialized round trip.");
+
+    cout << "Round trip: " << timer.GetElapsedMilliseconds() << " ms serialized" << endl;
+    return;
+  }
+
+  // The chunks are bands of rows of M. A band is rotated into a band of columns of MR, which is read back
+  // with a rectangular copy. Only the naive kernel can run on a band, the optimized one places its tiles
+  // by the group ids within the whole matrix. Bands are multiples of the local work size in y, so no
+  // work-group spills into the next band.
+  CTransferPipeline pipeline;
+  if (!pipeline.Init(CommandQueue)) return;
+  size_t chunkRows = CLUtil::GetGlobalWorkSize((m_SizeY + nChunks - 1) / nChunks, localWorkSize[1]);
+
+  auto upload = [&](cl_command_queue Queue, const CTransferPipeline::Chunk& Chunk, cl_uint NWaitEvents,
+                    const cl_event* pWaitEvents, cl_event* pEvent) -> cl_int {
+    size_t offset = Chunk.Offset * m_SizeX;
+    return clEnqueueWriteBuffer(Queue, m_dM, CL_FALSE, offset * sizeof(float), Chunk.Count * m_SizeX * sizeof(float), m_hM + offset,
+                                NWaitEvents, pWaitEvents, pEvent);
+  };
+  auto compute = [&](cl_command_queue Queue, const CTransferPipeline::Chunk& Chunk, cl_uint NWaitEvents,
+                     const cl_event* pWaitEvents, cl_event* pEvent) -> cl_int {
+    size_t offset[2] = {0, Chunk.Offset};
+    size_t globalWorkSize[2] = {CLUtil::GetGlobalWorkSize(m_SizeX, localWorkSize[0]), CLUtil::GetGlobalWorkSize(Chunk.Count, localWorkSize[1])};
+    return clEnqueueNDRangeKernel(Queue, m_NaiveKernel, 2, offset, globalWorkSize, localWorkSize, NWaitEvents, pWaitEvents, pEvent);
+  };
+  auto download = [&](cl_command_queue Queue, const CTransferPipeline::Chunk& Chunk, cl_uint NWaitEvents,
+                      const cl_event* pWaitEvents, cl_event* pEvent) -> cl_int {
+    // rows [Offset, Offset + Count) of M are the columns starting at m_SizeY - Offset - Count of MR
+    size_t origin[3] = {(m_SizeY - Chunk.Offset - Chunk.Count) * sizeof(float), 0, 0};
+    size_t region[3] = {Chunk.Count * sizeof(float), m_SizeX, 1};
+    return clEnqueueReadBufferRect(Queue, m_dMR, CL_FALSE, origin, origin, region, m_SizeY * sizeof(float), 0, m_SizeY * sizeof(float), 0,
+                                   m_hGPUResultNaive, NWaitEvents, pWaitEvents, pEvent);
+  };
+
+  timer.Start();
+  if (!pipeline.Run(m_SizeY, chunkRows, 0, upload, compute, download)) return;
+  timer.Stop();
+
+  cout << "Round trip: " << timer.GetElapsedMilliseconds() << " ms in " << nChunks << " overlapped bands" << endl;
+}
+
 void CMatrixRotateTask::ComputeCPU() {
-  for (unsigned int x = 0; x < m_SizeX; x++) {
-    for (unsigned int y = 0; y < m_SizeY; y++) {
-      m_hMR[x * m_SizeY + (m_SizeY - y - 1)] = m_hM[y * m_SizeX + x];
+  // rotate in tiles, so that the strided reads of a tile stay in the cache
+  const unsigned int tileSize = 32;
+  CThreadPool::GetInstance().ParallelFor(0, m_SizeX, tileSize, [&](size_t BeginX, size_t EndX) {
+    for (unsigned int tileY = 0; tileY < m_SizeY; tileY += tileSize) {
+      unsigned int endY = min(tileY + tileSize, m_SizeY);
+      for (unsigned int x = (unsigned int)BeginX; x < EndX; x++) {
+        for (unsigned int y = tileY; y < endY; y++) {
+          m_hMR[x * m_SizeY + (m_SizeY - y - 1)] = m_hM[y * m_SizeX + x];
+        }
+      }
     }
+  });
+}
+
+bool CMatrixRotateTask::PrepareMultiDevice(CMultiDevice& Devices) {
+  // the round trips are measured on the device of the queue
+  if (m_Mode != CTransferPipeline::ProfileKernels) return false;
+
+  string programCode;
+  if (!CLUtil::LoadProgramSourceToMemory("MatrixRot.cl", programCode)) return false;
+
+  m_DeviceKernels.assign(2 * Devices.GetNumDevices(), nullptr);
+  for (size_t i = 0; i < Devices.GetNumDevices(); i++) {
+    m_DeviceKernels[2 * i] = Devices.CreateKernel(i, programCode, "MatrixRotNaive", CLDefines());
+    m_DeviceKernels[2 * i + 1] = Devices.CreateKernel(i, programCode, "MatrixRotOptimized", CLDefines());
+    if (m_DeviceKernels[2 * i] == nullptr || m_DeviceKernels[2 * i + 1] == nullptr) return false;
+  }
+
+  return Devices.Calibrate("MatrixRot", m_SizeY, 16,
+                           [&](size_t DeviceIndex, size_t Begin, size_t End) { return ComputeRange(Devices, DeviceIndex, Begin, End); });
+}
+
+bool CMatrixRotateTask::ComputeMultiDevice(CMultiDevice& Devices) {
+  if (m_DeviceKernels.empty()) return false;
+
+  bool success = Devices.Run("MatrixRot", m_SizeY, 16,
+                             [&](size_t DeviceIndex, size_t Begin, size_t End) { return ComputeRange(Devices, DeviceIndex, Begin, End); });
+  if (!success) return false;
+
+  Devices.PrintLastRun();
+  return true;
+}
+
+bool CMatrixRotateTask::ComputeRange(CMultiDevice& Devices, size_t DeviceIndex, size_t Begin, size_t End) {
+  // Every device rotates a band of rows of M. The rotated band is a band of columns of MR,
+  // which is read back with a rectangular copy.
+  const size_t localWorkSize[2] = {16, 16};
+  const CMultiDevice::Device& device = Devices.GetDevice(DeviceIndex);
+  cl_uint rows = (cl_uint)(End - Begin);
+  size_t bytes = m_SizeX * rows * sizeof(float);
+
+  cl_kernel kernels[2] = {m_DeviceKernels[2 * DeviceIndex], m_DeviceKernels[2 * DeviceIndex + 1]};
+  float* results[2] = {m_hGPUResultNaive, m_hGPUResultOpt};
+
+  cl_int clError, clError2;
+  cl_mem dM = CBufferPool::GetInstance().Create(device.Context, CL_MEM_READ_ONLY, bytes, &clError2);
+  clError = clError2;
+  cl_mem dMR = CBufferPool::GetInstance().Create(device.Context, CL_MEM_WRITE_ONLY, bytes, &clError2);
+  clError |= clError2;
+
+  if (clError == CL_SUCCESS)
+    clError = clEnqueueWriteBuffer(device.Queue, dM, CL_FALSE, 0, bytes, m_hM + Begin * m_SizeX, 0, NULL, NULL);
+  for (int k = 0; k < 2 && clError == CL_SUCCESS; k++) {
+    clError = clSetKernelArg(kernels[k], 0, sizeof(cl_mem), (void*)&dM);
+    clError |= clSetKernelArg(kernels[k], 1, sizeof(cl_mem), (void*)&dMR);
+    clError |= clSetKernelArg(kernels[k], 2, sizeof(cl_uint), (void*)&m_SizeX);
+    clError |= clSetKernelArg(kernels[k], 3, sizeof(cl_uint), (void*)&rows);
+    if (k == 1) clError |= clSetKernelArg(kernels[k], 4, localWorkSize[0] * localWorkSize[1] * sizeof(float), NULL);
+
+    size_t globalWorkSize[2] = {CLUtil::GetGlobalWorkSize(m_SizeX, localWorkSize[0]), CLUtil::GetGlobalWorkSize(rows, localWorkSize[1])};
+    clError |= clEnqueueNDRangeKernel(device.Queue, kernels[k], 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+
+    // the band holds m_SizeX rows of 'rows' elements, they start at column m_SizeY - End of MR
+    size_t bufferOrigin[3] = {0, 0, 0};
+    size_t hostOrigin[3] = {(m_SizeY - End) * sizeof(float), 0, 0};
+    size_t region[3] = {rows * sizeof(float), m_SizeX, 1};
+    clError |= clEnqueueReadBufferRect(device.Queue, dMR, CL_TRUE, bufferOrigin, hostOrigin, region, rows * sizeof(float), 0,
+                                       m_SizeY * sizeof(float), 0, results[k], 0, NULL, NULL);
   }
+
+  SAFE_RELEASE_POOLED(dM);
+  SAFE_RELEASE_POOLED(dMR);
+  V_RETURN_FALSE_CL(clError, "Failed to rotate the matrix on " << device.Name << ".");
+  return true;
 }
 
 bool CMatrixRotateTask::ValidateResults() {
-  if (!(memcmp(m_hMR, m_hGPUResultNaive, m_SizeX * m_SizeY * sizeof(float)) == 0)) {
+  // the rotated matrix has m_SizeX rows of m_SizeY elements
+  CResultValidator::Report naive = CResultValidator::Compare(m_hMR, m_hGPUResultNaive, m_SizeY, m_SizeX, m_SizeY);
+  if (!naive.Passed()) {
     cout << "Results of the naive kernel are incorrect!" << endl;
+    CResultValidator::PrintReport(naive, "MatrixRotNaive");
     return false;
   }
-  if (!(memcmp(m_hMR, m_hGPUResultOpt, m_SizeX * m_SizeY * sizeof(float)) == 0)) {
+  // the round trips only run the naive kernel
+  if (m_Mode != CTransferPipeline::ProfileKernels) return true;
+
+  CResultValidator::Report optimized = CResultValidator::Compare(m_hMR, m_hGPUResultOpt, m_SizeY, m_SizeX, m_SizeY);
+  if (!optimized.Passed()) {
     cout << "Results of the optimized kernel are incorrect!" << endl;
+    CResultValidator::PrintReport(optimized, "MatrixRotOpt");
     return false;
   }
   return true;
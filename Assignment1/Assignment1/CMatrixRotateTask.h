@@ -21,12 +21,16 @@
 #define _CMATRIX_ROTATE_TASK_H
 
 #include "../Common/IComputeTask.h"
+#include "../Common/CTransferPipeline.h"
+
+#include <vector>
 
 //! A1/T2: Matrix rotation
 class CMatrixRotateTask : public IComputeTask
 {
 public:
-	CMatrixRotateTask(size_t SizeX, size_t SizeY);
+	//! Mode selects whether ComputeGPU() profiles both kernels or measures a round trip of the naive one, serialized or pipelined
+	CMatrixRotateTask(size_t SizeX, size_t SizeY, CTransferPipeline::Mode Mode = CTransferPipeline::ProfileKernels);
 	virtual ~CMatrixRotateTask();
 
 	// IComputeTask
@@ -34,19 +38,36 @@ public:
 	
 	virtual void ReleaseResources();
 
+	//! Looks up or tunes the local work sizes of both kernels, unless the given one is forced
+	virtual void PrepareComputeGPU(cl_command_queue CommandQueue, const size_t LocalWorkSize[3], bool TuneLocalWorkSize);
+
 	virtual void ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 
 	virtual void ComputeCPU();
 
 	virtual bool ValidateResults();
 
+	virtual bool PrepareMultiDevice(CMultiDevice& Devices);
+
+	virtual bool ComputeMultiDevice(CMultiDevice& Devices);
+
+	virtual std::string GetName() const { return "MatrixRotate"; }
+
 protected:
+	//! One write -> kernel -> read round trip, in overlapping bands of rows with CTransferPipeline::Pipelined
+	void ComputeRoundTrip(cl_command_queue CommandQueue, const size_t LocalWorkSize[3]);
+
+	//! Rotates the rows [Begin, End) with both kernels on one device of ComputeMultiDevice()
+	bool ComputeRange(CMultiDevice& Devices, size_t DeviceIndex, size_t Begin, size_t End);
+
 	//NOTE: we have two memory address spaces, so we mark pointers with a prefix
 	//to avoid confusions: 'h' - host, 'd' - device
 
 	unsigned int		m_SizeX;
 	unsigned int		m_SizeY;
 
+	CTransferPipeline::Mode	m_Mode;
+
 	//float data on the CPU
 	//M: original matrix, MR: rotated matrix
 	float				*m_hM, *m_hMR;
@@ -61,6 +82,13 @@ protected:
 	cl_program			m_Program;
 	cl_kernel			m_NaiveKernel;
 	cl_kernel			m_OptimizedKernel;
+
+	//the local work sizes found by PrepareComputeGPU(), 0 if ComputeGPU() uses the given one
+	size_t				m_TunedNaiveLocalWorkSize[3] = {0, 1, 1};
+	size_t				m_TunedOptimizedLocalWorkSize[3] = {0, 1, 1};
+
+	//the naive and the optimized kernel of every device, built by PrepareMultiDevice()
+	std::vector<cl_kernel>	m_DeviceKernels;
 };
 
 #endif // _CMATRIX_ROTATE_TASK_H
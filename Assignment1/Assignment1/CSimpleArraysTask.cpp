@@ -5,7 +5,17 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CSimpleArraysTask.h"
 
+#include "../Common/CBufferPool.h"
+#include "../Common/CCounterRNG.h"
 #include "../Common/CLUtil.h"
+#include "../Common/CMultiDevice.h"
+#include "../Common/CPinnedHostBuffer.h"
+#include "../Common/CResultValidator.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CTimer.h"
+#include "../Common/CTransferPipeline.h"
+#include "../Common/CWorkGroupTuner.h"
 
 #include <string.h>
 
@@ -14,7 +24,7 @@ using namespace std;
 ///////////////////////////////////////////////////////////////////////////////
 // CSimpleArraysTask
 
-CSimpleArraysTask::CSimpleArraysTask(size_t ArraySize) : m_ArraySize(ArraySize) {
+CSimpleArraysTask::CSimpleArraysTask(size_t ArraySize, CTransferPipeline::Mode Mode) : m_ArraySize(ArraySize), m_Mode(Mode) {
 }
 
 CSimpleArraysTask::~CSimpleArraysTask() {
@@ -23,16 +33,19 @@ CSimpleArraysTask::~CSimpleArraysTask() {
 
 bool CSimpleArraysTask::InitResources(cl_device_id Device, cl_context Context) {
   // CPU resources
-  m_hA = new int[m_ArraySize];
-  m_hB = new int[m_ArraySize];
+  // the arrays we transfer are pinned, so that the copies can use DMA
+  if (!m_PinnedA.Allocate(Context, Device, m_ArraySize * sizeof(int), CL_MEM_READ_ONLY)) return false;
+  if (!m_PinnedB.Allocate(Context, Device, m_ArraySize * sizeof(int), CL_MEM_READ_ONLY)) return false;
+  if (!m_PinnedGPUResult.Allocate(Context, Device, m_ArraySize * sizeof(int), CL_MEM_WRITE_ONLY)) return false;
+  m_hA = m_PinnedA.Get<int>();
+  m_hB = m_PinnedB.Get<int>();
   m_hC = new int[m_ArraySize];
-  m_hGPUResult = new int[m_ArraySize];
+  m_hGPUResult = m_PinnedGPUResult.Get<int>();
 
-  // fill A and B with random integers
-  for (unsigned int i = 0; i < m_ArraySize; i++) {
-    m_hA[i] = rand() % 1024;
-    m_hB[i] = rand() % 1024;
-  }
+  // fill A and B with random integers (independent streams, reproducible with GPUC_SEED)
+  CCounterRNG rng;
+  rng.FillInt(m_hA, m_ArraySize, 1024, 0);
+  rng.FillInt(m_hB, m_ArraySize, 1024, 1);
 
   // device resources
 
@@ -40,13 +53,13 @@ bool CSimpleArraysTask::InitResources(cl_device_id Device, cl_context Context) {
   // Sect. 4.5
   // Create a OpenCL buffer resource for each input and output array
   cl_int clError;
-  m_dA = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_int) * m_ArraySize, NULL, &clError);
+  m_dA = CBufferPool::GetInstance().Create(Context, CL_MEM_READ_ONLY, sizeof(cl_int) * m_ArraySize, &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create buffer A.");
 
-  m_dB = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_int) * m_ArraySize, NULL, &clError);
+  m_dB = CBufferPool::GetInstance().Create(Context, CL_MEM_READ_ONLY, sizeof(cl_int) * m_ArraySize, &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create buffer B.");
 
-  m_dC = clCreateBuffer(Context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * m_ArraySize, NULL, &clError);
+  m_dC = CBufferPool::GetInstance().Create(Context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * m_ArraySize, &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create buffer C.");
 
 
@@ -61,6 +74,8 @@ bool CSimpleArraysTask::InitResources(cl_device_id Device, cl_context Context) {
 
   m_Kernel = clCreateKernel(m_Program, "VecAdd", &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create kernel for \"VecAdd\".");
+  // two ints read, one written and one addition per work-item
+  CRoofline::SetKernelCost(m_Kernel, {8, 4, 1}, (double)m_ArraySize);
 
   // Set the input parameters of the kernel
   clError = clSetKernelArg(m_Kernel, 0, sizeof(cl_mem), (void*)&m_dA);
@@ -74,16 +89,20 @@ bool CSimpleArraysTask::InitResources(cl_device_id Device, cl_context Context) {
 
 void CSimpleArraysTask::ReleaseResources() {
   // CPU resources
-  SAFE_DELETE_ARRAY(m_hA);
-  SAFE_DELETE_ARRAY(m_hB);
+  m_PinnedA.Release();
+  m_PinnedB.Release();
+  m_PinnedGPUResult.Release();
+  m_hA = m_hB = m_hGPUResult = nullptr;
   SAFE_DELETE_ARRAY(m_hC);
-  SAFE_DELETE_ARRAY(m_hGPUResult);
 
   /////////////////////////////////////////////////
   // Sect. 4.5., 4.6.
-  SAFE_RELEASE_MEMOBJECT(m_dA);
-  SAFE_RELEASE_MEMOBJECT(m_dB);
-  SAFE_RELEASE_MEMOBJECT(m_dC);
+  SAFE_RELEASE_POOLED(m_dA);
+  SAFE_RELEASE_POOLED(m_dB);
+  SAFE_RELEASE_POOLED(m_dC);
+
+  for (size_t i = 0; i < m_DeviceKernels.size(); i++) SAFE_RELEASE_KERNEL(m_DeviceKernels[i]);
+  m_DeviceKernels.clear();
 
   if (m_Kernel != nullptr) {
     clReleaseKernel(m_Kernel);
@@ -98,12 +117,31 @@ void CSimpleArraysTask::ReleaseResources() {
 }
 
 void CSimpleArraysTask::ComputeCPU() {
-  for (unsigned int i = 0; i < m_ArraySize; i++) {
-    m_hC[i] = m_hA[i] + m_hB[m_ArraySize - i - 1];
-  }
+  // both streams are contiguous (b backwards), so the compiler vectorizes the chunks
+  CThreadPool::GetInstance().ParallelFor(0, m_ArraySize, 0, [&](size_t Begin, size_t End) {
+    for (size_t i = Begin; i < End; i++) {
+      m_hC[i] = m_hA[i] + m_hB[m_ArraySize - i - 1];
+    }
+  });
+}
+
+void CSimpleArraysTask::PrepareComputeGPU(cl_command_queue CommandQueue, const size_t LocalWorkSize[3], bool TuneLocalWorkSize) {
+  // tuning launches the kernel, so it is done here instead of in the timed ComputeGPU()
+  m_TunedLocalWorkSize[0] = 0;
+  if ((LocalWorkSize[0] == 0 || TuneLocalWorkSize) && !CWorkGroupTuner::Tune(CommandQueue, m_Kernel, 1, &m_ArraySize, m_TunedLocalWorkSize))
+    cerr << "Error: failed to tune the local work size." << endl;
 }
 
 void CSimpleArraysTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]) {
+  // The local work size tuned by PrepareComputeGPU() takes precedence, a failed tuning keeps the given one
+  if (m_TunedLocalWorkSize[0] != 0) LocalWorkSize = m_TunedLocalWorkSize;
+  if (LocalWorkSize[0] == 0) return;
+
+  if (m_Mode != CTransferPipeline::ProfileKernels) {
+    ComputeRoundTrip(CommandQueue, LocalWorkSize[0]);
+    return;
+  }
+
   /////////////////////////////////////////////////
   // Sect. 4.5
   // Copy input data into CL buffers
@@ -130,9 +168,12 @@ void CSimpleArraysTask::ComputeGPU(cl_context Context, cl_command_queue CommandQ
 
   // Execute the kernel n times
   int NIterations = 100;
-  double ms = CLUtil::ProfileKernel(CommandQueue, m_Kernel, 1, &globalWorkSize, LocalWorkSize, NIterations);
+  CLUtil::KernelProfile profile;
+  if (!CLUtil::ProfileKernel(CommandQueue, m_Kernel, 1, &globalWorkSize, LocalWorkSize, NIterations, profile)) return;
+  double ms = profile.Mean;
   cout << cout.precision(10) << "\n\tAveraging " << ms << " milliseconds over " << NIterations << " iterations ...";
-  cout << "\n\t" << m_ArraySize / ms / 1000000.0 << " million elements per millisecond ...";
+  cout << "\n\t" << m_ArraySize / ms / 1000000.0 << " million elements per millisecond ..." << endl;
+  CLUtil::PrintKernelProfile(profile);
 
   // cout << endl
   //     << endl
@@ -143,8 +184,129 @@ void CSimpleArraysTask::ComputeGPU(cl_context Context, cl_command_queue CommandQ
   V_RETURN_CL(clError, "Failed to enqueue buffer read operation for C.");
 }
 
+void CSimpleArraysTask::ComputeRoundTrip(cl_command_queue CommandQueue, size_t LocalWorkSize) {
+  const size_t nChunks = 8;
+  CTimer timer;
+
+  if (m_Mode == CTransferPipeline::Serialized) {
+    size_t globalWorkSize = CLUtil::GetGlobalWorkSize(m_ArraySize, LocalWorkSize);
+    timer.Start();
+    cl_int clError = clEnqueueWriteBuffer(CommandQueue, m_dA, CL_FALSE, 0, m_ArraySize * sizeof(int), m_hA, 0, NULL, NULL);
+    clError |= clEnqueueWriteBuffer(CommandQueue, m_dB, CL_FALSE, 0, m_ArraySize * sizeof(int), m_hB, 0, NULL, NULL);
+    clError |= clEnqueueNDRangeKernel(CommandQueue, m_Kernel, 1, NULL, &globalWorkSize, &LocalWorkSize, 0, NULL, NULL);
+    clError |= clEnqueueReadBuffer(CommandQueue, m_dC, CL_TRUE, 0, m_ArraySize * sizeof(int), m_hGPUResult, 0, NULL, NULL);
+    timer.Stop();
+    V_RETURN_CL(clError, "Failed to execute the serialized round trip.");
+
+    cout << "\tRound trip: " << timer.GetElapsedMilliseconds() << " ms serialized" << endl;
+    return;
+  }
+
+  // The transfers of neighbouring chunks overlap the kernel.
+  // Chunks are multiples of the local work size, so no work-group spills into the next chunk.
+  CTransferPipeline pipeline;
+  if (!pipeline.Init(CommandQueue)) return;
+  size_t chunkElements = CLUtil::GetGlobalWorkSize((m_ArraySize + nChunks - 1) / nChunks, LocalWorkSize);
+
+  // the kernel reads b in reverse order, so chunk [Offset, Offset + Count) of c needs the mirrored range of b.
+  // All chunks live in the full-size buffers, so no slot is reused.
+  auto upload = [&](cl_command_queue Queue, const CTransferPipeline::Chunk& Chunk, cl_uint NWaitEvents,
+                    const cl_event* pWaitEvents, cl_event* pEvent) -> cl_int {
+    size_t mirrored = m_ArraySize - Chunk.Offset - Chunk.Count;
+    cl_int err = clEnqueueWriteBuffer(Queue, m_dA, CL_FALSE, Chunk.Offset * sizeof(int), Chunk.Count * sizeof(int),
+                                      m_hA + Chunk.Offset, NWaitEvents, pWaitEvents, NULL);
+    if (err != CL_SUCCESS) return err;
+    return clEnqueueWriteBuffer(Queue, m_dB, CL_FALSE, mirrored * sizeof(int), Chunk.Count * sizeof(int), m_hB + mirrored,
+                                0, NULL, pEvent);
+  };
+  auto compute = [&](cl_command_queue Queue, const CTransferPipeline::Chunk& Chunk, cl_uint NWaitEvents,
+                     const cl_event* pWaitEvents, cl_event* pEvent) -> cl_int {
+    size_t offset = Chunk.Offset;
+    size_t chunkWorkSize = CLUtil::GetGlobalWorkSize(Chunk.Count, LocalWorkSize);
+    return clEnqueueNDRangeKernel(Queue, m_Kernel, 1, &offset, &chunkWorkSize, &LocalWorkSize, NWaitEvents, pWaitEvents,
+                                  pEvent);
+  };
+  auto download = [&](cl_command_queue Queue, const CTransferPipeline::Chunk& Chunk, cl_uint NWaitEvents,
+                      const cl_event* pWaitEvents, cl_event* pEvent) -> cl_int {
+    return clEnqueueReadBuffer(Queue, m_dC, CL_FALSE, Chunk.Offset * sizeof(int), Chunk.Count * sizeof(int),
+                               m_hGPUResult + Chunk.Offset, NWaitEvents, pWaitEvents, pEvent);
+  };
+
+  timer.Start();
+  if (!pipeline.Run(m_ArraySize, chunkElements, 0, upload, compute, download)) return;
+  timer.Stop();
+
+  cout << "\tRound trip: " << timer.GetElapsedMilliseconds() << " ms in " << nChunks << " overlapped chunks" << endl;
+}
+
+bool CSimpleArraysTask::PrepareMultiDevice(CMultiDevice& Devices) {
+  // the round trips are measured on the device of the queue
+  if (m_Mode != CTransferPipeline::ProfileKernels) return false;
+
+  string programCode;
+  if (!CLUtil::LoadProgramSourceToMemory("VectorAdd.cl", programCode)) return false;
+
+  m_DeviceKernels.assign(Devices.GetNumDevices(), nullptr);
+  for (size_t i = 0; i < m_DeviceKernels.size(); i++) {
+    m_DeviceKernels[i] = Devices.CreateKernel(i, programCode, "VecAdd", CLDefines());
+    if (m_DeviceKernels[i] == nullptr) return false;
+  }
+
+  return Devices.Calibrate("VecAdd", m_ArraySize, 256,
+                           [&](size_t DeviceIndex, size_t Begin, size_t End) { return ComputeRange(Devices, DeviceIndex, Begin, End); });
+}
+
+bool CSimpleArraysTask::ComputeMultiDevice(CMultiDevice& Devices) {
+  if (m_DeviceKernels.empty()) return false;
+
+  bool success = Devices.Run("VecAdd", m_ArraySize, 256,
+                             [&](size_t DeviceIndex, size_t Begin, size_t End) { return ComputeRange(Devices, DeviceIndex, Begin, End); });
+  if (!success) return false;
+
+  Devices.PrintLastRun();
+  return true;
+}
+
+bool CSimpleArraysTask::ComputeRange(CMultiDevice& Devices, size_t DeviceIndex, size_t Begin, size_t End) {
+  // Every device gets its range of a and c and the mirrored range of b in buffers of its own.
+  // Within the range the kernel then reads b backwards, as it does for the whole array.
+  const CMultiDevice::Device& device = Devices.GetDevice(DeviceIndex);
+  cl_kernel kernel = m_DeviceKernels[DeviceIndex];
+  cl_int count = (cl_int)(End - Begin);
+  size_t bytes = (End - Begin) * sizeof(int);
+
+  cl_int clError, clError2;
+  cl_mem dA = CBufferPool::GetInstance().Create(device.Context, CL_MEM_READ_ONLY, bytes, &clError2);
+  clError = clError2;
+  cl_mem dB = CBufferPool::GetInstance().Create(device.Context, CL_MEM_READ_ONLY, bytes, &clError2);
+  clError |= clError2;
+  cl_mem dC = CBufferPool::GetInstance().Create(device.Context, CL_MEM_WRITE_ONLY, bytes, &clError2);
+  clError |= clError2;
+
+  if (clError == CL_SUCCESS) {
+    clError = clEnqueueWriteBuffer(device.Queue, dA, CL_FALSE, 0, bytes, m_hA + Begin, 0, NULL, NULL);
+    clError |= clEnqueueWriteBuffer(device.Queue, dB, CL_FALSE, 0, bytes, m_hB + (m_ArraySize - End), 0, NULL, NULL);
+    clError |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dA);
+    clError |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dB);
+    clError |= clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&dC);
+    clError |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&count);
+    // the runtime picks the local size, it has to fit CPU devices as well
+    size_t globalWorkSize = End - Begin;
+    clError |= clEnqueueNDRangeKernel(device.Queue, kernel, 1, NULL, &globalWorkSize, NULL, 0, NULL, NULL);
+    clError |= clEnqueueReadBuffer(device.Queue, dC, CL_TRUE, 0, bytes, m_hGPUResult + Begin, 0, NULL, NULL);
+  }
+
+  SAFE_RELEASE_POOLED(dA);
+  SAFE_RELEASE_POOLED(dB);
+  SAFE_RELEASE_POOLED(dC);
+  V_RETURN_FALSE_CL(clError, "Failed to add the vectors on " << device.Name << ".");
+  return true;
+}
+
 bool CSimpleArraysTask::ValidateResults() {
-  return (memcmp(m_hC, m_hGPUResult, m_ArraySize * sizeof(float)) == 0);
+  CResultValidator::Report report = CResultValidator::Compare(m_hC, m_hGPUResult, m_ArraySize, 1, m_ArraySize);
+  CResultValidator::PrintReport(report, "VecAdd");
+  return report.Passed();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
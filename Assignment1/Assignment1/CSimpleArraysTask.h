@@ -21,12 +21,17 @@
 #define _CSIMPLE_ARRAYS_TASK_H
 
 #include "../Common/IComputeTask.h"
+#include "../Common/CPinnedHostBuffer.h"
+#include "../Common/CTransferPipeline.h"
+
+#include <vector>
 
 //! A1/T1: Simple vector addition
 class CSimpleArraysTask : public IComputeTask
 {
 public:
-	CSimpleArraysTask(size_t ArraySize);
+	//! Mode selects whether ComputeGPU() profiles the kernel or measures a round trip, serialized or pipelined
+	CSimpleArraysTask(size_t ArraySize, CTransferPipeline::Mode Mode = CTransferPipeline::ProfileKernels);
 	virtual ~CSimpleArraysTask();
 
 	// IComputeTask
@@ -35,19 +40,36 @@ public:
 	
 	virtual void ReleaseResources();
 
+	//! Looks up or tunes the local work size of the kernel, unless the given one is forced
+	virtual void PrepareComputeGPU(cl_command_queue CommandQueue, const size_t LocalWorkSize[3], bool TuneLocalWorkSize);
+
 	virtual void ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 
 	virtual void ComputeCPU();
 
 	virtual bool ValidateResults();
 
+	virtual bool PrepareMultiDevice(CMultiDevice& Devices);
+
+	virtual bool ComputeMultiDevice(CMultiDevice& Devices);
+
+	virtual std::string GetName() const { return "SimpleArrays"; }
+
 protected:
+	//! One write -> kernel -> read round trip, in overlapping chunks with CTransferPipeline::Pipelined
+	void ComputeRoundTrip(cl_command_queue CommandQueue, size_t LocalWorkSize);
+
+	//! Adds the range [Begin, End) on one device of ComputeMultiDevice()
+	bool ComputeRange(CMultiDevice& Devices, size_t DeviceIndex, size_t Begin, size_t End);
+
 	//NOTE: we have two memory address spaces, so we mark pointers with a prefix
 	//to avoid confusions: 'h' - host, 'd' - device
 	
 	//number of array elements
 	size_t				m_ArraySize = 0;
 
+	CTransferPipeline::Mode	m_Mode;
+
 	//integer arrays on the CPU
 	int					*m_hA = nullptr, *m_hB = nullptr, *m_hC = nullptr;
 
@@ -55,9 +77,18 @@ protected:
 	cl_mem				m_dA = nullptr, m_dB = nullptr, m_dC = nullptr;
 	int					*m_hGPUResult = nullptr;
 
+	//pinned host memory behind m_hA, m_hB and m_hGPUResult
+	CPinnedHostBuffer	m_PinnedA, m_PinnedB, m_PinnedGPUResult;
+
 	//OpenCL program and kernels
 	cl_program			m_Program = nullptr;
 	cl_kernel			m_Kernel = nullptr;
+
+	//the local work size found by PrepareComputeGPU(), 0 if ComputeGPU() uses the given one
+	size_t				m_TunedLocalWorkSize[3] = {0, 1, 1};
+
+	//the kernel of every device, built by PrepareMultiDevice()
+	std::vector<cl_kernel>	m_DeviceKernels;
 };
 
 #endif // _CSIMPLE_ARRAYS_TASK_H
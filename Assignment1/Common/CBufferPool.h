@@ -0,0 +1,108 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CBUFFER_POOL_H
+#define _CBUFFER_POOL_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+//! Recycles device buffers across tasks instead of creating and releasing them every time
+/*!
+	Create() rounds the size up to a size class (four classes per power of two,
+	so at most 25% are wasted) and returns a free buffer of that class and the
+	same flags, if there is one. Release() puts the buffer back into the pool.
+	The buffers are only freed by ReleaseContext() / ReleaseAll(), which
+	CAssignmentBase calls before it releases its context.
+
+	Pooled buffers are never initialized, so flags with a host pointer
+	(CL_MEM_COPY_HOST_PTR, CL_MEM_USE_HOST_PTR) are not supported. Write the
+	data with clEnqueueWriteBuffer instead. A buffer can be larger than
+	requested, kernels must not derive the element count from CL_MEM_SIZE.
+
+	The pool keeps track of the live bytes and of the peak device footprint
+	(live + cached), see PrintStatistics(). CMemoryTracker charges a buffer to
+	the task that took it out of the pool, and to "Buffer pool (cached)" while
+	it is cached.
+*/
+class CBufferPool
+{
+public:
+	static CBufferPool& GetInstance();
+
+	//! Same as clCreateBuffer() without a host pointer
+	cl_mem Create(cl_context Context, cl_mem_flags Flags, size_t Size, cl_int* pErrorCode = NULL);
+
+	//! Returns a buffer from Create() to the pool. Buffers that are not from the pool are released.
+	void Release(cl_mem Buffer);
+
+	//! Frees all cached buffers of a context (live buffers are not affected)
+	void ReleaseContext(cl_context Context);
+
+	void ReleaseAll();
+
+	size_t GetLiveBytes() const;
+	//! Peak of the device memory held by the pool (live and cached buffers)
+	size_t GetHighWaterMark() const;
+
+	void PrintStatistics() const;
+
+	static size_t GetSizeClass(size_t Size);
+
+	//! CMemoryTracker task of the cached buffers
+	static const char* CachedTask;
+
+protected:
+	CBufferPool();
+	~CBufferPool();
+
+	struct Key
+	{
+		cl_context		Context;
+		cl_mem_flags	Flags;
+		size_t			Size;
+
+		bool operator<(const Key& Other) const;
+	};
+
+	mutable std::mutex						m_Mutex;
+	std::map<Key, std::vector<cl_mem> >		m_FreeBuffers;
+	std::map<cl_mem, Key>					m_LiveBuffers;
+
+	size_t		m_LiveBytes;
+	size_t		m_CachedBytes;
+	size_t		m_HighWaterMark;
+	size_t		m_NHits;
+	size_t		m_NMisses;
+};
+
+//! Returns a buffer to the pool and resets the pointer
+#define SAFE_RELEASE_POOLED(ptr) do {if(ptr){ CBufferPool::GetInstance().Release(ptr); ptr = NULL; }} while(0)
+
+#endif // _CBUFFER_POOL_H
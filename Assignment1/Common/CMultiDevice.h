@@ -0,0 +1,125 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CMULTI_DEVICE_H
+#define _CMULTI_DEVICE_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class CLDefines;
+
+//! All OpenCL devices of the machine, for splitting data-parallel work by range
+/*!
+	Init() opens every device of the requested type. A context cannot span
+	platforms, so the devices of one platform share a context and every device
+	gets its own in-order queue.
+
+	Run() splits [0, N) into one range per device, proportional to the
+	throughput each device has shown for the same named work so far, and
+	runs the ranges concurrently, one host thread per device. Calibrate()
+	measures that throughput: it splits by compute units x clock and records
+	the elements per ms of every device. Call it (and build the kernels with
+	CreateKernel()) before a Run() that is timed, see
+	IComputeTask::PrepareMultiDevice(); otherwise the first Run() of a name
+	calibrates itself and does the work twice. Bodies therefore have to be
+	repeatable and have to write every result of their range.
+
+	The caller merges the partial results on the host, GetLastPartition()
+	tells which device computed which range in the final run.
+*/
+class CMultiDevice
+{
+public:
+	struct Device
+	{
+		cl_platform_id		Platform;
+		cl_device_id		Id;
+		cl_context			Context;
+		cl_command_queue	Queue;
+		std::string			Name;
+		// compute units x clock, used before anything was measured
+		double				PeakScore;
+	};
+
+	struct Range
+	{
+		size_t	Begin;
+		size_t	End;
+	};
+
+	//! Computes [Begin, End) on device DeviceIndex and returns when the results are on the host
+	typedef std::function<bool(size_t DeviceIndex, size_t Begin, size_t End)> Body;
+
+	CMultiDevice();
+
+	~CMultiDevice();
+
+	bool Init(cl_device_type DeviceType = CL_DEVICE_TYPE_ALL);
+
+	void Release();
+
+	size_t GetNumDevices() const { return m_Devices.size(); }
+
+	const Device& GetDevice(size_t Index) const { return m_Devices[Index]; }
+
+	//! Builds (or takes from the cache) the program for a device and creates one of its kernels
+	cl_kernel CreateKernel(size_t DeviceIndex, const std::string& Source, const char* KernelName,
+		const CLDefines& Defines, const std::string& CompileOptions = "");
+
+	//! Splits [0, N) into ranges of multiples of Granularity, proportional to Weights
+	static std::vector<Range> Partition(size_t N, size_t Granularity, const std::vector<double>& Weights);
+
+	//! Runs Work once to measure the throughput of every device, unless Name was measured before
+	bool Calibrate(const std::string& Name, size_t N, size_t Granularity, const Body& Work);
+
+	//! Runs Work on all devices, see the class description
+	bool Run(const std::string& Name, size_t N, size_t Granularity, const Body& Work);
+
+	const std::vector<Range>& GetLastPartition() const { return m_LastPartition; }
+
+	//! Prints the ranges and times of the last Run()
+	void PrintLastRun() const;
+
+protected:
+	bool RunPartition(const std::vector<Range>& Parts, const Body& Work, std::vector<double>& Milliseconds);
+
+	std::vector<Device>							m_Devices;
+	std::vector<cl_context>						m_Contexts;
+
+	// elements per ms of every device, by the name of the work
+	std::map<std::string, std::vector<double> >	m_Throughputs;
+
+	std::string									m_LastName;
+	std::vector<Range>							m_LastPartition;
+	std::vector<double>							m_LastMilliseconds;
+};
+
+#endif // _CMULTI_DEVICE_H
@@ -0,0 +1,122 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CTASK_SCHEDULER_H
+#define _CTASK_SCHEDULER_H
+
+#include "IComputeTask.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! Runs independent compute tasks concurrently on one device
+/*!
+	Every worker thread owns an in-order, profiling enabled command queue of
+	the shared context and runs whole jobs on it: InitResources(), ComputeCPU(), ComputeGPU(),
+	ValidateResults() and ReleaseResources(). This way small tasks keep the
+	device busy instead of waiting for each other on the host.
+
+	A job is only started while its DeviceBytes fit into the memory budget
+	(by default 3/4 of CL_DEVICE_GLOBAL_MEM_SIZE) next to the jobs that are
+	already running. Jobs are taken in order, but a later job that fits is
+	preferred over waiting for memory. A job larger than the whole budget
+	runs alone. DeviceBytes = 0 takes IComputeTask::GetDeviceBytes() of the
+	task; jobs that do not know their size at all are accounted with an equal
+	share of the budget per queue.
+
+	The tasks must not share state with each other; the console output of
+	concurrent jobs interleaves, PrintResults() gives the summary.
+*/
+class CTaskScheduler
+{
+public:
+	//! A task and how to run it. LocalWorkSize must stay valid until Run() returns.
+	struct Job
+	{
+		IComputeTask*	pTask;
+		size_t*			LocalWorkSize;
+		size_t			DeviceBytes;
+		std::string		Name;
+		bool			TuneLocalWorkSize;
+	};
+
+	struct JobResult
+	{
+		std::string		Name;
+		bool			Initialized;
+		bool			Valid;
+		double			CPUMs;
+		double			GPUMs;
+	};
+
+	CTaskScheduler();
+
+	~CTaskScheduler();
+
+	//! Creates the command queues
+	/*!
+		NQueues = 0 reads GPUC_SCHED_QUEUES (default 2), MemoryBudget = 0
+		uses 3/4 of the global memory of the device.
+	*/
+	bool Init(cl_device_id Device, cl_context Context, unsigned int NQueues = 0, size_t MemoryBudget = 0);
+
+	void Release();
+
+	//! DeviceBytes = 0 and an empty Name are taken from the task, TuneLocalWorkSize is passed to PrepareComputeGPU()
+	void AddJob(IComputeTask* pTask, size_t LocalWorkSize[3], size_t DeviceBytes = 0, const std::string& Name = "",
+		bool TuneLocalWorkSize = true);
+
+	//! Runs all jobs added since the last Run(), returns true if all of them initialized and validated
+	bool Run();
+
+	const std::vector<JobResult>& GetResults() const { return m_Results; }
+
+	void PrintResults() const;
+
+	size_t GetMemoryBudget() const { return m_MemoryBudget; }
+
+protected:
+	void WorkerLoop(cl_command_queue CommandQueue);
+
+	//! Blocks until a job fits into the budget, returns false when all jobs have been started
+	bool AcquireJob(size_t& JobIndex, size_t& Bytes);
+
+	void ReleaseJob(size_t Bytes);
+
+	void RunJob(const Job& CurrentJob, cl_command_queue CommandQueue, JobResult& Result);
+
+	cl_device_id					m_Device;
+	cl_context						m_Context;
+	std::vector<cl_command_queue>	m_Queues;
+	size_t							m_MemoryBudget;
+
+	std::vector<Job>				m_Jobs;
+	std::vector<JobResult>			m_Results;
+
+	// admission state of Run()
+	std::mutex						m_Mutex;
+	std::condition_variable			m_JobFinished;
+	std::vector<bool>				m_Started;
+	size_t							m_BytesInUse;
+	unsigned int					m_NRunning;
+};
+
+#endif // _CTASK_SCHEDULER_H
@@ -0,0 +1,245 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CTraceRecorder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace std;
+
+// nesting depth of the open CScopeTimers on the current thread
+static thread_local int s_ScopeDepth = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+// CTraceRecorder
+
+CTraceRecorder& CTraceRecorder::GetInstance()
+{
+	static CTraceRecorder s_Instance;
+	return s_Instance;
+}
+
+CTraceRecorder::CTraceRecorder()
+	: m_Enabled(false)
+{
+	const char* env = getenv("GPUC_TRACE");
+	if (env != NULL && env[0] != '\0')
+		Enable(env);
+}
+
+void CTraceRecorder::Enable(const std::string& OutputPath)
+{
+	lock_guard<mutex> lock(m_Mutex);
+	m_OutputPath = OutputPath;
+	m_Enabled = true;
+}
+
+double CTraceRecorder::GetTimeMicroseconds()
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, counter;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&counter);
+	return 1.0e6 * double(counter.QuadPart) / double(freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1.0e6 * (double)ts.tv_sec + 1.0e-3 * (double)ts.tv_nsec;
+#endif
+}
+
+int CTraceRecorder::GetThreadId()
+{
+	// m_Mutex is held by the caller
+	thread::id id = this_thread::get_id();
+	map<thread::id, int>::iterator it = m_ThreadIds.find(id);
+	if (it != m_ThreadIds.end())
+		return it->second;
+
+	int threadId = (int)m_ThreadIds.size();
+	m_ThreadIds[id] = threadId;
+	return threadId;
+}
+
+int CTraceRecorder::GetQueueId(cl_command_queue Queue, cl_device_id Device)
+{
+	// m_Mutex is held by the caller
+	map<cl_command_queue, int>::iterator it = m_QueueIds.find(Queue);
+	if (it != m_QueueIds.end())
+		return it->second;
+
+	char deviceName[256] = "";
+	clGetDeviceInfo(Device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+
+	int queueId = (int)m_QueueIds.size();
+	m_QueueIds[Queue] = queueId;
+
+	stringstream name;
+	name << "Queue " << queueId << " (" << deviceName << ")";
+	m_QueueNames.push_back(name.str());
+	return queueId;
+}
+
+double CTraceRecorder::DeviceClock::GetOffsetUs() const
+{
+	// the enqueue bound is tight unless the driver delays the QUEUED timestamp,
+	// the completion bound includes the time until the event was collected
+	return HasMinOffset ? min(MinOffsetUs, MaxOffsetUs) : MaxOffsetUs;
+}
+
+void CTraceRecorder::AddHostEvent(const std::string& Name, const std::string& Category, double StartUs, double DurationUs, int Depth)
+{
+	if (!m_Enabled)
+		return;
+
+	lock_guard<mutex> lock(m_Mutex);
+	TraceEvent e = { Name, Category, StartUs, DurationUs, GetThreadId(), Depth, NULL };
+	m_Events.push_back(e);
+}
+
+void CTraceRecorder::AddDeviceEvent(const std::string& Name, cl_event Event, double EnqueueUs)
+{
+	if (!m_Enabled || Event == NULL)
+		return;
+
+	cl_ulong queued = 0, start = 0, end = 0;
+	if (clGetEventProfilingInfo(Event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, NULL) != CL_SUCCESS ||
+		clGetEventProfilingInfo(Event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL) != CL_SUCCESS ||
+		clGetEventProfilingInfo(Event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL) != CL_SUCCESS)
+		return;
+
+	double nowUs = GetTimeMicroseconds();
+
+	cl_command_queue queue = NULL;
+	cl_device_id device = NULL;
+	clGetEventInfo(Event, CL_EVENT_COMMAND_QUEUE, sizeof(cl_command_queue), &queue, NULL);
+	clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+
+	lock_guard<mutex> lock(m_Mutex);
+
+	// the command has completed, so it ended no later than now
+	double maxOffsetUs = nowUs - 1.0e-3 * (double)end;
+	map<cl_device_id, DeviceClock>::iterator it = m_DeviceClocks.find(device);
+	if (it == m_DeviceClocks.end())
+	{
+		DeviceClock clock = { 0.0, maxOffsetUs, false };
+		it = m_DeviceClocks.insert(make_pair(device, clock)).first;
+	}
+	DeviceClock& clock = it->second;
+	clock.MaxOffsetUs = min(clock.MaxOffsetUs, maxOffsetUs);
+
+	// and it was queued no earlier than the host enqueued it
+	if (EnqueueUs >= 0.0)
+	{
+		double minOffsetUs = EnqueueUs - 1.0e-3 * (double)queued;
+		clock.MinOffsetUs = clock.HasMinOffset ? max(clock.MinOffsetUs, minOffsetUs) : minOffsetUs;
+		clock.HasMinOffset = true;
+	}
+
+	TraceEvent e = { Name, "device", 1.0e-3 * (double)start, 1.0e-3 * (double)(end - start), GetQueueId(queue, device), 0, device };
+	m_Events.push_back(e);
+}
+
+static void WriteJSONString(ostream& Out, const std::string& Str)
+{
+	Out << '"';
+	for (size_t i = 0; i < Str.size(); i++)
+	{
+		char c = Str[i];
+		if (c == '"' || c == '\\')
+			Out << '\\' << c;
+		else if ((unsigned char)c < 0x20)
+			Out << ' ';
+		else
+			Out << c;
+	}
+	Out << '"';
+}
+
+bool CTraceRecorder::Flush()
+{
+	lock_guard<mutex> lock(m_Mutex);
+	if (!m_Enabled || m_Events.empty())
+		return true;
+
+	ofstream file(m_OutputPath.c_str());
+	if (!file.is_open())
+	{
+		cerr << "Failed to open trace file '" << m_OutputPath << "'." << endl;
+		return false;
+	}
+
+	// host events go to process 1, device events to process 2 with one thread per queue
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Host\"}}," << endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"OpenCL device\"}}";
+	for (size_t i = 0; i < m_QueueNames.size(); i++)
+	{
+		file << "," << endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":" << i << ",\"args\":{\"name\":";
+		WriteJSONString(file, m_QueueNames[i]);
+		file << "}}";
+	}
+
+	file << fixed << setprecision(3);
+	for (size_t i = 0; i < m_Events.size(); i++)
+	{
+		const TraceEvent& e = m_Events[i];
+		double startUs = e.StartUs;
+		if (e.Device != NULL)
+			startUs += m_DeviceClocks[e.Device].GetOffsetUs();
+
+		file << "," << endl << "{\"name\":";
+		WriteJSONString(file, e.Name);
+		file << ",\"cat\":";
+		WriteJSONString(file, e.Category);
+		file << ",\"ph\":\"X\",\"ts\":" << startUs << ",\"dur\":" << e.DurationUs
+			<< ",\"pid\":" << (e.Device != NULL ? 2 : 1) << ",\"tid\":" << e.ThreadId
+			<< ",\"args\":{\"depth\":" << e.Depth << "}}";
+	}
+	file << endl << "]}" << endl;
+
+	cout << "Wrote " << m_Events.size() << " trace events to '" << m_OutputPath << "'." << endl;
+	m_Events.clear();
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CScopeTimer
+
+CScopeTimer::CScopeTimer(const std::string& Name, const std::string& Category)
+	: m_StartUs(0.0), m_Active(CTraceRecorder::GetInstance().IsEnabled())
+{
+	if (!m_Active)
+		return;
+
+	m_Name = Name;
+	m_Category = Category;
+	s_ScopeDepth++;
+	m_StartUs = CTraceRecorder::GetTimeMicroseconds();
+}
+
+CScopeTimer::~CScopeTimer()
+{
+	if (!m_Active)
+		return;
+
+	double endUs = CTraceRecorder::GetTimeMicroseconds();
+	s_ScopeDepth--;
+	CTraceRecorder::GetInstance().AddHostEvent(m_Name, m_Category, m_StartUs, endUs - m_StartUs, s_ScopeDepth);
+}
+
+///////////////////////////////////////////////////////////////////////////////
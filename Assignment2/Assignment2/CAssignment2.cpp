@@ -8,6 +8,9 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CReductionTask.h"
 #include "CScanTask.h"
 
+#include "../Common/CBenchmarkSweep.h"
+#include "../Common/CLUtil.h"
+
 #include <iostream>
 
 using namespace std;
@@ -41,4 +44,51 @@ bool CAssignment2::DoCompute()
 	return true;
 }
 
+bool CAssignment2::DoBenchmarkSweep()
+{
+	// With a variant ComputeGPU() uploads the array, runs that kernel once and reads the result back.
+	// The kernels read every element at least once, so the byte counts are lower bounds.
+	CBenchmarkSweep reduction("Reduction", [](const CBenchmarkSweep::Configuration& Config, size_t& Elements, size_t& Bytes) -> IComputeTask*
+	{
+		Elements = Config.ProblemSize;
+		Bytes = 2 * Config.ProblemSize * sizeof(cl_uint);
+		return new CReductionTask(Config.ProblemSize, Config.Variant);
+	});
+	reduction.AddVariant("interleavedAddressing");
+	reduction.AddVariant("sequentialAddressing");
+	reduction.AddVariant("kernelDecomposition");
+	reduction.AddVariant("kernelDecompositionUnroll");
+
+	// the scans also write every element, and all of them are read back
+	CBenchmarkSweep scan("Scan", [](const CBenchmarkSweep::Configuration& Config, size_t& Elements, size_t& Bytes) -> IComputeTask*
+	{
+		Elements = Config.ProblemSize;
+		Bytes = 4 * Config.ProblemSize * sizeof(cl_uint);
+		return new CScanTask(Config.ProblemSize, Config.LocalWorkSize[0], Config.Variant);
+	});
+	scan.AddVariant("scanNaive");
+	scan.AddVariant("scanWorkEfficient");
+
+	size_t locsize[] = {64, 128, 256, 512};
+	size_t arraysize[] = {1 << 20, 1 << 22, 1 << 24};
+	for(size_t i = 0; i < ARRAYLEN(locsize); i++)
+	{
+		reduction.AddLocalWorkSize(locsize[i]);
+		scan.AddLocalWorkSize(locsize[i]);
+	}
+	for(size_t i = 0; i < ARRAYLEN(arraysize); i++)
+	{
+		reduction.AddProblemSize(arraysize[i]);
+		scan.AddProblemSize(arraysize[i]);
+	}
+	reduction.SetIterations(1, 5);
+	scan.SetIterations(1, 5);
+
+	if(!RunBenchmarkSweep(reduction) || !RunBenchmarkSweep(scan))
+		return false;
+
+	return reduction.WriteCSV("ReductionSweep.csv") && reduction.WriteJSON("ReductionSweep.json")
+		&& scan.WriteCSV("ScanSweep.csv") && scan.WriteJSON("ScanSweep.json");
+}
+
 ///////////////////////////////////////////////////////////////////////////////
@@ -30,6 +30,8 @@ public:
 
 	//! This overloaded method contains the specific solution of A2
 	virtual bool DoCompute();
+
+	virtual bool DoBenchmarkSweep();
 };
 
 #endif // _CASSIGNMENT2_H
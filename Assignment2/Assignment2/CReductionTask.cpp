@@ -5,18 +5,34 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CReductionTask.h"
 
+#include "../Common/CBenchmark.h"
+#include "../Common/CBufferPool.h"
+#include "../Common/CCounterRNG.h"
+#include "../Common/CDeviceCaps.h"
 #include "../Common/CLUtil.h"
+#include "../Common/CMultiDevice.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
 #include "../Common/CTimer.h"
+#include "../Common/CWorkGroupTuner.h"
+
+#include <algorithm>
 
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////////////////
 // CReductionTask
 
-string g_kernelNames[4] = {"interleavedAddressing", "sequentialAddressing", "kernelDecomposition", "kernelDecompositionUnroll"};
+string g_kernelNames[5] = {"interleavedAddressing", "sequentialAddressing", "kernelDecomposition", "kernelDecompositionUnroll",
+                           "kernelDecompositionSubgroup"};
+
+// Global memory traffic and additions per input element, over all passes. The in-place variants read
+// about two elements and write one, the decompositions read every element once and write little.
+static const CRoofline::KernelCost g_kernelCosts[5] = {{8, 4, 1}, {8, 4, 1}, {4, 0, 1}, {4, 0, 1}, {4, 0, 1}};
 
-CReductionTask::CReductionTask(size_t ArraySize)
+CReductionTask::CReductionTask(size_t ArraySize, const std::string& Variant)
     : m_N(ArraySize),
+      m_Variant(-1),
       m_hInput(NULL),
       m_dPingArray(NULL),
       m_dPongArray(NULL),
@@ -24,7 +40,15 @@ CReductionTask::CReductionTask(size_t ArraySize)
       m_InterleavedAddressingKernel(NULL),
       m_SequentialAddressingKernel(NULL),
       m_DecompKernel(NULL),
-      m_DecompUnrollKernel(NULL) {
+      m_DecompUnrollKernel(NULL),
+      m_DecompSubgroupKernel(NULL),
+      m_InterleavedArray(NULL),
+      m_InterleavedLocalSize(0),
+      m_DeviceInput(false),
+      m_DeviceInputChecked(false) {
+  for (int i = 0; i < (int)ARRAYLEN(g_kernelNames); i++)
+    if (g_kernelNames[i] == Variant) m_Variant = i;
+  if (!Variant.empty() && m_Variant < 0) cerr << "Warning: unknown reduction kernel '" << Variant << "', running all of them." << endl;
 }
 
 CReductionTask::~CReductionTask() {
@@ -36,15 +60,14 @@ bool CReductionTask::InitResources(cl_device_id Device, cl_context Context) {
   m_hInput = new unsigned int[m_N];
 
   // fill the array with some values
-  for (unsigned int i = 0; i < m_N; i++)
-    // m_hInput[i] = 1;			// Use this for debugging
-    m_hInput[i] = rand() & 15;
+  // for (unsigned int i = 0; i < m_N; i++) m_hInput[i] = 1;			// Use this for debugging
+  CCounterRNG().FillUInt(m_hInput, m_N, 16);
 
   // device resources
   cl_int clError, clError2;
-  m_dPingArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+  m_dPingArray = CBufferPool::GetInstance().Create(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, &clError2);
   clError = clError2;
-  m_dPongArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+  m_dPongArray = CBufferPool::GetInstance().Create(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, &clError2);
   clError |= clError2;
   V_RETURN_FALSE_CL(clError, "Error allocating device arrays");
 
@@ -52,7 +75,11 @@ bool CReductionTask::InitResources(cl_device_id Device, cl_context Context) {
   string programCode;
 
   CLUtil::LoadProgramSourceToMemory("Reduction.cl", programCode);
-  m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+  // the variant for this device, e.g. Reduction_DecompUnroll needs its lockstep width
+  const CDeviceCaps& caps = CDeviceCaps::Get(Device);
+  CLDefines defines;
+  caps.AddDefines(defines);
+  m_Program = CLUtil::BuildProgramVariant(Device, Context, programCode, defines, caps.SubgroupOptions);
   if (m_Program == nullptr) return false;
 
   // create kernels
@@ -68,6 +95,11 @@ bool CReductionTask::InitResources(cl_device_id Device, cl_context Context) {
   m_DecompUnrollKernel = clCreateKernel(m_Program, "Reduction_DecompUnroll", &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create kernel: Reduction_DecompUnroll.");
 
+  if (caps.HasSubgroups) {
+    m_DecompSubgroupKernel = clCreateKernel(m_Program, "Reduction_DecompSubgroup", &clError);
+    V_RETURN_FALSE_CL(clError, "Failed to create kernel: Reduction_DecompSubgroup.");
+  }
+
   return true;
 }
 
@@ -76,27 +108,72 @@ void CReductionTask::ReleaseResources() {
   SAFE_DELETE_ARRAY(m_hInput);
 
   // device resources
-  SAFE_RELEASE_MEMOBJECT(m_dPingArray);
-  SAFE_RELEASE_MEMOBJECT(m_dPongArray);
+  m_InterleavedLaunches.Release();
+  SAFE_RELEASE_POOLED(m_dPingArray);
+  SAFE_RELEASE_POOLED(m_dPongArray);
 
   SAFE_RELEASE_KERNEL(m_InterleavedAddressingKernel);
   SAFE_RELEASE_KERNEL(m_SequentialAddressingKernel);
   SAFE_RELEASE_KERNEL(m_DecompKernel);
   SAFE_RELEASE_KERNEL(m_DecompUnrollKernel);
+  SAFE_RELEASE_KERNEL(m_DecompSubgroupKernel);
+
+  for (size_t i = 0; i < m_DeviceKernels.size(); i++) SAFE_RELEASE_KERNEL(m_DeviceKernels[i]);
+  m_DeviceKernels.clear();
 
   SAFE_RELEASE_PROGRAM(m_Program);
 }
 
+void CReductionTask::PrepareComputeGPU(cl_command_queue CommandQueue, const size_t LocalWorkSize[3], bool TuneLocalWorkSize) {
+  // Three blocks of the device generator are checked instead of reading back a whole device input
+  if (!m_DeviceInputChecked) {
+    m_DeviceInputChecked = true;
+    m_DeviceInput = CCounterRNG::CheckDevice(CommandQueue);
+    if (!m_DeviceInput) cerr << "Warning: the device random numbers fail the known-answer test, uploading the host input instead." << endl;
+  }
+
+  // Tuning launches the kernels, so it is done here instead of in the timed ComputeGPU().
+  // ExecuteTask() and TestPerformance() write the input afterwards.
+  cl_kernel kernels[5] = {m_InterleavedAddressingKernel, m_SequentialAddressingKernel, m_DecompKernel, m_DecompUnrollKernel, m_DecompSubgroupKernel};
+  for (unsigned int i = 0; i < 5; i++) {
+    m_TunedLocalWorkSize[i][0] = 0;
+    if ((LocalWorkSize[0] != 0 && !TuneLocalWorkSize) || kernels[i] == nullptr || (m_Variant >= 0 && m_Variant != (int)i)) continue;
+
+    // the arguments of the first pass, which adds two elements per work-item
+    size_t problemSize = m_N / 2 + m_N % 2;
+    cl_uint stride = i == 0 ? 1 : (cl_uint)problemSize;
+    cl_int clErr = clSetKernelArg(kernels[i], 0, sizeof(cl_mem), (void*)&m_dPingArray);
+    if (i < 2)
+      clErr |= clSetKernelArg(kernels[i], 1, sizeof(cl_uint), (void*)&stride);
+    else
+      clErr |= clSetKernelArg(kernels[i], 1, sizeof(cl_mem), (void*)&m_dPongArray);
+    clErr |= clSetKernelArg(kernels[i], 2, sizeof(cl_uint), (void*)&m_N);
+    V_RETURN_CL(clErr, "Error setting kernel arguments.");
+
+    // the decompositions size their local buffer (argument 3) by the work-group, Reduction_DecompUnroll needs two work-items
+    bool tuned = i < 2 ? CWorkGroupTuner::Tune(CommandQueue, kernels[i], 1, &problemSize, m_TunedLocalWorkSize[i])
+                       : CWorkGroupTuner::Tune(CommandQueue, kernels[i], 1, &problemSize, m_TunedLocalWorkSize[i], 3, sizeof(cl_uint), 10, i == 3 ? 2 : 1);
+    if (!tuned) cerr << "Error: failed to tune the local work size of " << g_kernelNames[i] << "." << endl;
+  }
+}
+
 void CReductionTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]) {
+  if (m_Variant >= 0) {
+    ExecuteTask(Context, CommandQueue, LocalWorkSize, m_Variant);
+    return;
+  }
+
   ExecuteTask(Context, CommandQueue, LocalWorkSize, 0);
   ExecuteTask(Context, CommandQueue, LocalWorkSize, 1);
   ExecuteTask(Context, CommandQueue, LocalWorkSize, 2);
   ExecuteTask(Context, CommandQueue, LocalWorkSize, 3);
+  if (m_DecompSubgroupKernel) ExecuteTask(Context, CommandQueue, LocalWorkSize, 4);
 
   TestPerformance(Context, CommandQueue, LocalWorkSize, 0);
   TestPerformance(Context, CommandQueue, LocalWorkSize, 1);
   TestPerformance(Context, CommandQueue, LocalWorkSize, 2);
   TestPerformance(Context, CommandQueue, LocalWorkSize, 3);
+  if (m_DecompSubgroupKernel) TestPerformance(Context, CommandQueue, LocalWorkSize, 4);
 }
 
 void CReductionTask::ComputeCPU() {
@@ -105,10 +182,23 @@ void CReductionTask::ComputeCPU() {
 
   unsigned int nIterations = 10;
   for (unsigned int j = 0; j < nIterations; j++) {
-    m_resultCPU = m_hInput[0];
-    for (unsigned int i = 1; i < m_N; i++) {
-      m_resultCPU += m_hInput[i];
-    }
+    // unsigned overflow wraps, so the order of the partial sums does not change the result
+    m_resultCPU = CThreadPool::GetInstance().ParallelReduce(
+        size_t(0), size_t(m_N), 0, 0u,
+        [this](size_t Begin, size_t End) {
+          // independent accumulators keep the adds out of one dependency chain
+          unsigned int sum[4] = {0, 0, 0, 0};
+          size_t i = Begin;
+          for (; i + 4 <= End; i += 4) {
+            sum[0] += m_hInput[i];
+            sum[1] += m_hInput[i + 1];
+            sum[2] += m_hInput[i + 2];
+            sum[3] += m_hInput[i + 3];
+          }
+          for (; i < End; i++) sum[0] += m_hInput[i];
+          return sum[0] + sum[1] + sum[2] + sum[3];
+        },
+        [](unsigned int A, unsigned int B) { return A + B; });
   }
 
   timer.Stop();
@@ -117,10 +207,137 @@ void CReductionTask::ComputeCPU() {
   cout << "  average time: " << ms << " ms, throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" << endl;
 }
 
+//! Enqueues all passes of a kernel decomposition variant over the first N elements of Ping, the sum ends up in Ping[0]
+static cl_int EnqueueDecomposition(cl_command_queue CommandQueue, cl_kernel Kernel, cl_mem& Ping, cl_mem& Pong, cl_uint N, size_t LocalWorkSize) {
+  cl_int clErr = CL_SUCCESS;
+
+  // N is the number of elements to be reduced in the current iteration
+  // Stop reducing for less than 2 elements
+  while (N >= 2 && clErr == CL_SUCCESS) {
+    // The number of threads is half the number of elements in the array, that need to be reduced in this iteration
+    size_t globalWorkSize = CLUtil::GetGlobalWorkSize(N / 2 + N % 2, LocalWorkSize);
+
+    // Set the kernel arguments, input and output buffer, the size of the array and the local block
+    // And launch the kernel
+    clErr = clSetKernelArg(Kernel, 0, sizeof(cl_mem), (void*)&Ping);
+    clErr |= clSetKernelArg(Kernel, 1, sizeof(cl_mem), (void*)&Pong);
+    clErr |= clSetKernelArg(Kernel, 2, sizeof(cl_uint), (void*)&N);
+    clErr |= clSetKernelArg(Kernel, 3, LocalWorkSize * sizeof(cl_uint), NULL);
+    clErr |= clEnqueueNDRangeKernel(CommandQueue, Kernel, 1, NULL, &globalWorkSize, &LocalWorkSize, 0, NULL, NULL);
+
+    // Every work-group wrote one partial sum, these are reduced in the next iteration
+    N = (cl_uint)(globalWorkSize / LocalWorkSize);
+    swap(Ping, Pong);
+  }
+  return clErr;
+}
+
+//! Enqueues all passes of one reduction variant over the first N elements of Ping, the sum ends up in Ping[0]
+static cl_int EnqueueReduction(cl_command_queue CommandQueue, cl_kernel Kernel, unsigned int Variant, cl_mem& Ping, cl_mem& Pong,
+                               cl_uint N, size_t LocalWorkSize) {
+  // one partial sum per work-group, ping-ponging between the buffers
+  if (Variant >= 2) return EnqueueDecomposition(CommandQueue, Kernel, Ping, Pong, N, LocalWorkSize);
+
+  // in place, with the stride doubling (interleaved) or halving (sequential)
+  cl_int clErr = CL_SUCCESS;
+  cl_uint total = N, stride = 1;
+  while (N >= 2 && clErr == CL_SUCCESS) {
+    size_t globalWorkSize = CLUtil::GetGlobalWorkSize(N / 2 + N % 2, LocalWorkSize);
+    cl_uint next = N / 2 + N % 2;
+    if (Variant == 1) stride = next;
+    clErr = clSetKernelArg(Kernel, 0, sizeof(cl_mem), (void*)&Ping);
+    clErr |= clSetKernelArg(Kernel, 1, sizeof(cl_uint), (void*)&stride);
+    clErr |= clSetKernelArg(Kernel, 2, sizeof(cl_uint), Variant == 0 ? (void*)&total : (void*)&N);
+    clErr |= clEnqueueNDRangeKernel(CommandQueue, Kernel, 1, NULL, &globalWorkSize, &LocalWorkSize, 0, NULL, NULL);
+    if (Variant == 0) stride <<= 1;
+    N = next;
+  }
+  return clErr;
+}
+
+bool CReductionTask::PrepareMultiDevice(CMultiDevice& Devices) {
+  string programCode;
+  if (!CLUtil::LoadProgramSourceToMemory("Reduction.cl", programCode)) return false;
+
+  // Devices without subgroups run Reduction_DecompUnroll in place of Reduction_DecompSubgroup
+  m_DeviceKernels.assign(5 * Devices.GetNumDevices(), nullptr);
+  for (size_t i = 0; i < Devices.GetNumDevices(); i++) {
+    const CDeviceCaps& caps = CDeviceCaps::Get(Devices.GetDevice(i).Id);
+    for (unsigned int variant = 0; variant < 5; variant++) {
+      string kernelName = "Reduction_" + string(variant == 0 ? "InterleavedAddressing" : variant == 1 ? "SequentialAddressing" : variant == 2 ? "Decomp"
+                                                : variant == 4 && caps.HasSubgroups ? "DecompSubgroup" : "DecompUnroll");
+      CLDefines defines;
+      caps.AddDefines(defines);
+      m_DeviceKernels[5 * i + variant] = Devices.CreateKernel(i, programCode, kernelName.c_str(), defines, caps.SubgroupOptions);
+      if (m_DeviceKernels[5 * i + variant] == nullptr) return false;
+    }
+  }
+
+  m_DevicePartials.assign(Devices.GetNumDevices(), vector<unsigned int>(5, 0));
+  return Devices.Calibrate("Reduction", m_N, 1024,
+                           [&](size_t DeviceIndex, size_t Begin, size_t End) { return ComputeRange(Devices, DeviceIndex, Begin, End); });
+}
+
+bool CReductionTask::ComputeMultiDevice(CMultiDevice& Devices) {
+  if (m_DeviceKernels.empty()) return false;
+
+  // every device reduces its range with all five variants, the partial sums are added up on the host
+  bool success = Devices.Run("Reduction", m_N, 1024,
+                             [&](size_t DeviceIndex, size_t Begin, size_t End) { return ComputeRange(Devices, DeviceIndex, Begin, End); });
+  if (!success) return false;
+
+  // only the ranges of the final run count, the calibration run may have used other devices
+  const vector<CMultiDevice::Range>& parts = Devices.GetLastPartition();
+  for (unsigned int variant = 0; variant < 5; variant++) {
+    m_resultGPU[variant] = 0;
+    for (size_t i = 0; i < parts.size(); i++)
+      if (parts[i].End > parts[i].Begin) m_resultGPU[variant] += m_DevicePartials[i][variant];
+  }
+
+  Devices.PrintLastRun();
+  return true;
+}
+
+bool CReductionTask::ComputeRange(CMultiDevice& Devices, size_t DeviceIndex, size_t Begin, size_t End) {
+  const CMultiDevice::Device& device = Devices.GetDevice(DeviceIndex);
+  cl_uint count = (cl_uint)(End - Begin);
+
+  cl_int clError, clError2;
+  cl_mem dPing = CBufferPool::GetInstance().Create(device.Context, CL_MEM_READ_WRITE, count * sizeof(cl_uint), &clError2);
+  clError = clError2;
+  cl_mem dPong = CBufferPool::GetInstance().Create(device.Context, CL_MEM_READ_WRITE, count * sizeof(cl_uint), &clError2);
+  clError |= clError2;
+
+  for (unsigned int variant = 0; variant < 5 && clError == CL_SUCCESS; variant++) {
+    cl_kernel kernel = m_DeviceKernels[5 * DeviceIndex + variant];
+
+    // the decomposition kernels need a power of two, up to 256 work-items
+    size_t maxLocalSize = 256, localWorkSize = 1;
+    clGetKernelWorkGroupInfo(kernel, device.Id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxLocalSize, NULL);
+    while (localWorkSize * 2 <= min<size_t>(maxLocalSize, 256)) localWorkSize *= 2;
+
+    clError = clEnqueueWriteBuffer(device.Queue, dPing, CL_FALSE, 0, count * sizeof(cl_uint), m_hInput + Begin, 0, NULL, NULL);
+    clError |= EnqueueReduction(device.Queue, kernel, variant, dPing, dPong, count, localWorkSize);
+    clError |= clEnqueueReadBuffer(device.Queue, dPing, CL_TRUE, 0, sizeof(cl_uint), &m_DevicePartials[DeviceIndex][variant], 0, NULL, NULL);
+  }
+
+  SAFE_RELEASE_POOLED(dPing);
+  SAFE_RELEASE_POOLED(dPong);
+  V_RETURN_FALSE_CL(clError, "Failed to reduce on " << device.Name << ".");
+  return true;
+}
+
 bool CReductionTask::ValidateResults() {
   bool success = true;
 
-  for (int i = 0; i < 4; i++)
+  // the subgroup variant only runs on devices that have subgroups
+  int firstVariant = 0;
+  int nVariants = m_DecompSubgroupKernel ? 5 : 4;
+  if (m_Variant >= 0) {
+    firstVariant = m_Variant;
+    nVariants = m_Variant + 1;
+  }
+  for (int i = firstVariant; i < nVariants; i++)
     if (m_resultGPU[i] != m_resultCPU) {
       cout << "Validation of reduction kernel " << g_kernelNames[i] << " failed." << endl;
       success = false;
@@ -130,32 +347,39 @@ bool CReductionTask::ValidateResults() {
 }
 
 void CReductionTask::Reduction_InterleavedAddressing(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]) {
-  cl_int clErr;
-  size_t globalWorkSize[1];
-  size_t localWorkSize[1] = {LocalWorkSize[0]};
-  unsigned int stride = 1;
-
-  // N is the number of elements to be reduced in the current iteration
-  // Stop reducing for less than 2 elements
-  size_t N = m_N;
-  while (N >= 2) {
-    // The number of threads is half the number of elements in the array
-    // In the next iteration the number of elements is exaclty the number of threads for this iteration
-    N = N / 2 + N % 2;
-    globalWorkSize[0] = CLUtil::GetGlobalWorkSize(N, localWorkSize[0]);
-
-    // Set the kernel arguments, read-write buffer, the stride and the size of the array
-    // And launch the kernel
-    clErr = clSetKernelArg(m_InterleavedAddressingKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
-    clErr |= clSetKernelArg(m_InterleavedAddressingKernel, 1, sizeof(cl_uint), (void*)&stride);
-    clErr |= clSetKernelArg(m_InterleavedAddressingKernel, 2, sizeof(cl_uint), (void*)&m_N);
-    V_RETURN_CL(clErr, "Error setting kernel arguments.");
-    clErr = clEnqueueNDRangeKernel(CommandQueue, m_InterleavedAddressingKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
-    V_RETURN_CL(clErr, "Error when enqueuing kernel.");
+  // The launches only depend on the array and the work-group size. They are recorded once
+  // and replayed, the other variants swap the ping and pong array though.
+  if (!m_InterleavedLaunches.IsRecorded(CommandQueue) || m_InterleavedArray != m_dPingArray || m_InterleavedLocalSize != LocalWorkSize[0]) {
+    cl_int clErr;
+    size_t globalWorkSize[1];
+    size_t localWorkSize[1] = {LocalWorkSize[0]};
+    unsigned int stride = 1;
+
+    m_InterleavedLaunches.Begin(CommandQueue);
+
+    // N is the number of elements to be reduced in the current iteration
+    // Stop reducing for less than 2 elements
+    size_t N = m_N;
+    while (N >= 2) {
+      // The number of threads is half the number of elements in the array
+      // In the next iteration the number of elements is exaclty the number of threads for this iteration
+      N = N / 2 + N % 2;
+      globalWorkSize[0] = CLUtil::GetGlobalWorkSize(N, localWorkSize[0]);
+
+      // Record the launch with its arguments, read-write buffer, the stride and the size of the array
+      clErr = m_InterleavedLaunches.Launch(CommandQueue, m_InterleavedAddressingKernel, 1, globalWorkSize, localWorkSize, {m_dPingArray, stride, m_N});
+      V_RETURN_CL(clErr, "Error when recording kernel.");
+
+      // The stride is doubled for the nes iteration
+      stride <<= 1;
+    }
 
-    // The stride is doubled for the nes iteration
-    stride <<= 1;
+    m_InterleavedLaunches.End();
+    m_InterleavedArray = m_dPingArray;
+    m_InterleavedLocalSize = LocalWorkSize[0];
   }
+
+  V_RETURN_CL(m_InterleavedLaunches.Replay(), "Error when replaying the kernel launches.");
 }
 
 void CReductionTask::Reduction_SequentialAddressing(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]) {
@@ -188,71 +412,34 @@ void CReductionTask::Reduction_SequentialAddressing(cl_context Context, cl_comma
 }
 
 void CReductionTask::Reduction_Decomp(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]) {
-  cl_int clErr;
-  size_t globalWorkSize[1];
-  size_t localWorkSize[1] = {LocalWorkSize[0]};
-  size_t nGroups;
-
-  // N is the number of elements to be reduced in the current iteration
-  // Stop reducing for less than 2 elements
-  size_t N = m_N;
-  while (N >= 2) {
-    // The number of threads is half the number of elements in the array, that need to be reduced in this iteration
-    // This is exactly the same offset to the right summand.
-    globalWorkSize[0] = CLUtil::GetGlobalWorkSize(N / 2 + N % 2, localWorkSize[0]);
-    nGroups = globalWorkSize[0] / localWorkSize[0];
-
-    // Set the kernel arguments, read-write buffer, the stride and the size of the array
-    // And launch the kernel
-    clErr = clSetKernelArg(m_DecompKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
-    clErr |= clSetKernelArg(m_DecompKernel, 1, sizeof(cl_mem), (void*)&m_dPongArray);
-    clErr |= clSetKernelArg(m_DecompKernel, 2, sizeof(cl_uint), (void*)&N);
-    clErr |= clSetKernelArg(m_DecompKernel, 3, LocalWorkSize[0] * sizeof(cl_uint), NULL);
-    V_RETURN_CL(clErr, "Error setting kernel arguments.");
-    clErr = clEnqueueNDRangeKernel(CommandQueue, m_DecompKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
-    V_RETURN_CL(clErr, "Error when enqueuing kernel.");
-
-    // In this iteration stride elements have been written, so the number of to be reduces elements in the next iteration is stride.
-    N = nGroups;
-    swap(m_dPingArray, m_dPongArray);
-  }
+  V_RETURN_CL(EnqueueDecomposition(CommandQueue, m_DecompKernel, m_dPingArray, m_dPongArray, m_N, LocalWorkSize[0]), "Error when enqueuing kernel.");
 }
 
 void CReductionTask::Reduction_DecompUnroll(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]) {
-  cl_int clErr;
-  size_t globalWorkSize[1];
-  size_t localWorkSize[1] = {LocalWorkSize[0]};
-  size_t nGroups;
+  V_RETURN_CL(EnqueueDecomposition(CommandQueue, m_DecompUnrollKernel, m_dPingArray, m_dPongArray, m_N, LocalWorkSize[0]), "Error when enqueuing kernel.");
+}
 
-  // N is the number of elements to be reduced in the current iteration
-  // Stop reducing for less than 2 elements
-  size_t N = m_N;
-  while (N >= 2) {
-    // The number of threads is half the number of elements in the array, that need to be reduced in this iteration
-    // This is exactly the same offset to the right summand.
-    globalWorkSize[0] = CLUtil::GetGlobalWorkSize(N / 2 + N % 2, localWorkSize[0]);
-    nGroups = globalWorkSize[0] / localWorkSize[0];
+void CReductionTask::Reduction_DecompSubgroup(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]) {
+  V_RETURN_CL(EnqueueDecomposition(CommandQueue, m_DecompSubgroupKernel, m_dPingArray, m_dPongArray, m_N, LocalWorkSize[0]), "Error when enqueuing kernel.");
+}
 
-    // Set the kernel arguments, read-write buffer, the stride and the size of the array
-    // And launch the kernel
-    clErr = clSetKernelArg(m_DecompUnrollKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
-    clErr |= clSetKernelArg(m_DecompUnrollKernel, 1, sizeof(cl_mem), (void*)&m_dPongArray);
-    clErr |= clSetKernelArg(m_DecompUnrollKernel, 2, sizeof(cl_uint), (void*)&N);
-    clErr |= clSetKernelArg(m_DecompUnrollKernel, 3, LocalWorkSize[0] * sizeof(cl_uint), NULL);
-    V_RETURN_CL(clErr, "Error setting kernel arguments.");
-    clErr = clEnqueueNDRangeKernel(CommandQueue, m_DecompUnrollKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
-    V_RETURN_CL(clErr, "Error when enqueuing kernel.");
+bool CReductionTask::WriteInput(cl_command_queue CommandQueue) {
+  // generate the input on the GPU, with the same values as the host input
+  if (m_DeviceInput && CCounterRNG().FillDeviceUInt(CommandQueue, m_dPingArray, m_N, 16)) return true;
+  m_DeviceInput = false;
 
-    // In this iteration stride elements have been written, so the number of to be reduces elements in the next iteration is stride.
-    N = nGroups;
-    swap(m_dPingArray, m_dPongArray);
-  }
+  // otherwise write input data to the GPU
+  V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N * sizeof(cl_uint), m_hInput, 0, NULL, NULL),
+                    "Error copying data from host to device!");
+  return true;
 }
 
 void CReductionTask::ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task) {
-  // write input data to the GPU
-  V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N * sizeof(cl_uint), m_hInput, 0, NULL, NULL),
-              "Error copying data from host to device!");
+  // The local work size tuned by PrepareComputeGPU() takes precedence, a failed tuning keeps the given one
+  if (m_TunedLocalWorkSize[Task][0] != 0) LocalWorkSize = m_TunedLocalWorkSize[Task];
+  if (LocalWorkSize[0] == 0) return;
+
+  if (!WriteInput(CommandQueue)) return;
 
   // run selected task
   switch (Task) {
@@ -260,6 +447,7 @@ void CReductionTask::ExecuteTask(cl_context Context, cl_command_queue CommandQue
     case 1: Reduction_SequentialAddressing(Context, CommandQueue, LocalWorkSize); break;
     case 2: Reduction_Decomp(Context, CommandQueue, LocalWorkSize); break;
     case 3: Reduction_DecompUnroll(Context, CommandQueue, LocalWorkSize); break;
+    case 4: Reduction_DecompSubgroup(Context, CommandQueue, LocalWorkSize); break;
   }
 
   // read back the results synchronously.
@@ -269,36 +457,28 @@ void CReductionTask::ExecuteTask(cl_context Context, cl_command_queue CommandQue
 }
 
 void CReductionTask::TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task) {
-  cout << "Testing performance of task " << g_kernelNames[Task] << endl;
+  if (m_TunedLocalWorkSize[Task][0] != 0) LocalWorkSize = m_TunedLocalWorkSize[Task];
+  if (LocalWorkSize[0] == 0) return;
+  cout << "Testing performance of task " << g_kernelNames[Task] << " (local work size " << LocalWorkSize[0] << ")" << endl;
 
-  // write input data to the GPU
-  V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N * sizeof(cl_uint), m_hInput, 0, NULL, NULL),
-              "Error copying data from host to device!");
+  if (!WriteInput(CommandQueue)) return;
   // finish all before we start meassuring the time
   V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
 
-  CTimer timer;
-  timer.Start();
-
-  // run the kernel N times
-  unsigned int nIterations = 100;
-  for (unsigned int i = 0; i < nIterations; i++) {
-    // run selected task
+  // run the selected task until its time is known precisely enough
+  CBenchmark::Result result = CBenchmark::GetInstance().Measure("Reduction/" + g_kernelNames[Task], CommandQueue, [&]() {
     switch (Task) {
       case 0: Reduction_InterleavedAddressing(Context, CommandQueue, LocalWorkSize); break;
       case 1: Reduction_SequentialAddressing(Context, CommandQueue, LocalWorkSize); break;
       case 2: Reduction_Decomp(Context, CommandQueue, LocalWorkSize); break;
       case 3: Reduction_DecompUnroll(Context, CommandQueue, LocalWorkSize); break;
+      case 4: Reduction_DecompSubgroup(Context, CommandQueue, LocalWorkSize); break;
     }
-  }
-
-  // wait until the command queue is empty again
-  V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
+  });
 
-  timer.Stop();
-
-  double ms = timer.GetElapsedMilliseconds() / double(nIterations);
-  cout << "  average time: " << ms << " ms, throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" << endl;
+  double ms = result.MedianMs;
+  cout << "  throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" << endl;
+  CRoofline::Report(CommandQueue, g_kernelNames[Task], g_kernelCosts[Task], m_N, ms);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
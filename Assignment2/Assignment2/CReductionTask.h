@@ -20,13 +20,18 @@
 #ifndef _CREDUCTION_TASK_H
 #define _CREDUCTION_TASK_H
 
+#include "../Common/CLaunchRecording.h"
 #include "../Common/IComputeTask.h"
 
+#include <string>
+#include <vector>
+
 //! A2/T1: Parallel reduction
 class CReductionTask : public IComputeTask
 {
 public:
-	CReductionTask(size_t ArraySize);
+	//! A Variant names one kernel, which ComputeGPU() then runs once without the performance tests (for the benchmark sweep)
+	CReductionTask(size_t ArraySize, const std::string& Variant = "");
 
 	virtual ~CReductionTask();
 
@@ -36,32 +41,51 @@ public:
 	
 	virtual void ReleaseResources();
 
+	//! Looks up or tunes the local work size of every variant, unless the given one is forced
+	virtual void PrepareComputeGPU(cl_command_queue CommandQueue, const size_t LocalWorkSize[3], bool TuneLocalWorkSize);
+
 	virtual void ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 
 	virtual void ComputeCPU();
 
 	virtual bool ValidateResults();
 
+	virtual bool PrepareMultiDevice(CMultiDevice& Devices);
+
+	virtual bool ComputeMultiDevice(CMultiDevice& Devices);
+
+	virtual std::string GetName() const { return "Reduction"; }
+
 protected:
 
 	void Reduction_InterleavedAddressing(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 	void Reduction_SequentialAddressing(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 	void Reduction_Decomp(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 	void Reduction_DecompUnroll(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	//! Only available on devices with subgroups (see CDeviceCaps)
+	void Reduction_DecompSubgroup(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+
+	//! Generates the input on the device if CCounterRNG::CheckDevice() passed, otherwise uploads m_hInput
+	bool WriteInput(cl_command_queue CommandQueue);
 
 	void ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int task);
 	void TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int task);
 
+	//! Reduces [Begin, End) with all five variants on one device of ComputeMultiDevice()
+	bool ComputeRange(CMultiDevice& Devices, size_t DeviceIndex, size_t Begin, size_t End);
+
 	//NOTE: we have two memory address spaces, so we mark pointers with a prefix
 	//to avoid confusions: 'h' - host, 'd' - device
 
 	unsigned int		m_N;
+	// the kernel selected by the constructor, -1 for all of them
+	int					m_Variant;
 
 	// input data
 	unsigned int		*m_hInput;
 	// results
 	unsigned int		m_resultCPU;
-	unsigned int		m_resultGPU[4];
+	unsigned int		m_resultGPU[5];
 
 	cl_mem				m_dPingArray;
 	cl_mem				m_dPongArray;
@@ -72,6 +96,24 @@ protected:
 	cl_kernel			m_SequentialAddressingKernel;
 	cl_kernel			m_DecompKernel;
 	cl_kernel			m_DecompUnrollKernel;
+	cl_kernel			m_DecompSubgroupKernel;
+
+	//! The local work size of every variant found by PrepareComputeGPU(), 0 if the given one is used
+	size_t				m_TunedLocalWorkSize[5][3] = {};
+
+	//! The log2(N) launches of Reduction_InterleavedAddressing(), replayed while the array and work-group size stay the same
+	CLaunchRecording	m_InterleavedLaunches;
+	cl_mem				m_InterleavedArray;
+	size_t				m_InterleavedLocalSize;
+
+	//! WriteInput() generates the input with CCounterRNG::FillDeviceUInt() instead of uploading it,
+	//! if the known-answer check in PrepareComputeGPU() passed on the device
+	bool				m_DeviceInput;
+	bool				m_DeviceInputChecked;
+
+	//! The five variants of every device, built by PrepareMultiDevice(), and their partial sums
+	std::vector<cl_kernel>					m_DeviceKernels;
+	std::vector<std::vector<unsigned int> >	m_DevicePartials;
 
 };
 
@@ -5,34 +5,39 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CScanTask.h"
 
+#include "../Common/CBenchmark.h"
+#include "../Common/CBufferPool.h"
+#include "../Common/CCounterRNG.h"
+#include "../Common/CDeviceCaps.h"
 #include "../Common/CLUtil.h"
+#include "../Common/CResultValidator.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
 #include "../Common/CTimer.h"
 
+#include <cmath>
 #include <string.h>
 
 using namespace std;
 
-// number of banks in the local memory. This can be used to avoid bank conflicts
-// but we also need to allocate more local memory for that.
-#define NUM_BANKS	32
-
 ///////////////////////////////////////////////////////////////////////////////
 // CScanTask
 
 // only useful for debug info
-const string g_kernelNames[2] = {"scanNaive", "scanWorkEfficient"};
+const string g_kernelNames[3] = {"scanNaive", "scanWorkEfficient", "scanSubgroup"};
 
-CScanTask::CScanTask(size_t ArraySize, size_t MinLocalWorkSize)
+CScanTask::CScanTask(size_t ArraySize, size_t MinLocalWorkSize, const std::string& Variant)
     : m_N(ArraySize),
+      m_Variant(-1),
       m_hArray(NULL),
       m_hResultCPU(NULL),
-      m_hResultGPU(NULL),
       m_dPingArray(NULL),
       m_dPongArray(NULL),
       m_Program(NULL),
       m_ScanNaiveKernel(NULL),
       m_ScanWorkEfficientKernel(NULL),
-      m_ScanWorkEfficientAddKernel(NULL) {
+      m_ScanWorkEfficientAddKernel(NULL),
+      m_ScanSubgroupKernel(NULL) {
   // compute the number of levels that we need for the work-efficient algorithm
 
   m_MinLocalWorkSize = MinLocalWorkSize;
@@ -44,8 +49,11 @@ CScanTask::CScanTask(size_t ArraySize, size_t MinLocalWorkSize)
     m_nLevels++;
   }
 
-  // Reset validation results
-  for (int i = 0; i < (int)ARRAYLEN(m_bValidationResults); i++) m_bValidationResults[i] = false;
+  for (int i = 0; i < (int)ARRAYLEN(m_hResultGPU); i++) m_hResultGPU[i] = NULL;
+
+  for (int i = 0; i < (int)ARRAYLEN(g_kernelNames); i++)
+    if (g_kernelNames[i] == Variant) m_Variant = i;
+  if (!Variant.empty() && m_Variant < 0) cerr << "Warning: unknown scan kernel '" << Variant << "', running all of them." << endl;
 }
 
 CScanTask::~CScanTask() {
@@ -56,26 +64,25 @@ bool CScanTask::InitResources(cl_device_id Device, cl_context Context) {
   // CPU resources
   m_hArray = new unsigned int[m_N];
   m_hResultCPU = new unsigned int[m_N];
-  m_hResultGPU = new unsigned int[m_N];
+  for (int i = 0; i < (int)ARRAYLEN(m_hResultGPU); i++) m_hResultGPU[i] = new unsigned int[m_N];
 
   // fill the array with some values
-  for (unsigned int i = 0; i < m_N; i++)
-    // m_hArray[i] = 1;			// Use this for debugging
-    m_hArray[i] = rand() & 15;
+  // for (unsigned int i = 0; i < m_N; i++) m_hArray[i] = 1;			// Use this for debugging
+  CCounterRNG().FillUInt(m_hArray, m_N, 16);
 
   // device resources
   // ping-pong buffers
   cl_int clError, clError2;
-  m_dPingArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+  m_dPingArray = CBufferPool::GetInstance().Create(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, &clError2);
   clError = clError2;
-  m_dPongArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+  m_dPongArray = CBufferPool::GetInstance().Create(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, &clError2);
   clError |= clError2;
 
   // level buffer
   m_dLevelArrays = new cl_mem[m_nLevels];
   unsigned int N = m_N;
   for (unsigned int i = 0; i < m_nLevels; i++) {
-    m_dLevelArrays[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * N, NULL, &clError2);
+    m_dLevelArrays[i] = CBufferPool::GetInstance().Create(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * N, &clError2);
     clError |= clError2;
     N = max(N / (2 * m_MinLocalWorkSize), m_MinLocalWorkSize);
   }
@@ -85,7 +92,11 @@ bool CScanTask::InitResources(cl_device_id Device, cl_context Context) {
   string programCode;
 
   CLUtil::LoadProgramSourceToMemory("Scan.cl", programCode);
-  m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+  // the variant for this device, with its number of local memory banks
+  const CDeviceCaps& caps = CDeviceCaps::Get(Device);
+  CLDefines defines;
+  caps.AddDefines(defines);
+  m_Program = CLUtil::BuildProgramVariant(Device, Context, programCode, defines, caps.SubgroupOptions);
   if (m_Program == nullptr) return false;
 
   // create kernels
@@ -98,6 +109,11 @@ bool CScanTask::InitResources(cl_device_id Device, cl_context Context) {
   m_ScanWorkEfficientAddKernel = clCreateKernel(m_Program, "Scan_WorkEfficientAdd", &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create kernel.");
 
+  if (caps.HasSubgroups) {
+    m_ScanSubgroupKernel = clCreateKernel(m_Program, "Scan_Subgroup", &clError);
+    V_RETURN_FALSE_CL(clError, "Failed to create kernel.");
+  }
+
   return true;
 }
 
@@ -106,35 +122,43 @@ void CScanTask::ReleaseResources() {
   SAFE_DELETE_ARRAY(m_hArray);
 
   SAFE_DELETE_ARRAY(m_hResultCPU);
-  SAFE_DELETE_ARRAY(m_hResultGPU);
+  for (int i = 0; i < (int)ARRAYLEN(m_hResultGPU); i++) SAFE_DELETE_ARRAY(m_hResultGPU[i]);
 
   // device resources
-  SAFE_RELEASE_MEMOBJECT(m_dPingArray);
-  SAFE_RELEASE_MEMOBJECT(m_dPongArray);
+  SAFE_RELEASE_POOLED(m_dPingArray);
+  SAFE_RELEASE_POOLED(m_dPongArray);
 
   if (m_dLevelArrays)
     for (unsigned int i = 0; i < m_nLevels; i++) {
-      SAFE_RELEASE_MEMOBJECT(m_dLevelArrays[i]);
+      SAFE_RELEASE_POOLED(m_dLevelArrays[i]);
     }
   SAFE_DELETE_ARRAY(m_dLevelArrays);
 
   SAFE_RELEASE_KERNEL(m_ScanNaiveKernel);
   SAFE_RELEASE_KERNEL(m_ScanWorkEfficientKernel);
   SAFE_RELEASE_KERNEL(m_ScanWorkEfficientAddKernel);
+  SAFE_RELEASE_KERNEL(m_ScanSubgroupKernel);
 
   SAFE_RELEASE_PROGRAM(m_Program);
 }
 
 void CScanTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]) {
+  if (m_Variant >= 0) {
+    ExecuteTask(Context, CommandQueue, LocalWorkSize, m_Variant);
+    return;
+  }
+
   cout << endl;
 
-  ValidateTask(Context, CommandQueue, LocalWorkSize, 0);
-  ValidateTask(Context, CommandQueue, LocalWorkSize, 1);
+  ExecuteTask(Context, CommandQueue, LocalWorkSize, 0);
+  ExecuteTask(Context, CommandQueue, LocalWorkSize, 1);
+  if (m_ScanSubgroupKernel) ExecuteTask(Context, CommandQueue, LocalWorkSize, 2);
 
   cout << endl;
 
   TestPerformance(Context, CommandQueue, LocalWorkSize, 0);
   TestPerformance(Context, CommandQueue, LocalWorkSize, 1);
+  if (m_ScanSubgroupKernel) TestPerformance(Context, CommandQueue, LocalWorkSize, 2);
 
   cout << endl;
 }
@@ -145,11 +169,30 @@ void CScanTask::ComputeCPU() {
 
   unsigned int nIterations = 1;
   for (unsigned int j = 0; j < nIterations; j++) {
-    unsigned int sum = 0;
-    for (unsigned int i = 0; i < m_N; i++) {
-      sum += m_hArray[i];
-      m_hResultCPU[i] = sum;
+    // two passes: sum up every chunk, then scan the chunks starting at the sum of their predecessors
+    CThreadPool& pool = CThreadPool::GetInstance();
+    size_t grain = pool.GetDefaultGrain(m_N);
+    vector<unsigned int> chunkOffsets((m_N + grain - 1) / grain, 0);
+    pool.ParallelFor(0, m_N, grain, [&](size_t Begin, size_t End) {
+      unsigned int sum = 0;
+      for (size_t i = Begin; i < End; i++) sum += m_hArray[i];
+      chunkOffsets[Begin / grain] = sum;
+    });
+
+    unsigned int offset = 0;
+    for (size_t c = 0; c < chunkOffsets.size(); c++) {
+      unsigned int chunkSum = chunkOffsets[c];
+      chunkOffsets[c] = offset;
+      offset += chunkSum;
     }
+
+    pool.ParallelFor(0, m_N, grain, [&](size_t Begin, size_t End) {
+      unsigned int sum = chunkOffsets[Begin / grain];
+      for (size_t i = Begin; i < End; i++) {
+        sum += m_hArray[i];
+        m_hResultCPU[i] = sum;
+      }
+    });
   }
 
   timer.Stop();
@@ -160,11 +203,21 @@ void CScanTask::ComputeCPU() {
 bool CScanTask::ValidateResults() {
   bool success = true;
 
-  for (int i = 0; i < 2; i++)
-    if (!m_bValidationResults[i]) {
-      cout << "Validation of reduction kernel " << g_kernelNames[i] << " failed." << endl;
+  // the subgroup variant only runs on devices that have subgroups
+  int firstVariant = 0;
+  int nVariants = m_ScanSubgroupKernel ? 3 : 2;
+  if (m_Variant >= 0) {
+    firstVariant = m_Variant;
+    nVariants = m_Variant + 1;
+  }
+  for (int i = firstVariant; i < nVariants; i++) {
+    CResultValidator::Report report = CResultValidator::Compare(m_hResultCPU, m_hResultGPU[i], m_N, 1, m_N);
+    CResultValidator::PrintReport(report, g_kernelNames[i]);
+    if (!report.Passed()) {
+      cout << "Validation of scan kernel " << g_kernelNames[i] << " failed." << endl;
       success = false;
     }
+  }
 
   return success;
 }
@@ -194,11 +247,17 @@ void CScanTask::Scan_Naive(cl_context Context, cl_command_queue CommandQueue, si
   }
 }
 
-void CScanTask::Scan_WorkEfficient(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]) {
+void CScanTask::Scan_WorkEfficient(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], cl_kernel ScanKernel) {
   cl_int clErr;
   size_t globalWorkSize[1];
   size_t localWorkSize[1] = {LocalWorkSize[0]};
 
+  // The local block is padded to avoid bank conflicts, by the number of banks of the device the program was built for.
+  // Scan_Subgroup needs only one element per subgroup, so the same size fits both kernels.
+  cl_device_id device;
+  clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+  size_t localBlockSize = CDeviceCaps::Get(device).GetPaddedLocalElements(localWorkSize[0] * 2) * sizeof(cl_uint);
+
   // Loop to compute the local PPS
   for (size_t level = 0; level < m_nLevels - 1; ++level) {
     // The number of elements processed in this level, is the actual number of elements divided by pow(double group size, level)
@@ -208,11 +267,11 @@ void CScanTask::Scan_WorkEfficient(cl_context Context, cl_command_queue CommandQ
     globalWorkSize[0] = CLUtil::GetGlobalWorkSize(N / 2, localWorkSize[0]);
 
     // Set the kernel arguments, read-write buffer, the stride and the size of the array and launch the kernel
-    clErr = clSetKernelArg(m_ScanWorkEfficientKernel, 0, sizeof(cl_mem), (void*)&m_dLevelArrays[level]);
-    clErr |= clSetKernelArg(m_ScanWorkEfficientKernel, 1, sizeof(cl_mem), (void*)&m_dLevelArrays[level + 1]);
-    clErr |= clSetKernelArg(m_ScanWorkEfficientKernel, 2, localWorkSize[0] * sizeof(cl_uint) * 2 + localWorkSize[0] / 32 * sizeof(cl_uint), NULL);
+    clErr = clSetKernelArg(ScanKernel, 0, sizeof(cl_mem), (void*)&m_dLevelArrays[level]);
+    clErr |= clSetKernelArg(ScanKernel, 1, sizeof(cl_mem), (void*)&m_dLevelArrays[level + 1]);
+    clErr |= clSetKernelArg(ScanKernel, 2, localBlockSize, NULL);
     V_RETURN_CL(clErr, "Error setting kernel arguments.");
-    clErr = clEnqueueNDRangeKernel(CommandQueue, m_ScanWorkEfficientKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+    clErr = clEnqueueNDRangeKernel(CommandQueue, ScanKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
     V_RETURN_CL(clErr, "Error when enqueuing kernel.");
   }
 
@@ -233,27 +292,25 @@ void CScanTask::Scan_WorkEfficient(cl_context Context, cl_command_queue CommandQ
   }
 }
 
-void CScanTask::ValidateTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task) {
+void CScanTask::ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task) {
   // run selected task
   switch (Task) {
     case 0:
       V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N * sizeof(cl_uint), m_hArray, 0, NULL, NULL),
                   "Error copying data from host to device!");
       Scan_Naive(Context, CommandQueue, LocalWorkSize);
-      V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, m_N * sizeof(cl_uint), m_hResultGPU, 0, NULL, NULL),
+      V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, m_N * sizeof(cl_uint), m_hResultGPU[Task], 0, NULL, NULL),
                   "Error reading data from device!");
       break;
     case 1:
+    case 2:
       V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dLevelArrays[0], CL_FALSE, 0, m_N * sizeof(cl_uint), m_hArray, 0, NULL, NULL),
                   "Error copying data from host to device!");
-      Scan_WorkEfficient(Context, CommandQueue, LocalWorkSize);
-      V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dLevelArrays[0], CL_TRUE, 0, m_N * sizeof(cl_uint), m_hResultGPU, 0, NULL, NULL),
+      Scan_WorkEfficient(Context, CommandQueue, LocalWorkSize, Task == 1 ? m_ScanWorkEfficientKernel : m_ScanSubgroupKernel);
+      V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dLevelArrays[0], CL_TRUE, 0, m_N * sizeof(cl_uint), m_hResultGPU[Task], 0, NULL, NULL),
                   "Error reading data from device!");
       break;
   }
-
-  // validate results
-  m_bValidationResults[Task] = (memcmp(m_hResultCPU, m_hResultGPU, m_N * sizeof(unsigned int)) == 0);
 }
 
 void CScanTask::TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task) {
@@ -265,27 +322,24 @@ void CScanTask::TestPerformance(cl_context Context, cl_command_queue CommandQueu
   // finish all before we start meassuring the time
   V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
 
-  CTimer timer;
-  timer.Start();
-
-  // run the kernel N times
-  unsigned int nIterations = 100;
-  cout << "ITERATIONS = " << nIterations << endl;
-  for (unsigned int i = 0; i < nIterations; i++) {
-    // run selected task
+  // run the selected task until its time is known precisely enough
+  CBenchmark::Result result = CBenchmark::GetInstance().Measure("Scan/" + g_kernelNames[Task], CommandQueue, [&]() {
     switch (Task) {
       case 0: Scan_Naive(Context, CommandQueue, LocalWorkSize); break;
-      case 1: Scan_WorkEfficient(Context, CommandQueue, LocalWorkSize); break;
+      case 1: Scan_WorkEfficient(Context, CommandQueue, LocalWorkSize, m_ScanWorkEfficientKernel); break;
+      case 2: Scan_WorkEfficient(Context, CommandQueue, LocalWorkSize, m_ScanSubgroupKernel); break;
     }
-  }
+  });
 
-  // wait until the command queue is empty again
-  V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
-
-  timer.Stop();
+  double ms = result.MedianMs;
+  cout << "  throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" << endl;
 
-  double ms = timer.GetElapsedMilliseconds() / double(nIterations);
-  cout << "  average time: " << ms << " ms, throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" << endl;
+  // Global memory traffic and additions per element, over all passes. The naive scan reads two elements and
+  // writes one in each of its log2(N) passes, the multi-level scans read and write every element twice.
+  double passes = ceil(log2((double)m_N));
+  CRoofline::KernelCost cost = {8, 8, 3};
+  if (Task == 0) cost = {8 * passes, 4 * passes, passes};
+  CRoofline::Report(CommandQueue, g_kernelNames[Task], cost, m_N, ms);
 }
 
 
@@ -22,12 +22,18 @@
 
 #include "../Common/IComputeTask.h"
 
+#include <string>
+
 //! A2 / T2 Parallel prefix sum (scan)
 class CScanTask : public IComputeTask
 {
 public:
 	//! The second parameter is necessary to pre-allocate the multi-level arrays
-	CScanTask(size_t ArraySize, size_t MinLocalWorkSize);
+	/*!
+		A Variant names one kernel, which ComputeGPU() then runs once without
+		the performance tests (for the benchmark sweep).
+	*/
+	CScanTask(size_t ArraySize, size_t MinLocalWorkSize, const std::string& Variant = "");
 
 	virtual ~CScanTask();
 
@@ -42,22 +48,28 @@ public:
 
 	virtual bool ValidateResults();
 
+	virtual std::string GetName() const { return "Scan"; }
+
 protected:
 
 	void Scan_Naive(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
-	void Scan_WorkEfficient(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	//! Runs the multi-level scan with ScanKernel, Scan_WorkEfficient or Scan_Subgroup
+	void Scan_WorkEfficient(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], cl_kernel ScanKernel);
 
-	void ValidateTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task);
+	//! Runs a variant once and reads its result back, ValidateResults() compares it
+	void ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task);
 	void TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task);
 
 	unsigned int		m_N;
+	// the kernel selected by the constructor, -1 for all of them
+	int					m_Variant;
 
 	//float data on the CPU
 	unsigned int		*m_hArray;
 
 	unsigned int		*m_hResultCPU;
-	unsigned int		*m_hResultGPU;
-	bool				m_bValidationResults[2];
+	// one result per variant, the CPU result may still be computed while they run (--async)
+	unsigned int		*m_hResultGPU[3];
 
 	// ping-pong arrays for the naive scan
 	cl_mem				m_dPingArray;
@@ -73,6 +85,8 @@ protected:
 	cl_kernel			m_ScanNaiveKernel;
 	cl_kernel			m_ScanWorkEfficientKernel;
 	cl_kernel			m_ScanWorkEfficientAddKernel;
+	// only on devices with subgroups (see CDeviceCaps)
+	cl_kernel			m_ScanSubgroupKernel;
 };
 
 #endif // _CSCAN_TASK_H
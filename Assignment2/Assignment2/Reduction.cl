@@ -56,6 +56,12 @@ __kernel void Reduction_Decomp(const __global uint* inArray, __global uint* outA
   if (LID == 0) outArray[Grp] = localBlock[0];
 }
 
+// Number of work-items that run in lockstep and can share local memory without barriers.
+// The host passes the value of the device (see CDeviceCaps), 1 is correct on every device.
+#ifndef LOCKSTEP_WIDTH
+#define LOCKSTEP_WIDTH 1
+#endif
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 __kernel void Reduction_DecompUnroll(const __global uint* inArray, __global uint* outArray, uint N, __local uint* localBlock) {
   // Reduce a block length of <local_size * 2> elements
@@ -78,9 +84,9 @@ __kernel void Reduction_DecompUnroll(const __global uint* inArray, __global uint
   barrier(CLK_LOCAL_MEM_FENCE);
 
 
-  // Reduction of the localBlock
+  // Reduction of the localBlock, with barriers until the remaining elements fit into the work-items that run in lockstep
   stride >>= 1;
-  while (stride > 32) {
+  while (stride > LOCKSTEP_WIDTH) {
     // We do need to check that we do not address elements outside the range of the localBlock.
     // But we do NOT have to take care of elements in the localBlock that do not have a valid element copied from before.
     if (LID < stride) localBlock[LID] += localBlock[LID + stride];
@@ -89,13 +95,47 @@ __kernel void Reduction_DecompUnroll(const __global uint* inArray, __global uint
     barrier(CLK_LOCAL_MEM_FENCE);
   }
 
-  if (LID < 32) localBlock[LID] += localBlock[LID + 32];
-  if (LID < 16) localBlock[LID] += localBlock[LID + 16];
-  if (LID < 8) localBlock[LID] += localBlock[LID + 8];
-  if (LID < 4) localBlock[LID] += localBlock[LID + 4];
-  if (LID < 2) localBlock[LID] += localBlock[LID + 2];
-  //if (LID < 1) localBlock[LID] += localBlock[LID + 1];
+  // The rest without barriers. volatile makes every step read what the other work-items wrote in the step before.
+  volatile __local uint* lockstepBlock = localBlock;
+  if (LID < LOCKSTEP_WIDTH) {
+    for (; stride > 1; stride >>= 1)
+      if (LID < stride) lockstepBlock[LID] += lockstepBlock[LID + stride];
+  }
 
   // Let the first thread in the group write back the result of the local reduction
-  if (LID == 0) outArray[Grp] = localBlock[0] + localBlock[1];
+  if (LID == 0) outArray[Grp] = lockstepBlock[0] + lockstepBlock[1];
+}
+
+#ifdef HAS_SUBGROUPS
+#ifdef cl_khr_subgroups
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void Reduction_DecompSubgroup(const __global uint* inArray, __global uint* outArray, uint N, __local uint* localBlock) {
+  // Same blocks as Reduction_Decomp, but the reduction inside a group uses the subgroup functions of the device.
+  // How the work-items map to subgroups is up to the device, so only the subgroup ids are used for indexing.
+  int stride = get_local_size(0);
+  int Grp = get_group_id(0);
+  int LID = get_local_id(0);
+  int pos = LID + Grp * stride * 2;
+
+  uint elem = 0;
+  if (pos < N) elem += inArray[pos];
+  if (pos + stride < N) elem += inArray[pos + stride];
+
+  // One partial sum per subgroup, without any barrier
+  uint sum = sub_group_reduce_add(elem);
+  if (get_sub_group_local_id() == 0) localBlock[get_sub_group_id()] = sum;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // The first subgroup adds up the partial sums
+  if (get_sub_group_id() == 0) {
+    sum = 0;
+    for (uint i = get_sub_group_local_id(); i < get_num_sub_groups(); i += get_sub_group_size()) sum += localBlock[i];
+    sum = sub_group_reduce_add(sum);
+    if (get_sub_group_local_id() == 0) outArray[Grp] = sum;
+  }
 }
+#endif // HAS_SUBGROUPS
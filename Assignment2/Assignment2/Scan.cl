@@ -17,9 +17,15 @@ __kernel void Scan_Naive(const __global uint* inArray, __global uint* outArray,
 // Why did we not have conflicts in the Reduction? Because of the sequential addressing (here we use interleaved => we have conflicts).
 
 #define UNROLL
+// The host passes the values of the device (see CDeviceCaps), these are the defaults
+#ifndef NUM_BANKS
 #define NUM_BANKS 32
 #define NUM_BANKS_LOG 5
-#define SIMD_GROUP_SIZE 32
+#endif
+#ifndef SIMD_WIDTH
+#define SIMD_WIDTH 32
+#endif
+#define SIMD_GROUP_SIZE SIMD_WIDTH
 
 // Bank conflicts
 #define AVOID_BANK_CONFLICTS
@@ -93,3 +99,49 @@ __kernel void Scan_WorkEfficientAdd(__global uint* higherLevelArray, __global ui
   // The first block of [local_size*2] elements does not need to be modified
   array[get_global_id(0) + get_local_size(0) * 2] += higherLevelArray[get_group_id(0) / 2];
 }
+
+
+#ifdef HAS_SUBGROUPS
+#ifdef cl_khr_subgroups
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void Scan_Subgroup(__global uint* array, __global uint* higherLevelArray, __local uint* localBlock) {
+  // Same contract as Scan_WorkEfficient, but scanned with the subgroup functions of the device instead of up and down sweep.
+  // The elements are ordered by subgroup id and the id inside the subgroup, this assumes that only the last subgroup
+  // of a group can be smaller than the others. The local block holds one element per subgroup.
+  uint sgId = get_sub_group_id();
+  uint numSg = get_num_sub_groups();
+  uint idx = sgId * get_max_sub_group_size() + get_sub_group_local_id();
+  // Every work item scans two neighbouring elements
+  int GID = get_group_id(0) * get_local_size(0) * 2 + idx * 2;
+
+  uint a = array[GID];
+  uint b = array[GID + 1];
+
+  // Scan inside the subgroup, the last work item knows the total of the subgroup
+  uint sum = sub_group_scan_inclusive_add(a + b);
+  if (get_sub_group_local_id() == get_sub_group_size() - 1) localBlock[sgId] = sum;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // The first subgroup turns the totals into offsets, in chunks of its size
+  if (sgId == 0) {
+    uint carry = 0;
+    for (uint i = 0; i < numSg; i += get_sub_group_size()) {
+      uint j = i + get_sub_group_local_id();
+      uint total = j < numSg ? localBlock[j] : 0;
+      uint offset = sub_group_scan_exclusive_add(total);
+      if (j < numSg) localBlock[j] = carry + offset;
+      carry += sub_group_reduce_add(total);
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // Write back to main array and the higher level array
+  uint offset = localBlock[sgId] + sum - (a + b);
+  array[GID] = offset + a;
+  array[GID + 1] = offset + a + b;
+  if (idx == get_local_size(0) - 1) higherLevelArray[get_group_id(0)] = offset + a + b;
+}
+#endif // HAS_SUBGROUPS
@@ -5,9 +5,22 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CAssignmentBase.h"
 
+#include "CBenchmark.h"
+#include "CBenchmarkSweep.h"
+#include "CBufferPool.h"
+#include "CDeviceCaps.h"
 #include "CLUtil.h"
+#include "CMemoryTracker.h"
+#include "CRoofline.h"
+#include "CThreadPool.h"
 #include "CTimer.h"
+#include "CTraceRecorder.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
 #include <vector>
 
 using namespace std;
@@ -35,30 +48,216 @@ using namespace std;
 // CAssignmentBase
 
 CAssignmentBase::CAssignmentBase()
-	: m_CLPlatform(nullptr), m_CLDevice(nullptr), m_CLContext(nullptr), m_CLCommandQueue(nullptr)
+	: m_CLPlatform(nullptr), m_CLDevice(nullptr), m_CLContext(nullptr), m_CLCommandQueue(nullptr),
+	m_CLDeviceType(CL_DEVICE_TYPE_GPU), m_CLPlatformIndex(-1), m_CLDeviceIndex(-1), m_RankCLDevices(false),
+	m_CPUOnly(false), m_AsyncCompute(false), m_ConcurrentQueues(0), m_UseMultiDevice(false),
+	m_HeadlessSteps(0), m_RunSweep(false), m_ForceLocalWorkSize(false), m_LastComputeCPUMs(0.0), m_LastComputeGPUMs(0.0), m_LastResultValid(false),
+	m_ValidateResults(true), m_PendingTask(nullptr), m_PendingValid(false), m_PendingValidated(true)
 {
 }
 
 CAssignmentBase::~CAssignmentBase()
 {
 	ReleaseCLContext();
+
+	CTraceRecorder::GetInstance().Flush();
 }
 
-bool CAssignmentBase::EnterMainLoop(int, char**)
+bool CAssignmentBase::EnterMainLoop(int argc, char** argv)
 {
+	ParseDeviceOptions(argc, argv);
+
 	if(!InitCLContext())
 		return false;
 
-	bool success = DoCompute();
+	bool success = m_RunSweep ? DoBenchmarkSweep() : DoCompute();
 
 	ReleaseCLContext();
 
-	return success;
+	// regressions against a benchmark baseline fail the run, see CBenchmark
+	return CBenchmark::GetInstance().Finish() && success;
 }
 
-#define PRINT_INFO(title, buffer, bufferSize, maxBufferSize, expr) { expr; buffer[bufferSize] = '\0'; std::cout << title << ": " << buffer << std::endl; }
+bool CAssignmentBase::DoBenchmarkSweep()
+{
+	std::cerr << "Error: this assignment has no benchmark sweep." << endl;
+	return false;
+}
 
-bool CAssignmentBase::InitCLContext()
+static bool ParseDeviceType(const std::string& Name, cl_device_type& DeviceType)
+{
+	std::string name(Name);
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+	if (name == "gpu")
+		DeviceType = CL_DEVICE_TYPE_GPU;
+	else if (name == "cpu")
+		DeviceType = CL_DEVICE_TYPE_CPU;
+	else if (name == "accelerator")
+		DeviceType = CL_DEVICE_TYPE_ACCELERATOR;
+	else if (name == "all")
+		DeviceType = CL_DEVICE_TYPE_ALL;
+	else
+	{
+		cerr << "Warning: unknown OpenCL device type '" << Name << "', expected gpu, cpu, accelerator or all." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+void CAssignmentBase::ParseDeviceOptions(int argc, char** argv)
+{
+	// The environment is read first, so that explicit arguments take precedence.
+	const char* env;
+	if ((env = getenv("GPUC_CL_TYPE")) != NULL)
+		ParseDeviceType(env, m_CLDeviceType);
+	if ((env = getenv("GPUC_CL_PLATFORM")) != NULL)
+		m_CLPlatformIndex = atoi(env);
+	if ((env = getenv("GPUC_CL_DEVICE")) != NULL)
+		m_CLDeviceIndex = atoi(env);
+	if ((env = getenv("GPUC_CL_RANK")) != NULL)
+		m_RankCLDevices = atoi(env) != 0;
+	if ((env = getenv("GPUC_CPU_ONLY")) != NULL)
+		m_CPUOnly = atoi(env) != 0;
+	if ((env = getenv("GPUC_ASYNC")) != NULL)
+		m_AsyncCompute = atoi(env) != 0;
+	if ((env = getenv("GPUC_CONCURRENT")) != NULL)
+		m_ConcurrentQueues = (unsigned int)atoi(env);
+	if ((env = getenv("GPUC_MULTI_DEVICE")) != NULL)
+		m_UseMultiDevice = atoi(env) != 0;
+	if ((env = getenv("GPUC_HEADLESS")) != NULL)
+		m_HeadlessSteps = (unsigned int)atoi(env);
+	if ((env = getenv("GPUC_SWEEP")) != NULL)
+		m_RunSweep = atoi(env) != 0;
+	if ((env = getenv("GPUC_FORCE_LWS")) != NULL)
+		m_ForceLocalWorkSize = atoi(env) != 0;
+
+	// Unknown arguments are ignored, they might be meant for the assignment itself.
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--cl-type" && hasValue)
+			ParseDeviceType(argv[++i], m_CLDeviceType);
+		else if (arg == "--cl-platform" && hasValue)
+			m_CLPlatformIndex = atoi(argv[++i]);
+		else if (arg == "--cl-device" && hasValue)
+			m_CLDeviceIndex = atoi(argv[++i]);
+		else if (arg == "--cl-rank")
+			m_RankCLDevices = true;
+		else if (arg == "--cpu-only")
+			m_CPUOnly = true;
+		else if (arg == "--async")
+			m_AsyncCompute = true;
+		else if (arg == "--concurrent" && hasValue)
+			m_ConcurrentQueues = (unsigned int)atoi(argv[++i]);
+		else if (arg == "--multi-device")
+			m_UseMultiDevice = true;
+		else if (arg == "--headless" && hasValue)
+			m_HeadlessSteps = (unsigned int)atoi(argv[++i]);
+		else if (arg == "--sweep")
+			m_RunSweep = true;
+		else if (arg == "--force-lws")
+			m_ForceLocalWorkSize = true;
+	}
+}
+
+//! Measures the device-to-device copy bandwidth of a device in GB/s
+static double MeasureCopyBandwidth(cl_device_id Device)
+{
+	cl_int clError;
+	cl_context context = clCreateContext(NULL, 1, &Device, NULL, NULL, &clError);
+	if (clError != CL_SUCCESS)
+		return 0.0;
+
+	cl_command_queue commandQueue = clCreateCommandQueue(context, Device, 0, &clError);
+	if (clError != CL_SUCCESS)
+	{
+		clReleaseContext(context);
+		return 0.0;
+	}
+
+	cl_ulong maxAllocSize = 0;
+	clGetDeviceInfo(Device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAllocSize, NULL);
+	size_t size = (size_t)std::min<cl_ulong>(64 << 20, maxAllocSize);
+
+	cl_mem src = clCreateBuffer(context, CL_MEM_READ_WRITE, size, NULL, NULL);
+	cl_mem dst = clCreateBuffer(context, CL_MEM_READ_WRITE, size, NULL, NULL);
+
+	double bandwidth = 0.0;
+	if (src && dst)
+	{
+		// The first copy also forces the allocation on the device.
+		clEnqueueCopyBuffer(commandQueue, src, dst, 0, 0, size, 0, NULL, NULL);
+		clFinish(commandQueue);
+
+		const int nIterations = 5;
+		CTimer timer;
+		timer.Start();
+		for (int i = 0; i < nIterations; i++)
+			clEnqueueCopyBuffer(commandQueue, src, dst, 0, 0, size, 0, NULL, NULL);
+		clFinish(commandQueue);
+		timer.Stop();
+
+		// Every copied byte is read once and written once.
+		double ms = timer.GetElapsedMilliseconds();
+		if (ms > 0.0)
+			bandwidth = 2.0 * size * nIterations / (ms * 1.0e6);
+	}
+
+	SAFE_RELEASE_MEMOBJECT(src);
+	SAFE_RELEASE_MEMOBJECT(dst);
+	clReleaseCommandQueue(commandQueue);
+	clReleaseContext(context);
+
+	return bandwidth;
+}
+
+//! Scores each device by compute units x clock and by measured memory bandwidth, returns the best one
+static cl_device_id RankDevices(const std::vector<cl_device_id>& DeviceIds)
+{
+	std::vector<double> compute(DeviceIds.size());
+	std::vector<double> bandwidth(DeviceIds.size());
+	double maxCompute = 0.0, maxBandwidth = 0.0;
+
+	for (size_t i = 0; i < DeviceIds.size(); i++)
+	{
+		cl_uint computeUnits = 0, clockFrequency = 0;
+		clGetDeviceInfo(DeviceIds[i], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+		clGetDeviceInfo(DeviceIds[i], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_uint), &clockFrequency, NULL);
+
+		compute[i] = (double)computeUnits * clockFrequency;
+		bandwidth[i] = MeasureCopyBandwidth(DeviceIds[i]);
+		maxCompute = std::max(maxCompute, compute[i]);
+		maxBandwidth = std::max(maxBandwidth, bandwidth[i]);
+	}
+
+	std::cout << "Ranking OpenCL devices:" << std::endl;
+	size_t best = 0;
+	double bestScore = -1.0;
+	for (size_t i = 0; i < DeviceIds.size(); i++)
+	{
+		// Both metrics are normalized to the best candidate and weighted equally.
+		double score = (maxCompute > 0.0 ? compute[i] / maxCompute : 0.0) + (maxBandwidth > 0.0 ? bandwidth[i] / maxBandwidth : 0.0);
+		if (score > bestScore)
+		{
+			best = i;
+			bestScore = score;
+		}
+
+		char name[256] = "";
+		clGetDeviceInfo(DeviceIds[i], CL_DEVICE_NAME, sizeof(name), name, NULL);
+		std::cout << "  [" << i << "] " << name << ": " << compute[i] << " CU*MHz, "
+			<< bandwidth[i] << " GB/s, score " << score << std::endl;
+	}
+	std::cout << std::endl;
+
+	return DeviceIds[best];
+}
+
+bool CAssignmentBase::SelectCLDevice()
 {
 	//////////////////////////////////////////////////////
 	//(Sect 4.3)
@@ -73,33 +272,60 @@ bool CAssignmentBase::InitCLContext()
 	V_RETURN_FALSE_CL(clGetPlatformIDs(c_MaxPlatforms, &platformIds[0], &countPlatforms), "Failed to get CL platform ID");
 	platformIds.resize(countPlatforms);
 
-	// 2. find all available GPU devices
-	std::vector<cl_device_id> deviceIds;
-	const int maxDevices = 16;
-	deviceIds.resize(maxDevices);
-	int countAllDevices = 0;
-
-
-	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+	if (m_CLPlatformIndex >= (int)countPlatforms)
+	{
+		std::cerr << "Error: OpenCL platform " << m_CLPlatformIndex << " requested, but only " << countPlatforms << " platforms were found." << endl;
+		return false;
+	}
 
+	// 2. find all available devices of the requested type
+	std::vector<cl_device_id> deviceIds;
 	for (size_t i = 0; i < platformIds.size(); i++)
 	{
+		if (m_CLPlatformIndex >= 0 && (int)i != m_CLPlatformIndex)
+			continue;
+
 		// Getting the available devices.
-		cl_uint countDevices;
-		clGetDeviceIDs(platformIds[i], deviceType, 1, &deviceIds[countAllDevices], &countDevices);
-		countAllDevices += countDevices;
+		cl_uint countDevices = 0;
+		if (clGetDeviceIDs(platformIds[i], m_CLDeviceType, 0, NULL, &countDevices) != CL_SUCCESS || countDevices == 0)
+			continue;
+
+		size_t offset = deviceIds.size();
+		deviceIds.resize(offset + countDevices);
+		clGetDeviceIDs(platformIds[i], m_CLDeviceType, countDevices, &deviceIds[offset], NULL);
 	}
-	deviceIds.resize(countAllDevices);
 
-	if (countAllDevices == 0)
+	if (deviceIds.empty())
 	{
 		std::cout << "No device of the selected type with OpenCL support was found.";
 		return false;
 	}
-	// Choosing the first available device.
-	m_CLDevice = deviceIds[0];
+
+	if (m_CLDeviceIndex >= (int)deviceIds.size())
+	{
+		std::cerr << "Error: OpenCL device " << m_CLDeviceIndex << " requested, but only " << deviceIds.size() << " devices were found." << endl;
+		return false;
+	}
+
+	m_CLDevice = NULL;
+	if (m_CLDeviceIndex >= 0)
+		m_CLDevice = deviceIds[m_CLDeviceIndex];
+	else if (m_RankCLDevices)
+		m_CLDevice = RankDevices(deviceIds);
+	else
+	{
+		// Choosing the first available device.
+		m_CLDevice = deviceIds[0];
+	}
 	clGetDeviceInfo(m_CLDevice, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &m_CLPlatform, NULL);
 
+	return true;
+}
+
+#define PRINT_INFO(title, buffer, bufferSize, maxBufferSize, expr) { expr; buffer[bufferSize] = '\0'; std::cout << title << ": " << buffer << std::endl; }
+
+void CAssignmentBase::PrintCLDeviceInfo()
+{
 	// Printing platform and device data.
 	const int maxBufferSize = 1024;
 	char buffer[maxBufferSize];
@@ -116,9 +342,17 @@ bool CAssignmentBase::InitCLContext()
 	cl_ulong localMemorySize;
 	clGetDeviceInfo(m_CLDevice, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemorySize, &bufferSize);
 	std::cout << "Local memory size: " << localMemorySize << " Byte" << std::endl;
+	CDeviceCaps::Get(m_CLDevice).Print();
 	std::cout << std::endl << "******************************" << std::endl << std::endl;
+}
+
+bool CAssignmentBase::InitCLContext()
+{
+	if (!SelectCLDevice())
+		return false;
+
+	PrintCLDeviceInfo();
 
-        
 	cl_int clError;
 
 	m_CLContext = clCreateContext(NULL, 1, &m_CLDevice, NULL, NULL, &clError);
@@ -129,14 +363,30 @@ bool CAssignmentBase::InitCLContext()
 	// from the CPU into this queue. This way the host program can continue the execution until some results
 	// from that device are needed.
 
-	m_CLCommandQueue = clCreateCommandQueue(m_CLContext, m_CLDevice, 0, &clError);
+	// Profiling is enabled so that CLUtil::ProfileKernel() can use device timestamps.
+	m_CLCommandQueue = clCreateCommandQueue(m_CLContext, m_CLDevice, CL_QUEUE_PROFILING_ENABLE, &clError);
 	V_RETURN_FALSE_CL(clError, "Failed to create the command queue in the context");
 
+	if (m_UseMultiDevice && !m_MultiDevice.Init())
+		return false;
+
+	// the roofline probes would otherwise run inside the timed ComputeGPU() of the first task
+	{
+		CScopeTimer timer("RooflineProbes");
+		CRoofline::Prepare(m_CLDevice);
+		for (size_t i = 0; i < m_MultiDevice.GetNumDevices(); i++)
+			CRoofline::Prepare(m_MultiDevice.GetDevice(i).Id);
+	}
+
 	return true;
 }
 
 void CAssignmentBase::ReleaseCLContext()
 {
+	// the pending task still releases its resources
+	FinishPendingValidation();
+	m_MultiDevice.Release();
+
 	if (m_CLCommandQueue != nullptr)
 	{
 		clReleaseCommandQueue(m_CLCommandQueue);
@@ -145,49 +395,288 @@ void CAssignmentBase::ReleaseCLContext()
 
 	if (m_CLContext != nullptr)
 	{
+		// pooled buffers keep the context alive
+		CBufferPool::GetInstance().PrintStatistics();
+		CBufferPool::GetInstance().ReleaseContext(m_CLContext);
+		CMemoryTracker::GetInstance().PrintStatistics();
+		CLUtil::ReleaseProgramVariants(m_CLContext);
 		clReleaseContext(m_CLContext);
 		m_CLContext = nullptr;
 	}
 }
 
 bool CAssignmentBase::RunComputeTask(IComputeTask& Task, size_t LocalWorkSize[3])
+{
+	if (!RunComputeTask(Task, LocalWorkSize, nullptr))
+		return false;
+
+	FinishPendingValidation();
+	return true;
+}
+
+bool CAssignmentBase::RunComputeTask(IComputeTask& Task, size_t LocalWorkSize[3], const std::function<void(bool)>& OnValidated)
 {
 	if(m_CLContext == nullptr)
 	{
 		std::cerr<<"Error: RunComputeTask() cannot execute because the OpenCL context has not been created first."<<endl;
 	}
-	
-	if(!Task.InitResources(m_CLDevice, m_CLContext))
+
+	CScopeTimer taskTimer("RunComputeTask");
+	// the device memory of InitResources() and ComputeGPU() is accounted to the task
+	CMemoryTracker::TaskScope memoryScope(Task.GetName());
+
+	// The task object is still being validated (and released) from the last run.
+	if (m_PendingTask == &Task)
+		FinishPendingValidation();
+	m_LastResultValid = false;
+
+	bool initialized;
+	{
+		CScopeTimer timer("InitResources");
+		initialized = Task.InitResources(m_CLDevice, m_CLContext);
+	}
+
+	// The validation of the previous task overlapped with this initialization.
+	FinishPendingValidation();
+	m_LastResultValid = false;
+
+	if(!initialized)
 	{
 		std::cerr << "Error during resource allocation. Aborting execution." <<endl;
 		Task.ReleaseResources();
 		return false;
 	}
 
-	// Compute the golden result.
-	cout << "Computing CPU reference result...";
-	Task.ComputeCPU();
-	cout << "DONE" << endl;
+	// Compute the golden result. In async mode this runs on its own thread while
+	// the device work below is enqueued; the CPU side uses the thread pool as usual.
+	auto computeCPU = [this, &Task]()
+	{
+		CScopeTimer timer("ComputeCPU");
+		CTimer cpuTimer;
+		cpuTimer.Start();
+		Task.ComputeCPU();
+		cpuTimer.Stop();
+		m_LastComputeCPUMs = cpuTimer.GetElapsedMilliseconds();
+	};
+
+	std::future<void> cpuResult;
+	if (m_AsyncCompute && !m_CPUOnly)
+	{
+		cout << "Computing CPU reference result in the background..." << endl;
+		cpuResult = std::async(std::launch::async, computeCPU);
+	}
+	else
+	{
+		cout << "Computing CPU reference result...";
+		computeCPU();
+		cout << "DONE (" << m_LastComputeCPUMs << " ms, " << CThreadPool::GetInstance().GetNumThreads() << " threads)" << endl;
+	}
+
+	// The CPU backend alone: no device work and nothing to validate against,
+	// the task is reported as not validated rather than as failed.
+	if (m_CPUOnly)
+	{
+		Task.ReleaseResources();
+		m_LastComputeGPUMs = 0.0;
+		m_PendingValid = true;
+		m_PendingValidated = false;
+		m_PendingTask = &Task;
+		m_PendingCallback = OnValidated;
+		return true;
+	}
+
+	// Neither the tuning of the task nor the kernel builds of all devices and the calibration of the split are timed
+	{
+		CScopeTimer timer("PrepareComputeGPU");
+		Task.PrepareComputeGPU(m_CLCommandQueue, LocalWorkSize, !m_ForceLocalWorkSize);
+	}
+	bool multiDevice = false;
+	if (m_MultiDevice.GetNumDevices() > 0)
+	{
+		CScopeTimer timer("PrepareMultiDevice");
+		multiDevice = Task.PrepareMultiDevice(m_MultiDevice);
+	}
 
 	// Running the same task on the GPU.
 	cout << "Computing GPU result...";
 
 	// Runing the kernel N times. This make the measurement of the execution time more accurate.
-	Task.ComputeGPU(m_CLContext, m_CLCommandQueue, LocalWorkSize);
-	cout << "DONE" << endl;
+	{
+		CScopeTimer timer("ComputeGPU");
+		CTimer gpuTimer;
+		gpuTimer.Start();
+		if (!multiDevice || !Task.ComputeMultiDevice(m_MultiDevice))
+		{
+			Task.ComputeGPU(m_CLContext, m_CLCommandQueue, LocalWorkSize);
+			clFinish(m_CLCommandQueue);
+		}
+		gpuTimer.Stop();
+		m_LastComputeGPUMs = gpuTimer.GetElapsedMilliseconds();
+	}
+	cout << "DONE (" << m_LastComputeGPUMs << " ms)" << endl;
+
+	if (cpuResult.valid())
+	{
+		cpuResult.get();
+		cout << "CPU reference result DONE (" << m_LastComputeCPUMs << " ms, " << CThreadPool::GetInstance().GetNumThreads() << " threads)" << endl;
+	}
 
-	// Validating results.
-	if (Task.ValidateResults())
+	// Validating results. In async mode this continues in the background until
+	// FinishPendingValidation(), which the next RunComputeTask() calls after its
+	// InitResources().
+	bool validateResults = m_ValidateResults;
+	auto validate = [&Task, validateResults]()
 	{
-		cout << "GOLD TEST PASSED!" << endl;
+		bool valid = true;
+		if (validateResults)
+		{
+			CScopeTimer timer("ValidateResults");
+			valid = Task.ValidateResults();
+		}
+
+		// Cleaning up.
+		Task.ReleaseResources();
+		return valid;
+	};
+
+	if (m_AsyncCompute)
+		m_PendingValidation = std::async(std::launch::async, validate);
+	else
+		m_PendingValid = validate();
+	m_PendingValidated = validateResults;
+	m_PendingTask = &Task;
+	m_PendingCallback = OnValidated;
+
+	return true;
+}
+
+bool CAssignmentBase::RunComputeTasks(const std::vector<IComputeTask*>& Tasks, size_t LocalWorkSize[3], const std::vector<size_t>& DeviceBytes)
+{
+	bool success = true;
+	if (!m_CPUOnly)
+	{
+		for (size_t i = 0; i < Tasks.size(); i++)
+			Tasks[i]->StartProgramBuilds(m_CLDevice, m_CLContext);
+	}
+
+	if (m_ConcurrentQueues <= 1 || m_CPUOnly)
+	{
+		for (size_t i = 0; i < Tasks.size(); i++)
+			success = RunComputeTask(*Tasks[i], LocalWorkSize) && m_LastResultValid && success;
+		return success;
+	}
+
+	FinishPendingValidation();
+
+	CTaskScheduler scheduler;
+	if (!scheduler.Init(m_CLDevice, m_CLContext, m_ConcurrentQueues))
+		return false;
+	for (size_t i = 0; i < Tasks.size(); i++)
+		scheduler.AddJob(Tasks[i], LocalWorkSize, i < DeviceBytes.size() ? DeviceBytes[i] : 0, "", !m_ForceLocalWorkSize);
+	success = scheduler.Run();
+	scheduler.PrintResults();
+
+	return success;
+}
+
+bool CAssignmentBase::FinishPendingValidation()
+{
+	if (m_PendingTask == nullptr)
+		return true;
+
+	bool valid = m_PendingValidation.valid() ? m_PendingValidation.get() : m_PendingValid;
+	m_LastResultValid = valid;
+
+	if (!m_PendingValidated)
+	{
+		cout << "NOT VALIDATED" << endl;
 	}
 	else
 	{
-		cout << "INVALID RESULTS!" << endl;
+		if (valid)
+		{
+			cout << "GOLD TEST PASSED!" << endl;
+		}
+		else
+		{
+			cout << "INVALID RESULTS!" << endl;
+		}
 	}
-	
-	// Cleaning up.
-	Task.ReleaseResources();
+
+	// reset before the callback, it may start the next task
+	std::function<void(bool)> callback;
+	callback.swap(m_PendingCallback);
+	m_PendingTask = nullptr;
+	if (callback)
+		callback(valid);
+
+	return valid;
+}
+
+bool CAssignmentBase::RunBenchmarkSweep(CBenchmarkSweep& Sweep)
+{
+	vector<CBenchmarkSweep::Configuration> configs = Sweep.GetConfigurations();
+	if (configs.empty())
+	{
+		std::cerr << "Error: the benchmark sweep needs at least one problem size and one local work size." << endl;
+		return false;
+	}
+
+	// tasks without a CPU reference are run, but not validated
+	m_ValidateResults = Sweep.IsValidated();
+	// the sweep measures the local work sizes it is given, a size of 0 is still tuned
+	bool forceLocalWorkSize = m_ForceLocalWorkSize;
+	m_ForceLocalWorkSize = true;
+
+	int nRuns = Sweep.GetWarmupIterations() + Sweep.GetMeasuredIterations();
+	for (size_t i = 0; i < configs.size(); i++)
+	{
+		const CBenchmarkSweep::Configuration& config = configs[i];
+		size_t elements, bytes;
+		IComputeTask* pTask = Sweep.CreateTask(config, elements, bytes);
+		if (!pTask)
+		{
+			std::cerr << "Error: the benchmark sweep could not create a task." << endl;
+			FinishPendingValidation();
+			m_ValidateResults = true;
+			m_ForceLocalWorkSize = forceLocalWorkSize;
+			return false;
+		}
+
+		size_t localWorkSize[3] = { config.LocalWorkSize[0], config.LocalWorkSize[1], config.LocalWorkSize[2] };
+		// Without device work there is no time to record, the result keeps no measured runs
+		std::shared_ptr<vector<double> > pTimes = std::make_shared<vector<double> >();
+		bool valid = true;
+		for (int run = 0; run < nRuns - 1 && valid; run++)
+		{
+			valid = RunComputeTask(*pTask, localWorkSize) && m_LastResultValid;
+			if (run >= Sweep.GetWarmupIterations() && !m_CPUOnly)
+				pTimes->push_back(m_LastComputeGPUMs);
+		}
+
+		// The last run is validated while the next configuration initializes,
+		// the result is recorded once that validation has finished.
+		if (valid)
+		{
+			valid = RunComputeTask(*pTask, localWorkSize, [&Sweep, config, elements, bytes, pTimes, pTask](bool Valid)
+			{
+				Sweep.AddResult(config, elements, bytes, Valid, *pTimes);
+				delete pTask;
+			});
+			if (valid && nRuns - 1 >= Sweep.GetWarmupIterations() && !m_CPUOnly)
+				pTimes->push_back(m_LastComputeGPUMs);
+		}
+		if (!valid)
+		{
+			SAFE_DELETE(pTask);
+			Sweep.AddResult(config, elements, bytes, false, *pTimes);
+		}
+	}
+	FinishPendingValidation();
+	m_ValidateResults = true;
+	m_ForceLocalWorkSize = forceLocalWorkSize;
+
+	Sweep.PrintResults();
 
 	return true;
 }
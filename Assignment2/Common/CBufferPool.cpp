@@ -0,0 +1,178 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CBufferPool.h"
+#include "CMemoryTracker.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CBufferPool
+
+const char* CBufferPool::CachedTask = "Buffer pool (cached)";
+
+CBufferPool& CBufferPool::GetInstance()
+{
+	static CBufferPool instance;
+	return instance;
+}
+
+CBufferPool::CBufferPool()
+	: m_LiveBytes(0), m_CachedBytes(0), m_HighWaterMark(0), m_NHits(0), m_NMisses(0)
+{
+}
+
+CBufferPool::~CBufferPool()
+{
+	// the contexts are usually gone by now, their buffers must have been released before
+}
+
+bool CBufferPool::Key::operator<(const Key& Other) const
+{
+	if (Context != Other.Context)
+		return Context < Other.Context;
+	if (Flags != Other.Flags)
+		return Flags < Other.Flags;
+	return Size < Other.Size;
+}
+
+size_t CBufferPool::GetSizeClass(size_t Size)
+{
+	const size_t minSize = 4096;
+	if (Size <= minSize)
+		return minSize;
+
+	// the largest power of two below Size, split into quarters
+	size_t power = minSize;
+	while (power * 2 < Size)
+		power *= 2;
+	size_t quarter = power / 4;
+	return (Size + quarter - 1) / quarter * quarter;
+}
+
+cl_mem CBufferPool::Create(cl_context Context, cl_mem_flags Flags, size_t Size, cl_int* pErrorCode)
+{
+	if (Flags & (CL_MEM_COPY_HOST_PTR | CL_MEM_USE_HOST_PTR))
+	{
+		cerr << "Error: pooled buffers cannot be created from host memory." << endl;
+		if (pErrorCode)
+			*pErrorCode = CL_INVALID_VALUE;
+		return NULL;
+	}
+
+	Key key;
+	key.Context = Context;
+	key.Flags = Flags;
+	key.Size = GetSizeClass(Size);
+
+	lock_guard<mutex> lock(m_Mutex);
+
+	cl_mem buffer = NULL;
+	map<Key, vector<cl_mem> >::iterator it = m_FreeBuffers.find(key);
+	if (it != m_FreeBuffers.end() && !it->second.empty())
+	{
+		buffer = it->second.back();
+		it->second.pop_back();
+		m_CachedBytes -= key.Size;
+		m_NHits++;
+		CMemoryTracker::GetInstance().Recharge(buffer);
+		if (pErrorCode)
+			*pErrorCode = CL_SUCCESS;
+	}
+	else
+	{
+		cl_int clError;
+		buffer = CMemoryTracker::GetInstance().CreateBuffer(Context, Flags, key.Size, NULL, &clError, "Buffer pool");
+		if (pErrorCode)
+			*pErrorCode = clError;
+		if (clError != CL_SUCCESS)
+			return NULL;
+		m_NMisses++;
+	}
+
+	m_LiveBuffers[buffer] = key;
+	m_LiveBytes += key.Size;
+	m_HighWaterMark = max(m_HighWaterMark, m_LiveBytes + m_CachedBytes);
+
+	return buffer;
+}
+
+void CBufferPool::Release(cl_mem Buffer)
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	map<cl_mem, Key>::iterator it = m_LiveBuffers.find(Buffer);
+	if (it == m_LiveBuffers.end())
+	{
+		clReleaseMemObject(Buffer);
+		return;
+	}
+
+	CMemoryTracker::GetInstance().Recharge(Buffer, CachedTask);
+	m_FreeBuffers[it->second].push_back(Buffer);
+	m_LiveBytes -= it->second.Size;
+	m_CachedBytes += it->second.Size;
+	m_LiveBuffers.erase(it);
+}
+
+void CBufferPool::ReleaseContext(cl_context Context)
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	map<Key, vector<cl_mem> >::iterator it = m_FreeBuffers.begin();
+	while (it != m_FreeBuffers.end())
+	{
+		if (it->first.Context != Context)
+		{
+			++it;
+			continue;
+		}
+		for (size_t i = 0; i < it->second.size(); i++)
+			clReleaseMemObject(it->second[i]);
+		m_CachedBytes -= it->first.Size * it->second.size();
+		m_FreeBuffers.erase(it++);
+	}
+}
+
+void CBufferPool::ReleaseAll()
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	for (map<Key, vector<cl_mem> >::iterator it = m_FreeBuffers.begin(); it != m_FreeBuffers.end(); ++it)
+	{
+		for (size_t i = 0; i < it->second.size(); i++)
+			clReleaseMemObject(it->second[i]);
+	}
+	m_FreeBuffers.clear();
+	m_CachedBytes = 0;
+}
+
+size_t CBufferPool::GetLiveBytes() const
+{
+	lock_guard<mutex> lock(m_Mutex);
+	return m_LiveBytes;
+}
+
+size_t CBufferPool::GetHighWaterMark() const
+{
+	lock_guard<mutex> lock(m_Mutex);
+	return m_HighWaterMark;
+}
+
+void CBufferPool::PrintStatistics() const
+{
+	lock_guard<mutex> lock(m_Mutex);
+	if (m_NHits + m_NMisses == 0)
+		return;
+
+	cout << "Buffer pool: " << m_NHits + m_NMisses << " allocations, " << m_NHits << " recycled, "
+		<< "high-water mark " << m_HighWaterMark / (1024.0 * 1024.0) << " MB, "
+		<< m_LiveBytes / (1024.0 * 1024.0) << " MB still live." << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,138 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CPinnedHostBuffer.h"
+
+#include "CLUtil.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CPinnedHostBuffer
+
+static void* AllocateAligned(size_t Size, size_t Alignment)
+{
+#ifdef _WIN32
+	return _aligned_malloc(Size, Alignment);
+#else
+	void* ptr = NULL;
+	if (posix_memalign(&ptr, Alignment, Size) != 0)
+		return NULL;
+	return ptr;
+#endif
+}
+
+static void FreeAligned(void* Ptr)
+{
+#ifdef _WIN32
+	_aligned_free(Ptr);
+#else
+	free(Ptr);
+#endif
+}
+
+CPinnedHostBuffer::CPinnedHostBuffer()
+	: m_CommandQueue(NULL), m_Buffer(NULL), m_pHostPtr(NULL), m_pAlignedAlloc(NULL), m_Size(0)
+{
+}
+
+CPinnedHostBuffer::~CPinnedHostBuffer()
+{
+	Release();
+}
+
+bool CPinnedHostBuffer::Allocate(cl_context Context, cl_device_id Device, size_t Size, cl_mem_flags DeviceAccess)
+{
+	Release();
+
+	cl_int clError;
+	m_CommandQueue = clCreateCommandQueue(Context, Device, 0, &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create a command queue for mapping the host buffer.");
+
+	m_Buffer = clCreateBuffer(Context, DeviceAccess | CL_MEM_ALLOC_HOST_PTR, Size, NULL, &clError);
+	if (clError != CL_SUCCESS)
+	{
+		// wrap page-aligned memory (more than CL_DEVICE_MEM_BASE_ADDR_ALIGN requires)
+		cl_uint alignBits = 0;
+		clGetDeviceInfo(Device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &alignBits, NULL);
+		size_t alignment = alignBits / 8 > 4096 ? alignBits / 8 : 4096;
+		size_t alignedSize = (Size + alignment - 1) / alignment * alignment;
+
+		m_pAlignedAlloc = AllocateAligned(alignedSize, alignment);
+		if (!m_pAlignedAlloc)
+		{
+			cerr << "Failed to allocate " << Size << " bytes of aligned host memory." << endl;
+			Release();
+			return false;
+		}
+		m_Buffer = clCreateBuffer(Context, DeviceAccess | CL_MEM_USE_HOST_PTR, alignedSize, m_pAlignedAlloc, &clError);
+		V_RETURN_FALSE_CL(clError, "Failed to create the host buffer.");
+	}
+	m_Size = Size;
+
+	return Map();
+}
+
+void CPinnedHostBuffer::Release()
+{
+	if (m_pHostPtr)
+		Unmap();
+	if (m_CommandQueue)
+		clFinish(m_CommandQueue);
+
+	SAFE_RELEASE_MEMOBJECT(m_Buffer);
+	if (m_CommandQueue)
+	{
+		clReleaseCommandQueue(m_CommandQueue);
+		m_CommandQueue = NULL;
+	}
+	if (m_pAlignedAlloc)
+	{
+		FreeAligned(m_pAlignedAlloc);
+		m_pAlignedAlloc = NULL;
+	}
+	m_Size = 0;
+}
+
+bool CPinnedHostBuffer::Unmap()
+{
+	if (!m_pHostPtr)
+		return true;
+
+	cl_int clError = clEnqueueUnmapMemObject(m_CommandQueue, m_Buffer, m_pHostPtr, 0, NULL, NULL);
+	m_pHostPtr = NULL;
+	V_RETURN_FALSE_CL(clError, "Failed to unmap the host buffer.");
+	V_RETURN_FALSE_CL(clFinish(m_CommandQueue), "Failed to unmap the host buffer.");
+	return true;
+}
+
+bool CPinnedHostBuffer::Map()
+{
+	if (m_pHostPtr)
+		return true;
+
+	cl_int clError;
+	m_pHostPtr = clEnqueueMapBuffer(m_CommandQueue, m_Buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, m_Size, 0, NULL, NULL, &clError);
+	if (clError != CL_SUCCESS)
+		m_pHostPtr = NULL;
+	V_RETURN_FALSE_CL(clError, "Failed to map the host buffer.");
+	return true;
+}
+
+bool CPinnedHostBuffer::IsZeroCopyDevice(cl_device_id Device)
+{
+	cl_bool unified = CL_FALSE;
+	clGetDeviceInfo(Device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &unified, NULL);
+	return unified == CL_TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
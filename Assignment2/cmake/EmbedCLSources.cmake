@@ -0,0 +1,117 @@
+# Embeds OpenCL kernel sources into the executable.
+#
+#   embed_cl_sources(<output variable> <kernel files...>)
+#
+# generates EmbeddedCLSources.cpp in the current binary directory and stores
+# its path in the output variable, add it to the sources of the executable.
+# The generated table registers itself with CLUtil, so that
+# CLUtil::LoadProgramSourceToMemory("VectorAdd.cl", ...) no longer depends on
+# the working directory. Paths are relative to the current source directory.
+#
+# With GPUC_EMBED_SPIRV the kernels are also compiled to SPIR-V (clang and
+# llvm-spirv are needed at build time), which CLUtil hands to devices that
+# support cl_khr_il_program. Kernels that only compile with defines from the
+# host code are embedded as source only.
+#
+# The same file is run in script mode (cmake -P) to generate the table.
+
+if (CMAKE_SCRIPT_MODE_FILE)
+
+	string(REPLACE "|" ";" SOURCES "${SOURCES}")
+
+	# Turns a file into a C array of bytes with a terminating zero
+	function(hex_array Name File Result Size)
+		file(READ ${File} hex HEX)
+		string(LENGTH "${hex}" length)
+		math(EXPR bytes "${length} / 2")
+		# 16 bytes per line
+		string(REGEX REPLACE "([0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f])" "\\1\n\t" hex "${hex}")
+		string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," hex "${hex}")
+		set(${Result} "static const unsigned char ${Name}[] = {\n\t${hex}0x00\n};\n\n" PARENT_SCOPE)
+		set(${Size} ${bytes} PARENT_SCOPE)
+	endfunction()
+
+	set(arrays "")
+	set(table "")
+	set(count 0)
+	foreach (file ${SOURCES})
+		file(RELATIVE_PATH name ${SOURCE_DIR} ${file})
+
+		hex_array(s_Source${count} ${file} array size)
+		set(arrays "${arrays}${array}")
+
+		set(il "nullptr")
+		set(ilSize 0)
+		if (CLANG AND LLVM_SPIRV)
+			set(bc ${OUTPUT}.${count}.bc)
+			set(spv ${OUTPUT}.${count}.spv)
+			execute_process(COMMAND ${CLANG} -cl-std=CL1.2 -target spir64 -O2 -emit-llvm -c ${file} -o ${bc}
+				RESULT_VARIABLE result OUTPUT_QUIET ERROR_QUIET)
+			if (result EQUAL 0)
+				execute_process(COMMAND ${LLVM_SPIRV} ${bc} -o ${spv} RESULT_VARIABLE result OUTPUT_QUIET ERROR_QUIET)
+			endif()
+			if (result EQUAL 0)
+				hex_array(s_IL${count} ${spv} array ilSize)
+				set(arrays "${arrays}${array}")
+				set(il "s_IL${count}")
+			else()
+				message(STATUS "${name}: no SPIR-V, the source is built at run time")
+			endif()
+			file(REMOVE ${bc} ${spv})
+		endif()
+
+		set(table "${table}\t{ \"${name}\", (const char*)s_Source${count}, ${size}, ${il}, ${ilSize} },\n")
+		math(EXPR count "${count} + 1")
+	endforeach()
+
+	file(WRITE ${OUTPUT}.tmp
+		"// Generated by EmbedCLSources.cmake, do not edit.\n\n"
+		"#include \"${COMMON_DIR}/CLUtil.h\"\n\n"
+		"${arrays}"
+		"static const CLUtil::EmbeddedSource s_EmbeddedSources[] = {\n${table}};\n\n"
+		"static const bool s_Registered = CLUtil::RegisterEmbeddedSources(s_EmbeddedSources, ${count});\n")
+	# keeps the timestamp if nothing changed, so that nothing is recompiled
+	execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+	file(REMOVE ${OUTPUT}.tmp)
+
+	return()
+endif()
+
+option(GPUC_EMBED_SPIRV "Precompile the embedded OpenCL kernels to SPIR-V (needs clang and llvm-spirv)" OFF)
+
+set(EMBED_CL_SOURCES_SCRIPT ${CMAKE_CURRENT_LIST_FILE})
+
+function(embed_cl_sources Result)
+	set(output ${CMAKE_CURRENT_BINARY_DIR}/EmbeddedCLSources.cpp)
+
+	set(sources "")
+	foreach (file ${ARGN})
+		get_filename_component(path ${file} ABSOLUTE)
+		list(APPEND sources ${path})
+	endforeach()
+	# lists cannot be passed on the command line as they are
+	string(REPLACE ";" "|" sourceList "${sources}")
+
+	get_filename_component(commonDir ${CMAKE_SOURCE_DIR}/../Common ABSOLUTE)
+	set(args -DOUTPUT=${output} -DSOURCE_DIR=${CMAKE_CURRENT_SOURCE_DIR} -DCOMMON_DIR=${commonDir} -DSOURCES=${sourceList})
+
+	if (GPUC_EMBED_SPIRV)
+		find_program(CLANG_EXECUTABLE clang)
+		find_program(LLVM_SPIRV_EXECUTABLE llvm-spirv)
+		if (CLANG_EXECUTABLE AND LLVM_SPIRV_EXECUTABLE)
+			list(APPEND args -DCLANG=${CLANG_EXECUTABLE} -DLLVM_SPIRV=${LLVM_SPIRV_EXECUTABLE})
+		else()
+			message(WARNING "clang or llvm-spirv not found, the kernels are embedded as source only.")
+		endif()
+	endif()
+
+	add_custom_command(
+		OUTPUT ${output}
+		COMMAND ${CMAKE_COMMAND} ${args} -P ${EMBED_CL_SOURCES_SCRIPT}
+		DEPENDS ${sources} ${EMBED_CL_SOURCES_SCRIPT}
+		COMMENT "Embedding OpenCL kernels"
+		VERBATIM
+	)
+
+	set(${Result} ${output} PARENT_SCOPE)
+endfunction()
@@ -9,8 +9,13 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CConvolutionSeparableTask.h"
 #include "CConvolutionBilateralTask.h"
 #include "CHistogramTask.h"
+#include "Pfm.h"
+
+#include "../Common/CBenchmarkSweep.h"
+#include "../Common/CDeviceCaps.h"
 
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
@@ -29,7 +34,15 @@ bool CAssignment3::DoCompute()
 	cout<<"########################################"<<endl;
 	cout<<"Task 1: 3x3 convolution"<<endl<<endl;
 	{
+		//a row of the tile should be at least one SIMD group wide, 16 x 8 where that is enough
+		//or where 32 x 16 work-items do not fit into a work-group
+		const CDeviceCaps& caps = CDeviceCaps::Get(m_CLDevice);
 		size_t TileSize[2] = {32, 16};
+		if(caps.SimdWidth <= 16 || caps.MaxWorkGroupSize < 512)
+		{
+			TileSize[0] = 16;
+			TileSize[1] = 8;
+		}
 		float ConvKernel[3][3] = {
 			{ -1.0f / 8.0f, -1.0f / 8.0f, -1.0f / 8.0f },
 			{ -1.0f / 8.0f,  1.0f,        -1.0f / 8.0f },
@@ -46,40 +59,31 @@ bool CAssignment3::DoCompute()
 		size_t HGroupSize[2] = {32, 16};
 		size_t VGroupSize[2] = {32, 16};
 
-	
-		{
-			//simple box filter
-			float ConvKernel[9];
-			for(int i = 0; i < 9; i++)
-				ConvKernel[i] = 1.0f / 9.0f;
-
-			CConvolutionSeparableTask convTask("box_4x4", "Images/input.pfm", HGroupSize, VGroupSize,
-				3, 3, 4, ConvKernel, ConvKernel);
-			// note: the last argument is ignored, but our framework requires it
-			// for the horizontal and vertical passes different local sizes might be used
-			RunComputeTask(convTask, HGroupSize);
-		}
 
-		{
-			//simple box filter
-			float ConvKernel[17];
-			for(int i = 0; i < 17; i++)
-				ConvKernel[i] = 1.0f / 17.0f;
-
-			CConvolutionSeparableTask convTask("box_8x8", "Images/input.pfm", HGroupSize, VGroupSize,
-				3, 3, 8, ConvKernel, ConvKernel);
-			RunComputeTask(convTask, HGroupSize);
-		}
+		//simple box filters
+		float BoxKernel4[9];
+		for(int i = 0; i < 9; i++)
+			BoxKernel4[i] = 1.0f / 9.0f;
+		float BoxKernel8[17];
+		for(int i = 0; i < 17; i++)
+			BoxKernel8[i] = 1.0f / 17.0f;
 
-		{
-			// Gaussian blur
-			float ConvKernel[7] = {
-				0.000817774f, 0.0286433f, 0.235018f, 0.471041f, 0.235018f, 0.0286433f, 0.000817774f
-			};
-			CConvolutionSeparableTask convTask("gauss_3x3", "Images/input.pfm", HGroupSize, VGroupSize,
-				3, 3, 3, ConvKernel, ConvKernel);
-			RunComputeTask(convTask, HGroupSize);
-		}
+		// Gaussian blur
+		float GaussKernel[7] = {
+			0.000817774f, 0.0286433f, 0.235018f, 0.471041f, 0.235018f, 0.0286433f, 0.000817774f
+		};
+
+		CConvolutionSeparableTask box4Task("box_4x4", "Images/input.pfm", HGroupSize, VGroupSize,
+			3, 3, 4, BoxKernel4, BoxKernel4);
+		CConvolutionSeparableTask box8Task("box_8x8", "Images/input.pfm", HGroupSize, VGroupSize,
+			3, 3, 8, BoxKernel8, BoxKernel8);
+		CConvolutionSeparableTask gaussTask("gauss_3x3", "Images/input.pfm", HGroupSize, VGroupSize,
+			3, 3, 3, GaussKernel, GaussKernel);
+
+		// note: the last argument is ignored, but our framework requires it
+		// for the horizontal and vertical passes different local sizes might be used
+		// the three filters are independent, with --concurrent they share the device
+		RunComputeTasks({ &box4Task, &box8Task, &gaussTask }, HGroupSize);
 	}
 
 
@@ -100,18 +104,52 @@ bool CAssignment3::DoCompute()
 	cout<<"Task 4: Histogram"<<endl<<endl;
 	{
 		size_t group_size[2] = {16, 8};
-		{
-			CHistogramTask histogram(0.25f, 0.26f, false, "Images/input.pfm");
-			RunComputeTask(histogram, group_size);
-		}
-
-		{
-			CHistogramTask histogram(0.25f, 0.26f, true, "Images/input.pfm");
-			RunComputeTask(histogram, group_size);
-		}
+		CHistogramTask histogram(0.25f, 0.26f, false, "Images/input.pfm");
+		CHistogramTask histogramAtomics(0.25f, 0.26f, true, "Images/input.pfm");
+		RunComputeTasks({ &histogram, &histogramAtomics }, group_size);
 	}
 
 	return true;
 }
 
+bool CAssignment3::DoBenchmarkSweep()
+{
+	//the throughput refers to the pixels of the input image
+	PFM input;
+	if(!input.LoadRGB("Images/input.pfm"))
+	{
+		cerr<<"Error loading file: Images/input.pfm."<<endl;
+		return false;
+	}
+	size_t nPixels = (size_t)input.width * input.height;
+
+	//box filters of the swept radius, with the same work-group size for both passes.
+	//ComputeGPU() runs both passes 100 times on each of the three channels and reads them back,
+	//each pass reads and writes every pixel once
+	CBenchmarkSweep sweep("ConvolutionSeparable", [nPixels](const CBenchmarkSweep::Configuration& Config, size_t& Elements, size_t& Bytes) -> IComputeTask*
+	{
+		Elements = 3 * 100 * nPixels;
+		Bytes = (3 * 100 * 2 * 2 + 3) * nPixels * sizeof(float);
+		int radius = (int)Config.ProblemSize;
+		vector<float> boxKernel(2 * radius + 1, 1.0f / (2 * radius + 1));
+		size_t groupSize[2] = {Config.LocalWorkSize[0], Config.LocalWorkSize[1]};
+		return new CConvolutionSeparableTask("sweep", "Images/input.pfm", groupSize, groupSize,
+			3, 3, radius, boxKernel.data(), boxKernel.data());
+	});
+
+	//the halo of a work-group must cover the radius
+	int radius[] = {1, 2, 4, 8};
+	for(size_t i = 0; i < ARRAYLEN(radius); i++)
+		sweep.AddProblemSize(radius[i]);
+	sweep.AddLocalWorkSize(16, 8);
+	sweep.AddLocalWorkSize(32, 8);
+	sweep.AddLocalWorkSize(32, 16);
+	sweep.SetIterations(1, 3);
+
+	if(!RunBenchmarkSweep(sweep))
+		return false;
+
+	return sweep.WriteCSV("ConvolutionSeparableSweep.csv") && sweep.WriteJSON("ConvolutionSeparableSweep.json");
+}
+
 ///////////////////////////////////////////////////////////////////////////////
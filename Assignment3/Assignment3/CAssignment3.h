@@ -29,6 +29,8 @@ public:
 	virtual ~CAssignment3() {};
 
 	virtual bool DoCompute();
+
+	virtual bool DoBenchmarkSweep();
 };
 
 #endif // _CASSIGNMENT2_H
@@ -5,7 +5,13 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CConvolution3x3Task.h"
 
+#include "../Common/CBufferPool.h"
+#include "../Common/CDeviceCaps.h"
 #include "../Common/CLUtil.h"
+#include "../Common/CMemoryTracker.h"
+#include "../Common/CMultiDevice.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
 #include "../Common/CTimer.h"
 
 using namespace std;
@@ -50,6 +56,18 @@ CConvolution3x3Task::~CConvolution3x3Task()
 	ReleaseResources();
 }
 
+void CConvolution3x3Task::StartProgramBuilds(cl_device_id Device, cl_context Context)
+{
+	string programCode;
+
+	CLUtil::LoadProgramSourceToMemory("Convolution3x3.cl", programCode);
+	CLDefines defines;
+	AddProgramDefines(Device, defines);
+
+	m_ProgramBuilder.Clear();
+	m_ProgramBuilder.AddVariant(Device, Context, programCode, defines);
+}
+
 bool CConvolution3x3Task::InitResources(cl_device_id Device, cl_context Context)
 {
 	if(!CConvolutionTaskBase::InitResources(Device, Context))
@@ -64,19 +82,21 @@ bool CConvolution3x3Task::InitResources(cl_device_id Device, cl_context Context)
 	kernelConstants[9] = m_KernelWeight;
 	kernelConstants[10] = m_Offset;
 
-	m_dKernelConstants = clCreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 11 * sizeof(cl_float), 
-		kernelConstants, &clError);
+	m_dKernelConstants = CMemoryTracker::GetInstance().CreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 11 * sizeof(cl_float), 
+		kernelConstants, &clError, "Convolution3x3/kernel constants");
 	V_RETURN_FALSE_CL(clError, "Error allocating device kernel constants.");
 
-	string programCode;
-
-	CLUtil::LoadProgramSourceToMemory("Convolution3x3.cl", programCode);
-	m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	//RunComputeTasks() started the build already, a task that runs alone starts it now
+	if(!m_ProgramBuilder.HasPending())
+		StartProgramBuilds(Device, Context);
+	m_Program = m_ProgramBuilder.Get(0);
 	if(m_Program == nullptr) return false;
 
 	//create kernel(s)
 	m_ConvolutionKernel = clCreateKernel(m_Program, "Convolution", &clError);
 	V_RETURN_FALSE_CL(clError, "Failed to create kernel.");
+	// one pixel per work-item, the neighbours come from the tile in local memory: 9 multiply-adds, weight and offset
+	CRoofline::SetKernelCost(m_ConvolutionKernel, {4, 4, 20}, (double)m_Width * m_Height);
 	
 	//bind kernel attributes
 	clError = clSetKernelArg(m_ConvolutionKernel, 2, sizeof(cl_mem), (void*)&m_dKernelConstants);
@@ -95,6 +115,10 @@ void CConvolution3x3Task::ReleaseResources()
 	SAFE_RELEASE_KERNEL(m_ConvolutionKernel);
 	SAFE_RELEASE_PROGRAM(m_Program);
 
+	for(size_t i = 0; i < m_DeviceKernels.size(); i++)
+		SAFE_RELEASE_KERNEL(m_DeviceKernels[i]);
+	m_DeviceKernels.clear();
+
 	CConvolutionTaskBase::ReleaseResources();
 }
 
@@ -128,6 +152,111 @@ void CConvolution3x3Task::ComputeGPU(cl_context Context, cl_command_queue Comman
 	SaveImage("Images/GPUResult3x3.pfm", m_hGPUResultChannels);
 }
 
+void CConvolution3x3Task::AddProgramDefines(cl_device_id Device, CLDefines& Defines) const
+{
+	//the kernel requires its work-group size, so it has to know the tile size we launch it with
+	CDeviceCaps::Get(Device).AddDefines(Defines);
+	Defines.Set("TILE_X", m_TileSize[0]).Set("TILE_Y", m_TileSize[1]);
+}
+
+bool CConvolution3x3Task::PrepareMultiDevice(CMultiDevice& Devices)
+{
+	string programCode;
+	if(!CLUtil::LoadProgramSourceToMemory("Convolution3x3.cl", programCode))
+		return false;
+
+	m_DeviceKernels.assign(Devices.GetNumDevices(), nullptr);
+	for(size_t i = 0; i < m_DeviceKernels.size(); i++)
+	{
+		CLDefines defines;
+		AddProgramDefines(Devices.GetDevice(i).Id, defines);
+		m_DeviceKernels[i] = Devices.CreateKernel(i, programCode, "Convolution", defines);
+		if(m_DeviceKernels[i] == nullptr)
+			return false;
+	}
+
+	return Devices.Calibrate("Convolution3x3", m_Height, m_TileSize[1], [&](size_t DeviceIndex, size_t Begin, size_t End)
+	{
+		return ConvolutionRange(Devices, DeviceIndex, Begin, End);
+	});
+}
+
+bool CConvolution3x3Task::ComputeMultiDevice(CMultiDevice& Devices)
+{
+	if(m_DeviceKernels.empty())
+		return false;
+
+	bool success = Devices.Run("Convolution3x3", m_Height, m_TileSize[1], [&](size_t DeviceIndex, size_t Begin, size_t End)
+	{
+		return ConvolutionRange(Devices, DeviceIndex, Begin, End);
+	});
+	if(!success)
+		return false;
+
+	Devices.PrintLastRun();
+
+	SaveImage("Images/GPUResult3x3.pfm", m_hGPUResultChannels);
+	return true;
+}
+
+bool CConvolution3x3Task::ConvolutionRange(CMultiDevice& Devices, size_t DeviceIndex, size_t Begin, size_t End)
+{
+	cl_float kernelConstants[11];
+	for(int y = 0; y < 3; y++)
+		for(int x = 0; x < 3; x++)
+			kernelConstants[3*y + x] = m_hConvolutionKernel[y][x];
+	kernelConstants[9] = m_KernelWeight;
+	kernelConstants[10] = m_Offset;
+
+	unsigned int numChannels = m_Monochrome ? 1 : 3;
+
+	// Every device convolves a strip of rows. The strip is uploaded with one halo row above and
+	// below (where the image has them), so the kernel sees the same neighbours as for the whole image.
+	const CMultiDevice::Device& device = Devices.GetDevice(DeviceIndex);
+	cl_kernel kernel = m_DeviceKernels[DeviceIndex];
+	size_t first = Begin > 0 ? Begin - 1 : 0;
+	size_t last = min<size_t>(End + 1, m_Height);
+	cl_uint rows = (cl_uint)(last - first);
+	// one spare row, the kernel loads the bottom halo of the last tile unconditionally
+	size_t bytes = (rows + 1) * m_Pitch * sizeof(cl_float);
+
+	cl_int clError, clError2;
+	cl_mem dConstants = CBufferPool::GetInstance().Create(device.Context, CL_MEM_READ_ONLY, sizeof(kernelConstants), &clError2);
+	clError = clError2;
+	cl_mem dSource = CBufferPool::GetInstance().Create(device.Context, CL_MEM_READ_ONLY, bytes, &clError2);
+	clError |= clError2;
+	cl_mem dResult = CBufferPool::GetInstance().Create(device.Context, CL_MEM_WRITE_ONLY, bytes, &clError2);
+	clError |= clError2;
+
+	if(clError == CL_SUCCESS)
+	{
+		clError = clEnqueueWriteBuffer(device.Queue, dConstants, CL_FALSE, 0, sizeof(kernelConstants), kernelConstants, 0, NULL, NULL);
+		clError |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dResult);
+		clError |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dSource);
+		clError |= clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&dConstants);
+		clError |= clSetKernelArg(kernel, 3, sizeof(cl_uint), (void*)&m_Width);
+		clError |= clSetKernelArg(kernel, 4, sizeof(cl_uint), (void*)&rows);
+		clError |= clSetKernelArg(kernel, 5, sizeof(cl_uint), (void*)&m_Pitch);
+	}
+
+	size_t globalWorkSize[2] = {CLUtil::GetGlobalWorkSize(m_Width, m_TileSize[0]), CLUtil::GetGlobalWorkSize(rows, m_TileSize[1])};
+	for(unsigned int iChannel = 0; iChannel < numChannels && clError == CL_SUCCESS; iChannel++)
+	{
+		clError = clEnqueueWriteBuffer(device.Queue, dSource, CL_FALSE, 0, rows * m_Pitch * sizeof(cl_float),
+			m_hSourceChannels[iChannel] + first * m_Pitch, 0, NULL, NULL);
+		clError |= clEnqueueNDRangeKernel(device.Queue, kernel, 2, NULL, globalWorkSize, m_TileSize, 0, NULL, NULL);
+		// only the rows of the strip itself, not the halo
+		clError |= clEnqueueReadBuffer(device.Queue, dResult, CL_TRUE, (Begin - first) * m_Pitch * sizeof(cl_float),
+			(End - Begin) * m_Pitch * sizeof(cl_float), m_hGPUResultChannels[iChannel] + Begin * m_Pitch, 0, NULL, NULL);
+	}
+
+	SAFE_RELEASE_POOLED(dConstants);
+	SAFE_RELEASE_POOLED(dSource);
+	SAFE_RELEASE_POOLED(dResult);
+	V_RETURN_FALSE_CL(clError, "Failed to convolve the strip on " << device.Name << ".");
+	return true;
+}
+
 void CConvolution3x3Task::ComputeCPU()
 {
 	//number of channels to compute
@@ -157,26 +286,29 @@ double CConvolution3x3Task::ConvolutionChannelCPU(unsigned int Channel)
 	for(int iter = 0; iter < nIterations; iter++)
 	{
 
-		for(unsigned int y = 0; y < m_Height; y++)
+		CThreadPool::GetInstance().ParallelFor(0, m_Height, 0, [&](size_t Begin, size_t End)
 		{
-			for(unsigned int x = 0; x < m_Width; x++)
+			for(unsigned int y = (unsigned int)Begin; y < End; y++)
 			{
-				float value = 0;
-				//apply convolution kernel
-				for(int offsetY = -1; offsetY < 2; offsetY ++)
+				for(unsigned int x = 0; x < m_Width; x++)
 				{
-					int sy = y + offsetY;
-					if(sy >= 0 && sy < int(m_Height))
-						for(int offsetX = -1; offsetX < 2; offsetX++)
-						{
-							int sx = x + offsetX;
-							if(sx >= 0 && sx < int(m_Width))
-								value += m_hSourceChannels[Channel][sy * m_Pitch + sx] * m_hConvolutionKernel[1 + offsetY][1 + offsetX];
-						}
+					float value = 0;
+					//apply convolution kernel
+					for(int offsetY = -1; offsetY < 2; offsetY ++)
+					{
+						int sy = y + offsetY;
+						if(sy >= 0 && sy < int(m_Height))
+							for(int offsetX = -1; offsetX < 2; offsetX++)
+							{
+								int sx = x + offsetX;
+								if(sx >= 0 && sx < int(m_Width))
+									value += m_hSourceChannels[Channel][sy * m_Pitch + sx] * m_hConvolutionKernel[1 + offsetY][1 + offsetX];
+							}
+					}
+					m_hCPUResultChannels[Channel][y * m_Pitch + x] = value * m_KernelWeight + m_Offset;		
 				}
-				m_hCPUResultChannels[Channel][y * m_Pitch + x] = value * m_KernelWeight + m_Offset;		
 			}
-		}
+		});
 
 	}
 
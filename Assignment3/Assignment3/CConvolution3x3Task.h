@@ -21,8 +21,10 @@
 #define _CCONVOLUTION_3X3_TASK_H
 
 #include "CConvolutionTaskBase.h"
+#include "../Common/CProgramBuilder.h"
 
 #include <string>
+#include <vector>
 
 //! A3 / T1 3x3 convolution
 class CConvolution3x3Task : public CConvolutionTaskBase
@@ -39,6 +41,8 @@ public:
 
 	// IComputeTask
 
+	virtual void StartProgramBuilds(cl_device_id Device, cl_context Context);
+
 	virtual bool InitResources(cl_device_id Device, cl_context Context);
 	
 	virtual void ReleaseResources();
@@ -47,13 +51,23 @@ public:
 
 	virtual void ComputeCPU();
 
+	virtual bool PrepareMultiDevice(CMultiDevice& Devices);
+
+	virtual bool ComputeMultiDevice(CMultiDevice& Devices);
+
 protected:
 	
+	//the tile size and the capabilities of the device the program is built for
+	void AddProgramDefines(cl_device_id Device, CLDefines& Defines) const;
+
 	// the return value is the run time in milliseconds
 	double ConvolutionChannelCPU(unsigned int Channel);
 	//the last parameter is for timing, and the returned value is the average run time in milliseconds
 	double ConvolutionChannelGPU(unsigned int Channel, cl_context Context, cl_command_queue CommandQueue, int NIterations);
 
+	//convolves the rows [Begin, End) of all channels on one device of ComputeMultiDevice()
+	bool ConvolutionRange(CMultiDevice& Devices, size_t DeviceIndex, size_t Begin, size_t End);
+
 	size_t			m_TileSize[2];
 
 	// host data
@@ -65,8 +79,13 @@ protected:
 	cl_mem			m_dKernelConstants = nullptr;
 
 	cl_program		m_Program = nullptr;
+	//the variant build started by StartProgramBuilds()
+	CProgramBuilder	m_ProgramBuilder;
 	cl_kernel		m_ConvolutionKernel = nullptr;
 
+	//the kernel of every device, built by PrepareMultiDevice()
+	std::vector<cl_kernel>	m_DeviceKernels;
+
 };
 
 #endif // _CCONVOLUTION_3X3_TASK_H
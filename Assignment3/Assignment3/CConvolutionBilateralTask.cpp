@@ -6,6 +6,8 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CConvolutionBilateralTask.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CMemoryTracker.h"
+#include "../Common/CThreadPool.h"
 #include "../Common/CTimer.h"
 #include "Pfm.h"
 
@@ -89,9 +91,10 @@ bool CConvolutionBilateralTask::InitResources(cl_device_id Device, cl_context Co
 	cl_int clError = 0;
 	cl_int clErr;
 
-	m_dDiscBuffer = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_Pitch * m_Height * sizeof(cl_int),  NULL, &clErr);
+	CMemoryTracker& memory = CMemoryTracker::GetInstance();
+	m_dDiscBuffer = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, m_Pitch * m_Height * sizeof(cl_int),  NULL, &clErr, "ConvolutionBilateral/discontinuities");
 	clError = clErr;
-	m_dNormDepthBuffer = clCreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, m_Pitch * m_Height * sizeof(cl_float4),  m_hNormDepthBuffer, &clErr);
+	m_dNormDepthBuffer = memory.CreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, m_Pitch * m_Height * sizeof(cl_float4),  m_hNormDepthBuffer, &clErr, "ConvolutionBilateral/normals and depth");
 	clError |= clErr;
 	V_RETURN_FALSE_CL(clError, "Error allocating device memory.");
 
@@ -201,6 +204,12 @@ void CConvolutionBilateralTask::ComputeGPU(cl_context Context, cl_command_queue
 	SaveIntImage("Images/GPUDiscontinuities.pfm", m_hGPUDiscBuffer);
 }
 
+size_t CConvolutionBilateralTask::GetDeviceBytes() const
+{
+	//the int discontinuity buffer and the float4 normal and depth buffer
+	return CConvolutionSeparableTask::GetDeviceBytes() + 5 * GetChannelBytes();
+}
+
 void CConvolutionBilateralTask::ComputeCPU()
 {
 	double runTime = 0.0;
@@ -209,46 +218,49 @@ void CConvolutionBilateralTask::ComputeCPU()
 	timer.Start();
 	
 	// Detect discontinuities
-	for(unsigned int y = 0; y < m_Height; y++)
-		for(unsigned int x = 0; x < m_Width; x++)
-		{
-			cl_float4 myNormDepth = m_hNormDepthBuffer[y*m_Pitch + x];
-			int flag = 0;
-
-			// Left neighbor
-			if (x > 0) {
-				cl_float4 normDepth = m_hNormDepthBuffer[y*m_Pitch + x - 1];
-				if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+	CThreadPool::GetInstance().ParallelFor(0, m_Height, 0, [&](size_t Begin, size_t End)
+	{
+		for(unsigned int y = (unsigned int)Begin; y < End; y++)
+			for(unsigned int x = 0; x < m_Width; x++)
+			{
+				cl_float4 myNormDepth = m_hNormDepthBuffer[y*m_Pitch + x];
+				int flag = 0;
+
+				// Left neighbor
+				if (x > 0) {
+					cl_float4 normDepth = m_hNormDepthBuffer[y*m_Pitch + x - 1];
+					if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+						flag |= 1;
+				} else
 					flag |= 1;
-			} else
-				flag |= 1;
 
-			// Right neighbor
-			if (x < m_Width - 1) {
-				cl_float4 normDepth  = m_hNormDepthBuffer[y*m_Pitch + x + 1];
-				if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+				// Right neighbor
+				if (x < m_Width - 1) {
+					cl_float4 normDepth  = m_hNormDepthBuffer[y*m_Pitch + x + 1];
+					if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+						flag |= 2;
+				} else
 					flag |= 2;
-			} else
-				flag |= 2;
 
-			// Upper neighbor
-			if (y > 0) {
-				cl_float4 normDepth = m_hNormDepthBuffer[(y-1)*m_Pitch + x];
-				if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+				// Upper neighbor
+				if (y > 0) {
+					cl_float4 normDepth = m_hNormDepthBuffer[(y-1)*m_Pitch + x];
+					if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+						flag |= 4;
+				} else
 					flag |= 4;
-			} else
-				flag |= 4;
 
-			// Lower neighbor
-			if (y < m_Height - 1) {
-				cl_float4 normDepth  = m_hNormDepthBuffer[(y+1)*m_Pitch + x];
-				if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+				// Lower neighbor
+				if (y < m_Height - 1) {
+					cl_float4 normDepth  = m_hNormDepthBuffer[(y+1)*m_Pitch + x];
+					if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+						flag |= 8;
+				} else
 					flag |= 8;
-			} else
-				flag |= 8;
 
-			m_hCPUDiscBuffer[y * m_Pitch + x] = flag;
-		}
+				m_hCPUDiscBuffer[y * m_Pitch + x] = flag;
+			}
+	});
 
 	timer.Stop();
 
@@ -271,108 +283,114 @@ double CConvolutionBilateralTask::ConvolutionChannelCPU(unsigned int Channel)
 	timer.Start();
 
 	// HORIZONTAL PASS
-	for(unsigned int y = 0; y < m_Height; y++) 
+	CThreadPool::GetInstance().ParallelFor(0, m_Height, 0, [&](size_t Begin, size_t End)
 	{
-		for(unsigned int x = 0; x < m_Width; x++)
+		for(unsigned int y = (unsigned int)Begin; y < End; y++)
 		{
-			float sum = 0.f;
-			float weight = 0.f;
+			for(unsigned int x = 0; x < m_Width; x++)
+			{
+				float sum = 0.f;
+				float weight = 0.f;
 
-			// Middle pixel
-			weight	= m_hKernelHorizontal[m_KernelRadius];
-			sum		= m_hSourceChannels[Channel][y * m_Pitch + x] * weight;
+				// Middle pixel
+				weight	= m_hKernelHorizontal[m_KernelRadius];
+				sum		= m_hSourceChannels[Channel][y * m_Pitch + x] * weight;
 
-			// Left neighborhood
-			for(int k = 0; k > -m_KernelRadius; ) {
+				// Left neighborhood
+				for(int k = 0; k > -m_KernelRadius; ) {
 
-				int flag = m_hCPUDiscBuffer[y * m_Pitch + x + k];
-				// If discontinuity on the left detected, bail out
-				if (flag & 1 ||  (int)x+k <= 0)
-					break;
+					int flag = m_hCPUDiscBuffer[y * m_Pitch + x + k];
+					// If discontinuity on the left detected, bail out
+					if (flag & 1 ||  (int)x+k <= 0)
+						break;
 
-				k--; 
+					k--; 
 
-				float w = m_hKernelHorizontal[m_KernelRadius - k];
-				sum += m_hSourceChannels[Channel][y * m_Pitch + x + k] * w;
-				weight += w;
-			}
+					float w = m_hKernelHorizontal[m_KernelRadius - k];
+					sum += m_hSourceChannels[Channel][y * m_Pitch + x + k] * w;
+					weight += w;
+				}
 
-			// Right neighborhood
-			for(int k = 0; k < m_KernelRadius; ) {
+				// Right neighborhood
+				for(int k = 0; k < m_KernelRadius; ) {
 
-				int flag = m_hCPUDiscBuffer[y * m_Pitch + x + k];
-				// If discontinuity on the right is detected, bail out
-				if (flag & 2 || (int)x+k >= (int)m_Width-1)
-					break;
+					int flag = m_hCPUDiscBuffer[y * m_Pitch + x + k];
+					// If discontinuity on the right is detected, bail out
+					if (flag & 2 || (int)x+k >= (int)m_Width-1)
+						break;
 
-				k++; 
+					k++; 
 
-				float w = m_hKernelHorizontal[m_KernelRadius - k];
-				sum += m_hSourceChannels[Channel][y * m_Pitch + x + k] * w;
-				weight += w;
-			}
+					float w = m_hKernelHorizontal[m_KernelRadius - k];
+					sum += m_hSourceChannels[Channel][y * m_Pitch + x + k] * w;
+					weight += w;
+				}
 
-			// Re-normalize
-			if (weight != 0.f)
-				sum /= weight;
-			else
-				sum = 0.f;
+				// Re-normalize
+				if (weight != 0.f)
+					sum /= weight;
+				else
+					sum = 0.f;
 
-			m_hCPUWorkingBuffer[y * m_Pitch + x] = sum;
+				m_hCPUWorkingBuffer[y * m_Pitch + x] = sum;
+			}
 		}
-	}
+	});
 
 	//VERTICAL PASS
-	for(unsigned int x = 0; x < m_Width; x++)
+	CThreadPool::GetInstance().ParallelFor(0, m_Width, 0, [&](size_t Begin, size_t End)
 	{
-		for(unsigned int y = 0; y < m_Height; y++)
+		for(unsigned int x = (unsigned int)Begin; x < End; x++)
 		{
-			float sum = 0.f;
-			float weight = 0.f;
+			for(unsigned int y = 0; y < m_Height; y++)
+			{
+				float sum = 0.f;
+				float weight = 0.f;
 
-			// Middle pixel
-			weight	= m_hKernelHorizontal[m_KernelRadius];
-			sum		= m_hCPUWorkingBuffer[y * m_Pitch + x] * weight;
+				// Middle pixel
+				weight	= m_hKernelHorizontal[m_KernelRadius];
+				sum		= m_hCPUWorkingBuffer[y * m_Pitch + x] * weight;
 
-			// Upper neighborhood
-			for(int k = 0; k > -m_KernelRadius; ) {
+				// Upper neighborhood
+				for(int k = 0; k > -m_KernelRadius; ) {
 
-				int flag = m_hCPUDiscBuffer[(y+k) * m_Pitch + x];
-				// If discontinuity on the left detected, bail out
-				if (flag & 4 || y+k <= 0)
-					break;
+					int flag = m_hCPUDiscBuffer[(y+k) * m_Pitch + x];
+					// If discontinuity on the left detected, bail out
+					if (flag & 4 || y+k <= 0)
+						break;
 
-				k--; 
+					k--; 
 
-				float w = m_hKernelHorizontal[m_KernelRadius - k];
-				sum += m_hCPUWorkingBuffer[(y+k) * m_Pitch + x] * w;
-				weight += w;
-			}
+					float w = m_hKernelHorizontal[m_KernelRadius - k];
+					sum += m_hCPUWorkingBuffer[(y+k) * m_Pitch + x] * w;
+					weight += w;
+				}
 
-			// Lower neighborhood
-			for(int k = 0; k < m_KernelRadius; ) {
+				// Lower neighborhood
+				for(int k = 0; k < m_KernelRadius; ) {
 
-				int flag = m_hCPUDiscBuffer[(y+k) * m_Pitch + x];
-				// If discontinuity on the right is detected, bail out
-				if (flag & 8 || (int)y+k >= (int)m_Height-1)
-					break;
+					int flag = m_hCPUDiscBuffer[(y+k) * m_Pitch + x];
+					// If discontinuity on the right is detected, bail out
+					if (flag & 8 || (int)y+k >= (int)m_Height-1)
+						break;
 
-				k++; 
+					k++; 
 
-				float w = m_hKernelHorizontal[m_KernelRadius - k];
-				sum += m_hCPUWorkingBuffer[(y+k) * m_Pitch + x] * w;
-				weight += w;
-			}
+					float w = m_hKernelHorizontal[m_KernelRadius - k];
+					sum += m_hCPUWorkingBuffer[(y+k) * m_Pitch + x] * w;
+					weight += w;
+				}
 
-			// Re-normalize
-			if (weight != 0.f)
-				sum /= weight;
-			else
-				sum = 0.f;
+				// Re-normalize
+				if (weight != 0.f)
+					sum /= weight;
+				else
+					sum = 0.f;
 
-			m_hCPUResultChannels[Channel][y * m_Pitch + x] = sum;
+				m_hCPUResultChannels[Channel][y * m_Pitch + x] = sum;
+			}
 		}
-	}
+	});
 	
 
 	timer.Stop();
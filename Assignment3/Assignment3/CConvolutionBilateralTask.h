@@ -33,6 +33,8 @@
 	This class implements a separable convolution filter, but
 	extended with a discontinuity detection pass. Therefore with
 	inherit it from the second task...
+	The program build of ConvolutionBilateral.cl is started by the
+	inherited StartProgramBuilds(), with the defines of the separable task.
 */
 class CConvolutionBilateralTask: public CConvolutionSeparableTask
 {
@@ -55,6 +57,8 @@ public:
 
 	virtual void ComputeCPU();
 
+	virtual size_t GetDeviceBytes() const;
+
 protected:
 
 	// the return value is the run time in milliseconds
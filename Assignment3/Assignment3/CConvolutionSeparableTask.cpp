@@ -6,6 +6,9 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CConvolutionSeparableTask.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CMemoryTracker.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
 #include "../Common/CTimer.h"
 
 #include <sstream>
@@ -59,6 +62,26 @@ CConvolutionSeparableTask::~CConvolutionSeparableTask()
 	ReleaseResources();
 }
 
+void CConvolutionSeparableTask::StartProgramBuilds(cl_device_id Device, cl_context Context)
+{
+	string programCode;
+
+	CLUtil::LoadProgramSourceToMemory(m_ProgramName, programCode);
+
+	//This time we define several kernel-specific constants that we did not know during
+	//implementing the kernel, but we need to include during compile time.
+	//Tasks with the same constants share the program.
+	CLDefines defines;
+	defines.Set("KERNEL_RADIUS", m_KernelRadius)
+		.Set("H_GROUPSIZE_X", m_LocalSizeHorizontal[0]).Set("H_GROUPSIZE_Y", m_LocalSizeHorizontal[1])
+		.Set("H_RESULT_STEPS", m_StepsHorizontal)
+		.Set("V_GROUPSIZE_X", m_LocalSizeVertical[0]).Set("V_GROUPSIZE_Y", m_LocalSizeVertical[1])
+		.Set("V_RESULT_STEPS", m_StepsVertical);
+
+	m_ProgramBuilder.Clear();
+	m_ProgramBuilder.AddVariant(Device, Context, programCode, defines, "-cl-fast-relaxed-math");
+}
+
 bool CConvolutionSeparableTask::InitResources(cl_device_id Device, cl_context Context)
 {
 	if(!CConvolutionTaskBase::InitResources(Device, Context))
@@ -69,36 +92,26 @@ bool CConvolutionSeparableTask::InitResources(cl_device_id Device, cl_context Co
 	//we can init the kernel buffer during creation as its contents will not change
 	const unsigned int kernelSize = 2 * m_KernelRadius + 1;
 
+	CMemoryTracker& memory = CMemoryTracker::GetInstance();
 	cl_int clError = 0;
 	cl_int clErr;
-	m_dKernelHorizontal = clCreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, kernelSize * sizeof(cl_float), 
-		m_hKernelHorizontal, &clErr);
+	m_dKernelHorizontal = memory.CreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, kernelSize * sizeof(cl_float), 
+		m_hKernelHorizontal, &clErr, "ConvolutionSeparable/horizontal kernel");
 	clError |= clErr;
-	m_dKernelVertical = clCreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, kernelSize * sizeof(cl_float), 
-		m_hKernelVertical, &clErr);
+	m_dKernelVertical = memory.CreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, kernelSize * sizeof(cl_float), 
+		m_hKernelVertical, &clErr, "ConvolutionSeparable/vertical kernel");
 	clError |= clErr;
 	V_RETURN_FALSE_CL(clError, "Error allocating device kernel constants.");
 
-	m_dGPUWorkingBuffer = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_Pitch * m_Height * sizeof(cl_float), NULL, &clError);
+	m_dGPUWorkingBuffer = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, m_Pitch * m_Height * sizeof(cl_float), NULL, &clError, "ConvolutionSeparable/working buffer");
 	V_RETURN_FALSE_CL(clError, "Error allocating device working array");
 
 	m_hCPUWorkingBuffer = new float[m_Height * m_Pitch];
 
-	string programCode;
-
-	CLUtil::LoadProgramSourceToMemory(m_ProgramName, programCode);
-
-	//This time we define several kernel-specific constants that we did not know during
-	//implementing the kernel, but we need to include during compile time.
-	stringstream compileOptions;
-	compileOptions<<"-cl-fast-relaxed-math"
-	<<" -D KERNEL_RADIUS="<<m_KernelRadius
-	<<" -D H_GROUPSIZE_X="<<m_LocalSizeHorizontal[0]<<" -D H_GROUPSIZE_Y="<<m_LocalSizeHorizontal[1]
-	<<" -D H_RESULT_STEPS="<<m_StepsHorizontal
-	<<" -D V_GROUPSIZE_X="<<m_LocalSizeVertical[0]<<" -D V_GROUPSIZE_Y="<<m_LocalSizeVertical[1]
-	<<" -D V_RESULT_STEPS="<<m_StepsVertical;
-
-	m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode, compileOptions.str());
+	//RunComputeTasks() started the build already, a task that runs alone starts it now
+	if(!m_ProgramBuilder.HasPending())
+		StartProgramBuilds(Device, Context);
+	m_Program = m_ProgramBuilder.Get(0);
 	if(m_Program == nullptr) return false;
 
 
@@ -116,6 +129,13 @@ bool CConvolutionSeparableTask::InitKernels()
 	m_VerticalKernel = clCreateKernel(m_Program, "ConvVertical", &clError);
 	V_RETURN_FALSE_CL(clError, "Failed to create vertical kernel.");
 
+	// every work-item computes [steps] pixels and loads one apron pixel on either side
+	double kernelLength = 2 * m_KernelRadius + 1;
+	CRoofline::SetKernelCost(m_HorizontalKernel, {4.0 * (m_StepsHorizontal + 2), 4.0 * m_StepsHorizontal, 2 * kernelLength * m_StepsHorizontal},
+		(double)(m_Width / m_StepsHorizontal) * m_Height);
+	CRoofline::SetKernelCost(m_VerticalKernel, {4.0 * (m_StepsVertical + 2), 4.0 * m_StepsVertical, 2 * kernelLength * m_StepsVertical},
+		(double)m_Width * (m_Height / m_StepsVertical));
+
 	//bind kernel attributes
 	//the resulting image will be in buffer 1
 	clError = clSetKernelArg(m_HorizontalKernel, 2, sizeof(cl_mem), (void*)&m_dKernelHorizontal);
@@ -172,6 +192,12 @@ void CConvolutionSeparableTask::ComputeGPU(cl_context Context, cl_command_queue
 	SaveImage("Images/GPUResultSeparable_" + m_OutFileName + ".pfm", m_hGPUResultChannels);
 }
 
+size_t CConvolutionSeparableTask::GetDeviceBytes() const
+{
+	//the working buffer between the passes and the two kernels
+	return CConvolutionTaskBase::GetDeviceBytes() + GetChannelBytes() + 2 * (2 * m_KernelRadius + 1) * sizeof(cl_float);
+}
+
 void CConvolutionSeparableTask::ComputeCPU()
 {
 	double runTime = 0.0;
@@ -191,34 +217,40 @@ double CConvolutionSeparableTask::ConvolutionChannelCPU(unsigned int Channel)
 	timer.Start();
 
 	//horizontal pass
-	for(int y = 0; y < (int)m_Height; y++)
-		for(int x = 0; x < (int)m_Width; x++)
-		{
-			float value = 0;
-			//apply horizontal kernel
-			for(int k = -m_KernelRadius; k <= m_KernelRadius; k++)
+	CThreadPool::GetInstance().ParallelFor(0, m_Height, 0, [&](size_t Begin, size_t End)
+	{
+		for(int y = (int)Begin; y < (int)End; y++)
+			for(int x = 0; x < (int)m_Width; x++)
 			{
-				int sx = x + k;
-				if(sx >= 0 && sx < (int)m_Width)
-					value += m_hSourceChannels[Channel][y * m_Pitch + sx] * m_hKernelHorizontal[m_KernelRadius - k];
+				float value = 0;
+				//apply horizontal kernel
+				for(int k = -m_KernelRadius; k <= m_KernelRadius; k++)
+				{
+					int sx = x + k;
+					if(sx >= 0 && sx < (int)m_Width)
+						value += m_hSourceChannels[Channel][y * m_Pitch + sx] * m_hKernelHorizontal[m_KernelRadius - k];
+				}
+				m_hCPUWorkingBuffer[y * m_Pitch + x] = value;
 			}
-			m_hCPUWorkingBuffer[y * m_Pitch + x] = value;
-		}
-
-	//vertical pass
-	for(int x = 0; x < (int)m_Width; x++)
-		for(int y = 0; y < (int)m_Height; y++)
-		{
-			float value = 0;
-			//apply horizontal kernel
-			for(int k = -m_KernelRadius; k <= m_KernelRadius; k++)
+	});
+
+	//vertical pass, row by row: the rows above and below are read contiguously
+	CThreadPool::GetInstance().ParallelFor(0, m_Height, 0, [&](size_t Begin, size_t End)
+	{
+		for(int y = (int)Begin; y < (int)End; y++)
+			for(int x = 0; x < (int)m_Width; x++)
 			{
-				int sy = y + k;
-				if(sy >= 0 && sy < (int)m_Height)
-					value += m_hCPUWorkingBuffer[sy * m_Pitch + x] * m_hKernelVertical[m_KernelRadius - k];
+				float value = 0;
+				//apply horizontal kernel
+				for(int k = -m_KernelRadius; k <= m_KernelRadius; k++)
+				{
+					int sy = y + k;
+					if(sy >= 0 && sy < (int)m_Height)
+						value += m_hCPUWorkingBuffer[sy * m_Pitch + x] * m_hKernelVertical[m_KernelRadius - k];
+				}
+				m_hCPUResultChannels[Channel][y * m_Pitch + x] = value;
 			}
-			m_hCPUResultChannels[Channel][y * m_Pitch + x] = value;
-		}
+	});
 
 	timer.Stop();
 
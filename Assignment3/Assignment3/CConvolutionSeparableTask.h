@@ -21,6 +21,7 @@
 #define _CCONVOLUTION_SEPARABLE_TASK_H
 
 #include "CConvolutionTaskBase.h"
+#include "../Common/CProgramBuilder.h"
 
 #include <string>
 
@@ -43,6 +44,8 @@ public:
 
 	// IComputeTask
 
+	virtual void StartProgramBuilds(cl_device_id Device, cl_context Context);
+
 	virtual bool InitResources(cl_device_id Device, cl_context Context);
 	virtual bool InitKernels();
 	
@@ -52,6 +55,8 @@ public:
 
 	virtual void ComputeCPU();
 
+	virtual size_t GetDeviceBytes() const;
+
 protected:
 	// the return value is the run time in milliseconds
 	double ConvolutionChannelCPU(unsigned int Channel);
@@ -82,6 +87,8 @@ protected:
 
 	cl_program		m_Program = nullptr;
 	std::string		m_ProgramName;
+	//the variant build started by StartProgramBuilds()
+	CProgramBuilder	m_ProgramBuilder;
 	//horizontal convolution pass
 	cl_kernel		m_HorizontalKernel = nullptr;
 	//vertical convolution pass
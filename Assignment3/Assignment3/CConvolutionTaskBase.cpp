@@ -6,6 +6,8 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CConvolutionTaskBase.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CMemoryTracker.h"
+#include "../Common/CResultValidator.h"
 
 #include "Pfm.h"
 
@@ -89,13 +91,14 @@ bool CConvolutionTaskBase::InitResources(cl_device_id , cl_context Context)
 
 	unsigned int dataSize = m_Pitch * m_Height * sizeof(cl_float);
 	
+	CMemoryTracker& memory = CMemoryTracker::GetInstance();
 	cl_int clError;
 	for(int i = 0; i < 3; i++)
 	{
-		m_dSourceChannels[i] = clCreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize, m_hSourceChannels[i], &clError);
+		m_dSourceChannels[i] = memory.CreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize, m_hSourceChannels[i], &clError, "Convolution/source channel");
 		V_RETURN_FALSE_CL(clError, "Error allocating device input array");
 
-		m_dResultChannels[i] = clCreateBuffer(Context, CL_MEM_WRITE_ONLY, dataSize, NULL, &clError);
+		m_dResultChannels[i] = memory.CreateBuffer(Context, CL_MEM_WRITE_ONLY, dataSize, NULL, &clError, "Convolution/result channel");
 		V_RETURN_FALSE_CL(clError, "Error allocating device output array");
 	}
 
@@ -115,45 +118,67 @@ void CConvolutionTaskBase::ReleaseResources()
 	}
 }
 
+std::string CConvolutionTaskBase::GetName() const
+{
+	return "Convolution" + m_FileNamePostfix;
+}
+
+size_t CConvolutionTaskBase::GetDeviceBytes() const
+{
+	//source and result buffer of each channel
+	return 6 * GetChannelBytes();
+}
+
+size_t CConvolutionTaskBase::GetChannelBytes() const
+{
+	int width, height;
+	if(!PFM::LoadSize(m_FileName.c_str(), width, height))
+		return 0;
+
+	size_t pitch = width;
+	if(width % 32 != 0)
+		pitch = width + 32 - (width % 32);
+	return pitch * height * sizeof(cl_float);
+}
+
 bool CConvolutionTaskBase::ValidateResults()
 {
 	//number of channels to compute
 	unsigned int numChannels = m_Monochrome ? 1 : 3;
 
-	//calculate the average squared difference
-	float avgError = 0;
-	float maxError = 0;
-	float numValues = float(numChannels * m_Width * (m_Height - 1));
-	float scaling = 1.0f / numValues;
+	// Ignore the last line for the difference computations because we seem to have issues with NANs and other incorrect values in the last line with
+	// the current driver version (versions 344.75, 344.11 and 335.23) in the separable kernel exercise.
+	// This should be removed ASAP if the driver works again.
+	unsigned int validatedHeight = m_Height - 1;
 
-	for(unsigned int y = 0; y < m_Height; y++)
-		for(unsigned int x = 0; x < m_Width; x++)
-			for(unsigned int i = 0; i < numChannels; i++)
-			{
-				float L2Error = m_hCPUResultChannels[i][y * m_Pitch + x] - m_hGPUResultChannels[i][y * m_Pitch + x];
-				L2Error = L2Error * L2Error;
-
-				// Ignore the last line for the difference computations because we seem to have issues with NANs and other incorrect values in the last line with
-				// the current driver version (versions 344.75, 344.11 and 335.23) in the separable kernel exercise.
-				// This should be removed ASAP if the driver works again. You will also have to change the numValues initialization above.
-				if (y < m_Height - 1)
-				{
-					maxError = max(maxError, L2Error);
-					avgError += L2Error * scaling;
-				}
-
-				//to see the difference...
-				m_hCPUResultChannels[i][y * m_Pitch + x] = L2Error;
-			}
-	cout<<"Mean sq. error (MSE): "<<avgError<<endl;
-	cout<<"Maximum sq. error: "<<maxError<<endl;
+	//the squared differences go to a separate image, the CPU result stays intact
+	vector<float> differenceImage[3];
+	float* differenceChannels[3];
+	vector<CResultValidator::Report> reports;
+	for(unsigned int i = 0; i < numChannels; i++)
+	{
+		differenceImage[i].assign(m_Height * m_Pitch, 0.0f);
+		differenceChannels[i] = differenceImage[i].data();
+
+		//a max. sq. error of 1e-8 is an abs. error of 1e-4
+		reports.push_back(CResultValidator::Compare(m_hCPUResultChannels[i], m_hGPUResultChannels[i], m_Width, validatedHeight, m_Pitch,
+			CResultValidator::Tolerance(1e-4), 1.0, differenceChannels[i]));
+	}
+	for(unsigned int i = numChannels; i < 3; i++)
+		differenceChannels[i] = differenceChannels[0];
+
+	CResultValidator::Report report = CResultValidator::Merge(reports);
+	cout<<"Mean sq. error (MSE): "<<report.MSE<<endl;
+	cout<<"Maximum sq. error: "<<report.MaxAbsError * report.MaxAbsError<<endl;
+	cout<<"PSNR: "<<report.PSNR<<" dB"<<endl;
+	CResultValidator::PrintReport(report, "Convolution" + m_FileNamePostfix);
 
 	//save difference image
 	std::stringstream strm;
 	strm<<"Images/DifferenceImage"<<m_FileNamePostfix<<".pfm";
-	SaveImage(strm.str().c_str(), m_hCPUResultChannels);
+	SaveImage(strm.str().c_str(), differenceChannels);
 
-	return (avgError < 1e-10f && maxError < 1e-8);
+	return (report.MSE < 1e-10 && report.Passed());
 }
 
 #ifdef HAVE_BIG_ENDIAN
@@ -44,7 +44,13 @@ public:
 
 	virtual bool ValidateResults();
 
+	virtual std::string GetName() const;
+
+	virtual size_t GetDeviceBytes() const;
+
 protected:
+	// size of one padded channel of the input image, read from its header; 0 if it cannot be read
+	size_t GetChannelBytes() const;
 
 	void SaveImage(const std::string& FileName, float* Channels[3]);
 	void SaveIntImage(const std::string& FileName, int* Channel);
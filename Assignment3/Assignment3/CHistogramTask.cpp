@@ -1,6 +1,11 @@
 #include "CHistogramTask.h"
+#include "../Common/CBufferPool.h"
 #include "../Common/CLUtil.h"
+#include "../Common/CMemoryTracker.h"
+#include "../Common/CMultiDevice.h"
+#include "../Common/CThreadPool.h"
 #include "../Common/CTimer.h"
+#include "../Common/CWorkGroupTuner.h"
 #include "Pfm.h"
 #include <string.h>
 #include <cassert>
@@ -20,6 +25,22 @@ CHistogramTask::
 	ReleaseResources();
 }
 
+std::string CHistogramTask::
+GetName() const
+{
+	return m_use_local_memory ? "Histogram local" : "Histogram global";
+}
+
+size_t CHistogramTask::
+GetDeviceBytes() const
+{
+	int width, height;
+	if(!PFM::LoadSize(m_img_path.c_str(), width, height))
+		return 0;
+	size_t stride = width % 32 ? (width + 32 - width % 32) : width;
+	return sizeof(float) * stride * height + NUM_HIST_BINS * sizeof(int);
+}
+
 bool CHistogramTask::
 InitResources(cl_device_id dev, cl_context ctx)
 {
@@ -43,16 +64,18 @@ InitResources(cl_device_id dev, cl_context ctx)
 		   	s += img.pImg[(y * img.width + x) * 3 + 2] * 0.11f;
 		}
 	}
-	m_d_pixels = clCreateBuffer(ctx,
+	CMemoryTracker &memory = CMemoryTracker::GetInstance();
+	m_d_pixels = memory.CreateBuffer(ctx,
 			CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
 			sizeof(float) * m_pixels.size(),
 			m_pixels.data(),
-			&err);
+			&err,
+			"Histogram/pixels");
 	V_RETURN_FALSE_CL(err, "Failed to allocate device memory");
 
 	std::vector<int> zeroes(NUM_HIST_BINS, 0);
-	m_d_hist = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, NUM_HIST_BINS * sizeof(int),
-			zeroes.data(), &err);
+	m_d_hist = memory.CreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, NUM_HIST_BINS * sizeof(int),
+			zeroes.data(), &err, "Histogram/bins");
 	V_RETURN_FALSE_CL(err, "Failed to allocate device memory");
 
 
@@ -110,6 +133,9 @@ ReleaseResources()
 	 SAFE_RELEASE_MEMOBJECT(m_d_hist);
 	 SAFE_RELEASE_KERNEL(m_kernel_histogram);
 	 SAFE_RELEASE_KERNEL(m_kernel_set_to_val);
+	 for(auto &kernel: m_device_kernels)
+		 SAFE_RELEASE_KERNEL(kernel);
+	 m_device_kernels.clear();
 }
 
 static void
@@ -137,9 +163,30 @@ print_histogram(const std::vector<int> &h)
 	std::cout << "+\n";
 }
 
+void CHistogramTask::
+PrepareComputeGPU(cl_command_queue cmdq, const size_t lws[3], bool tune_lws)
+{
+	// tuning launches the kernel, ComputeGPU() clears the histogram before every launch anyway
+	m_tuned_lws[0] = 0;
+	if(lws[0] != 0 && !tune_lws)
+		return;
+
+	// the local memory variant clears and adds up its bins with one work-item each
+	size_t problem_size[2] = { size_t(m_img_width), size_t(m_img_height) };
+	if(!CWorkGroupTuner::Tune(cmdq, m_kernel_histogram, 2, problem_size, m_tuned_lws, -1, 0, 10,
+			m_use_local_memory ? NUM_HIST_BINS : 1))
+		std::cerr << "Error: failed to tune the local work size of the histogram." << std::endl;
+}
+
 void CHistogramTask::
 ComputeGPU(cl_context ctx, cl_command_queue cmdq, size_t lws[3])
 {
+	// the local work size tuned by PrepareComputeGPU() takes precedence, a failed tuning keeps the given one
+	if(m_tuned_lws[0] != 0)
+		lws = m_tuned_lws;
+	if(lws[0] == 0)
+		return;
+
 	size_t local_size_clear = 256;
 	size_t global_size_clear = ((NUM_HIST_BINS + local_size_clear - 1) / local_size_clear) * local_size_clear;
 	size_t global_size[2] = {
@@ -172,19 +219,123 @@ ComputeGPU(cl_context ctx, cl_command_queue cmdq, size_t lws[3])
 
 }
 
+bool CHistogramTask::
+PrepareMultiDevice(CMultiDevice &devices)
+{
+	std::string src;
+	if(!CLUtil::LoadProgramSourceToMemory("histogram.cl", src))
+		return false;
+
+	m_device_kernels.assign(devices.GetNumDevices(), nullptr);
+	for(size_t i = 0; i < m_device_kernels.size(); i++) {
+		m_device_kernels[i] = devices.CreateKernel(i, src,
+			m_use_local_memory ? "compute_histogram_local_memory" : "compute_histogram", CLDefines());
+		if(!m_device_kernels[i])
+			return false;
+	}
+
+	m_device_partials.assign(devices.GetNumDevices(), std::vector<int>(NUM_HIST_BINS, 0));
+	return devices.Calibrate(m_use_local_memory ? "HistogramLocal" : "Histogram", m_img_height, 8,
+		[&](size_t device_index, size_t begin, size_t end) { return compute_range(devices, device_index, begin, end); });
+}
+
+bool CHistogramTask::
+ComputeMultiDevice(CMultiDevice &devices)
+{
+	if(m_device_kernels.empty())
+		return false;
+
+	// every device counts a strip of rows, the partial histograms are added up on the host
+	bool success = devices.Run(m_use_local_memory ? "HistogramLocal" : "Histogram", m_img_height, 8,
+		[&](size_t device_index, size_t begin, size_t end) { return compute_range(devices, device_index, begin, end); });
+	if(!success)
+		return false;
+
+	// only the strips of the final run count, the calibration run may have used other devices
+	const std::vector<CMultiDevice::Range> &parts = devices.GetLastPartition();
+	m_histogram_gpu.assign(NUM_HIST_BINS, 0);
+	for(size_t d = 0; d < parts.size(); d++) {
+		if(parts[d].End == parts[d].Begin)
+			continue;
+		for(int i = 0; i < NUM_HIST_BINS; i++)
+			m_histogram_gpu[i] += m_device_partials[d][i];
+	}
+
+	devices.PrintLastRun();
+	return true;
+}
+
+bool CHistogramTask::
+compute_range(CMultiDevice &devices, size_t device_index, size_t begin, size_t end)
+{
+	const CMultiDevice::Device &device = devices.GetDevice(device_index);
+	cl_kernel kernel = m_device_kernels[device_index];
+	int rows = int(end - begin);
+	int num_hist_bins = NUM_HIST_BINS;
+
+	cl_int err, err2;
+	cl_mem d_pixels = CBufferPool::GetInstance().Create(device.Context, CL_MEM_READ_ONLY,
+		sizeof(float) * m_img_stride * rows, &err2);
+	err = err2;
+	cl_mem d_hist = CBufferPool::GetInstance().Create(device.Context, CL_MEM_READ_WRITE, sizeof(int) * NUM_HIST_BINS, &err2);
+	err |= err2;
+
+	if(err == CL_SUCCESS) {
+		std::vector<int> zeroes(NUM_HIST_BINS, 0);
+		err = clEnqueueWriteBuffer(device.Queue, d_pixels, CL_FALSE, 0, sizeof(float) * m_img_stride * rows,
+			m_pixels.data() + begin * m_img_stride, 0, nullptr, nullptr);
+		err |= clEnqueueWriteBuffer(device.Queue, d_hist, CL_TRUE, 0, sizeof(int) * NUM_HIST_BINS,
+			zeroes.data(), 0, nullptr, nullptr);
+
+		err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &d_hist);
+		err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &d_pixels);
+		err |= clSetKernelArg(kernel, 2, sizeof(int), &m_img_width);
+		err |= clSetKernelArg(kernel, 3, sizeof(int), &rows);
+		err |= clSetKernelArg(kernel, 4, sizeof(int), &m_img_stride);
+		err |= clSetKernelArg(kernel, 5, sizeof(int), &num_hist_bins);
+		if(m_use_local_memory)
+			err |= clSetKernelArg(kernel, 6, sizeof(int) * NUM_HIST_BINS, nullptr);
+
+		size_t lws[2] = { 16, 8 };
+		size_t global_size[2] = {
+			((m_img_width + lws[0] - 1) / lws[0]) * lws[0],
+			((rows        + lws[1] - 1) / lws[1]) * lws[1]
+		};
+		err |= clEnqueueNDRangeKernel(device.Queue, kernel, 2, NULL, global_size, lws, 0, NULL, NULL);
+		err |= clEnqueueReadBuffer(device.Queue, d_hist, CL_TRUE, 0, sizeof(int) * NUM_HIST_BINS,
+			m_device_partials[device_index].data(), 0, nullptr, nullptr);
+	}
+
+	SAFE_RELEASE_POOLED(d_pixels);
+	SAFE_RELEASE_POOLED(d_hist);
+	V_RETURN_FALSE_CL(err, "Failed to compute the histogram on " << device.Name << ".");
+	return true;
+}
+
 void CHistogramTask::
 ComputeCPU()
 {
-	m_histogram.assign(NUM_HIST_BINS, 0);
 	CTimer timer;
 	timer.Start();
-	for(int y = 0; y < m_img_height; y++) {
-		for(int x = 0; x < m_img_width; x++) {
-			float p = m_pixels[y * m_img_stride + x] * float(NUM_HIST_BINS);
-			int h_idx = std::min<int>(NUM_HIST_BINS - 1, std::max<int>(0, int(p)));
-			m_histogram[h_idx]++;
-		}
-	}
+	// every chunk of rows fills a private histogram, they are summed up afterwards
+	m_histogram = CThreadPool::GetInstance().ParallelReduce(size_t(0), size_t(m_img_height), 0,
+		std::vector<int>(NUM_HIST_BINS, 0),
+		[this](size_t Begin, size_t End) {
+			std::vector<int> histogram(NUM_HIST_BINS, 0);
+			for(int y = int(Begin); y < int(End); y++) {
+				for(int x = 0; x < m_img_width; x++) {
+					float p = m_pixels[y * m_img_stride + x] * float(NUM_HIST_BINS);
+					int h_idx = std::min<int>(NUM_HIST_BINS - 1, std::max<int>(0, int(p)));
+					histogram[h_idx]++;
+				}
+			}
+			return histogram;
+		},
+		[](std::vector<int> A, const std::vector<int>& B) {
+			for(size_t i = 0; i < A.size(); i++)
+				A[i] += B[i];
+			return A;
+		});
 	timer.Stop();
 
 	std::cout << "  Histogram CPU time: " << timer.GetElapsedMilliseconds() << " ms\n";
@@ -14,11 +14,19 @@ public:
 
 	virtual bool InitResources(cl_device_id Device, cl_context Context) override;
 	virtual void ReleaseResources() override;
+	virtual void PrepareComputeGPU(cl_command_queue cmdq, const size_t lws[3], bool tune_lws) override;
 	virtual void ComputeGPU(cl_context ctx, cl_command_queue cmdq, size_t lws[3]) override;
 	virtual void ComputeCPU() override;
 	virtual bool ValidateResults() override;
+	virtual bool PrepareMultiDevice(CMultiDevice &devices) override;
+	virtual bool ComputeMultiDevice(CMultiDevice &devices) override;
+	virtual std::string GetName() const override;
+	virtual size_t GetDeviceBytes() const override;
 
 protected:
+	// counts the rows [begin, end) on one device of ComputeMultiDevice()
+	bool compute_range(CMultiDevice &devices, size_t device_index, size_t begin, size_t end);
+
 	float m_min_val = 0.0f, m_max_val = 1.0f;
 	const std::string m_img_path;
 	const bool m_use_local_memory;
@@ -28,9 +36,15 @@ protected:
 	cl_kernel m_kernel_histogram = nullptr, m_kernel_set_to_val = nullptr;
 	cl_mem m_d_pixels = nullptr;
 	cl_mem m_d_hist = nullptr;
+	// the local work size found by PrepareComputeGPU(), 0 if ComputeGPU() uses the given one
+	size_t m_tuned_lws[3] = { 0, 1, 1 };
 
 	std::vector<int> m_histogram, m_histogram_gpu;
 	std::vector<float> m_pixels;
+
+	// the kernel of every device, built by PrepareMultiDevice(), and their partial histograms
+	std::vector<cl_kernel> m_device_kernels;
+	std::vector<std::vector<int> > m_device_partials;
 };
 
 
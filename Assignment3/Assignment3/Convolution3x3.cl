@@ -8,9 +8,14 @@ to be the multiple of the given tile-size.
 */
 
 // should be multiple of 32 on Fermi and 16 on pre-Fermi...
+// The host passes its tile size (see CConvolution3x3Task), TILE_X must be 2 * TILE_Y and TILE_Y at least 8.
+#ifndef TILE_X
 #define TILE_X 32
+#endif
 
+#ifndef TILE_Y
 #define TILE_Y 16
+#endif
 
 // d_Dst is the convolution of d_Src with the kernel c_Kernel
 // c_Kernel is assumed to be a float[11] array of the 3x3 convolution constants, one multiplier (for normalization) and an offset (in this order!)
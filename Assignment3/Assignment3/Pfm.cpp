@@ -51,6 +51,21 @@ bool PFM::LoadRGB(const char *file) {
 	return true;
 }
 
+bool PFM::LoadSize(const char *file, int &w, int &h) {
+
+	FILE *f = fopen( file, "rb" );
+
+	if ( !f )
+		return false;
+
+	char tmp[ 1024 ];
+	bool valid = fscanf( f, "%1023s", tmp ) == 1 && ( strcmp( tmp, "PF" ) == 0 || strcmp( tmp, "Pf" ) == 0 )
+		&& fscanf( f, "%d%d", &w, &h ) == 2;
+
+	fclose( f );
+	return valid;
+}
+
 bool PFM::SaveRGB(const char* file) {
 
 	FILE *f = fopen( file, "wb" );
@@ -23,6 +23,8 @@ public:
 	bool SaveRGB(const char*); 
     bool LoadGrayscale(const char *);
 	bool SaveGrayscale(const char*); 
+	//reads only the header, e.g. to estimate memory before loading
+	static bool LoadSize(const char *, int &, int &);
 
 private:
 
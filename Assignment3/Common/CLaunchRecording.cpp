@@ -0,0 +1,260 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CLaunchRecording.h"
+#include "CDeviceCaps.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+// cl_khr_command_buffer, not every cl_ext.h has it (or the same revision of it)
+typedef _cl_command_buffer_khr* (CL_API_CALL *CreateCommandBufferFunc)(cl_uint, const cl_command_queue*, const cl_ulong*, cl_int*);
+typedef cl_int (CL_API_CALL *CommandNDRangeKernelFunc)(_cl_command_buffer_khr*, cl_command_queue, const cl_ulong*, cl_kernel, cl_uint,
+	const size_t*, const size_t*, const size_t*, cl_uint, const cl_uint*, cl_uint*, void*);
+typedef cl_int (CL_API_CALL *FinalizeCommandBufferFunc)(_cl_command_buffer_khr*);
+
+static bool IsCommandBufferEnabled()
+{
+	const char* env = getenv("GPUC_COMMAND_BUFFER");
+	return env == NULL || atoi(env) != 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CLaunchRecording
+
+CLaunchRecording::CLaunchRecording()
+	: m_Queue(NULL), m_Recording(false), m_Failed(false), m_Recorded(false), m_CommandBuffer(NULL), m_LastReplay(NULL),
+	m_EnqueueCommandBuffer(NULL), m_ReleaseCommandBuffer(NULL)
+{
+}
+
+CLaunchRecording::~CLaunchRecording()
+{
+	Release();
+}
+
+void CLaunchRecording::Begin(cl_command_queue Queue)
+{
+	Release();
+	m_Queue = Queue;
+	m_Recording = true;
+}
+
+cl_int CLaunchRecording::Launch(cl_command_queue Queue, cl_kernel Kernel, cl_uint WorkDim, const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize,
+	initializer_list<Arg> Args)
+{
+	cl_int clError = CL_SUCCESS;
+
+	if (!m_Recording)
+	{
+		cl_uint index = 0;
+		for (const Arg& arg : Args)
+			clError |= clSetKernelArg(Kernel, index++, arg.Size, arg.pValue);
+		if (clError != CL_SUCCESS)
+			return clError;
+		return clEnqueueNDRangeKernel(Queue, Kernel, WorkDim, NULL, pGlobalWorkSize, pLocalWorkSize, 0, NULL, NULL);
+	}
+
+	if (Queue != m_Queue)
+		clError = CL_INVALID_COMMAND_QUEUE;
+	else if (WorkDim < 1 || WorkDim > 3)
+		clError = CL_INVALID_WORK_DIMENSION;
+
+	Baked launch;
+	if (clError == CL_SUCCESS)
+		launch.Kernel = GetBakedKernel(Kernel, Args, &clError);
+	if (clError != CL_SUCCESS)
+	{
+		m_Failed = true;
+		return clError;
+	}
+	launch.WorkDim = WorkDim;
+	launch.HasLocalWorkSize = pLocalWorkSize != NULL;
+	for (cl_uint i = 0; i < 3; i++)
+	{
+		launch.GlobalWorkSize[i] = i < WorkDim ? pGlobalWorkSize[i] : 1;
+		launch.LocalWorkSize[i] = i < WorkDim && pLocalWorkSize ? pLocalWorkSize[i] : 1;
+	}
+	m_Launches.push_back(launch);
+	return CL_SUCCESS;
+}
+
+cl_kernel CLaunchRecording::GetBakedKernel(cl_kernel Kernel, initializer_list<Arg> Args, cl_int* pErrorCode)
+{
+	// the arguments are part of the kernel object, all of them are needed
+	cl_uint numArgs = 0;
+	*pErrorCode = clGetKernelInfo(Kernel, CL_KERNEL_NUM_ARGS, sizeof(numArgs), &numArgs, NULL);
+	if (*pErrorCode != CL_SUCCESS)
+		return NULL;
+	if (numArgs != Args.size())
+	{
+		*pErrorCode = CL_INVALID_KERNEL_ARGS;
+		return NULL;
+	}
+
+	string values;
+	for (const Arg& arg : Args)
+	{
+		values.append((const char*)&arg.Size, sizeof(arg.Size));
+		values.push_back(arg.pValue ? 'v' : 'l');
+		if (arg.pValue)
+			values.append((const char*)arg.pValue, arg.Size);
+	}
+
+	pair<cl_kernel, string> key(Kernel, values);
+	map<pair<cl_kernel, string>, cl_kernel>::iterator it = m_BakedKernels.find(key);
+	if (it != m_BakedKernels.end())
+		return it->second;
+
+	// a new kernel object of the same program and function
+	cl_program program;
+	*pErrorCode = clGetKernelInfo(Kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, NULL);
+	if (*pErrorCode != CL_SUCCESS)
+		return NULL;
+	size_t nameSize = 0;
+	*pErrorCode = clGetKernelInfo(Kernel, CL_KERNEL_FUNCTION_NAME, 0, NULL, &nameSize);
+	if (*pErrorCode != CL_SUCCESS)
+		return NULL;
+	string name(nameSize, '\0');
+	clGetKernelInfo(Kernel, CL_KERNEL_FUNCTION_NAME, nameSize, &name[0], NULL);
+
+	cl_kernel baked = clCreateKernel(program, name.c_str(), pErrorCode);
+	if (*pErrorCode != CL_SUCCESS)
+		return NULL;
+
+	cl_uint index = 0;
+	for (const Arg& arg : Args)
+		*pErrorCode |= clSetKernelArg(baked, index++, arg.Size, arg.pValue);
+	if (*pErrorCode != CL_SUCCESS)
+	{
+		clReleaseKernel(baked);
+		return NULL;
+	}
+
+	m_BakedKernels[key] = baked;
+	return baked;
+}
+
+void CLaunchRecording::End()
+{
+	// a partial recording would replay wrong results
+	if (m_Failed)
+	{
+		Release();
+		return;
+	}
+
+	m_Recording = false;
+	m_Recorded = true;
+
+	if (IsCommandBufferEnabled())
+		RecordCommandBuffer();
+}
+
+bool CLaunchRecording::RecordCommandBuffer()
+{
+	cl_device_id device;
+	if (clGetCommandQueueInfo(m_Queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL) != CL_SUCCESS)
+		return false;
+	if (!CDeviceCaps::Get(device).HasCommandBuffer)
+		return false;
+
+	cl_platform_id platform;
+	if (clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL) != CL_SUCCESS)
+		return false;
+
+	CreateCommandBufferFunc createCommandBuffer =
+		(CreateCommandBufferFunc)clGetExtensionFunctionAddressForPlatform(platform, "clCreateCommandBufferKHR");
+	CommandNDRangeKernelFunc commandNDRangeKernel =
+		(CommandNDRangeKernelFunc)clGetExtensionFunctionAddressForPlatform(platform, "clCommandNDRangeKernelKHR");
+	FinalizeCommandBufferFunc finalizeCommandBuffer =
+		(FinalizeCommandBufferFunc)clGetExtensionFunctionAddressForPlatform(platform, "clFinalizeCommandBufferKHR");
+	EnqueueCommandBufferFunc enqueueCommandBuffer =
+		(EnqueueCommandBufferFunc)clGetExtensionFunctionAddressForPlatform(platform, "clEnqueueCommandBufferKHR");
+	ReleaseCommandBufferFunc releaseCommandBuffer =
+		(ReleaseCommandBufferFunc)clGetExtensionFunctionAddressForPlatform(platform, "clReleaseCommandBufferKHR");
+	if (!createCommandBuffer || !commandNDRangeKernel || !finalizeCommandBuffer || !enqueueCommandBuffer || !releaseCommandBuffer)
+		return false;
+
+	// fails if the queue lacks properties the device requires for command buffers
+	cl_int clError;
+	_cl_command_buffer_khr* commandBuffer = createCommandBuffer(1, &m_Queue, NULL, &clError);
+	if (clError != CL_SUCCESS)
+		return false;
+
+	// the queue is in-order, so are the recorded commands; no sync points needed
+	for (size_t i = 0; i < m_Launches.size() && clError == CL_SUCCESS; i++)
+	{
+		const Baked& launch = m_Launches[i];
+		clError = commandNDRangeKernel(commandBuffer, NULL, NULL, launch.Kernel, launch.WorkDim, NULL, launch.GlobalWorkSize,
+			launch.HasLocalWorkSize ? launch.LocalWorkSize : NULL, 0, NULL, NULL, NULL);
+	}
+	if (clError == CL_SUCCESS)
+		clError = finalizeCommandBuffer(commandBuffer);
+	if (clError != CL_SUCCESS)
+	{
+		releaseCommandBuffer(commandBuffer);
+		return false;
+	}
+
+	m_CommandBuffer = commandBuffer;
+	m_EnqueueCommandBuffer = enqueueCommandBuffer;
+	m_ReleaseCommandBuffer = releaseCommandBuffer;
+	return true;
+}
+
+cl_int CLaunchRecording::Replay()
+{
+	if (!m_Recorded)
+		return CL_INVALID_OPERATION;
+
+	if (m_CommandBuffer)
+	{
+		cl_event event = NULL;
+		cl_int clError = m_EnqueueCommandBuffer(1, &m_Queue, m_CommandBuffer, 0, NULL, &event);
+		// without simultaneous use, a command buffer cannot be enqueued while its last replay is pending
+		if (clError == CL_INVALID_OPERATION && m_LastReplay)
+		{
+			clWaitForEvents(1, &m_LastReplay);
+			clError = m_EnqueueCommandBuffer(1, &m_Queue, m_CommandBuffer, 0, NULL, &event);
+		}
+		if (m_LastReplay)
+			clReleaseEvent(m_LastReplay);
+		m_LastReplay = clError == CL_SUCCESS ? event : NULL;
+		return clError;
+	}
+
+	for (size_t i = 0; i < m_Launches.size(); i++)
+	{
+		const Baked& launch = m_Launches[i];
+		cl_int clError = clEnqueueNDRangeKernel(m_Queue, launch.Kernel, launch.WorkDim, NULL, launch.GlobalWorkSize,
+			launch.HasLocalWorkSize ? launch.LocalWorkSize : NULL, 0, NULL, NULL);
+		if (clError != CL_SUCCESS)
+			return clError;
+	}
+	return CL_SUCCESS;
+}
+
+void CLaunchRecording::Release()
+{
+	if (m_LastReplay)
+		clReleaseEvent(m_LastReplay);
+	m_LastReplay = NULL;
+
+	if (m_CommandBuffer)
+		m_ReleaseCommandBuffer(m_CommandBuffer);
+	m_CommandBuffer = NULL;
+
+	for (map<pair<cl_kernel, string>, cl_kernel>::iterator it = m_BakedKernels.begin(); it != m_BakedKernels.end(); ++it)
+		clReleaseKernel(it->second);
+	m_BakedKernels.clear();
+	m_Launches.clear();
+
+	m_Queue = NULL;
+	m_Recording = false;
+	m_Failed = false;
+	m_Recorded = false;
+}
@@ -0,0 +1,246 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CMultiDevice.h"
+
+#include "CBufferPool.h"
+#include "CLUtil.h"
+#include "CTimer.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CMultiDevice
+
+CMultiDevice::CMultiDevice()
+{
+}
+
+CMultiDevice::~CMultiDevice()
+{
+	Release();
+}
+
+bool CMultiDevice::Init(cl_device_type DeviceType)
+{
+	Release();
+
+	cl_uint nPlatforms = 0;
+	V_RETURN_FALSE_CL(clGetPlatformIDs(0, NULL, &nPlatforms), "Failed to get the number of OpenCL platforms.");
+	vector<cl_platform_id> platforms(nPlatforms);
+	V_RETURN_FALSE_CL(clGetPlatformIDs(nPlatforms, platforms.data(), NULL), "Failed to get the OpenCL platforms.");
+
+	for (size_t p = 0; p < platforms.size(); p++)
+	{
+		cl_uint nDevices = 0;
+		if (clGetDeviceIDs(platforms[p], DeviceType, 0, NULL, &nDevices) != CL_SUCCESS || nDevices == 0)
+			continue;
+		vector<cl_device_id> deviceIds(nDevices);
+		V_RETURN_FALSE_CL(clGetDeviceIDs(platforms[p], DeviceType, nDevices, deviceIds.data(), NULL), "Failed to get the OpenCL devices.");
+
+		cl_int clError;
+		cl_context context = clCreateContext(NULL, nDevices, deviceIds.data(), NULL, NULL, &clError);
+		V_RETURN_FALSE_CL(clError, "Failed to create a multi-device context.");
+		m_Contexts.push_back(context);
+
+		for (size_t d = 0; d < deviceIds.size(); d++)
+		{
+			Device device;
+			device.Platform = platforms[p];
+			device.Id = deviceIds[d];
+			device.Context = context;
+			device.Queue = clCreateCommandQueue(context, deviceIds[d], 0, &clError);
+			V_RETURN_FALSE_CL(clError, "Failed to create a multi-device command queue.");
+
+			char name[256] = "";
+			cl_uint computeUnits = 0, clockFrequency = 0;
+			clGetDeviceInfo(deviceIds[d], CL_DEVICE_NAME, sizeof(name), name, NULL);
+			clGetDeviceInfo(deviceIds[d], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+			clGetDeviceInfo(deviceIds[d], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_uint), &clockFrequency, NULL);
+			device.Name = name;
+			device.PeakScore = max(1.0, (double)computeUnits * clockFrequency);
+			m_Devices.push_back(device);
+		}
+	}
+
+	if (m_Devices.empty())
+	{
+		cerr << "Error: no OpenCL device found for the multi-device mode." << endl;
+		return false;
+	}
+
+	cout << "Multi-device mode on " << m_Devices.size() << " devices:" << endl;
+	for (size_t i = 0; i < m_Devices.size(); i++)
+		cout << "  [" << i << "] " << m_Devices[i].Name << endl;
+	cout << endl;
+
+	return true;
+}
+
+void CMultiDevice::Release()
+{
+	for (size_t i = 0; i < m_Devices.size(); i++)
+	{
+		if (m_Devices[i].Queue != nullptr)
+			clReleaseCommandQueue(m_Devices[i].Queue);
+	}
+	m_Devices.clear();
+
+	for (size_t i = 0; i < m_Contexts.size(); i++)
+	{
+		CBufferPool::GetInstance().ReleaseContext(m_Contexts[i]);
+		CLUtil::ReleaseProgramVariants(m_Contexts[i]);
+		clReleaseContext(m_Contexts[i]);
+	}
+	m_Contexts.clear();
+
+	m_Throughputs.clear();
+	m_LastPartition.clear();
+	m_LastMilliseconds.clear();
+}
+
+cl_kernel CMultiDevice::CreateKernel(size_t DeviceIndex, const std::string& Source, const char* KernelName,
+	const CLDefines& Defines, const std::string& CompileOptions)
+{
+	const Device& device = m_Devices[DeviceIndex];
+	cl_program program = CLUtil::BuildProgramVariant(device.Id, device.Context, Source, Defines, CompileOptions);
+	if (program == nullptr)
+		return nullptr;
+
+	cl_int clError;
+	cl_kernel kernel = clCreateKernel(program, KernelName, &clError);
+	clReleaseProgram(program);
+	if (clError != CL_SUCCESS)
+	{
+		cerr << "Error: failed to create kernel \"" << KernelName << "\" on " << device.Name << ": "
+			<< CLUtil::GetCLErrorString(clError) << endl;
+		return nullptr;
+	}
+	return kernel;
+}
+
+vector<CMultiDevice::Range> CMultiDevice::Partition(size_t N, size_t Granularity, const vector<double>& Weights)
+{
+	if (Granularity == 0)
+		Granularity = 1;
+
+	double total = 0.0;
+	for (size_t i = 0; i < Weights.size(); i++)
+		total += Weights[i];
+
+	vector<Range> parts(Weights.size());
+	size_t begin = 0;
+	double accumulated = 0.0;
+	for (size_t i = 0; i < Weights.size(); i++)
+	{
+		// rounding the running sum keeps the total exact
+		accumulated += Weights[i];
+		size_t end = N;
+		if (i + 1 < Weights.size())
+		{
+			size_t share = total > 0.0 ? (size_t)(N * (accumulated / total)) : N * (i + 1) / Weights.size();
+			end = min(N, max(begin, (share + Granularity / 2) / Granularity * Granularity));
+		}
+		parts[i].Begin = begin;
+		parts[i].End = end;
+		begin = end;
+	}
+	return parts;
+}
+
+bool CMultiDevice::RunPartition(const vector<Range>& Parts, const Body& Work, vector<double>& Milliseconds)
+{
+	Milliseconds.assign(Parts.size(), 0.0);
+	vector<char> succeeded(Parts.size(), 1);
+
+	auto runDevice = [&](size_t Index)
+	{
+		if (Parts[Index].Begin == Parts[Index].End)
+			return;
+		CTimer timer;
+		timer.Start();
+		succeeded[Index] = Work(Index, Parts[Index].Begin, Parts[Index].End) ? 1 : 0;
+		timer.Stop();
+		Milliseconds[Index] = timer.GetElapsedMilliseconds();
+	};
+
+	// one host thread per device, the calling thread takes the first one
+	vector<thread> threads;
+	for (size_t i = 1; i < Parts.size(); i++)
+		threads.push_back(thread(runDevice, i));
+	runDevice(0);
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	return find(succeeded.begin(), succeeded.end(), 0) == succeeded.end();
+}
+
+bool CMultiDevice::Calibrate(const std::string& Name, size_t N, size_t Granularity, const Body& Work)
+{
+	if (m_Devices.empty())
+		return false;
+	if (m_Throughputs.find(Name) != m_Throughputs.end())
+		return true;
+
+	// split by the peak scores
+	vector<double> weights(m_Devices.size());
+	for (size_t i = 0; i < m_Devices.size(); i++)
+		weights[i] = m_Devices[i].PeakScore;
+
+	vector<Range> parts = Partition(N, Granularity, weights);
+	vector<double> ms;
+	if (!RunPartition(parts, Work, ms))
+		return false;
+
+	vector<double> throughputs(m_Devices.size(), 0.0);
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		size_t count = parts[i].End - parts[i].Begin;
+		// a device without work keeps a small share, so it gets measured next time
+		throughputs[i] = (count > 0 && ms[i] > 0.0) ? count / ms[i] : 0.0;
+	}
+	double maxThroughput = *max_element(throughputs.begin(), throughputs.end());
+	for (size_t i = 0; i < throughputs.size(); i++)
+		throughputs[i] = max(throughputs[i], 0.01 * maxThroughput);
+	m_Throughputs[Name] = throughputs;
+	return true;
+}
+
+bool CMultiDevice::Run(const std::string& Name, size_t N, size_t Granularity, const Body& Work)
+{
+	if (!Calibrate(Name, N, Granularity, Work))
+		return false;
+
+	map<string, vector<double> >::iterator it = m_Throughputs.find(Name);
+	m_LastName = Name;
+	m_LastPartition = Partition(N, Granularity, it->second);
+	if (!RunPartition(m_LastPartition, Work, m_LastMilliseconds))
+		return false;
+
+	// blend in the new measurement, the times include the transfers of every device
+	for (size_t i = 0; i < m_LastPartition.size(); i++)
+	{
+		size_t count = m_LastPartition[i].End - m_LastPartition[i].Begin;
+		if (count > 0 && m_LastMilliseconds[i] > 0.0)
+			it->second[i] = 0.5 * it->second[i] + 0.5 * count / m_LastMilliseconds[i];
+	}
+
+	return true;
+}
+
+void CMultiDevice::PrintLastRun() const
+{
+	cout << "  Multi-device split of " << m_LastName << ":" << endl;
+	for (size_t i = 0; i < m_LastPartition.size(); i++)
+	{
+		cout << "    [" << i << "] " << m_Devices[i].Name << ": [" << m_LastPartition[i].Begin << ", "
+			<< m_LastPartition[i].End << ") in " << m_LastMilliseconds[i] << " ms" << endl;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,90 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CRESULT_VALIDATOR_H
+#define _CRESULT_VALIDATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//! Compares a result with its reference in parallel and reports how far they are apart
+/*!
+	The data is a Width x Height region of rows that are Pitch elements apart
+	(Height = 1 and Pitch = Width for plain arrays). An element is a mismatch if
+	it exceeds all three tolerances: the absolute error, the error relative to
+	the reference, and the distance in units in the last place. The default
+	tolerance only accepts identical values.
+
+	Neither input is modified. The float version can also write the squared error
+	of every element to pSquaredError (same layout), e.g. for a difference image.
+*/
+class CResultValidator
+{
+public:
+	struct Tolerance
+	{
+		double		Abs;
+		double		Rel;
+		uint64_t	ULP;
+
+		Tolerance(double AbsTolerance = 0.0, double RelTolerance = 0.0, uint64_t ULPTolerance = 0)
+			: Abs(AbsTolerance), Rel(RelTolerance), ULP(ULPTolerance) {}
+	};
+
+	struct Mismatch
+	{
+		size_t		X, Y;
+		double		Reference, Result;
+	};
+
+	struct Report
+	{
+		size_t		NElements;
+		size_t		NMismatches;
+		double		MaxAbsError;
+		double		MaxRelError;
+		uint64_t	MaxULP;
+		double		MSE;
+		double		PSNR;				//!< with respect to the peak value, infinite for identical data
+		std::vector<Mismatch>	FirstMismatches;	//!< in memory order
+
+		bool Passed() const { return NMismatches == 0; }
+	};
+
+	static Report Compare(const float* pReference, const float* pResult, size_t Width, size_t Height, size_t Pitch,
+		const Tolerance& Tol = Tolerance(), double PeakValue = 1.0, float* pSquaredError = NULL);
+
+	static Report Compare(const int* pReference, const int* pResult, size_t Width, size_t Height, size_t Pitch,
+		const Tolerance& Tol = Tolerance(), double PeakValue = 1.0);
+
+	static Report Compare(const unsigned int* pReference, const unsigned int* pResult, size_t Width, size_t Height, size_t Pitch,
+		const Tolerance& Tol = Tolerance(), double PeakValue = 1.0);
+
+	//! Merges the reports of several channels of one image
+	static Report Merge(const std::vector<Report>& Reports);
+
+	//! Prints the errors and the first mismatches (all of the report if Verbose is set)
+	static void PrintReport(const Report& ValidationReport, const std::string& Name, bool Verbose = false);
+
+	//! Number of mismatches that are recorded with their location
+	static const size_t MaxRecordedMismatches = 10;
+};
+
+#endif // _CRESULT_VALIDATOR_H
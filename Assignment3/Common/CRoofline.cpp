@@ -0,0 +1,265 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CRoofline.h"
+#include "CLUtil.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+// STREAM copy and triad on float4, and four independent float4 chains of mad() per work-item
+static const char* s_ProbeSource =
+	"__kernel void Copy(__global float4* a, const __global float4* b)\n"
+	"{ size_t i = get_global_id(0); a[i] = b[i]; }\n"
+	"__kernel void Triad(__global float4* a, const __global float4* b, const __global float4* c, float s)\n"
+	"{ size_t i = get_global_id(0); a[i] = b[i] + s * c[i]; }\n"
+	"__kernel void Mad(__global float* out, float s)\n"
+	"{\n"
+	"	float4 x0 = (float4)(get_global_id(0)), x1 = x0 + 1.0f, x2 = x0 + 2.0f, x3 = x0 + 3.0f;\n"
+	"	for (int i = 0; i < 128; i++) {\n"
+	"		x0 = mad(x0, s, 0.5f); x1 = mad(x1, s, 0.5f); x2 = mad(x2, s, 0.5f); x3 = mad(x3, s, 0.5f);\n"
+	"	}\n"
+	"	float4 x = x0 + x1 + x2 + x3;\n"
+	"	out[get_global_id(0)] = x.x + x.y + x.z + x.w;\n"
+	"}\n";
+
+// 128 iterations of 4 float4 mad(), 2 operations each
+#define PROBE_MAD_OPS_PER_ITEM	(128 * 4 * 4 * 2)
+
+//! Best time of N launches in milliseconds, 0 on errors
+static double MinKernelTime(cl_command_queue Queue, cl_kernel Kernel, size_t GlobalWorkSize, int NIterations)
+{
+	double best = 0.0;
+	for (int i = 0; i < NIterations; i++)
+	{
+		cl_event event = NULL;
+		if (clEnqueueNDRangeKernel(Queue, Kernel, 1, NULL, &GlobalWorkSize, NULL, 0, NULL, &event) != CL_SUCCESS)
+			return 0.0;
+		cl_ulong start = 0, end = 0;
+		cl_int clError = clWaitForEvents(1, &event);
+		clError |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+		clError |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		clReleaseEvent(event);
+		if (clError != CL_SUCCESS)
+			return 0.0;
+
+		double ms = (end - start) * 1.0e-6;
+		if (ms > 0.0 && (best == 0.0 || ms < best))
+			best = ms;
+	}
+	return best;
+}
+
+static string GetKernelName(cl_kernel Kernel)
+{
+	char name[256] = "";
+	clGetKernelInfo(Kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name), name, NULL);
+	return name;
+}
+
+//! Declared cost of a kernel, the name guards against a released kernel whose handle was reused
+struct DeclaredCost
+{
+	string					Name;
+	CRoofline::KernelCost	Cost;
+	double					Items;
+};
+
+static mutex s_CostMutex;
+static map<cl_kernel, DeclaredCost> s_KernelCosts;
+
+///////////////////////////////////////////////////////////////////////////////
+// CRoofline
+
+bool CRoofline::IsEnabled()
+{
+	const char* env = getenv("GPUC_ROOFLINE");
+	return env == NULL || atoi(env) != 0;
+}
+
+void CRoofline::SetKernelCost(cl_kernel Kernel, const KernelCost& Cost, double Items)
+{
+	DeclaredCost declared = { GetKernelName(Kernel), Cost, Items };
+	lock_guard<mutex> lock(s_CostMutex);
+	s_KernelCosts[Kernel] = declared;
+}
+
+const CRoofline::Peak& CRoofline::GetPeak(cl_device_id Device)
+{
+	static mutex s_Mutex;
+	static map<cl_device_id, Peak> s_Peaks;
+
+	lock_guard<mutex> lock(s_Mutex);
+	map<cl_device_id, Peak>::iterator it = s_Peaks.find(Device);
+	if (it == s_Peaks.end())
+		it = s_Peaks.insert(make_pair(Device, MeasurePeak(Device))).first;
+	return it->second;
+}
+
+void CRoofline::Prepare(cl_device_id Device)
+{
+	if (IsEnabled())
+		GetPeak(Device);
+}
+
+CRoofline::Peak CRoofline::MeasurePeak(cl_device_id Device)
+{
+	Peak peak = { 0.0, 0.0 };
+
+	// a context of its own, with a profiling queue, whatever the task uses
+	cl_int clError;
+	cl_context context = clCreateContext(NULL, 1, &Device, NULL, NULL, &clError);
+	if (clError != CL_SUCCESS)
+		return peak;
+	cl_command_queue queue = clCreateCommandQueue(context, Device, CL_QUEUE_PROFILING_ENABLE, &clError);
+	cl_program program = nullptr;
+	cl_kernel copy = nullptr, triad = nullptr, mad = nullptr;
+	cl_mem a = nullptr, b = nullptr, c = nullptr;
+
+	// built directly, the probes should neither show up in the build log nor in the cache
+	if (clError == CL_SUCCESS)
+		program = clCreateProgramWithSource(context, 1, &s_ProbeSource, NULL, &clError);
+	if (clError == CL_SUCCESS)
+		clError = clBuildProgram(program, 1, &Device, NULL, NULL, NULL);
+	if (clError == CL_SUCCESS)
+	{
+		copy = clCreateKernel(program, "Copy", &clError);
+		triad = clCreateKernel(program, "Triad", NULL);
+		mad = clCreateKernel(program, "Mad", NULL);
+	}
+
+	// three arrays of 64 MB, less if the device cannot hold them easily
+	cl_ulong maxAlloc = 0, globalMem = 0;
+	cl_uint computeUnits = 1;
+	clGetDeviceInfo(Device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAlloc, NULL);
+	clGetDeviceInfo(Device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMem, NULL);
+	clGetDeviceInfo(Device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+	size_t bytes = (size_t)min<cl_ulong>(min<cl_ulong>(64 << 20, maxAlloc), globalMem / 8) & ~(size_t)0xFFFF;
+
+	if (clError == CL_SUCCESS && copy && triad && mad && bytes > 0)
+	{
+		cl_int clError2;
+		a = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &clError2);
+		clError = clError2;
+		b = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &clError2);
+		clError |= clError2;
+		c = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &clError2);
+		clError |= clError2;
+	}
+
+	if (clError == CL_SUCCESS && a && b && c)
+	{
+		// touch the arrays once, some drivers allocate them lazily
+		cl_float zero = 0.0f, scale = 0.999f;
+		clEnqueueFillBuffer(queue, b, &zero, sizeof(zero), 0, bytes, 0, NULL, NULL);
+		clEnqueueFillBuffer(queue, c, &zero, sizeof(zero), 0, bytes, 0, NULL, NULL);
+		clFinish(queue);
+
+		size_t n = bytes / sizeof(cl_float4);
+		clSetKernelArg(copy, 0, sizeof(cl_mem), &a);
+		clSetKernelArg(copy, 1, sizeof(cl_mem), &b);
+		double copyMs = MinKernelTime(queue, copy, n, 10);
+
+		clSetKernelArg(triad, 0, sizeof(cl_mem), &a);
+		clSetKernelArg(triad, 1, sizeof(cl_mem), &b);
+		clSetKernelArg(triad, 2, sizeof(cl_mem), &c);
+		clSetKernelArg(triad, 3, sizeof(cl_float), &scale);
+		double triadMs = MinKernelTime(queue, triad, n, 10);
+
+		// bytes per millisecond to GB/s
+		if (copyMs > 0.0)
+			peak.GBPerSecond = 2.0 * bytes / copyMs * 1.0e-6;
+		if (triadMs > 0.0)
+			peak.GBPerSecond = max(peak.GBPerSecond, 3.0 * bytes / triadMs * 1.0e-6);
+
+		// enough work-items to fill every compute unit many times over, one float result each
+		size_t items = min<size_t>((size_t)computeUnits * 16384, bytes / sizeof(cl_float));
+		clSetKernelArg(mad, 0, sizeof(cl_mem), &a);
+		clSetKernelArg(mad, 1, sizeof(cl_float), &scale);
+		double madMs = MinKernelTime(queue, mad, items, 10);
+		if (madMs > 0.0)
+			peak.GFlopsPerSecond = (double)items * PROBE_MAD_OPS_PER_ITEM / madMs * 1.0e-6;
+	}
+
+	SAFE_RELEASE_MEMOBJECT(a);
+	SAFE_RELEASE_MEMOBJECT(b);
+	SAFE_RELEASE_MEMOBJECT(c);
+	SAFE_RELEASE_KERNEL(copy);
+	SAFE_RELEASE_KERNEL(triad);
+	SAFE_RELEASE_KERNEL(mad);
+	SAFE_RELEASE_PROGRAM(program);
+	if (queue)
+		clReleaseCommandQueue(queue);
+	clReleaseContext(context);
+
+	if (peak.GBPerSecond == 0.0 || peak.GFlopsPerSecond == 0.0)
+		cerr << "Warning: the roofline probes failed, some peaks are unknown." << endl;
+	return peak;
+}
+
+void CRoofline::Report(cl_command_queue CommandQueue, const string& Name, const KernelCost& Cost, double Count, double Ms)
+{
+	if (!IsEnabled() || Ms <= 0.0)
+		return;
+
+	cl_device_id device = nullptr;
+	clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+	const Peak& peak = GetPeak(device);
+
+	double bytes = (Cost.BytesRead + Cost.BytesWritten) * Count;
+	double ops = Cost.Ops * Count;
+	double gbPerSecond = bytes / Ms * 1.0e-6;
+	double gflopsPerSecond = ops / Ms * 1.0e-6;
+
+	ostringstream line;
+	line << fixed << setprecision(1) << "  roofline " << Name << ": " << gbPerSecond << " GB/s";
+	if (peak.GBPerSecond > 0.0)
+		line << " (" << 100.0 * gbPerSecond / peak.GBPerSecond << "% of " << peak.GBPerSecond << ")";
+	line << ", " << gflopsPerSecond << " GFLOP/s";
+	if (peak.GFlopsPerSecond > 0.0)
+		line << " (" << 100.0 * gflopsPerSecond / peak.GFlopsPerSecond << "% of " << peak.GFlopsPerSecond << ")";
+
+	if (bytes > 0.0 && peak.GBPerSecond > 0.0 && peak.GFlopsPerSecond > 0.0)
+	{
+		// left of the ridge point the bandwidth is the roof, right of it the throughput
+		double intensity = ops / bytes;
+		double ridge = peak.GFlopsPerSecond / peak.GBPerSecond;
+		bool memoryBound = intensity < ridge;
+		double roof = memoryBound ? gbPerSecond / peak.GBPerSecond : gflopsPerSecond / peak.GFlopsPerSecond;
+		line << setprecision(2) << ", " << intensity << " FLOP/B, " << (memoryBound ? "memory" : "compute") << "-bound (ridge "
+			<< ridge << " FLOP/B), " << setprecision(0) << 100.0 * roof << "% of the roof";
+	}
+	cout << line.str() << endl;
+}
+
+void CRoofline::ReportKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions, const size_t* pGlobalWorkSize, double Ms)
+{
+	if (!IsEnabled())
+		return;
+
+	string name = GetKernelName(Kernel);
+	DeclaredCost declared;
+	{
+		lock_guard<mutex> lock(s_CostMutex);
+		map<cl_kernel, DeclaredCost>::const_iterator it = s_KernelCosts.find(Kernel);
+		if (it == s_KernelCosts.end() || it->second.Name != name)
+			return;
+		declared = it->second;
+	}
+
+	// the padding of the global work size does no work
+	double count = 1.0;
+	for (cl_uint d = 0; d < Dimensions; d++)
+		count *= (double)pGlobalWorkSize[d];
+	if (declared.Items > 0.0)
+		count = min(count, declared.Items);
+	Report(CommandQueue, name, declared.Cost, count, Ms);
+}
@@ -0,0 +1,94 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CROOFLINE_H
+#define _CROOFLINE_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <string>
+
+//! Roofline model of a device, puts the measured time of a kernel in relation to the hardware limits
+/*!
+	Tasks declare the cost of a kernel per work-item with SetKernelCost() right
+	after creating it. CLUtil::ProfileKernel() then reports the achieved GB/s and
+	GFLOP/s of the declared kernels next to the peaks of the device, and whether
+	the kernel is memory- or compute-bound: its arithmetic intensity (FLOP per
+	byte) lies left or right of the ridge point peak GFLOP/s / peak GB/s.
+	Kernels that are timed on the host, across several launches, call Report()
+	with the cost per element instead.
+
+	The peaks are measured once per device by probe kernels: the best of a
+	STREAM copy and triad for the bandwidth, independent chains of mad() for
+	the throughput. CAssignmentBase::InitCLContext() runs them with Prepare(),
+	so that they do not end up in the time of the first task.
+	GPUC_ROOFLINE=0 disables the reports and the probes.
+*/
+class CRoofline
+{
+public:
+	//! Global memory traffic and arithmetic operations of one work-item (or element)
+	struct KernelCost
+	{
+		double		BytesRead;
+		double		BytesWritten;
+		double		Ops;
+	};
+
+	//! Measured limits of a device, 0 if a probe failed
+	struct Peak
+	{
+		double		GBPerSecond;
+		double		GFlopsPerSecond;
+	};
+
+	//! Declares the cost per work-item of a kernel, e.g. {8, 4, 1} for adding two int arrays
+	/*!
+		Items is the number of work-items of a launch that do work, e.g. the array
+		size when the global work size is rounded up to the local work size.
+		0 counts every work-item of the global work size.
+	*/
+	static void SetKernelCost(cl_kernel Kernel, const KernelCost& Cost, double Items = 0.0);
+
+	//! The peaks of a device, the probes run on the first call
+	static const Peak& GetPeak(cl_device_id Device);
+
+	//! Runs the probes of a device ahead of the first report, unless the reports are disabled
+	static void Prepare(cl_device_id Device);
+
+	//! Prints the roofline figures of Count work-items (or elements) of the given cost that took Ms milliseconds
+	static void Report(cl_command_queue CommandQueue, const std::string& Name, const KernelCost& Cost, double Count, double Ms);
+
+	//! Report() with the declared cost and items (at most the global work size), does nothing for undeclared kernels
+	static void ReportKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions, const size_t* pGlobalWorkSize, double Ms);
+
+	static bool IsEnabled();
+
+protected:
+	static Peak MeasurePeak(cl_device_id Device);
+};
+
+#endif // _CROOFLINE_H
@@ -0,0 +1,110 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CTHREAD_POOL_H
+#define _CTHREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Work-stealing thread pool for the CPU implementations of the tasks
+/*!
+	Every worker owns a job queue. It takes its own jobs from the back (the most
+	recently submitted, still warm in the cache) and steals from the front of
+	the other queues when its own is empty. The thread calling ParallelFor()
+	helps with the jobs until its loop is done, so ParallelFor() can be nested.
+
+	GetInstance() creates GPUC_CPU_THREADS threads (default: all hardware threads),
+	counting the calling thread. With GPUC_CPU_THREADS=1 everything runs serially
+	on the calling thread, which gives the scalar reference timings.
+*/
+class CThreadPool
+{
+public:
+	typedef std::function<void()> Job;
+
+	static CThreadPool& GetInstance();
+
+	//! NThreads includes the calling thread, NThreads - 1 workers are started
+	explicit CThreadPool(unsigned int NThreads);
+
+	~CThreadPool();
+
+	unsigned int GetNumThreads() const { return (unsigned int)m_Workers.size() + 1; }
+
+	//! Runs a job on one of the workers (or right away, if there are none)
+	void Submit(const Job& NewJob);
+
+	//! Calls Body(ChunkBegin, ChunkEnd) for chunks of Grain elements of [Begin, End) and waits for all of them
+	/*!
+		Grain = 0 picks a grain that yields a few chunks per thread.
+	*/
+	void ParallelFor(size_t Begin, size_t End, size_t Grain, const std::function<void(size_t, size_t)>& Body);
+
+	//! Combines the results of Map(ChunkBegin, ChunkEnd) of all chunks, in the order of the chunks
+	template<typename T, typename MapFunc, typename CombineFunc>
+	T ParallelReduce(size_t Begin, size_t End, size_t Grain, const T& Identity, MapFunc Map, CombineFunc Combine)
+	{
+		if (End <= Begin)
+			return Identity;
+		if (Grain == 0)
+			Grain = GetDefaultGrain(End - Begin);
+
+		std::vector<T> partials((End - Begin + Grain - 1) / Grain, Identity);
+		ParallelFor(Begin, End, Grain, [&](size_t ChunkBegin, size_t ChunkEnd) {
+			partials[(ChunkBegin - Begin) / Grain] = Map(ChunkBegin, ChunkEnd);
+		});
+
+		T result = Identity;
+		for (size_t i = 0; i < partials.size(); i++)
+			result = Combine(result, partials[i]);
+		return result;
+	}
+
+	size_t GetDefaultGrain(size_t NElements) const;
+
+protected:
+	struct WorkQueue
+	{
+		std::mutex			Mutex;
+		std::deque<Job>		Jobs;
+	};
+
+	void WorkerLoop(int Index);
+
+	//! Runs one job, preferably from the queue of the given worker (-1: any queue)
+	bool TryRunOne(int Preferred);
+
+	std::vector<std::unique_ptr<WorkQueue> >	m_Queues;
+	std::vector<std::thread>				m_Workers;
+
+	std::mutex								m_SleepMutex;
+	std::condition_variable					m_WakeUp;
+	std::atomic<size_t>						m_NPending;
+	std::atomic<unsigned int>				m_NextQueue;
+	bool									m_Stop;
+};
+
+#endif // _CTHREAD_POOL_H
@@ -0,0 +1,151 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CTRACE_RECORDER_H
+#define _CTRACE_RECORDER_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include "CommonDefs.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Collects timed events from any thread and exports them in the Chrome trace format
+/*!
+	The resulting JSON file can be opened in chrome://tracing or ui.perfetto.dev.
+
+	Recording is off by default. It is switched on by setting the environment
+	variable GPUC_TRACE to the output path, or by calling Enable().
+	The trace is written by Flush(), CAssignmentBase does this on destruction.
+
+	Host events use a monotonic clock. Device events are taken from the
+	profiling info of an OpenCL event and are shown on one track per command
+	queue. Each device has its own clock, which is aligned to the host clock
+	when the trace is written: a command was queued no earlier than the host
+	time it was enqueued at (if the caller passes it to AddDeviceEvent()) and
+	ended no later than the host time it was added at. The tightest of these
+	bounds over all events of the device is used.
+*/
+class CTraceRecorder
+{
+public:
+	static CTraceRecorder& GetInstance();
+
+	void Enable(const std::string& OutputPath);
+
+	bool IsEnabled() const { return m_Enabled; }
+
+	//! Current time of the monotonic host clock in microseconds
+	static double GetTimeMicroseconds();
+
+	//! Records a host event that ran on the calling thread
+	void AddHostEvent(const std::string& Name, const std::string& Category, double StartUs, double DurationUs, int Depth);
+
+	//! Records the execution of a completed OpenCL command (requires a profiling-enabled queue)
+	/*!
+		EnqueueUs is the host time (GetTimeMicroseconds()) taken right before the
+		command was enqueued, or negative if it is not known.
+	*/
+	void AddDeviceEvent(const std::string& Name, cl_event Event, double EnqueueUs = -1.0);
+
+	//! Writes all recorded events to the output path. Returns false if the file could not be written.
+	bool Flush();
+
+protected:
+	CTraceRecorder();
+
+	struct TraceEvent
+	{
+		std::string		Name;
+		std::string		Category;
+		double			StartUs;
+		double			DurationUs;
+		int				ThreadId;
+		int				Depth;
+		//! StartUs is on the clock of this device, NULL for host events
+		cl_device_id	Device;
+	};
+
+	//! Offset from a device clock to the host clock, bounded by the events of the device
+	struct DeviceClock
+	{
+		//! lower bound from the enqueue times, valid if HasMinOffset
+		double		MinOffsetUs;
+		//! upper bound from the completion of the events
+		double		MaxOffsetUs;
+		bool		HasMinOffset;
+
+		double GetOffsetUs() const;
+	};
+
+	int GetThreadId();
+
+	//! Track of a command queue on the device process
+	int GetQueueId(cl_command_queue Queue, cl_device_id Device);
+
+	std::mutex							m_Mutex;
+	//! read without the mutex by the recording functions of every thread
+	std::atomic<bool>					m_Enabled;
+	std::string							m_OutputPath;
+	std::vector<TraceEvent>				m_Events;
+	std::map<std::thread::id, int>		m_ThreadIds;
+
+	std::map<cl_command_queue, int>		m_QueueIds;
+	std::vector<std::string>			m_QueueNames;
+	std::map<cl_device_id, DeviceClock>	m_DeviceClocks;
+};
+
+//! Records the lifetime of a scope as a trace event
+/*!
+	Scopes nest per thread, e.g.
+
+		{
+			CScopeTimer timer("ComputeGPU");
+			...
+		}
+
+	Does nothing if the trace recorder is disabled.
+*/
+class CScopeTimer
+{
+public:
+	CScopeTimer(const std::string& Name, const std::string& Category = "host");
+
+	~CScopeTimer();
+
+protected:
+	std::string		m_Name;
+	std::string		m_Category;
+	double			m_StartUs;
+	bool			m_Active;
+};
+
+#endif // _CTRACE_RECORDER_H
@@ -0,0 +1,147 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CTransferPipeline.h"
+
+#include "CLUtil.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CTransferPipeline
+
+CTransferPipeline::CTransferPipeline()
+	: m_ComputeQueue(NULL), m_UploadQueue(NULL), m_DownloadQueue(NULL)
+{
+}
+
+CTransferPipeline::~CTransferPipeline()
+{
+	Release();
+}
+
+bool CTransferPipeline::Init(cl_command_queue ComputeQueue)
+{
+	Release();
+
+	cl_context context;
+	cl_device_id device;
+	cl_command_queue_properties properties = 0;
+	V_RETURN_FALSE_CL(clGetCommandQueueInfo(ComputeQueue, CL_QUEUE_CONTEXT, sizeof(cl_context), &context, NULL), "Failed to query the queue context.");
+	V_RETURN_FALSE_CL(clGetCommandQueueInfo(ComputeQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL), "Failed to query the queue device.");
+	V_RETURN_FALSE_CL(clGetCommandQueueInfo(ComputeQueue, CL_QUEUE_PROPERTIES, sizeof(properties), &properties, NULL), "Failed to query the queue properties.");
+
+	clRetainCommandQueue(ComputeQueue);
+	m_ComputeQueue = ComputeQueue;
+
+	if (properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+	{
+		// the events already allow all stages to run concurrently
+		clRetainCommandQueue(ComputeQueue);
+		clRetainCommandQueue(ComputeQueue);
+		m_UploadQueue = m_DownloadQueue = ComputeQueue;
+		return true;
+	}
+
+	// separate in-order queues, so that the driver can use its copy engines
+	cl_int clError;
+	m_UploadQueue = clCreateCommandQueue(context, device, properties, &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create the upload queue.");
+	m_DownloadQueue = clCreateCommandQueue(context, device, properties, &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create the download queue.");
+
+	return true;
+}
+
+void CTransferPipeline::Release()
+{
+	if (m_DownloadQueue)
+	{
+		clReleaseCommandQueue(m_DownloadQueue);
+		m_DownloadQueue = NULL;
+	}
+	if (m_UploadQueue)
+	{
+		clReleaseCommandQueue(m_UploadQueue);
+		m_UploadQueue = NULL;
+	}
+	if (m_ComputeQueue)
+	{
+		clReleaseCommandQueue(m_ComputeQueue);
+		m_ComputeQueue = NULL;
+	}
+}
+
+void CTransferPipeline::ReleaseEvents(vector<cl_event>& Events)
+{
+	for (size_t i = 0; i < Events.size(); i++)
+	{
+		if (Events[i])
+			clReleaseEvent(Events[i]);
+	}
+	Events.clear();
+}
+
+bool CTransferPipeline::Run(size_t NElements, size_t ChunkElements, unsigned int NBuffers,
+	const Stage& Upload, const Stage& Compute, const Stage& Download)
+{
+	if (!m_ComputeQueue)
+	{
+		cerr << "Error: the transfer pipeline is not initialized." << endl;
+		return false;
+	}
+	if (ChunkElements == 0)
+		ChunkElements = NElements;
+
+	size_t nChunks = (NElements + ChunkElements - 1) / ChunkElements;
+	vector<cl_event> uploaded(nChunks, (cl_event)NULL), computed(nChunks, (cl_event)NULL), downloaded(nChunks, (cl_event)NULL);
+
+	cl_int clError = CL_SUCCESS;
+	for (size_t i = 0; i < nChunks && clError == CL_SUCCESS; i++)
+	{
+		Chunk chunk;
+		chunk.Index = i;
+		chunk.Slot = NBuffers > 0 ? i % NBuffers : 0;
+		chunk.Offset = i * ChunkElements;
+		chunk.Count = min(ChunkElements, NElements - chunk.Offset);
+
+		// the kernel of the previous chunk in this slot has to be done with the input
+		bool reusesSlot = NBuffers > 0 && i >= NBuffers;
+		cl_uint nWait = reusesSlot ? 1 : 0;
+		clError = Upload(m_UploadQueue, chunk, nWait, reusesSlot ? &computed[i - NBuffers] : NULL, &uploaded[i]);
+		if (clError != CL_SUCCESS)
+			break;
+
+		// ... and its result has to be downloaded before we overwrite it
+		cl_event computeWait[2] = { uploaded[i], reusesSlot ? downloaded[i - NBuffers] : NULL };
+		clError = Compute(m_ComputeQueue, chunk, reusesSlot ? 2 : 1, computeWait, &computed[i]);
+		if (clError != CL_SUCCESS)
+			break;
+
+		clError = Download(m_DownloadQueue, chunk, 1, &computed[i], &downloaded[i]);
+
+		// start the copy engines early, the queues might otherwise batch the commands
+		clFlush(m_UploadQueue);
+		clFlush(m_ComputeQueue);
+		clFlush(m_DownloadQueue);
+	}
+
+	// wait for all enqueued work even if a stage failed, it might still use the host memory
+	clFinish(m_UploadQueue);
+	clFinish(m_ComputeQueue);
+	clFinish(m_DownloadQueue);
+
+	ReleaseEvents(uploaded);
+	ReleaseEvents(computed);
+	ReleaseEvents(downloaded);
+
+	V_RETURN_FALSE_CL(clError, "Failed to enqueue a stage of the transfer pipeline.");
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
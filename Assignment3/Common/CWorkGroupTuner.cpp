@@ -0,0 +1,228 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CWorkGroupTuner.h"
+
+#include "CLUtil.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CWorkGroupTuner
+
+mutex CWorkGroupTuner::s_Mutex;
+bool CWorkGroupTuner::s_Loaded = false;
+map<string, vector<size_t> > CWorkGroupTuner::s_Entries;
+
+static string GetDeviceString(cl_device_id Device, cl_device_info Param)
+{
+	char buffer[1024] = "";
+	clGetDeviceInfo(Device, Param, sizeof(buffer), buffer, NULL);
+	return buffer;
+}
+
+string CWorkGroupTuner::GetKey(cl_device_id Device, cl_kernel Kernel, cl_uint Dimensions, const size_t* pProblemSize)
+{
+	char kernelName[256] = "";
+	clGetKernelInfo(Kernel, CL_KERNEL_FUNCTION_NAME, sizeof(kernelName), kernelName, NULL);
+
+	// tab separated, the device name may contain spaces
+	ostringstream key;
+	key << GetDeviceString(Device, CL_DEVICE_NAME) << " / " << GetDeviceString(Device, CL_DRIVER_VERSION) << "\t" << kernelName << "\t";
+	for (cl_uint d = 0; d < Dimensions; d++)
+	{
+		size_t bucket = 1;
+		while (bucket < pProblemSize[d])
+			bucket <<= 1;
+		key << (d > 0 ? "x" : "") << bucket;
+	}
+	return key.str();
+}
+
+string CWorkGroupTuner::GetDatabasePath()
+{
+	const char* env = getenv("GPUC_TUNING_DB");
+	return env != NULL ? env : "WorkGroupSizes.txt";
+}
+
+void CWorkGroupTuner::LoadDatabase()
+{
+	// s_Mutex is held by the caller
+	if (s_Loaded)
+		return;
+	s_Loaded = true;
+
+	// one entry per line: device, kernel, bucket, local work size, time (tab separated).
+	// Later lines override earlier ones.
+	ifstream file(GetDatabasePath().c_str());
+	string line;
+	while (getline(file, line))
+	{
+		vector<string> fields;
+		istringstream fieldStream(line);
+		string field;
+		while (getline(fieldStream, field, '\t'))
+			fields.push_back(field);
+		if (fields.size() < 4)
+			continue;
+
+		vector<size_t> localWorkSize(3, 1);
+		istringstream sizeStream(fields[3]);
+		for (int d = 0; d < 3 && (sizeStream >> localWorkSize[d]); d++)
+			;
+		s_Entries[fields[0] + "\t" + fields[1] + "\t" + fields[2]] = localWorkSize;
+	}
+}
+
+void CWorkGroupTuner::StoreEntry(const std::string& Key, const size_t LocalWorkSize[3], double TimeMs)
+{
+	// s_Mutex is held by the caller
+	s_Entries[Key] = vector<size_t>(LocalWorkSize, LocalWorkSize + 3);
+
+	ofstream file(GetDatabasePath().c_str(), ios::app);
+	if (!file.is_open())
+	{
+		cerr << "Failed to open tuning database '" << GetDatabasePath() << "'." << endl;
+		return;
+	}
+	file << Key << "\t" << LocalWorkSize[0] << " " << LocalWorkSize[1] << " " << LocalWorkSize[2] << "\t" << TimeMs << endl;
+}
+
+bool CWorkGroupTuner::FindLocalWorkSize(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions,
+	const size_t* pProblemSize, size_t LocalWorkSize[3])
+{
+	cl_device_id device;
+	if (clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL) != CL_SUCCESS)
+		return false;
+
+	string key = GetKey(device, Kernel, Dimensions, pProblemSize);
+
+	lock_guard<mutex> lock(s_Mutex);
+	LoadDatabase();
+	map<string, vector<size_t> >::const_iterator it = s_Entries.find(key);
+	if (it == s_Entries.end())
+		return false;
+
+	for (int d = 0; d < 3; d++)
+		LocalWorkSize[d] = it->second[d];
+	return true;
+}
+
+vector<vector<size_t> > CWorkGroupTuner::GetCandidates(cl_device_id Device, cl_kernel Kernel, cl_uint Dimensions,
+	size_t LocalMemPerWorkItem, size_t MinWorkItems)
+{
+	vector<vector<size_t> > candidates;
+
+	// a kernel compiled with reqd_work_group_size can only be launched with that size
+	size_t required[3] = { 0, 0, 0 };
+	clGetKernelWorkGroupInfo(Kernel, Device, CL_KERNEL_COMPILE_WORK_GROUP_SIZE, sizeof(required), required, NULL);
+	if (required[0] != 0)
+	{
+		candidates.push_back(vector<size_t>(required, required + 3));
+		return candidates;
+	}
+
+	size_t kernelMaxSize = 0;
+	cl_ulong kernelLocalMem = 0, deviceLocalMem = 0;
+	size_t deviceMaxSizes[3] = { 1, 1, 1 };
+	clGetKernelWorkGroupInfo(Kernel, Device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelMaxSize, NULL);
+	clGetKernelWorkGroupInfo(Kernel, Device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(cl_ulong), &kernelLocalMem, NULL);
+	clGetDeviceInfo(Device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &deviceLocalMem, NULL);
+	clGetDeviceInfo(Device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(deviceMaxSizes), deviceMaxSizes, NULL);
+
+	// enumerate all power-of-two sizes per dimension
+	size_t size[3] = { 1, 1, 1 };
+	for (size[0] = 1; size[0] <= deviceMaxSizes[0]; size[0] <<= 1)
+	{
+		for (size[1] = 1; size[1] <= (Dimensions > 1 ? deviceMaxSizes[1] : 1); size[1] <<= 1)
+		{
+			for (size[2] = 1; size[2] <= (Dimensions > 2 ? deviceMaxSizes[2] : 1); size[2] <<= 1)
+			{
+				size_t workItems = size[0] * size[1] * size[2];
+				if (workItems > kernelMaxSize || workItems < MinWorkItems)
+					continue;
+				if (kernelLocalMem + workItems * LocalMemPerWorkItem > deviceLocalMem)
+					continue;
+				candidates.push_back(vector<size_t>(size, size + 3));
+			}
+		}
+	}
+
+	return candidates;
+}
+
+bool CWorkGroupTuner::Tune(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions,
+	const size_t* pProblemSize, size_t LocalWorkSize[3],
+	int LocalMemArgIndex, size_t LocalMemPerWorkItem, int NIterations, size_t MinWorkItems)
+{
+	if (FindLocalWorkSize(CommandQueue, Kernel, Dimensions, pProblemSize, LocalWorkSize))
+	{
+		// the dynamic local buffer has to match the stored size
+		if (LocalMemArgIndex >= 0)
+			clSetKernelArg(Kernel, LocalMemArgIndex, LocalWorkSize[0] * LocalWorkSize[1] * LocalWorkSize[2] * LocalMemPerWorkItem, NULL);
+		return true;
+	}
+
+	cl_device_id device;
+	V_RETURN_FALSE_CL(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL), "Failed to query the device of the command queue.");
+
+	vector<vector<size_t> > candidates = GetCandidates(device, Kernel, Dimensions, LocalMemArgIndex >= 0 ? LocalMemPerWorkItem : 0, MinWorkItems);
+
+	double bestTime = -1.0;
+	size_t best[3] = { 0, 0, 0 };
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		const vector<size_t>& local = candidates[i];
+		size_t globalWorkSize[3] = { 1, 1, 1 };
+		for (cl_uint d = 0; d < Dimensions; d++)
+			globalWorkSize[d] = CLUtil::GetGlobalWorkSize(pProblemSize[d], local[d]);
+
+		if (LocalMemArgIndex >= 0 &&
+			clSetKernelArg(Kernel, LocalMemArgIndex, local[0] * local[1] * local[2] * LocalMemPerWorkItem, NULL) != CL_SUCCESS)
+			continue;
+
+		// one launch to warm up, and to skip sizes the driver rejects
+		if (clEnqueueNDRangeKernel(CommandQueue, Kernel, Dimensions, NULL, globalWorkSize, &local[0], 0, NULL, NULL) != CL_SUCCESS ||
+			clFinish(CommandQueue) != CL_SUCCESS)
+			continue;
+
+		// the roofline of the kernel is reported when it runs, not once per candidate
+		double time = CLUtil::ProfileKernel(CommandQueue, Kernel, Dimensions, globalWorkSize, &local[0], NIterations, false);
+		if (time > 0.0 && (bestTime < 0.0 || time < bestTime))
+		{
+			bestTime = time;
+			for (int d = 0; d < 3; d++)
+				best[d] = local[d];
+		}
+	}
+
+	if (bestTime < 0.0)
+	{
+		cerr << "Error: no valid local work size found while tuning." << endl;
+		return false;
+	}
+
+	for (int d = 0; d < 3; d++)
+		LocalWorkSize[d] = best[d];
+	if (LocalMemArgIndex >= 0)
+		clSetKernelArg(Kernel, LocalMemArgIndex, best[0] * best[1] * best[2] * LocalMemPerWorkItem, NULL);
+
+	cout << "Tuned local work size (" << best[0] << "," << best[1] << "," << best[2] << "): " << bestTime << " ms, "
+		<< candidates.size() << " candidates." << endl;
+
+	string key = GetKey(device, Kernel, Dimensions, pProblemSize);
+	lock_guard<mutex> lock(s_Mutex);
+	LoadDatabase();
+	StoreEntry(key, best, bestTime);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
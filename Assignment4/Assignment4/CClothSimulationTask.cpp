@@ -6,6 +6,7 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CClothSimulationTask.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CMemoryTracker.h"
 
 #ifdef min  // these macros are defined under windows, but collide with our math utility
 #undef min
@@ -44,6 +45,97 @@ bool CClothSimulationTask::InitResources(cl_device_id Device, cl_context Context
     cout << "Failed to create cloth." << endl;
     return false;
   }
+  if (!m_Headless && !InitGL()) return false;
+
+  /////////////////////////////////////////////////////////////
+  // OpenCL resources
+
+  cl_int clError, clError2;
+
+  CMemoryTracker& memory = CMemoryTracker::GetInstance();
+  CMemoryTracker::TaskScope memoryScope(GetName());
+
+  if (m_Headless) {
+    // same initial state as the GL vertex and normal buffer
+    vector<hlsl::float4> positions, normals;
+    m_pClothModel->GetVertexData(positions, normals);
+    m_clPosArray = memory.CreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, positions.size() * sizeof(hlsl::float4), positions.data(), &clError, "Cloth/Positions");
+    m_clNormalArray = memory.CreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, normals.size() * sizeof(hlsl::float4), normals.data(), &clError2, "Cloth/Normals");
+  } else {
+    m_clPosArray = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_pClothModel->GetVertexBuffer(), &clError);
+    m_clNormalArray = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_pClothModel->GetNormalBuffer(), &clError2);
+    memory.Track(m_clPosArray, "Cloth/Positions (GL)");
+    memory.Track(m_clNormalArray, "Cloth/Normals (GL)");
+  }
+  clError |= clError2;
+
+  m_clPosArrayAux = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(hlsl::float4), 0, &clError2, "Cloth/Positions aux");
+  clError |= clError2;
+  m_clPosArrayOld = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(hlsl::float4), 0, &clError2, "Cloth/Old positions");
+  clError |= clError2;
+
+
+  m_clSpringArray = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(cl_uint), 0, &clError2, "Cloth/Springs");
+  vector<cl_uint> initsprings(m_ClothResX * m_ClothResY, 0xFFFF);
+  clEnqueueWriteBuffer(CommandQueue, m_clSpringArray, CL_TRUE, 0, m_ClothResX * m_ClothResY * sizeof(cl_uint), initsprings.data(), 0, NULL, NULL);
+
+  clError |= clError2;
+  V_RETURN_FALSE_CL(clError, "Error allocating device arrays.");
+
+  string programCode;
+  CLUtil::LoadProgramSourceToMemory("clothsim.cl", programCode);
+  m_ClothSimProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+  if (m_ClothSimProgram == nullptr) return false;
+
+
+  m_IntegrateKernel = clCreateKernel(m_ClothSimProgram, "Integrate", &clError);
+  V_RETURN_FALSE_CL(clError, "Failed to create Integrate kernel.");
+  m_NormalKernel = clCreateKernel(m_ClothSimProgram, "ComputeNormals", &clError);
+  V_RETURN_FALSE_CL(clError, "Failed to create Normal kernel.");
+  m_ConstraintKernel = clCreateKernel(m_ClothSimProgram, "SatisfyConstraints", &clError);
+  V_RETURN_FALSE_CL(clError, "Failed to create Constraint kernel.");
+  m_CollisionsKernel = clCreateKernel(m_ClothSimProgram, "CheckCollisions", &clError);
+  V_RETURN_FALSE_CL(clError, "Failed to create Collision kernel.");
+
+  // Compute the rest distance between two particles.
+  // We scale the distance by 0.9 to get a nicer look for the cloth (more folds).
+  m_RestDistance = 1.f / ((float)m_ClothResX) * 0.9f;
+
+  ////////////////////////////////////////////////////////////////////////
+  // Specify the arguments for each kernel
+  clError = clSetKernelArg(m_IntegrateKernel, 0, sizeof(unsigned int), &m_ClothResX);
+  clError |= clSetKernelArg(m_IntegrateKernel, 1, sizeof(unsigned int), &m_ClothResY);
+  clError |= clSetKernelArg(m_IntegrateKernel, 2, sizeof(cl_mem), (void*)&m_clPosArray);
+  clError |= clSetKernelArg(m_IntegrateKernel, 3, sizeof(cl_mem), (void*)&m_clPosArrayOld);
+  V_RETURN_FALSE_CL(clError, "Failed to set integration kernel params");
+
+  clError = clSetKernelArg(m_ConstraintKernel, 0, sizeof(unsigned int), &m_ClothResX);
+  clError |= clSetKernelArg(m_ConstraintKernel, 1, sizeof(unsigned int), &m_ClothResY);
+  clError |= clSetKernelArg(m_ConstraintKernel, 2, sizeof(float), &m_RestDistance);
+  clError |= clSetKernelArg(m_ConstraintKernel, 3, sizeof(hlsl::float4), &m_SpherePos);
+  clError |= clSetKernelArg(m_ConstraintKernel, 4, sizeof(float), (void*)&m_SphereRadius);
+  clError |= clSetKernelArg(m_ConstraintKernel, 5, sizeof(cl_mem), (void*)&m_clSpringArray);
+  // The rest of parameters is set before kernel launch (ping-ponging)
+  V_RETURN_FALSE_CL(clError, "Failed to set constraint kernel params");
+
+  clError = clSetKernelArg(m_NormalKernel, 0, sizeof(unsigned int), &m_ClothResX);
+  clError |= clSetKernelArg(m_NormalKernel, 1, sizeof(unsigned int), &m_ClothResY);
+  clError |= clSetKernelArg(m_NormalKernel, 2, sizeof(cl_mem), (void*)&m_clPosArray);
+  clError |= clSetKernelArg(m_NormalKernel, 3, sizeof(cl_mem), (void*)&m_clNormalArray);
+  V_RETURN_FALSE_CL(clError, "Failed to set normal computation kernel params");
+
+  clError = clSetKernelArg(m_CollisionsKernel, 0, sizeof(unsigned int), &m_ClothResX);
+  clError |= clSetKernelArg(m_CollisionsKernel, 1, sizeof(unsigned int), &m_ClothResY);
+  clError |= clSetKernelArg(m_CollisionsKernel, 2, sizeof(cl_mem), (void*)&m_clPosArray);
+  clError |= clSetKernelArg(m_CollisionsKernel, 3, sizeof(hlsl::float4), &m_SpherePos);
+  clError |= clSetKernelArg(m_CollisionsKernel, 4, sizeof(float), (void*)&m_SphereRadius);
+  // Dynamic sphere parameters are updated before kernel launch
+  V_RETURN_FALSE_CL(clError, "Failed to set collision kernel params");
+
+  return true;
+}
+
+bool CClothSimulationTask::InitGL() {
   if (!m_pClothModel->CreateGLResources()) {
     cout << "Failed to create cloth OpenGL resources" << endl;
     return false;
@@ -112,78 +204,6 @@ bool CClothSimulationTask::InitResources(cl_device_id Device, cl_context Context
   glRotatef(m_RotateY, 0.0, 1.0, 0.0);
   glRotatef(m_RotateX, 1.0, 0.0, 0.0);
 
-  /////////////////////////////////////////////////////////////
-  // OpenCL resources
-
-  cl_int clError, clError2;
-
-  m_clPosArray = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_pClothModel->GetVertexBuffer(), &clError);
-  m_clNormalArray = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_pClothModel->GetNormalBuffer(), &clError2);
-  clError |= clError2;
-
-  m_clPosArrayAux = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(hlsl::float4), 0, &clError2);
-  clError |= clError2;
-  m_clPosArrayOld = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(hlsl::float4), 0, &clError2);
-  clError |= clError2;
-
-
-  m_clSpringArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(cl_uint), 0, &clError2);
-  vector<cl_uint> initsprings(m_ClothResX * m_ClothResY, 0xFFFF);
-  clEnqueueWriteBuffer(CommandQueue, m_clSpringArray, CL_TRUE, 0, m_ClothResX * m_ClothResY * sizeof(cl_uint), initsprings.data(), 0, NULL, NULL);
-
-  clError |= clError2;
-  V_RETURN_FALSE_CL(clError, "Error allocating device arrays.");
-
-  string programCode;
-  CLUtil::LoadProgramSourceToMemory("clothsim.cl", programCode);
-  m_ClothSimProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
-  if (m_ClothSimProgram == nullptr) return false;
-
-
-  m_IntegrateKernel = clCreateKernel(m_ClothSimProgram, "Integrate", &clError);
-  V_RETURN_FALSE_CL(clError, "Failed to create Integrate kernel.");
-  m_NormalKernel = clCreateKernel(m_ClothSimProgram, "ComputeNormals", &clError);
-  V_RETURN_FALSE_CL(clError, "Failed to create Normal kernel.");
-  m_ConstraintKernel = clCreateKernel(m_ClothSimProgram, "SatisfyConstraints", &clError);
-  V_RETURN_FALSE_CL(clError, "Failed to create Constraint kernel.");
-  m_CollisionsKernel = clCreateKernel(m_ClothSimProgram, "CheckCollisions", &clError);
-  V_RETURN_FALSE_CL(clError, "Failed to create Collision kernel.");
-
-  // Compute the rest distance between two particles.
-  // We scale the distance by 0.9 to get a nicer look for the cloth (more folds).
-  float restDistance = 1.f / ((float)m_ClothResX) * 0.9f;
-
-  ////////////////////////////////////////////////////////////////////////
-  // Specify the arguments for each kernel
-  clError = clSetKernelArg(m_IntegrateKernel, 0, sizeof(unsigned int), &m_ClothResX);
-  clError |= clSetKernelArg(m_IntegrateKernel, 1, sizeof(unsigned int), &m_ClothResY);
-  clError |= clSetKernelArg(m_IntegrateKernel, 2, sizeof(cl_mem), (void*)&m_clPosArray);
-  clError |= clSetKernelArg(m_IntegrateKernel, 3, sizeof(cl_mem), (void*)&m_clPosArrayOld);
-  V_RETURN_FALSE_CL(clError, "Failed to set integration kernel params");
-
-  clError = clSetKernelArg(m_ConstraintKernel, 0, sizeof(unsigned int), &m_ClothResX);
-  clError |= clSetKernelArg(m_ConstraintKernel, 1, sizeof(unsigned int), &m_ClothResY);
-  clError |= clSetKernelArg(m_ConstraintKernel, 2, sizeof(float), &restDistance);
-  clError |= clSetKernelArg(m_ConstraintKernel, 3, sizeof(hlsl::float4), &m_SpherePos);
-  clError |= clSetKernelArg(m_ConstraintKernel, 4, sizeof(float), (void*)&m_SphereRadius);
-  clError |= clSetKernelArg(m_ConstraintKernel, 5, sizeof(cl_mem), (void*)&m_clSpringArray);
-  // The rest of parameters is set before kernel launch (ping-ponging)
-  V_RETURN_FALSE_CL(clError, "Failed to set constraint kernel params");
-
-  clError = clSetKernelArg(m_NormalKernel, 0, sizeof(unsigned int), &m_ClothResX);
-  clError |= clSetKernelArg(m_NormalKernel, 1, sizeof(unsigned int), &m_ClothResY);
-  clError |= clSetKernelArg(m_NormalKernel, 2, sizeof(cl_mem), (void*)&m_clPosArray);
-  clError |= clSetKernelArg(m_NormalKernel, 3, sizeof(cl_mem), (void*)&m_clNormalArray);
-  V_RETURN_FALSE_CL(clError, "Failed to set normal computation kernel params");
-
-  clError = clSetKernelArg(m_CollisionsKernel, 0, sizeof(unsigned int), &m_ClothResX);
-  clError |= clSetKernelArg(m_CollisionsKernel, 1, sizeof(unsigned int), &m_ClothResY);
-  clError |= clSetKernelArg(m_CollisionsKernel, 2, sizeof(cl_mem), (void*)&m_clPosArray);
-  clError |= clSetKernelArg(m_CollisionsKernel, 3, sizeof(hlsl::float4), &m_SpherePos);
-  clError |= clSetKernelArg(m_CollisionsKernel, 4, sizeof(float), (void*)&m_SphereRadius);
-  // Dynamic sphere parameters are updated before kernel launch
-  V_RETURN_FALSE_CL(clError, "Failed to set collision kernel params");
-
   return true;
 }
 
@@ -211,6 +231,7 @@ void CClothSimulationTask::ReleaseResources() {
 
   SAFE_RELEASE_KERNEL(m_IntegrateKernel);
   SAFE_RELEASE_KERNEL(m_NormalKernel);
+  m_ConstraintLaunches.Release();
   SAFE_RELEASE_KERNEL(m_ConstraintKernel);
   SAFE_RELEASE_KERNEL(m_CollisionsKernel);
 
@@ -233,9 +254,12 @@ void CClothSimulationTask::ComputeGPU(cl_context, cl_command_queue CommandQueue,
   globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_ClothResX, LocalWorkSize[0]);
   globalWorkSize[1] = CLUtil::GetGlobalWorkSize(m_ClothResY, LocalWorkSize[1]);
 
-  glFinish();
-  V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosArray, 0, NULL, NULL), "Error acquiring OpenGL vertex buffer.");
-  V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clNormalArray, 0, NULL, NULL), "Error acquiring OpenGL normal buffer.");
+  if (!m_Headless) {
+    glFinish();
+    V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosArray, 0, NULL, NULL), "Error acquiring OpenGL vertex buffer.");
+    V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clNormalArray, 0, NULL, NULL), "Error acquiring OpenGL normal buffer.");
+  }
+  BeginStages(CommandQueue);
 
   clErr = clSetKernelArg(m_IntegrateKernel, 0, sizeof(unsigned int), &m_ClothResX);
   clErr |= clSetKernelArg(m_IntegrateKernel, 1, sizeof(unsigned int), &m_ClothResY);
@@ -249,31 +273,48 @@ void CClothSimulationTask::ComputeGPU(cl_context, cl_command_queue CommandQueue,
 
   clErr = clEnqueueNDRangeKernel(CommandQueue, m_IntegrateKernel, 2, NULL, globalWorkSize, LocalWorkSize, 0, NULL, NULL);
   V_RETURN_CL(clErr, "Error executing m_IntegrateKernel!");
+  EndStage(CommandQueue, "Integrate");
 
 
   clErr = clEnqueueNDRangeKernel(CommandQueue, m_CollisionsKernel, 2, NULL, globalWorkSize, LocalWorkSize, 0, NULL, NULL);
   V_RETURN_CL(clErr, "Error executing m_CollisionsKernel!");
-
-  for (unsigned int i = 0; i < 2.0 * m_ClothResX; i++) {
-    clErr = clSetKernelArg(m_ConstraintKernel, 6, sizeof(cl_mem), (void*)&m_clPosArrayAux);
-    clErr |= clSetKernelArg(m_ConstraintKernel, 7, sizeof(cl_mem), (void*)&m_clPosArray);
-    V_RETURN_CL(clErr, "Failed to set constraint kernel params");
-
-    clErr = clEnqueueNDRangeKernel(CommandQueue, m_ConstraintKernel, 2, NULL, globalWorkSize, LocalWorkSize, 0, NULL, NULL);
-    V_RETURN_CL(clErr, "Error executing m_ConstraintKernel!");
-
-    // After this corrected positions are in PosArray agin...
-    swap(m_clPosArrayAux, m_clPosArray);
+  EndStage(CommandQueue, "CheckCollisions");
+
+  // The iterations only differ in the ping-pong buffers. After an even number of them the
+  // positions are back in m_clPosArray, so they are recorded once and replayed every frame.
+  if (!m_ConstraintLaunches.IsRecorded(CommandQueue) || m_ConstraintLocalSize[0] != LocalWorkSize[0] ||
+      m_ConstraintLocalSize[1] != LocalWorkSize[1]) {
+    m_ConstraintLaunches.Begin(CommandQueue);
+    for (unsigned int i = 0; i < 2.0 * m_ClothResX; i++) {
+      // the same arguments as set in InitResources(), plus the ping-pong buffers
+      clErr = m_ConstraintLaunches.Launch(CommandQueue, m_ConstraintKernel, 2, globalWorkSize, LocalWorkSize,
+                                          {m_ClothResX, m_ClothResY, m_RestDistance, m_SpherePos, m_SphereRadius, m_clSpringArray,
+                                           m_clPosArrayAux, m_clPosArray});
+      V_RETURN_CL(clErr, "Failed to record m_ConstraintKernel!");
+
+      // After this corrected positions are in PosArray agin...
+      swap(m_clPosArrayAux, m_clPosArray);
+    }
+    m_ConstraintLaunches.End();
+    m_ConstraintLocalSize[0] = LocalWorkSize[0];
+    m_ConstraintLocalSize[1] = LocalWorkSize[1];
   }
 
+  clErr = m_ConstraintLaunches.Replay();
+  V_RETURN_CL(clErr, "Error executing m_ConstraintKernel!");
+  EndStage(CommandQueue, "SatisfyConstraints");
+
 
   // compute correct normals
   clErr = clEnqueueNDRangeKernel(CommandQueue, m_NormalKernel, 2, 0, globalWorkSize, LocalWorkSize, 0, 0, 0);
   V_RETURN_CL(clErr, "Error executing normal computation kernel");
+  EndStage(CommandQueue, "ComputeNormals");
 
 
-  V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosArray, 0, NULL, NULL), "Error releasing OpenGL vertex buffer.");
-  V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clNormalArray, 0, NULL, NULL), "Error releasing OpenGL normal buffer.");
+  if (!m_Headless) {
+    V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosArray, 0, NULL, NULL), "Error releasing OpenGL vertex buffer.");
+    V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clNormalArray, 0, NULL, NULL), "Error releasing OpenGL normal buffer.");
+  }
 
   clFinish(CommandQueue);
   m_FrameCounter++;
@@ -383,15 +424,18 @@ void CClothSimulationTask::OnMouseMove(int X, int Y) {
 }
 
 void CClothSimulationTask::OnIdle(double, float ElapsedTime) {
+  m_ElapsedTime += ElapsedTime;
+  m_simulationTime += ElapsedTime;
+
+  // no camera without a window
+  if (m_Headless) return;
+
   // move camera?
   if (m_KeyboardMask[GLFW_KEY_W]) m_TranslateZ += 0.5f * ElapsedTime;
   if (m_KeyboardMask[GLFW_KEY_S]) m_TranslateZ -= 0.5f * ElapsedTime;
 
   if (m_TranslateZ > 0) m_TranslateZ = 0;
 
-  m_ElapsedTime += ElapsedTime;
-  m_simulationTime += ElapsedTime;
-
   // set the modelview matrix
   glMatrixMode(GL_MODELVIEW);
   glLoadIdentity();
@@ -20,6 +20,7 @@
 #ifndef _CCLOTH_SIMULATION_TASK_H
 #define _CCLOTH_SIMULATION_TASK_H
 
+#include "../Common/CLaunchRecording.h"
 #include "../Common/IGUIEnabledComputeTask.h"
 
 #include "CTriMesh.h"
@@ -49,6 +50,8 @@ public:
 	virtual void ComputeCPU() {};
 	virtual bool ValidateResults() {return false;};
 
+	virtual std::string GetName() const { return "CClothSimulationTask"; }
+
 	// IGUIEnabledComputeTask
 	virtual void Render();
 
@@ -63,6 +66,9 @@ public:
 	virtual void OnWindowResized(int Width, int Height);
 
 protected:
+	//! Loads the texture and the environment and creates the shaders, all only needed for rendering
+	bool InitGL();
+
 	unsigned int			m_ClothResX = 0;
 	unsigned int			m_ClothResY = 0;
 	unsigned int			m_FrameCounter = 0;
@@ -98,6 +104,11 @@ protected:
 	cl_kernel				m_ConstraintKernel = nullptr;
 	cl_kernel				m_CollisionsKernel = nullptr;
 
+	//! The 2 * ClothResX constraint launches, recorded for a work-group size and replayed every frame
+	CLaunchRecording		m_ConstraintLaunches;
+	size_t					m_ConstraintLocalSize[2] = {0, 0};
+	float					m_RestDistance = 0.0f;
+
 	float					m_ElapsedTime = 0.0f;
 	float					m_PrevElapsedTime = 0.0f;
 	float					m_simulationTime = 0.0f;
@@ -5,7 +5,10 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CParticleSystemTask.h"
 
+#include "../Common/CCounterRNG.h"
 #include "../Common/CLUtil.h"
+#include "../Common/CMemoryTracker.h"
+#include "../Common/CProgramBuilder.h"
 
 #ifdef min // these macros are defined under windows, but collide with our math utility
 #	undef min
@@ -52,6 +55,15 @@ CParticleSystemTask::CParticleSystemTask(
 
 	for(unsigned int i = 0; i < 3; i++)
 		m_LocalWorkSize[i] = LocalWorkSize[i];
+
+	for(unsigned int i = 0; i < 2; i++)
+	{
+		m_clPosLife[i] = nullptr;
+		m_clVelMass[i] = nullptr;
+		m_glPosLife[i] = 0;
+		m_glVelMass[i] = 0;
+		m_glTexVelMass[i] = 0;
+	}
 	
 	// compute the number of levels that we need for the work-efficient algorithm
 	m_nLevels = 1;
@@ -80,6 +92,18 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context,
 {
   (void) CommandQueue;
 
+	// the allocations below are accounted to this task, see CMemoryTracker::PrintStatistics()
+	CMemoryTracker& memory = CMemoryTracker::GetInstance();
+	CMemoryTracker::TaskScope memoryScope(GetName());
+
+	// Both programs build while the mesh and the buffers are set up
+	CProgramBuilder builder;
+	string programCode;
+	CLUtil::LoadProgramSourceToMemory("ParticleSystem.cl", programCode);
+	const size_t pSystemBuild = builder.Add(Device, Context, programCode);
+	CLUtil::LoadProgramSourceToMemory("Scan.cl", programCode);
+	const size_t scanBuild = builder.Add(Device, Context, programCode);
+
 	//Load mesh
 	float4x4 M = float4x4(	1.f, 0.f, 0.f, 0.f,
 							0.f, 1.f, 0.f, 0.f,
@@ -94,7 +118,7 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context,
 		cout<<"Failed to load mesh."<<endl;
 		return false;
 	}
-	if(!m_pMesh->CreateGLResources())
+	if(!m_Headless && !m_pMesh->CreateGLResources())
 	{
 		cout<<"Failed to create mesh OpenGL resources"<<endl;
 		return false;
@@ -106,12 +130,13 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context,
 	memset(pPosLife, 0, sizeof(cl_float4) * m_nParticles * 2);
 	memset(pVelMass, 0, sizeof(cl_float4) * m_nParticles * 2);
 
-	//fill the array with some values
+	//fill the array with some values (reproducible, see GPUC_SEED)
+	CCounterRNG rng;
 	for(unsigned int i = 0; i < m_nParticles; i++) {
-		pPosLife[i].s[0] = (float(rand()) / float(RAND_MAX) * 0.5f + 0.25f);
-		pPosLife[i].s[1] = (float(rand()) / float(RAND_MAX) * 0.5f + 0.25f);
-		pPosLife[i].s[2] = (float(rand()) / float(RAND_MAX) * 0.5f + 0.25f);
-		pPosLife[i].s[3] = 1.f + 5.f * (float(rand()) / float(RAND_MAX));
+		pPosLife[i].s[0] = (rng.GetFloat(0, 4 * i) * 0.5f + 0.25f);
+		pPosLife[i].s[1] = (rng.GetFloat(0, 4 * i + 1) * 0.5f + 0.25f);
+		pPosLife[i].s[2] = (rng.GetFloat(0, 4 * i + 2) * 0.5f + 0.25f);
+		pPosLife[i].s[3] = 1.f + 5.f * rng.GetFloat(0, 4 * i + 3);
 
 		// if (i & 1)
 		// 	pPosLife[i].s[3] = 0.f;
@@ -119,85 +144,58 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context,
 		pVelMass[i].s[0] = 0.f;
 		pVelMass[i].s[1] = 0.f;
 		pVelMass[i].s[2] = 0.f;
-		pVelMass[i].s[3] = (1.f + float(rand()) / float(RAND_MAX)) * 1.5f;
+		pVelMass[i].s[3] = (1.f + rng.GetFloat(1, i)) * 1.5f;
 	}
 
-	// Device resources
-	glGenBuffers(2, m_glPosLife);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glPosLife[0]);
-	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pPosLife, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glPosLife[1]);
-	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pPosLife, GL_DYNAMIC_DRAW);
-    CHECK_FOR_OGL_ERROR();
-
-	glGenBuffers(2, m_glVelMass);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glVelMass[0]);
-	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pVelMass, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glVelMass[1]);
-	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pVelMass, GL_DYNAMIC_DRAW);
-    CHECK_FOR_OGL_ERROR();
-
-	//create a texture for the TBO
-	glGenTextures(2, m_glTexVelMass);
-
-	glBindTexture(GL_TEXTURE_BUFFER_EXT, m_glTexVelMass[0]);
-	glTexBufferEXT(GL_TEXTURE_BUFFER_EXT, GL_RGBA32F_ARB, m_glVelMass[0]);
-	glBindBuffer(GL_TEXTURE_BUFFER_EXT, 0);
-	glBindTexture(GL_TEXTURE_BUFFER_EXT, 0);
-    CHECK_FOR_OGL_ERROR();
-
-	glBindTexture(GL_TEXTURE_BUFFER_EXT, m_glTexVelMass[1]);
-	glTexBufferEXT(GL_TEXTURE_BUFFER_EXT, GL_RGBA32F_ARB, m_glVelMass[1]);
-	glBindBuffer(GL_TEXTURE_BUFFER_EXT, 0);
-	glBindTexture(GL_TEXTURE_BUFFER_EXT, 0);
-    CHECK_FOR_OGL_ERROR();
-
+	cl_int clError, clError2;
 
-	//scatter force field sampling points
-	float* pForceSamples = new float[NUM_FORCE_LINES * 2 * 4];
-	for(int i = 0; i < NUM_FORCE_LINES; i++)
+	// Particle arrrays
+	if(m_Headless)
 	{
-		pForceSamples[8 * i] = float(rand()) / float(RAND_MAX);
-		pForceSamples[8 * i + 1] = float(rand()) / float(RAND_MAX);
-		pForceSamples[8 * i + 2] = float(rand()) / float(RAND_MAX);
-		pForceSamples[8 * i + 3] = 0.0f; 
-
-		pForceSamples[8 * i + 4] = pForceSamples[8 * i];
-		pForceSamples[8 * i + 5] = pForceSamples[8 * i +1];
-		pForceSamples[8 * i + 6] = pForceSamples[8 * i + 2];
-		pForceSamples[8 * i + 7] = 1.0f;
+		// nothing to share, both ping-pong buffers start from the same state as the VBOs would
+		size_t size = m_nParticles * sizeof(cl_float4) * 2;
+		m_clPosLife[0] = memory.CreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, pPosLife, &clError2, "Particles/PosLife");
+		clError = clError2;
+		m_clPosLife[1] = memory.CreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, pPosLife, &clError2, "Particles/PosLife");
+		clError |= clError2;
+		m_clVelMass[0] = memory.CreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, pVelMass, &clError2, "Particles/VelMass");
+		clError |= clError2;
+		m_clVelMass[1] = memory.CreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, pVelMass, &clError2, "Particles/VelMass");
+		clError |= clError2;
 	}
+	else
+	{
+		if(!InitGL(pPosLife, pVelMass))
+			return false;
 
-	glGenBuffers(1, &m_glForceLines);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glForceLines);
-	glBufferData(GL_ARRAY_BUFFER, NUM_FORCE_LINES * 2 * 4 * sizeof(float), pForceSamples, GL_DYNAMIC_DRAW);
-    CHECK_FOR_OGL_ERROR();
-
-	delete [] pForceSamples;
-
-	cl_int clError, clError2;
+		m_clPosLife[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glPosLife[0], &clError2);
+		clError = clError2;
+		m_clPosLife[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glPosLife[1], &clError2);
+		clError |= clError2;
+		m_clVelMass[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glVelMass[0], &clError2);
+		clError |= clError2;
+		m_clVelMass[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glVelMass[1], &clError2);
+		clError |= clError2;
 
-	// Particle arrrays
-	m_clPosLife[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glPosLife[0], &clError2);
-	clError = clError2;
-	m_clPosLife[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glPosLife[1], &clError2);
-	clError |= clError2;
-	m_clVelMass[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glVelMass[0], &clError2);
-	clError |= clError2;
-	m_clVelMass[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glVelMass[1], &clError2);
-	clError |= clError2;
-	m_clAlive = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_nParticles * sizeof(cl_uint) * 2, NULL, &clError2);
+		// the VBOs are device memory as well, shared with OpenGL
+		for (int i = 0; i < 2; i++)
+		{
+			memory.Track(m_clPosLife[i], "Particles/PosLife (GL)");
+			memory.Track(m_clVelMass[i], "Particles/VelMass (GL)");
+		}
+	}
+	m_clAlive = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, m_nParticles * sizeof(cl_uint) * 2, NULL, &clError2, "Particles/Alive");
 	clError |= clError2;
 
 	float *pTriangles;
 	m_pMesh->GetTriangleSoup(&pTriangles, &m_nTriangles);
-	m_clTriangleSoup = clCreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, m_nTriangles * 3 * sizeof(cl_float4), pTriangles, &clError2);
+	m_clTriangleSoup = memory.CreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, m_nTriangles * 3 * sizeof(cl_float4), pTriangles, &clError2, "Particles/Triangle soup");
 	clError |= clError2;
 	delete pTriangles;
 
-	m_clPingArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_nParticles * sizeof(cl_uint) * 2, NULL, &clError2);
+	m_clPingArray = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, m_nParticles * sizeof(cl_uint) * 2, NULL, &clError2, "Particles/Ping");
 	clError |= clError2;
-	m_clPongArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_nParticles * sizeof(cl_uint) * 2, NULL, &clError2);
+	m_clPongArray = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, m_nParticles * sizeof(cl_uint) * 2, NULL, &clError2, "Particles/Pong");
 	clError |= clError2;
 	V_RETURN_FALSE_CL(clError, "Error allocating device arrays");
 
@@ -208,7 +206,7 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context,
 	// Scan arrays
 	unsigned int N = m_nParticles * 2;
 	for (unsigned int i = 0; i < m_nLevels; i++) {
-		m_clLevelArrays[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * N, NULL, &clError2);
+		m_clLevelArrays[i] = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * N, NULL, &clError2, "Particles/Scan levels");
 		clError |= clError2;
 		N = std::max(N / (2 * m_LocalWorkSize[0]), m_LocalWorkSize[0]);
 	}
@@ -216,67 +214,8 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context,
 
 
 
-	//shader programs
-
-	m_VSMesh = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
-	m_PSMesh = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
-
-	if(!CreateShaderFromFile("mesh.vert", m_VSMesh))
-		return false;
-
-	if(!CreateShaderFromFile("mesh.frag", m_PSMesh))
-		return false;
-
-	m_ProgRenderMesh = glCreateProgramObjectARB();
-	glAttachObjectARB(m_ProgRenderMesh, m_VSMesh);
-	glAttachObjectARB(m_ProgRenderMesh, m_PSMesh);
-	if(!LinkGLSLProgram(m_ProgRenderMesh))
-		return false;
-
-	m_VSParticles = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
-	m_PSParticles = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
-
-	if(!CreateShaderFromFile("particles.vert", m_VSParticles))
-		return false;
-	
-	if(!CreateShaderFromFile("particles.frag", m_PSParticles))
-		return false;
-
-	m_ProgRenderParticles = glCreateProgramObjectARB();
-	glAttachObjectARB(m_ProgRenderParticles, m_VSParticles);
-	glAttachObjectARB(m_ProgRenderParticles, m_PSParticles);
-	if(!LinkGLSLProgram(m_ProgRenderParticles))
-		return false;
-
-	GLint tboSampler = glGetUniformLocationARB(m_ProgRenderParticles, "tboSampler");
-	glUseProgramObjectARB(m_ProgRenderParticles);
-	glUniform1i(tboSampler, 0);
-
-	m_VSForceField = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
-	m_PSForceField = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
-
-	if(!CreateShaderFromFile("forcefield.vert", m_VSForceField))
-		return false;
-
-	if(!CreateShaderFromFile("forcefield.frag", m_PSForceField))
-		return false;
-
-    CHECK_FOR_OGL_ERROR();
-	m_ProgRenderForceField = glCreateProgramObjectARB();
-	glAttachObjectARB(m_ProgRenderForceField, m_VSForceField);
-	glAttachObjectARB(m_ProgRenderForceField, m_PSForceField);
-	if(!LinkGLSLProgram(m_ProgRenderForceField))
-		return false;
-    CHECK_FOR_OGL_ERROR();
-
-	GLint texForceField = glGetUniformLocationARB(m_ProgRenderForceField, "texForceField");
-	glUseProgramObjectARB(m_ProgRenderForceField);
-	glUniform1i(texForceField, 0);
-
 	// Particle kernels
-	string programCode;
-	CLUtil::LoadProgramSourceToMemory("ParticleSystem.cl", programCode);
-	m_PSystemProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	m_PSystemProgram = builder.Get(pSystemBuild);
 	if(!m_PSystemProgram)
 		return false;
 
@@ -288,8 +227,7 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context,
 	V_RETURN_FALSE_CL(clError, "Failed to create Reorganize kernel.");
 
 	// Scan kernels
-	CLUtil::LoadProgramSourceToMemory("Scan.cl", programCode);
-	m_ScanProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	m_ScanProgram = builder.Get(scanBuild);
 	if(!m_ScanProgram)
 		return false;
 
@@ -331,40 +269,44 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context,
 	fclose(fin);
 
 	// Create OpenGL texture
-	
-    CHECK_FOR_OGL_ERROR();
-	glEnable(GL_TEXTURE_3D);
-    CHECK_FOR_OGL_ERROR();
-	glGenTextures(1, &m_glVolTex3D);
-    CHECK_FOR_OGL_ERROR();
-    glBindTexture(GL_TEXTURE_3D, m_glVolTex3D);
-    CHECK_FOR_OGL_ERROR();
-	//if(!glIsEnabled(GL_TEXTURE_3D))
-	//	cout<<"3D textures are not supported."<<endl;
+	if(!m_Headless)
+	{
+		CHECK_FOR_OGL_ERROR();
+		glEnable(GL_TEXTURE_3D);
+		CHECK_FOR_OGL_ERROR();
+		glGenTextures(1, &m_glVolTex3D);
+		CHECK_FOR_OGL_ERROR();
+		glBindTexture(GL_TEXTURE_3D, m_glVolTex3D);
+		CHECK_FOR_OGL_ERROR();
+		//if(!glIsEnabled(GL_TEXTURE_3D))
+		//	cout<<"3D textures are not supported."<<endl;
 
-	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    CHECK_FOR_OGL_ERROR();
+		CHECK_FOR_OGL_ERROR();
+
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F_ARB, 
+						m_volumeRes[0], m_volumeRes[1], m_volumeRes[2],
+						0, GL_RGBA, GL_FLOAT, pVolume);
+		CHECK_FOR_OGL_ERROR();
+	}
 
-	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F_ARB, 
-					m_volumeRes[0], m_volumeRes[1], m_volumeRes[2],
-					0, GL_RGBA, GL_FLOAT, pVolume);
-    CHECK_FOR_OGL_ERROR();
-    
 	cl_image_format volume_format;
     volume_format.image_channel_order = CL_RGBA;
 	volume_format.image_channel_data_type = CL_FLOAT;
+	memory.CheckAllocation(Context, m_volumeRes[0] * m_volumeRes[1] * m_volumeRes[2] * sizeof(cl_float4), "Particles/Force volume");
     m_clVolTex3D = clCreateImage3D(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &volume_format, 
 									m_volumeRes[0], m_volumeRes[1], m_volumeRes[2],
 									(m_volumeRes[0] * sizeof(cl_float4)), (m_volumeRes[0] * m_volumeRes[1] * sizeof(cl_float4)),
 									pVolume, &clError);
 	V_RETURN_FALSE_CL(clError, "Failed to create OpenCL 3D texture.");
+	memory.Track(m_clVolTex3D, "Particles/Force volume");
 
 	SAFE_DELETE(pVolume);
 
@@ -383,12 +325,133 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context,
 	V_RETURN_FALSE_CL(clError, "Failed to set args for m_ReorganizeKernel");
 
 	//set the modelview matrix
-	glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-	glTranslatef(0.0f, 0.0f, m_TranslateZ);
-	glRotatef(m_RotateY, 0.0f, 1.0f, 0.0f);
-	glRotatef(m_RotateX, 1.0f, 0.0f, 0.0f);
-	glTranslatef(-0.5, -0.5, -0.5);
+	if(!m_Headless)
+	{
+		glMatrixMode(GL_MODELVIEW);
+		glLoadIdentity();
+		glTranslatef(0.0f, 0.0f, m_TranslateZ);
+		glRotatef(m_RotateY, 0.0f, 1.0f, 0.0f);
+		glRotatef(m_RotateX, 1.0f, 0.0f, 0.0f);
+		glTranslatef(-0.5, -0.5, -0.5);
+	}
+
+	return true;
+}
+
+bool CParticleSystemTask::InitGL(const cl_float4* pPosLife, const cl_float4* pVelMass)
+{
+	// the force field samples come from their own stream, a fresh generator yields the same ones
+	CCounterRNG rng;
+
+	// Device resources
+	glGenBuffers(2, m_glPosLife);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glPosLife[0]);
+	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pPosLife, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glPosLife[1]);
+	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pPosLife, GL_DYNAMIC_DRAW);
+    CHECK_FOR_OGL_ERROR();
+
+	glGenBuffers(2, m_glVelMass);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glVelMass[0]);
+	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pVelMass, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glVelMass[1]);
+	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pVelMass, GL_DYNAMIC_DRAW);
+    CHECK_FOR_OGL_ERROR();
+
+	//create a texture for the TBO
+	glGenTextures(2, m_glTexVelMass);
+
+	glBindTexture(GL_TEXTURE_BUFFER_EXT, m_glTexVelMass[0]);
+	glTexBufferEXT(GL_TEXTURE_BUFFER_EXT, GL_RGBA32F_ARB, m_glVelMass[0]);
+	glBindBuffer(GL_TEXTURE_BUFFER_EXT, 0);
+	glBindTexture(GL_TEXTURE_BUFFER_EXT, 0);
+    CHECK_FOR_OGL_ERROR();
+
+	glBindTexture(GL_TEXTURE_BUFFER_EXT, m_glTexVelMass[1]);
+	glTexBufferEXT(GL_TEXTURE_BUFFER_EXT, GL_RGBA32F_ARB, m_glVelMass[1]);
+	glBindBuffer(GL_TEXTURE_BUFFER_EXT, 0);
+	glBindTexture(GL_TEXTURE_BUFFER_EXT, 0);
+    CHECK_FOR_OGL_ERROR();
+
+
+	//scatter force field sampling points
+	float* pForceSamples = new float[NUM_FORCE_LINES * 2 * 4];
+	for(int i = 0; i < NUM_FORCE_LINES; i++)
+	{
+		pForceSamples[8 * i] = rng.GetFloat(2, 4 * i);
+		pForceSamples[8 * i + 1] = rng.GetFloat(2, 4 * i + 1);
+		pForceSamples[8 * i + 2] = rng.GetFloat(2, 4 * i + 2);
+		pForceSamples[8 * i + 3] = 0.0f; 
+
+		pForceSamples[8 * i + 4] = pForceSamples[8 * i];
+		pForceSamples[8 * i + 5] = pForceSamples[8 * i +1];
+		pForceSamples[8 * i + 6] = pForceSamples[8 * i + 2];
+		pForceSamples[8 * i + 7] = 1.0f;
+	}
+
+	glGenBuffers(1, &m_glForceLines);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glForceLines);
+	glBufferData(GL_ARRAY_BUFFER, NUM_FORCE_LINES * 2 * 4 * sizeof(float), pForceSamples, GL_DYNAMIC_DRAW);
+    CHECK_FOR_OGL_ERROR();
+
+	delete [] pForceSamples;
+
+	//shader programs
+
+	m_VSMesh = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
+	m_PSMesh = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+
+	if(!CreateShaderFromFile("mesh.vert", m_VSMesh))
+		return false;
+
+	if(!CreateShaderFromFile("mesh.frag", m_PSMesh))
+		return false;
+
+	m_ProgRenderMesh = glCreateProgramObjectARB();
+	glAttachObjectARB(m_ProgRenderMesh, m_VSMesh);
+	glAttachObjectARB(m_ProgRenderMesh, m_PSMesh);
+	if(!LinkGLSLProgram(m_ProgRenderMesh))
+		return false;
+
+	m_VSParticles = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
+	m_PSParticles = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+
+	if(!CreateShaderFromFile("particles.vert", m_VSParticles))
+		return false;
+	
+	if(!CreateShaderFromFile("particles.frag", m_PSParticles))
+		return false;
+
+	m_ProgRenderParticles = glCreateProgramObjectARB();
+	glAttachObjectARB(m_ProgRenderParticles, m_VSParticles);
+	glAttachObjectARB(m_ProgRenderParticles, m_PSParticles);
+	if(!LinkGLSLProgram(m_ProgRenderParticles))
+		return false;
+
+	GLint tboSampler = glGetUniformLocationARB(m_ProgRenderParticles, "tboSampler");
+	glUseProgramObjectARB(m_ProgRenderParticles);
+	glUniform1i(tboSampler, 0);
+
+	m_VSForceField = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
+	m_PSForceField = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+
+	if(!CreateShaderFromFile("forcefield.vert", m_VSForceField))
+		return false;
+
+	if(!CreateShaderFromFile("forcefield.frag", m_PSForceField))
+		return false;
+
+    CHECK_FOR_OGL_ERROR();
+	m_ProgRenderForceField = glCreateProgramObjectARB();
+	glAttachObjectARB(m_ProgRenderForceField, m_VSForceField);
+	glAttachObjectARB(m_ProgRenderForceField, m_PSForceField);
+	if(!LinkGLSLProgram(m_ProgRenderForceField))
+		return false;
+    CHECK_FOR_OGL_ERROR();
+
+	GLint texForceField = glGetUniformLocationARB(m_ProgRenderForceField, "texForceField");
+	glUseProgramObjectARB(m_ProgRenderForceField);
+	glUniform1i(texForceField, 0);
 
 	return true;
 }
@@ -397,7 +460,8 @@ void CParticleSystemTask::ReleaseResources()
 {
 	if(m_pMesh)
 	{
-		m_pMesh->ReleaseGLResources();
+		if(!m_Headless)
+			m_pMesh->ReleaseGLResources();
 		delete m_pMesh;
 		m_pMesh = NULL;
 	}
@@ -431,6 +495,10 @@ void CParticleSystemTask::ReleaseResources()
 	SAFE_RELEASE_KERNEL(m_ReorganizeKernel);
 	SAFE_RELEASE_PROGRAM(m_PSystemProgram);	
 
+	// there is no GL context in headless mode
+	if(m_Headless)
+		return;
+
 	SAFE_RELEASE_GL_BUFFER(m_glForceLines);
 	SAFE_RELEASE_GL_BUFFER(m_glPosLife[0]);
 	SAFE_RELEASE_GL_BUFFER(m_glPosLife[1]);
@@ -454,14 +522,19 @@ void CParticleSystemTask::ReleaseResources()
 
 void CParticleSystemTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
-	glFinish();
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosLife[0], 0, NULL, NULL),  "Error acquiring OpenGL buffer.");
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clVelMass[0], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosLife[1], 0, NULL, NULL),  "Error acquiring OpenGL buffer.");
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clVelMass[1], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+	if(!m_Headless)
+	{
+		glFinish();
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosLife[0], 0, NULL, NULL),  "Error acquiring OpenGL buffer.");
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clVelMass[0], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosLife[1], 0, NULL, NULL),  "Error acquiring OpenGL buffer.");
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clVelMass[1], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+	}
+	BeginStages(CommandQueue);
 
 	// Integration with a fixed timestep
 	Integrate(Context, CommandQueue, LocalWorkSize, 0.003f);
+	EndStage(CommandQueue, "Integrate");
 
 
 	//********************************************************
@@ -473,13 +546,18 @@ void CParticleSystemTask::ComputeGPU(cl_context Context, cl_command_queue Comman
 	// Enable these once you implement them
 	// Stream compaction
 	Scan(Context, CommandQueue, LocalWorkSize);
+	EndStage(CommandQueue, "Scan");
 	Reorganize(Context, CommandQueue, LocalWorkSize);
+	EndStage(CommandQueue, "Reorganize");
 
 
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosLife[0], 0, NULL, NULL),  "Error releasing OpenGL buffer.");
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clVelMass[0], 0, NULL, NULL), "Error releasing OpenGL buffer.");
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosLife[1], 0, NULL, NULL),  "Error releasing OpenGL buffer.");
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clVelMass[1], 0, NULL, NULL), "Error releasing OpenGL buffer.");
+	if(!m_Headless)
+	{
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosLife[0], 0, NULL, NULL),  "Error releasing OpenGL buffer.");
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clVelMass[0], 0, NULL, NULL), "Error releasing OpenGL buffer.");
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosLife[1], 0, NULL, NULL),  "Error releasing OpenGL buffer.");
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clVelMass[1], 0, NULL, NULL), "Error releasing OpenGL buffer.");
+	}
 
 	clFinish(CommandQueue);
 
@@ -628,6 +706,10 @@ void CParticleSystemTask::OnMouseMove(int X, int Y)
 
 void CParticleSystemTask::OnIdle(double , float ElapsedTime)
 {
+	// only the camera moves here
+	if(m_Headless)
+		return;
+
 	//move camera?
 	if(m_KeyboardMask[GLFW_KEY_W])
 		m_TranslateZ += 2.f * ElapsedTime;
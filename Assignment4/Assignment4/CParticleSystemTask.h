@@ -54,6 +54,8 @@ public:
 	virtual void ComputeCPU() {};
 	virtual bool ValidateResults() {return false;};
 
+	virtual std::string GetName() const { return "CParticleSystemTask"; }
+
 	// IGUIEnabledComputeTask
 	virtual void Render();
 
@@ -69,6 +71,9 @@ public:
 
 protected:
 
+	//! Creates the VBOs/TBOs for the particles, the force field lines and the shaders
+	bool InitGL(const cl_float4* pPosLife, const cl_float4* pVelMass);
+
 	void Scan(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 	void Integrate(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], float dT);
 	void Reorganize(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
@@ -328,6 +328,10 @@ bool CTriMesh::CreateGLResources()
 
 void CTriMesh::ReleaseGLResources()
 {
+	// a mesh without GL resources (e.g. in headless mode) must not touch GL at all
+	if(!m_glVertexBuffer && !m_glNormalBuffer && !m_glTexCoordBuffer && !m_glIndexBuffer)
+		return;
+
 	SAFE_RELEASE_GL_BUFFER(m_glVertexBuffer);
 	CHECK_FOR_OGL_ERROR();
 	SAFE_RELEASE_GL_BUFFER(m_glNormalBuffer);
@@ -411,4 +415,16 @@ void CTriMesh::GetTriangleSoup(float** ppPositionBuffer, unsigned int* pNumTrian
 	}
 }
 
+void CTriMesh::GetVertexData(std::vector<float4>& Positions, std::vector<float4>& Normals) const
+{
+	Positions.resize(m_Vertices.size());
+	Normals.resize(m_Vertices.size());
+
+	for(size_t iVert = 0; iVert < m_Vertices.size(); iVert++)
+	{
+		Positions[iVert] = float4(m_Vertices[iVert].Pos, 1.0f);
+		Normals[iVert] = float4(m_Vertices[iVert].Norm, 0.0f);
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -21,9 +21,16 @@
 #define _CASSIGNMENT_BASE_H
 
 #include "IComputeTask.h"
+#include "CMultiDevice.h"
+#include "CTaskScheduler.h"
 
 #include "CommonDefs.h"
 
+#include <functional>
+#include <future>
+
+class CBenchmarkSweep;
+
 //! Base class for all assignments
 /*! 
 	Inherit a new class for each specific assignment.
@@ -48,17 +55,131 @@ public:
 	//! You need to overload this to define a specific behavior for your assignments
 	virtual bool DoCompute() = 0;
 
+	//! Runs the benchmark sweep of the assignment instead of DoCompute(), see --sweep
+	virtual bool DoBenchmarkSweep();
+
 protected:	
+	//! Reads the OpenCL device selection from the environment and the command line
+	/*!
+		Environment variables are read first and are overridden by arguments:
+		--cl-type gpu|cpu|accelerator|all	(GPUC_CL_TYPE)
+		--cl-platform <index>				(GPUC_CL_PLATFORM)
+		--cl-device <index>					(GPUC_CL_DEVICE)
+		--cl-rank							(GPUC_CL_RANK=1)
+		--cpu-only							(GPUC_CPU_ONLY=1)
+		--async								(GPUC_ASYNC=1)
+		--concurrent <queues>				(GPUC_CONCURRENT)
+		--multi-device						(GPUC_MULTI_DEVICE=1)
+		--headless <steps>					(GPUC_HEADLESS)
+		--sweep								(GPUC_SWEEP=1)
+		--force-lws							(GPUC_FORCE_LWS=1)
+
+		The device index counts all devices of the selected type, restricted
+		to the selected platform if one is given. --cl-rank picks the device with
+		the best score from compute units x clock and measured memory bandwidth.
+
+		--cpu-only makes RunComputeTask() run the CPU implementations alone, as a
+		backend of their own. GPUC_CPU_THREADS sets the number of CPU threads
+		(see CThreadPool), GPUC_CPU_THREADS=1 gives the serial reference.
+
+		--async runs ComputeCPU() on a thread of its own while ComputeGPU() is
+		enqueued, and lets RunBenchmarkSweep() validate a configuration while the
+		next one initializes. Both sides then compete for the host, so compare
+		timings only between runs in the same mode.
+
+		--concurrent makes RunComputeTasks() share the device between its tasks
+		on that many command queues (see CTaskScheduler).
+
+		--multi-device opens all OpenCL devices next to the selected one (see
+		CMultiDevice), and RunComputeTask() uses ComputeMultiDevice() of the tasks
+		that implement it instead of ComputeGPU(). Their PrepareMultiDevice() runs
+		before the timer starts.
+
+		--headless makes the OpenGL assignments skip the window and the CL-GL
+		context sharing, run the given number of simulation steps with plain
+		OpenCL buffers and print the time of each stage.
+
+		--sweep runs DoBenchmarkSweep() instead of DoCompute(), which measures
+		the tasks of the assignment over a grid of problem and work-group sizes
+		and writes the results as CSV and JSON (see CBenchmarkSweep).
+
+		By default the tasks run with the local work size stored for them in the
+		tuning database, or tune one in PrepareComputeGPU() (see CWorkGroupTuner).
+		--force-lws makes them use the local work size they are given instead,
+		as the sweep does. A local work size of 0 is always tuned.
+	*/
+	virtual void ParseDeviceOptions(int argc, char** argv);
+
+	//! Chooses m_CLDevice and m_CLPlatform according to the device options
+	virtual bool SelectCLDevice();
+
+	void PrintCLDeviceInfo();
+
 	virtual bool InitCLContext();
 
 	virtual void ReleaseCLContext();
 
 	virtual bool RunComputeTask(IComputeTask& Task, size_t LocalWorkSize[3]);
 
+	//! Like RunComputeTask(), but leaves the validation pending
+	/*!
+		In async mode the validation and ReleaseResources() continue in the
+		background. The result is collected by FinishPendingValidation(), which
+		calls OnValidated (if set) on the calling thread. The next RunComputeTask()
+		does so after its InitResources(), or before it for the same task object.
+		The task must stay alive until then.
+	*/
+	virtual bool RunComputeTask(IComputeTask& Task, size_t LocalWorkSize[3], const std::function<void(bool)>& OnValidated);
+
+	//! Runs independent tasks, concurrently if m_ConcurrentQueues > 1, otherwise one after another
+	/*!
+		DeviceBytes, if given, overrides IComputeTask::GetDeviceBytes() of the tasks.
+		IComputeTask::StartProgramBuilds() is called for all tasks first, so that
+		their programs build while the first tasks run.
+	*/
+	virtual bool RunComputeTasks(const std::vector<IComputeTask*>& Tasks, size_t LocalWorkSize[3],
+		const std::vector<size_t>& DeviceBytes = std::vector<size_t>());
+
+	//! Waits for the pending validation, prints it and sets m_LastResultValid
+	bool FinishPendingValidation();
+
+	//! Runs every configuration of the sweep through RunComputeTask() and records the ComputeGPU() times
+	virtual bool RunBenchmarkSweep(CBenchmarkSweep& Sweep);
+
 	cl_platform_id		m_CLPlatform;
 	cl_device_id		m_CLDevice;
 	cl_context			m_CLContext;
 	cl_command_queue	m_CLCommandQueue;
+
+	// device selection options
+	cl_device_type		m_CLDeviceType;
+	int					m_CLPlatformIndex;
+	int					m_CLDeviceIndex;
+	bool				m_RankCLDevices;
+	bool				m_CPUOnly;
+	bool				m_AsyncCompute;
+	unsigned int		m_ConcurrentQueues;
+	bool				m_UseMultiDevice;
+	unsigned int		m_HeadlessSteps;
+	bool				m_RunSweep;
+	bool				m_ForceLocalWorkSize;
+
+	CMultiDevice		m_MultiDevice;
+
+	// outcome of the last RunComputeTask() call
+	double				m_LastComputeCPUMs;
+	double				m_LastComputeGPUMs;
+	bool				m_LastResultValid;
+
+	// false while RunBenchmarkSweep() runs tasks without a CPU reference
+	bool				m_ValidateResults;
+
+	// validation left pending by RunComputeTask()
+	IComputeTask*				m_PendingTask;
+	std::future<bool>			m_PendingValidation;
+	bool						m_PendingValid;
+	bool						m_PendingValidated;
+	std::function<void(bool)>	m_PendingCallback;
 };
 
 #endif // _CASSIGNMENT_BASE_H
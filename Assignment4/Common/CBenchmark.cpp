@@ -0,0 +1,304 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CBenchmark.h"
+#include "CTimer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+// Consecutive samples compared during warm-up, and between two checks of the confidence interval
+#define BENCHMARK_WINDOW		5
+#define BOOTSTRAP_RESAMPLES		1000
+
+static bool ReadNumber(const string& Line, const string& Key, double& Value)
+{
+	size_t pos = Line.find("\"" + Key + "\":");
+	if (pos == string::npos)
+		return false;
+	Value = strtod(Line.c_str() + pos + Key.size() + 3, NULL);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CBenchmark
+
+CBenchmark& CBenchmark::GetInstance()
+{
+	static CBenchmark s_Instance;
+	return s_Instance;
+}
+
+CBenchmark::Result CBenchmark::Measure(const string& Name, cl_command_queue CommandQueue, const function<void()>& Work)
+{
+	const Settings& settings = m_Settings;
+
+	// time per run of one batch, including the wait for the device
+	auto sample = [&](int BatchSize) -> double
+	{
+		CTimer timer;
+		timer.Start();
+		for (int i = 0; i < BatchSize; i++)
+			Work();
+		if (CommandQueue)
+			clFinish(CommandQueue);
+		timer.Stop();
+		return timer.GetElapsedMilliseconds() / BatchSize;
+	};
+
+	if (CommandQueue)
+		clFinish(CommandQueue);
+
+	Result result;
+	result.Name = Name;
+
+	// the first run may pay for lazy allocations, the second one decides the batch size
+	sample(1);
+	double single = sample(1);
+	if (single < settings.MinSampleMs)
+		result.BatchSize = (int)min(ceil(settings.MinSampleMs / max(single, 1.0e-6)), 10000.0);
+
+	// warm-up until two consecutive windows agree, e.g. after the clocks went up
+	double previous = 0.0;
+	for (int n = 0; n < settings.MaxWarmupSamples; n += BENCHMARK_WINDOW)
+	{
+		vector<double> window(BENCHMARK_WINDOW);
+		for (size_t i = 0; i < window.size(); i++)
+			window[i] = sample(result.BatchSize);
+		double median = Median(window);
+		if (previous > 0.0 && fabs(median - previous) <= settings.WarmupTolerance * previous)
+			break;
+		previous = median;
+	}
+
+	// more samples until the median is known precisely enough
+	vector<double> samples;
+	CTimer total;
+	total.Start();
+	for (;;)
+	{
+		samples.push_back(sample(result.BatchSize));
+		int n = (int)samples.size();
+		if (n >= settings.MaxSamples)
+			break;
+		total.Stop();
+		if (total.GetElapsedMilliseconds() > settings.MaxSeconds * 1000.0 && n >= 2)
+			break;
+
+		if (n >= settings.MinSamples && n % BENCHMARK_WINDOW == 0)
+		{
+			vector<double> filtered = samples;
+			RejectOutliers(filtered, settings.OutlierMADs);
+			if ((int)filtered.size() < settings.MinSamples)
+				continue;
+			double low, high;
+			BootstrapMedianCI(filtered, low, high);
+			if (0.5 * (high - low) <= settings.TargetPrecision * Median(filtered))
+				break;
+		}
+	}
+
+	vector<double> filtered = samples;
+	result.NOutliers = RejectOutliers(filtered, settings.OutlierMADs);
+	result.NSamples = (int)filtered.size();
+	result.MedianMs = Median(filtered);
+
+	double sum = 0.0, sqDiffSum = 0.0;
+	for (size_t i = 0; i < filtered.size(); i++)
+		sum += filtered[i];
+	result.MeanMs = sum / filtered.size();
+	for (size_t i = 0; i < filtered.size(); i++)
+		sqDiffSum += (filtered[i] - result.MeanMs) * (filtered[i] - result.MeanMs);
+	result.StdDevMs = filtered.size() > 1 ? sqrt(sqDiffSum / (filtered.size() - 1)) : 0.0;
+	BootstrapMedianCI(filtered, result.CILowMs, result.CIHighMs);
+
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_Results.push_back(result);
+	}
+	PrintResult(result);
+	return result;
+}
+
+void CBenchmark::PrintResult(const Result& R)
+{
+	cout << "  median time: " << R.MedianMs << " ms (95% CI " << R.CILowMs << " - " << R.CIHighMs << " ms), mean " << R.MeanMs
+		<< " ms, stddev " << R.StdDevMs << " ms, " << R.NSamples << " samples of " << R.BatchSize << " runs, "
+		<< R.NOutliers << " outliers" << endl;
+}
+
+double CBenchmark::Median(vector<double> Samples)
+{
+	if (Samples.empty())
+		return 0.0;
+	size_t n = Samples.size();
+	sort(Samples.begin(), Samples.end());
+	return (n % 2 == 1) ? Samples[n / 2] : 0.5 * (Samples[n / 2 - 1] + Samples[n / 2]);
+}
+
+int CBenchmark::RejectOutliers(vector<double>& Samples, double MADs)
+{
+	if (Samples.size() < 3)
+		return 0;
+
+	double median = Median(Samples);
+	vector<double> deviations(Samples.size());
+	for (size_t i = 0; i < Samples.size(); i++)
+		deviations[i] = fabs(Samples[i] - median);
+	// scaled, so that it estimates the standard deviation of normally distributed samples
+	double mad = 1.4826 * Median(deviations);
+	if (mad <= 0.0)
+		return 0;
+
+	size_t n = Samples.size();
+	Samples.erase(remove_if(Samples.begin(), Samples.end(), [&](double T) { return fabs(T - median) > MADs * mad; }), Samples.end());
+	return (int)(n - Samples.size());
+}
+
+void CBenchmark::BootstrapMedianCI(const vector<double>& Samples, double& Low, double& High)
+{
+	Low = High = Median(Samples);
+	if (Samples.size() < 2)
+		return;
+
+	// a fixed seed, the same samples always give the same interval
+	mt19937 rng(42);
+	uniform_int_distribution<size_t> pick(0, Samples.size() - 1);
+	vector<double> medians(BOOTSTRAP_RESAMPLES);
+	vector<double> resample(Samples.size());
+	for (size_t r = 0; r < medians.size(); r++)
+	{
+		for (size_t i = 0; i < resample.size(); i++)
+			resample[i] = Samples[pick(rng)];
+		medians[r] = Median(resample);
+	}
+
+	sort(medians.begin(), medians.end());
+	Low = medians[(size_t)(0.025 * BOOTSTRAP_RESAMPLES)];
+	High = medians[(size_t)(0.975 * BOOTSTRAP_RESAMPLES) - 1];
+}
+
+bool CBenchmark::Finish()
+{
+	lock_guard<mutex> lock(m_Mutex);
+	if (m_Results.empty())
+		return true;
+
+	const char* env;
+	if ((env = getenv("GPUC_BENCH_OUT")) != NULL)
+		WriteJSON(env);
+
+	if ((env = getenv("GPUC_BENCH_BASELINE")) == NULL)
+		return true;
+	string baselinePath = env;
+	vector<Result> baseline;
+	if (!ReadJSON(baselinePath, baseline))
+	{
+		cerr << "Failed to read the benchmark baseline '" << baselinePath << "'." << endl;
+		return false;
+	}
+
+	double threshold = 0.1;
+	if ((env = getenv("GPUC_BENCH_THRESHOLD")) != NULL)
+		threshold = atof(env) / 100.0;
+
+	cout << endl << "Comparison with the baseline '" << baselinePath << "':" << endl;
+	int nRegressions = 0;
+	for (size_t i = 0; i < m_Results.size(); i++)
+	{
+		const Result& r = m_Results[i];
+		const Result* b = NULL;
+		for (size_t j = 0; j < baseline.size() && !b; j++)
+			if (baseline[j].Name == r.Name)
+				b = &baseline[j];
+		if (!b || b->MedianMs <= 0.0)
+		{
+			cout << "  " << r.Name << ": not in the baseline" << endl;
+			continue;
+		}
+
+		// significant only if the confidence intervals do not overlap, and relevant only above the threshold
+		double change = r.MedianMs / b->MedianMs - 1.0;
+		bool slower = r.CILowMs > b->CIHighMs && change > threshold;
+		bool faster = r.CIHighMs < b->CILowMs && -change > threshold;
+		if (slower)
+			nRegressions++;
+		cout << "  " << r.Name << ": " << b->MedianMs << " -> " << r.MedianMs << " ms (" << showpos << fixed << setprecision(1)
+			<< 100.0 * change << "%" << noshowpos << defaultfloat << setprecision(6) << ") "
+			<< (slower ? "REGRESSION" : faster ? "faster" : "unchanged") << endl;
+	}
+
+	if (nRegressions > 0)
+		cerr << nRegressions << " benchmark(s) regressed against the baseline." << endl;
+	return nRegressions == 0;
+}
+
+bool CBenchmark::WriteJSON(const string& Path) const
+{
+	ofstream file(Path.c_str());
+	if (!file.is_open())
+	{
+		cerr << "Failed to open file '" << Path << "'." << endl;
+		return false;
+	}
+
+	// one benchmark per line, ReadJSON() relies on that
+	file << setprecision(9) << "{" << endl << "  \"benchmarks\": [";
+	for (size_t i = 0; i < m_Results.size(); i++)
+	{
+		const Result& r = m_Results[i];
+		file << (i > 0 ? "," : "") << endl << "    {\"name\": \"" << r.Name << "\", \"median_ms\": " << r.MedianMs
+			<< ", \"ci_low_ms\": " << r.CILowMs << ", \"ci_high_ms\": " << r.CIHighMs << ", \"mean_ms\": " << r.MeanMs
+			<< ", \"stddev_ms\": " << r.StdDevMs << ", \"samples\": " << r.NSamples << ", \"outliers\": " << r.NOutliers
+			<< ", \"batch\": " << r.BatchSize << "}";
+	}
+	file << endl << "  ]" << endl << "}" << endl;
+
+	return true;
+}
+
+bool CBenchmark::ReadJSON(const string& Path, vector<Result>& Results)
+{
+	ifstream file(Path.c_str());
+	if (!file.is_open())
+		return false;
+
+	Results.clear();
+	string line;
+	while (getline(file, line))
+	{
+		size_t begin = line.find("\"name\": \"");
+		if (begin == string::npos)
+			continue;
+		begin += 9;
+		size_t end = line.find('"', begin);
+		if (end == string::npos)
+			continue;
+
+		Result r;
+		r.Name = line.substr(begin, end - begin);
+		double samples = 0.0, outliers = 0.0, batch = 1.0;
+		if (!ReadNumber(line, "median_ms", r.MedianMs) || !ReadNumber(line, "ci_low_ms", r.CILowMs) || !ReadNumber(line, "ci_high_ms", r.CIHighMs))
+			continue;
+		ReadNumber(line, "mean_ms", r.MeanMs);
+		ReadNumber(line, "stddev_ms", r.StdDevMs);
+		ReadNumber(line, "samples", samples);
+		ReadNumber(line, "outliers", outliers);
+		ReadNumber(line, "batch", batch);
+		r.NSamples = (int)samples;
+		r.NOutliers = (int)outliers;
+		r.BatchSize = (int)batch;
+		Results.push_back(r);
+	}
+
+	return true;
+}
@@ -0,0 +1,230 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CBenchmarkSweep.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+//! Quotes a CSV field if it contains a separator, a quote or a line break
+static string EscapeCSV(const string& Field)
+{
+	if (Field.find_first_of(",\"\r\n") == string::npos)
+		return Field;
+
+	string escaped = "\"";
+	for (size_t i = 0; i < Field.size(); i++)
+	{
+		if (Field[i] == '"')
+			escaped += '"';
+		escaped += Field[i];
+	}
+	return escaped + "\"";
+}
+
+//! Escapes the contents of a JSON string
+static string EscapeJSON(const string& Text)
+{
+	string escaped;
+	for (size_t i = 0; i < Text.size(); i++)
+	{
+		unsigned char c = (unsigned char)Text[i];
+		switch (c)
+		{
+		case '"': escaped += "\\\""; break;
+		case '\\': escaped += "\\\\"; break;
+		case '\n': escaped += "\\n"; break;
+		case '\r': escaped += "\\r"; break;
+		case '\t': escaped += "\\t"; break;
+		default:
+			if (c < 0x20)
+			{
+				char code[8];
+				snprintf(code, sizeof(code), "\\u%04x", c);
+				escaped += code;
+			}
+			else
+				escaped += (char)c;
+		}
+	}
+	return escaped;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CBenchmarkSweep
+
+CBenchmarkSweep::CBenchmarkSweep(const std::string& Name, TaskFactory Factory)
+	: m_Name(Name), m_Factory(Factory), m_NWarmup(1), m_NMeasured(5), m_Validated(true)
+{
+}
+
+void CBenchmarkSweep::AddProblemSize(size_t ProblemSize)
+{
+	m_ProblemSizes.push_back(ProblemSize);
+}
+
+void CBenchmarkSweep::AddLocalWorkSize(size_t X, size_t Y, size_t Z)
+{
+	m_LocalWorkSizes.push_back(X);
+	m_LocalWorkSizes.push_back(Y);
+	m_LocalWorkSizes.push_back(Z);
+}
+
+void CBenchmarkSweep::AddVariant(const std::string& Variant)
+{
+	m_Variants.push_back(Variant);
+}
+
+void CBenchmarkSweep::SetIterations(int NWarmup, int NMeasured)
+{
+	m_NWarmup = max(NWarmup, 0);
+	m_NMeasured = max(NMeasured, 1);
+}
+
+vector<CBenchmarkSweep::Configuration> CBenchmarkSweep::GetConfigurations() const
+{
+	vector<string> variants = m_Variants;
+	if (variants.empty())
+		variants.push_back("");
+
+	vector<Configuration> configs;
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		for (size_t p = 0; p < m_ProblemSizes.size(); p++)
+		{
+			for (size_t l = 0; l < m_LocalWorkSizes.size(); l += 3)
+			{
+				Configuration config;
+				config.ProblemSize = m_ProblemSizes[p];
+				config.LocalWorkSize[0] = m_LocalWorkSizes[l];
+				config.LocalWorkSize[1] = m_LocalWorkSizes[l + 1];
+				config.LocalWorkSize[2] = m_LocalWorkSizes[l + 2];
+				config.Variant = variants[v];
+				configs.push_back(config);
+			}
+		}
+	}
+
+	return configs;
+}
+
+IComputeTask* CBenchmarkSweep::CreateTask(const Configuration& Config, size_t& Elements, size_t& Bytes) const
+{
+	Elements = 0;
+	Bytes = 0;
+	return m_Factory ? m_Factory(Config, Elements, Bytes) : NULL;
+}
+
+void CBenchmarkSweep::AddResult(const Configuration& Config, size_t Elements, size_t Bytes, bool Valid, const std::vector<double>& TimesMs)
+{
+	Result result;
+	result.Config = Config;
+	result.Elements = Elements;
+	result.Bytes = Bytes;
+	result.Valid = Valid;
+	result.NMeasured = (int)TimesMs.size();
+	result.MeanMs = 0.0;
+	result.MinMs = 0.0;
+	result.ElementsPerSecond = 0.0;
+	result.GBPerSecond = 0.0;
+
+	if (!TimesMs.empty())
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < TimesMs.size(); i++)
+			sum += TimesMs[i];
+		result.MeanMs = sum / TimesMs.size();
+		result.MinMs = *min_element(TimesMs.begin(), TimesMs.end());
+	}
+
+	if (result.MeanMs > 0.0)
+	{
+		result.ElementsPerSecond = Elements / (result.MeanMs * 1.0e-3);
+		result.GBPerSecond = Bytes / (result.MeanMs * 1.0e6);
+	}
+
+	m_Results.push_back(result);
+}
+
+void CBenchmarkSweep::PrintResults() const
+{
+	cout << endl << "Benchmark sweep '" << m_Name << "' (" << m_NWarmup << " warm-up, " << m_NMeasured << " measured runs"
+		<< (m_Validated ? "" : ", not validated") << "):" << endl;
+	for (size_t i = 0; i < m_Results.size(); i++)
+	{
+		const Result& r = m_Results[i];
+		cout << "  ";
+		if (!r.Config.Variant.empty())
+			cout << r.Config.Variant << " ";
+		cout << "size " << r.Config.ProblemSize << ", local (" << r.Config.LocalWorkSize[0] << "," << r.Config.LocalWorkSize[1]
+			<< "," << r.Config.LocalWorkSize[2] << "): ";
+		if (r.NMeasured > 0)
+			cout << r.MeanMs << " ms, " << r.ElementsPerSecond * 1.0e-6 << " M elements/s, " << r.GBPerSecond << " GB/s";
+		else
+			cout << "no device time";
+		cout << (r.Valid || !m_Validated ? "" : " [INVALID]") << endl;
+	}
+	cout << endl;
+}
+
+bool CBenchmarkSweep::WriteCSV(const std::string& Path) const
+{
+	ofstream file(Path.c_str());
+	if (!file.is_open())
+	{
+		cerr << "Failed to open file '" << Path << "'." << endl;
+		return false;
+	}
+
+	file << "benchmark,variant,problem_size,local_x,local_y,local_z,valid,runs,mean_ms,min_ms,elements_per_s,gb_per_s" << endl;
+	for (size_t i = 0; i < m_Results.size(); i++)
+	{
+		const Result& r = m_Results[i];
+		// the valid column stays empty if the results were not validated, the time columns if no run was measured
+		file << EscapeCSV(m_Name) << "," << EscapeCSV(r.Config.Variant) << "," << r.Config.ProblemSize << "," << r.Config.LocalWorkSize[0] << ","
+			<< r.Config.LocalWorkSize[1] << "," << r.Config.LocalWorkSize[2] << "," << (m_Validated ? (r.Valid ? "1" : "0") : "") << "," << r.NMeasured;
+		if (r.NMeasured > 0)
+			file << "," << r.MeanMs << "," << r.MinMs << "," << r.ElementsPerSecond << "," << r.GBPerSecond << endl;
+		else
+			file << ",,,," << endl;
+	}
+
+	return true;
+}
+
+bool CBenchmarkSweep::WriteJSON(const std::string& Path) const
+{
+	ofstream file(Path.c_str());
+	if (!file.is_open())
+	{
+		cerr << "Failed to open file '" << Path << "'." << endl;
+		return false;
+	}
+
+	file << "{" << endl << "  \"benchmark\": \"" << EscapeJSON(m_Name) << "\"," << endl;
+	file << "  \"warmup\": " << m_NWarmup << "," << endl << "  \"measured\": " << m_NMeasured << "," << endl;
+	file << "  \"results\": [";
+	for (size_t i = 0; i < m_Results.size(); i++)
+	{
+		const Result& r = m_Results[i];
+		file << (i > 0 ? "," : "") << endl << "    {\"variant\": \"" << EscapeJSON(r.Config.Variant) << "\", \"problem_size\": " << r.Config.ProblemSize
+			<< ", \"local_work_size\": [" << r.Config.LocalWorkSize[0] << ", " << r.Config.LocalWorkSize[1] << ", " << r.Config.LocalWorkSize[2]
+			<< "], \"valid\": " << (m_Validated ? (r.Valid ? "true" : "false") : "null") << ", \"runs\": " << r.NMeasured;
+		if (r.NMeasured > 0)
+			file << ", \"mean_ms\": " << r.MeanMs << ", \"min_ms\": " << r.MinMs << ", \"elements_per_s\": " << r.ElementsPerSecond
+				<< ", \"gb_per_s\": " << r.GBPerSecond << "}";
+		else
+			file << ", \"mean_ms\": null, \"min_ms\": null, \"elements_per_s\": null, \"gb_per_s\": null}";
+	}
+	file << endl << "  ]" << endl << "}" << endl;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,91 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CCOUNTER_RNG_H
+#define _CCOUNTER_RNG_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <cstdint>
+#include <cstddef>
+
+//! Counter-based random numbers (Philox4x32-10) for reproducible input data
+/*!
+	Element i of stream s is a pure function of (seed, s, i), so buffers can be
+	filled in parallel, in any order, on the host or on the device, and always
+	get the same values. Use different streams for arrays that should be
+	independent.
+
+	The seed is GPUC_SEED if set, otherwise a fixed constant.
+
+	The device fills build a small program through CLUtil::BuildProgramVariant()
+	and produce the same bits as the host fills (the float kernels disable
+	FP contraction for this).
+*/
+class CCounterRNG
+{
+public:
+	explicit CCounterRNG(uint64_t Seed = GetDefaultSeed());
+
+	static uint64_t GetDefaultSeed();
+
+	//! The four 32 bit words of the block Counter of a stream
+	void GenerateBlock(uint64_t Stream, uint64_t Counter, uint32_t Result[4]) const;
+
+	//! Word Index of a stream
+	uint32_t GetUInt(uint64_t Stream, uint64_t Index) const;
+
+	//! Uniform float in [0, 1) with 24 random bits
+	float GetFloat(uint64_t Stream, uint64_t Index) const;
+
+	//! Uniform integers in [0, Bound), Bound = 0 means the full 32 bit range
+	void FillUInt(unsigned int* pData, size_t N, uint32_t Bound, uint64_t Stream = 0) const;
+	void FillInt(int* pData, size_t N, uint32_t Bound, uint64_t Stream = 0) const;
+
+	//! Uniform floats in [Min, Max)
+	void FillFloat(float* pData, size_t N, float Min = 0.0f, float Max = 1.0f, uint64_t Stream = 0) const;
+
+	//! Same as FillUInt(), but writes a device buffer with a kernel
+	bool FillDeviceUInt(cl_command_queue CommandQueue, cl_mem Buffer, size_t N, uint32_t Bound, uint64_t Stream = 0) const;
+
+	//! Same as FillFloat(), but writes a device buffer with a kernel
+	bool FillDeviceFloat(cl_command_queue CommandQueue, cl_mem Buffer, size_t N, float Min = 0.0f, float Max = 1.0f, uint64_t Stream = 0) const;
+
+	//! Runs the device generator on the known-answer vectors of Random123, false if a single word differs
+	/*!
+		Reads back three blocks instead of a whole buffer, so a task can decide
+		cheaply whether the device fills reproduce its host input.
+	*/
+	static bool CheckDevice(cl_command_queue CommandQueue);
+
+protected:
+	bool FillDevice(cl_command_queue CommandQueue, const char* KernelName, cl_mem Buffer, size_t N,
+		const void* pArgs, size_t ArgSize, uint64_t Stream) const;
+
+	uint32_t	m_Key[2];
+};
+
+#endif // _CCOUNTER_RNG_H
@@ -0,0 +1,100 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CDEVICE_CAPS_H
+#define _CDEVICE_CAPS_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <string>
+
+class CLDefines;
+
+//! What a device can do, for picking the kernel variants that suit it
+/*!
+	Several kernels were written for NVIDIA GPUs and assume a warp of 32 work-items
+	and 32 local memory banks. Get() queries a device once, AddDefines() hands the
+	matching values to a program variant (see CLUtil::BuildProgramVariant()). Built
+	without them, the kernels fall back to values that are correct everywhere.
+
+	The SIMD width and the number of banks are not part of core OpenCL:
+	- SimdWidth is read from the vendor extensions (cl_nv_device_attribute_query,
+	  cl_amd_device_attribute_query, cl_intel_required_subgroup_size), otherwise it
+	  is the preferred work-group size multiple of a small probe kernel.
+	- LockstepWidth is the number of work-items that run in lockstep, which
+	  warp-synchronous code without barriers relies on. Only AMD GPUs and NVIDIA
+	  GPUs before Volta guarantee that, it is 1 on all other devices.
+	- NumLocalBanks is 16 on Intel GPUs and 32 on the others.
+*/
+class CDeviceCaps
+{
+public:
+	//! The capabilities of a device, queried on the first call. Device = nullptr gives the portable defaults.
+	static const CDeviceCaps& Get(cl_device_id Device);
+
+	//! Sets SIMD_WIDTH, LOCKSTEP_WIDTH, NUM_BANKS, NUM_BANKS_LOG, VECTOR_WIDTH_FLOAT/INT and HAS_FP16/FP64/INT64_ATOMICS/SUBGROUPS
+	//! Programs that use HAS_SUBGROUPS have to be built with SubgroupOptions.
+	void AddDefines(CLDefines& Defines) const;
+
+	//! Size of a local array of N elements that is padded with OFFSET(A) = A + A / NUM_BANKS
+	size_t GetPaddedLocalElements(size_t N) const { return N + N / NumLocalBanks; }
+
+	void Print() const;
+
+	std::string		Name;
+	std::string		Vendor;
+	bool			IsGPU = false;
+
+	unsigned int	SimdWidth = 1;
+	unsigned int	LockstepWidth = 1;
+	unsigned int	NumLocalBanks = 32;
+	cl_ulong		LocalMemSize = 0;
+	//! false if local memory is emulated in global memory, as on CPUs
+	bool			HasLocalMemory = false;
+	size_t			MaxWorkGroupSize = 1;
+	cl_uint			ComputeUnits = 1;
+
+	bool			HasFP16 = false;
+	bool			HasFP64 = false;
+	bool			HasInt64Atomics = false;
+	//! The sub_group_* functions, from cl_khr_subgroups (OpenCL C 2.0 or later) or cl_intel_subgroups
+	bool			HasSubgroups = false;
+	//! Compile options the subgroup functions need, e.g. -cl-std=CL2.0
+	std::string		SubgroupOptions;
+	//! Launches can be recorded into command buffers (cl_khr_command_buffer), see CLaunchRecording
+	bool			HasCommandBuffer = false;
+
+	cl_uint			VectorWidthFloat = 1;
+	cl_uint			VectorWidthInt = 1;
+
+protected:
+	void Query(cl_device_id Device);
+
+	//! Preferred work-group size multiple of a trivial kernel, 0 if it could not be built
+	static unsigned int ProbeSimdWidth(cl_device_id Device);
+};
+
+#endif // _CDEVICE_CAPS_H
@@ -0,0 +1,235 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CMemoryTracker.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// task of the allocations on this thread, see TaskScope
+static thread_local string t_Task;
+
+static double ToMB(double Bytes)
+{
+	return Bytes / (1024.0 * 1024.0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CMemoryTracker::TaskScope
+
+CMemoryTracker::TaskScope::TaskScope(const string& Task)
+	: m_PreviousTask(t_Task)
+{
+	t_Task = Task;
+}
+
+CMemoryTracker::TaskScope::~TaskScope()
+{
+	t_Task = m_PreviousTask;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CMemoryTracker
+
+CMemoryTracker& CMemoryTracker::GetInstance()
+{
+	static CMemoryTracker instance;
+	return instance;
+}
+
+CMemoryTracker::CMemoryTracker()
+{
+}
+
+CMemoryTracker::DeviceLimits CMemoryTracker::GetLimits(cl_context Context)
+{
+	DeviceLimits limits;
+
+	size_t bytes = 0;
+	if (clGetContextInfo(Context, CL_CONTEXT_DEVICES, 0, NULL, &bytes) != CL_SUCCESS || bytes == 0)
+		return limits;
+	vector<cl_device_id> devices(bytes / sizeof(cl_device_id));
+	if (clGetContextInfo(Context, CL_CONTEXT_DEVICES, bytes, &devices[0], NULL) != CL_SUCCESS)
+		return limits;
+
+	for (size_t i = 0; i < devices.size(); i++)
+	{
+		cl_ulong maxAlloc = 0, globalMem = 0;
+		clGetDeviceInfo(devices[i], CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAlloc), &maxAlloc, NULL);
+		clGetDeviceInfo(devices[i], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMem), &globalMem, NULL);
+
+		if (limits.GlobalMemSize == 0 || globalMem < limits.GlobalMemSize)
+		{
+			char name[256] = "";
+			clGetDeviceInfo(devices[i], CL_DEVICE_NAME, sizeof(name), name, NULL);
+			limits.DeviceName = name;
+			limits.GlobalMemSize = globalMem;
+		}
+		if (limits.MaxAllocSize == 0 || maxAlloc < limits.MaxAllocSize)
+			limits.MaxAllocSize = maxAlloc;
+	}
+	return limits;
+}
+
+bool CMemoryTracker::CheckAllocation(cl_context Context, size_t Size, const string& Tag)
+{
+	DeviceLimits limits = GetLimits(Context);
+	size_t live = GetLiveBytes(Context);
+
+	if (limits.MaxAllocSize > 0 && Size > limits.MaxAllocSize)
+	{
+		cerr << "Warning: " << Tag << " allocates " << ToMB((double)Size) << " MB, more than the "
+			<< ToMB((double)limits.MaxAllocSize) << " MB a single allocation may have on " << limits.DeviceName
+			<< " (CL_DEVICE_MAX_MEM_ALLOC_SIZE)." << endl;
+		return false;
+	}
+	if (limits.GlobalMemSize > 0 && live + Size > limits.GlobalMemSize)
+	{
+		cerr << "Warning: " << Tag << " allocates " << ToMB((double)Size) << " MB with "
+			<< ToMB((double)live) << " MB already allocated, more than the " << ToMB((double)limits.GlobalMemSize)
+			<< " MB of global memory of " << limits.DeviceName << "." << endl;
+		return false;
+	}
+	return true;
+}
+
+cl_mem CMemoryTracker::CreateBuffer(cl_context Context, cl_mem_flags Flags, size_t Size, void* pHostPtr, cl_int* pErrorCode, const string& Tag)
+{
+	// the driver reports the actual error, if any
+	CheckAllocation(Context, Size, Tag);
+
+	cl_int clError;
+	cl_mem buffer = clCreateBuffer(Context, Flags, Size, pHostPtr, &clError);
+	if (pErrorCode)
+		*pErrorCode = clError;
+	if (clError != CL_SUCCESS)
+		return NULL;
+
+	Track(buffer, Tag);
+	return buffer;
+}
+
+void CMemoryTracker::Track(cl_mem MemObject, const string& Tag)
+{
+	if (!MemObject)
+		return;
+
+	Allocation allocation;
+	allocation.Size = 0;
+	allocation.Context = NULL;
+	clGetMemObjectInfo(MemObject, CL_MEM_SIZE, sizeof(allocation.Size), &allocation.Size, NULL);
+	clGetMemObjectInfo(MemObject, CL_MEM_CONTEXT, sizeof(allocation.Context), &allocation.Context, NULL);
+	allocation.Tag = Tag;
+	allocation.Task = t_Task.empty() ? string("(no task)") : t_Task;
+
+	cl_ulong globalMemSize = GetLimits(allocation.Context).GlobalMemSize;
+
+	{
+		lock_guard<mutex> lock(m_Mutex);
+
+		// tracked twice, the first record stays
+		if (m_Allocations.find(MemObject) != m_Allocations.end())
+			return;
+		m_Allocations[MemObject] = allocation;
+		m_LiveBytes[allocation.Context] += allocation.Size;
+
+		TaskStatistics& task = m_Tasks[allocation.Task];
+		task.LiveBytes += allocation.Size;
+		task.PeakBytes = max(task.PeakBytes, task.LiveBytes);
+		task.NAllocations++;
+		task.GlobalMemSize = max(task.GlobalMemSize, globalMemSize);
+		size_t& tagBytes = task.Tags[Tag];
+		tagBytes = max(tagBytes, allocation.Size);
+	}
+
+	// removes the record when the last reference is released, wherever that happens
+	if (clSetMemObjectDestructorCallback(MemObject, OnDestroyed, this) != CL_SUCCESS)
+		Forget(MemObject);
+}
+
+void CMemoryTracker::Recharge(cl_mem MemObject, const string& Task)
+{
+	string newTask = !Task.empty() ? Task : (t_Task.empty() ? string("(no task)") : t_Task);
+
+	lock_guard<mutex> lock(m_Mutex);
+
+	map<cl_mem, Allocation>::iterator it = m_Allocations.find(MemObject);
+	if (it == m_Allocations.end() || it->second.Task == newTask)
+		return;
+
+	TaskStatistics& previous = m_Tasks[it->second.Task];
+	previous.LiveBytes -= it->second.Size;
+
+	TaskStatistics& task = m_Tasks[newTask];
+	task.LiveBytes += it->second.Size;
+	task.PeakBytes = max(task.PeakBytes, task.LiveBytes);
+	task.NAllocations++;
+	task.GlobalMemSize = max(task.GlobalMemSize, previous.GlobalMemSize);
+	size_t& tagBytes = task.Tags[it->second.Tag];
+	tagBytes = max(tagBytes, it->second.Size);
+
+	it->second.Task = newTask;
+}
+
+void CL_CALLBACK CMemoryTracker::OnDestroyed(cl_mem MemObject, void* pUserData)
+{
+	// may be called from a thread of the driver
+	static_cast<CMemoryTracker*>(pUserData)->Forget(MemObject);
+}
+
+void CMemoryTracker::Forget(cl_mem MemObject)
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	map<cl_mem, Allocation>::iterator it = m_Allocations.find(MemObject);
+	if (it == m_Allocations.end())
+		return;
+
+	m_LiveBytes[it->second.Context] -= it->second.Size;
+	m_Tasks[it->second.Task].LiveBytes -= it->second.Size;
+	m_Allocations.erase(it);
+}
+
+size_t CMemoryTracker::GetLiveBytes(cl_context Context) const
+{
+	lock_guard<mutex> lock(m_Mutex);
+	map<cl_context, size_t>::const_iterator it = m_LiveBytes.find(Context);
+	return it != m_LiveBytes.end() ? it->second : 0;
+}
+
+size_t CMemoryTracker::GetPeakBytes(const string& Task) const
+{
+	lock_guard<mutex> lock(m_Mutex);
+	map<string, TaskStatistics>::const_iterator it = m_Tasks.find(Task);
+	return it != m_Tasks.end() ? it->second.PeakBytes : 0;
+}
+
+void CMemoryTracker::PrintStatistics() const
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	for (map<string, TaskStatistics>::const_iterator it = m_Tasks.begin(); it != m_Tasks.end(); ++it)
+	{
+		const TaskStatistics& task = it->second;
+		cout << "Device memory of " << it->first << ": " << task.NAllocations << " allocations, peak "
+			<< ToMB((double)task.PeakBytes) << " MB";
+		if (task.GlobalMemSize > 0)
+			cout << " (" << 100.0 * task.PeakBytes / task.GlobalMemSize << "% of " << ToMB((double)task.GlobalMemSize) << " MB)";
+		cout << ", " << ToMB((double)task.LiveBytes) << " MB still live." << endl;
+
+		// the largest allocations first
+		vector<pair<size_t, string> > tags;
+		for (map<string, size_t>::const_iterator tag = task.Tags.begin(); tag != task.Tags.end(); ++tag)
+			tags.push_back(make_pair(tag->second, tag->first));
+		sort(tags.rbegin(), tags.rend());
+
+		const size_t maxTags = 5;
+		for (size_t i = 0; i < tags.size() && i < maxTags; i++)
+			cout << "  " << tags[i].second << ": " << ToMB((double)tags[i].first) << " MB" << endl;
+	}
+}
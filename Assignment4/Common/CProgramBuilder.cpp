@@ -0,0 +1,61 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CProgramBuilder.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CProgramBuilder
+
+CProgramBuilder::~CProgramBuilder()
+{
+	Clear();
+}
+
+size_t CProgramBuilder::Add(cl_device_id Device, cl_context Context, const std::string& SourceCode, const std::string& CompileOptions)
+{
+	// the strings are copied, the caller may reuse its buffers right away
+	m_Builds.push_back(async(launch::async, [=]() {
+		return CLUtil::BuildCLProgramFromMemory(Device, Context, SourceCode, CompileOptions);
+	}));
+	return m_Builds.size() - 1;
+}
+
+size_t CProgramBuilder::AddVariant(cl_device_id Device, cl_context Context, const std::string& SourceCode,
+	const CLDefines& Defines, const std::string& CompileOptions)
+{
+	m_Builds.push_back(async(launch::async, [=]() {
+		return CLUtil::BuildProgramVariant(Device, Context, SourceCode, Defines, CompileOptions);
+	}));
+	return m_Builds.size() - 1;
+}
+
+cl_program CProgramBuilder::Get(size_t Index)
+{
+	if (Index >= m_Builds.size() || !m_Builds[Index].valid())
+		return nullptr;
+	return m_Builds[Index].get();
+}
+
+bool CProgramBuilder::HasPending() const
+{
+	for (size_t i = 0; i < m_Builds.size(); i++)
+		if (m_Builds[i].valid())
+			return true;
+	return false;
+}
+
+void CProgramBuilder::Clear()
+{
+	for (size_t i = 0; i < m_Builds.size(); i++)
+	{
+		if (!m_Builds[i].valid())
+			continue;
+		cl_program prog = m_Builds[i].get();
+		SAFE_RELEASE_PROGRAM(prog);
+	}
+	m_Builds.clear();
+}
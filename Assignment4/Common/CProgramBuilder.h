@@ -0,0 +1,75 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CPROGRAM_BUILDER_H
+#define _CPROGRAM_BUILDER_H
+
+#include "CLUtil.h"
+
+#include <future>
+#include <string>
+#include <vector>
+
+//! Builds several CL programs concurrently
+/*!
+	clBuildProgram() blocks the calling thread on most drivers (the notify callback
+	is only called after the build, not instead of waiting for it), so each build
+	runs on a host thread of its own. A task starts all of its builds first and
+	waits for a program only where it creates the kernels, e.g.
+
+		CProgramBuilder builder;
+		size_t scan = builder.Add(Device, Context, scanCode);
+		size_t sort = builder.Add(Device, Context, sortCode);
+		...create buffers...
+		m_ScanProgram = builder.Get(scan);
+
+	The init time then is about that of the slowest build instead of the sum.
+	Programs that are never taken with Get() are released by the destructor,
+	which also waits for all builds, so returning early on an error is safe.
+*/
+class CProgramBuilder
+{
+public:
+	CProgramBuilder() {}
+	~CProgramBuilder();
+
+	//! Starts CLUtil::BuildCLProgramFromMemory(), returns the index for Get()
+	size_t Add(cl_device_id Device, cl_context Context, const std::string& SourceCode, const std::string& CompileOptions = "");
+
+	//! Starts CLUtil::BuildProgramVariant(), returns the index for Get()
+	size_t AddVariant(cl_device_id Device, cl_context Context, const std::string& SourceCode,
+		const CLDefines& Defines, const std::string& CompileOptions = "");
+
+	//! Waits for a build; the caller owns the program, nullptr if the build failed or was taken before
+	cl_program Get(size_t Index);
+
+	//! Whether there are builds that were not taken with Get() yet
+	bool HasPending() const;
+
+	//! Waits for all builds and releases the programs that were not taken
+	void Clear();
+
+protected:
+	CProgramBuilder(const CProgramBuilder&);
+	CProgramBuilder& operator=(const CProgramBuilder&);
+
+	std::vector<std::future<cl_program> >	m_Builds;
+};
+
+#endif // _CPROGRAM_BUILDER_H
@@ -0,0 +1,249 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CTaskScheduler.h"
+
+#include "CLUtil.h"
+#include "CMemoryTracker.h"
+#include "CTimer.h"
+#include "CTraceRecorder.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <thread>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CTaskScheduler
+
+CTaskScheduler::CTaskScheduler()
+	: m_Device(nullptr), m_Context(nullptr), m_MemoryBudget(0), m_BytesInUse(0), m_NRunning(0)
+{
+}
+
+CTaskScheduler::~CTaskScheduler()
+{
+	Release();
+}
+
+bool CTaskScheduler::Init(cl_device_id Device, cl_context Context, unsigned int NQueues, size_t MemoryBudget)
+{
+	Release();
+
+	m_Device = Device;
+	m_Context = Context;
+
+	if (NQueues == 0)
+	{
+		const char* env = getenv("GPUC_SCHED_QUEUES");
+		NQueues = (env != NULL && atoi(env) > 0) ? (unsigned int)atoi(env) : 2;
+	}
+
+	if (MemoryBudget == 0)
+	{
+		cl_ulong globalMemSize;
+		V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemSize, NULL),
+			"Failed to query the global memory size.");
+		MemoryBudget = (size_t)(globalMemSize / 4 * 3);
+	}
+	m_MemoryBudget = MemoryBudget;
+
+	for (unsigned int i = 0; i < NQueues; i++)
+	{
+		cl_int clError;
+		// the tasks time their kernels with CLUtil::ProfileKernel() as on the main queue
+		cl_command_queue queue = clCreateCommandQueue(Context, Device, CL_QUEUE_PROFILING_ENABLE, &clError);
+		V_RETURN_FALSE_CL(clError, "Failed to create a scheduler command queue.");
+		m_Queues.push_back(queue);
+	}
+
+	return true;
+}
+
+void CTaskScheduler::Release()
+{
+	for (size_t i = 0; i < m_Queues.size(); i++)
+		clReleaseCommandQueue(m_Queues[i]);
+	m_Queues.clear();
+	m_Jobs.clear();
+}
+
+void CTaskScheduler::AddJob(IComputeTask* pTask, size_t LocalWorkSize[3], size_t DeviceBytes, const std::string& Name,
+	bool TuneLocalWorkSize)
+{
+	Job job;
+	job.pTask = pTask;
+	job.LocalWorkSize = LocalWorkSize;
+	job.TuneLocalWorkSize = TuneLocalWorkSize;
+	job.DeviceBytes = DeviceBytes != 0 ? DeviceBytes : pTask->GetDeviceBytes();
+	job.Name = Name.empty() ? pTask->GetName() : Name;
+	if (job.Name.empty())
+	{
+		stringstream name;
+		name << "job " << m_Jobs.size();
+		job.Name = name.str();
+	}
+	m_Jobs.push_back(job);
+}
+
+bool CTaskScheduler::Run()
+{
+	if (m_Queues.empty())
+	{
+		cerr << "Error: the task scheduler has not been initialized." << endl;
+		return false;
+	}
+
+	m_Results.assign(m_Jobs.size(), JobResult());
+	m_Started.assign(m_Jobs.size(), false);
+	m_BytesInUse = 0;
+	m_NRunning = 0;
+
+	// one host thread per queue, the calling thread takes the first queue
+	vector<thread> workers;
+	for (size_t i = 1; i < m_Queues.size(); i++)
+		workers.push_back(thread(&CTaskScheduler::WorkerLoop, this, m_Queues[i]));
+	WorkerLoop(m_Queues[0]);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	m_Jobs.clear();
+
+	bool success = true;
+	for (size_t i = 0; i < m_Results.size(); i++)
+		success = success && m_Results[i].Initialized && m_Results[i].Valid;
+	return success;
+}
+
+void CTaskScheduler::WorkerLoop(cl_command_queue CommandQueue)
+{
+	size_t jobIndex, bytes;
+	while (AcquireJob(jobIndex, bytes))
+	{
+		RunJob(m_Jobs[jobIndex], CommandQueue, m_Results[jobIndex]);
+		ReleaseJob(bytes);
+	}
+}
+
+bool CTaskScheduler::AcquireJob(size_t& JobIndex, size_t& Bytes)
+{
+	unique_lock<mutex> lock(m_Mutex);
+	for (;;)
+	{
+		bool remaining = false;
+		for (size_t i = 0; i < m_Jobs.size(); i++)
+		{
+			if (m_Started[i])
+				continue;
+			remaining = true;
+
+			size_t bytes = m_Jobs[i].DeviceBytes;
+			if (bytes == 0)
+				bytes = m_MemoryBudget / m_Queues.size();
+
+			// an oversized job is admitted when the device is idle
+			if (m_BytesInUse + bytes <= m_MemoryBudget || m_NRunning == 0)
+			{
+				m_Started[i] = true;
+				m_BytesInUse += bytes;
+				m_NRunning++;
+				JobIndex = i;
+				Bytes = bytes;
+				return true;
+			}
+		}
+
+		if (!remaining)
+			return false;
+		m_JobFinished.wait(lock);
+	}
+}
+
+void CTaskScheduler::ReleaseJob(size_t Bytes)
+{
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_BytesInUse -= Bytes;
+		m_NRunning--;
+	}
+	m_JobFinished.notify_all();
+}
+
+void CTaskScheduler::RunJob(const Job& CurrentJob, cl_command_queue CommandQueue, JobResult& Result)
+{
+	CScopeTimer jobTimer(CurrentJob.Name);
+	CMemoryTracker::TaskScope memoryScope(CurrentJob.Name);
+
+	Result.Name = CurrentJob.Name;
+	Result.Valid = false;
+	Result.CPUMs = 0.0;
+	Result.GPUMs = 0.0;
+
+	{
+		CScopeTimer timer("InitResources");
+		Result.Initialized = CurrentJob.pTask->InitResources(m_Device, m_Context, CommandQueue);
+	}
+	if (!Result.Initialized)
+	{
+		cerr << "Error during resource allocation of " << CurrentJob.Name << "." << endl;
+		CurrentJob.pTask->ReleaseResources();
+		return;
+	}
+
+	CTimer timer;
+	{
+		CScopeTimer scope("ComputeCPU");
+		timer.Start();
+		CurrentJob.pTask->ComputeCPU();
+		timer.Stop();
+		Result.CPUMs = timer.GetElapsedMilliseconds();
+	}
+
+	{
+		CScopeTimer scope("PrepareComputeGPU");
+		CurrentJob.pTask->PrepareComputeGPU(CommandQueue, CurrentJob.LocalWorkSize, CurrentJob.TuneLocalWorkSize);
+	}
+
+	{
+		CScopeTimer scope("ComputeGPU");
+		timer.Start();
+		CurrentJob.pTask->ComputeGPU(m_Context, CommandQueue, CurrentJob.LocalWorkSize);
+		clFinish(CommandQueue);
+		timer.Stop();
+		Result.GPUMs = timer.GetElapsedMilliseconds();
+	}
+
+	{
+		CScopeTimer scope("ValidateResults");
+		Result.Valid = CurrentJob.pTask->ValidateResults();
+	}
+
+	CurrentJob.pTask->ReleaseResources();
+}
+
+void CTaskScheduler::PrintResults() const
+{
+	streamsize precision = cout.precision();
+	cout << "Scheduled " << m_Results.size() << " jobs on " << m_Queues.size() << " queues ("
+		<< m_MemoryBudget / (1024 * 1024) << " MB budget):" << endl;
+	for (size_t i = 0; i < m_Results.size(); i++)
+	{
+		const JobResult& result = m_Results[i];
+		cout << "  " << setw(24) << left << result.Name << right;
+		if (!result.Initialized)
+		{
+			cout << "  initialization failed" << endl;
+			continue;
+		}
+		cout << "  CPU " << setw(9) << fixed << setprecision(3) << result.CPUMs << " ms"
+			<< "  GPU " << setw(9) << result.GPUMs << " ms  "
+			<< (result.Valid ? "PASSED" : "INVALID") << endl;
+		cout.unsetf(ios::floatfield);
+	}
+	cout.precision(precision);
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,95 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CWORK_GROUP_TUNER_H
+#define _CWORK_GROUP_TUNER_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include "CommonDefs.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! Finds the fastest local work size of a kernel and remembers it across runs
+/*!
+	Candidates are all power-of-two local work sizes that respect
+	 - CL_KERNEL_WORK_GROUP_SIZE and the device limits per dimension,
+	 - the local memory of the device (static usage of the kernel plus
+	   the dynamic local buffer, if one is given),
+	 - reqd_work_group_size: a kernel compiled with it has exactly one candidate.
+
+	Each candidate is timed with CLUtil::ProfileKernel(), without a roofline
+	report per candidate. The winner is stored per
+	(device, kernel, problem size bucket) in a small text database, so that later
+	runs read it instead of tuning again. Buckets round every dimension of the
+	problem size up to the next power of two.
+
+	The database is GPUC_TUNING_DB (default: WorkGroupSizes.txt).
+
+	NOTE: tuning launches the kernel with its current arguments, so only tune
+	kernels whose repeated execution is harmless, or re-initialize the data afterwards.
+*/
+class CWorkGroupTuner
+{
+public:
+	//! Looks up a previously tuned local work size, returns false if there is none
+	static bool FindLocalWorkSize(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions,
+		const size_t* pProblemSize, size_t LocalWorkSize[3]);
+
+	//! Returns the tuned local work size from the database, tuning and storing it first if necessary
+	/*!
+		LocalMemArgIndex / LocalMemPerWorkItem describe a __local kernel argument whose size
+		scales with the work-group (e.g. one float per work-item). The tuner sets this
+		argument for every candidate. Pass -1 if the kernel has no such argument.
+		MinWorkItems excludes work-groups the kernel cannot work with, e.g. fewer
+		work-items than a local histogram has bins.
+	*/
+	static bool Tune(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions,
+		const size_t* pProblemSize, size_t LocalWorkSize[3],
+		int LocalMemArgIndex = -1, size_t LocalMemPerWorkItem = 0, int NIterations = 10, size_t MinWorkItems = 1);
+
+	//! All local work sizes that are legal for the kernel on the device of the queue
+	static std::vector<std::vector<size_t> > GetCandidates(cl_device_id Device, cl_kernel Kernel, cl_uint Dimensions,
+		size_t LocalMemPerWorkItem, size_t MinWorkItems = 1);
+
+protected:
+	static std::string GetKey(cl_device_id Device, cl_kernel Kernel, cl_uint Dimensions, const size_t* pProblemSize);
+
+	static std::string GetDatabasePath();
+
+	static void LoadDatabase();
+
+	static void StoreEntry(const std::string& Key, const size_t LocalWorkSize[3], double TimeMs);
+
+	static std::mutex								s_Mutex;
+	static bool										s_Loaded;
+	static std::map<std::string, std::vector<size_t> >	s_Entries;
+};
+
+#endif // _CWORK_GROUP_TUNER_H
@@ -12,7 +12,10 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "GLCommon.h"
 
+#include "../Common/CBenchmark.h"
+#include "../Common/CBenchmarkSweep.h"
 #include "../Common/CLUtil.h"
+#include "../Common/CTraceRecorder.h"
 #include <CL/cl_gl.h>
 
 #ifdef __linux__
@@ -63,9 +66,25 @@ CAssignment5::~CAssignment5() {
 }
 
 bool CAssignment5::EnterMainLoop(int argc, char** argv) {
+  ParseDeviceOptions(argc, argv);
+
+  if (m_RunSweep) {
+    // a plain context, the sweep creates headless tasks of its own
+    bool success = CAssignmentBase::InitCLContext() && DoBenchmarkSweep();
+    ReleaseCLContext();
+    return success;
+  }
+
+  if (m_HeadlessSteps > 0) return RunHeadless();
+
+  bool success = true;
+
   // create CL context with GL context sharing
   if (InitGL(argc, argv) && InitCLContext()) {
-    if (m_pCurrentTask) m_pCurrentTask->InitResources(m_CLDevice, m_CLContext, m_CLCommandQueue);
+    if (m_pCurrentTask) {
+      CScopeTimer timer("InitResources");
+      m_pCurrentTask->InitResources(m_CLDevice, m_CLContext, m_CLCommandQueue);
+    }
 
 
 #ifdef BUILD_PERF_TEST 
@@ -84,85 +103,94 @@ bool CAssignment5::EnterMainLoop(int argc, char** argv) {
     if (m_pCurrentTask) m_pCurrentTask->ReleaseResources();
   } else {
     cerr << "Failed to create GL and CL context, terminating..." << endl;
+    success = false;
   }
 
   ReleaseCLContext();
   CleanupGL();
 
-  return true;
+  // regressions against a benchmark baseline fail the performance test, see CBenchmark
+  return CBenchmark::GetInstance().Finish() && success;
 }
 
-bool CAssignment5::DoCompute() {
-  if (m_pCurrentTask) m_pCurrentTask->ComputeGPU(m_CLContext, m_CLCommandQueue, m_LocalWorkSize);
+bool CAssignment5::RunHeadless() {
+  // a plain context, there is no GL context to share with
+  if (!m_pCurrentTask || !CAssignmentBase::InitCLContext()) {
+    cerr << "Failed to create CL context, terminating..." << endl;
+    ReleaseCLContext();
+    return false;
+  }
 
-  return true;
-}
+  m_pCurrentTask->SetHeadless(true);
 
-#define PRINT_INFO(title, buffer, bufferSize, maxBufferSize, expr) \
-  {                                                                \
-    expr;                                                          \
-    buffer[bufferSize] = '\0';                                     \
-    std::cout << title << ": " << buffer << std::endl;             \
+  bool success;
+  {
+    CScopeTimer timer("InitResources");
+    success = m_pCurrentTask->InitResources(m_CLDevice, m_CLContext, m_CLCommandQueue);
   }
 
-bool CAssignment5::InitCLContext() {
-  // 1. get all platform IDs
+  if (success) {
+    // a fixed time step keeps the runs comparable
+    const float dT = 1.0f / 60.0f;
+    m_pCurrentTask->ResetStageTimes();
 
-  std::vector<cl_platform_id> platformIds;
-  const cl_uint c_MaxPlatforms = 16;
-  platformIds.resize(c_MaxPlatforms);
+    CTimer timer;
+    timer.Start();
+    for (unsigned int step = 0; step < m_HeadlessSteps; step++) {
+      m_pCurrentTask->OnIdle(step * dT, dT);
+      DoCompute();
+    }
+    timer.Stop();
 
-  cl_uint countPlatforms;
-  V_RETURN_FALSE_CL(clGetPlatformIDs(c_MaxPlatforms, &platformIds[0], &countPlatforms), "Failed to get CL platform ID");
-  platformIds.resize(countPlatforms);
+    cout << "Headless: " << m_HeadlessSteps << " steps in " << timer.GetElapsedMilliseconds() << " ms" << endl;
+    m_pCurrentTask->PrintStageTimes(m_HeadlessSteps);
+  } else {
+    cerr << "Failed to initialize the task, terminating..." << endl;
+  }
 
-  // 2. find all available GPU devices
-  std::vector<cl_device_id> deviceIds;
-  const int maxDevices = 16;
-  deviceIds.resize(maxDevices);
-  int countAllDevices = 0;
+  m_pCurrentTask->ReleaseResources();
+  ReleaseCLContext();
 
+  return success;
+}
 
-  cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+bool CAssignment5::DoBenchmarkSweep() {
+  // ComputeGPU() advances the boxes and rebuilds the BVH once. CCreateBVH has no CPU reference
+  // outside of TestPerformance(), and no byte count.
+  std::string meshPath = "Assets/cubeMonkey.obj";
+  CBenchmarkSweep sweep("CreateBVH", [meshPath](const CBenchmarkSweep::Configuration& Config, size_t& Elements, size_t& Bytes) -> IComputeTask* {
+    Elements = Config.ProblemSize;
+    Bytes = 0;
+    size_t localWorkSize[3] = {Config.LocalWorkSize[0], Config.LocalWorkSize[1], Config.LocalWorkSize[2]};
+    CCreateBVH* pTask = new CCreateBVH(meshPath, Config.ProblemSize, 512, localWorkSize);
+    pTask->SetHeadless(true);
+    return pTask;
+  });
+  sweep.SetValidated(false);
+
+  size_t locsize[] = {64, 128, 192, 256};
+  size_t nelements[] = {10000, 100000, 1000000};
+  for (size_t i = 0; i < ARRAYLEN(locsize); ++i) sweep.AddLocalWorkSize(locsize[i]);
+  for (size_t j = 0; j < ARRAYLEN(nelements); ++j) sweep.AddProblemSize(nelements[j]);
+  sweep.SetIterations(2, 10);
+
+  if (!RunBenchmarkSweep(sweep)) return false;
+  return sweep.WriteCSV("CreateBVHSweep.csv") && sweep.WriteJSON("CreateBVHSweep.json");
+}
 
-  for (size_t i = 0; i < platformIds.size(); i++) {
-    // Getting the available devices.
-    cl_uint countDevices;
-    clGetDeviceIDs(platformIds[i], deviceType, 1, &deviceIds[countAllDevices], &countDevices);
-    countAllDevices += countDevices;
+bool CAssignment5::DoCompute() {
+  if (m_pCurrentTask) {
+    CScopeTimer timer("ComputeGPU");
+    m_pCurrentTask->ComputeGPU(m_CLContext, m_CLCommandQueue, m_LocalWorkSize);
   }
-  deviceIds.resize(countAllDevices);
 
-  if (countAllDevices == 0) {
-    std::cout << "No device of the selected type with OpenCL support was found.";
-    return false;
-  }
-  // Choosing the first available device.
-  m_CLDevice = deviceIds[0];
-  clGetDeviceInfo(m_CLDevice, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &m_CLPlatform, NULL);
-
-  // Printing platform and device data.
-  const int maxBufferSize = 1024;
-  char buffer[maxBufferSize];
-  size_t bufferSize;
-  std::cout << "OpenCL platform:" << std::endl
-            << std::endl;
-  PRINT_INFO("Name", buffer, bufferSize, maxBufferSize, clGetPlatformInfo(m_CLPlatform, CL_PLATFORM_NAME, maxBufferSize, (void*)buffer, &bufferSize));
-  PRINT_INFO("Vendor", buffer, bufferSize, maxBufferSize, clGetPlatformInfo(m_CLPlatform, CL_PLATFORM_VENDOR, maxBufferSize, (void*)buffer, &bufferSize));
-  PRINT_INFO("Version", buffer, bufferSize, maxBufferSize, clGetPlatformInfo(m_CLPlatform, CL_PLATFORM_VERSION, maxBufferSize, (void*)buffer, &bufferSize));
-  PRINT_INFO("Profile", buffer, bufferSize, maxBufferSize, clGetPlatformInfo(m_CLPlatform, CL_PLATFORM_PROFILE, maxBufferSize, (void*)buffer, &bufferSize));
-  std::cout << std::endl
-            << "Device:" << std::endl
-            << std::endl;
-  PRINT_INFO("Name", buffer, bufferSize, maxBufferSize, clGetDeviceInfo(m_CLDevice, CL_DEVICE_NAME, maxBufferSize, (void*)buffer, &bufferSize));
-  PRINT_INFO("Vendor", buffer, bufferSize, maxBufferSize, clGetDeviceInfo(m_CLDevice, CL_DEVICE_VENDOR, maxBufferSize, (void*)buffer, &bufferSize));
-  PRINT_INFO("Driver version", buffer, bufferSize, maxBufferSize, clGetDeviceInfo(m_CLDevice, CL_DRIVER_VERSION, maxBufferSize, (void*)buffer, &bufferSize));
-  cl_ulong localMemorySize;
-  clGetDeviceInfo(m_CLDevice, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemorySize, &bufferSize);
-  std::cout << "Local memory size: " << localMemorySize << " Byte" << std::endl;
-  std::cout << std::endl
-            << "******************************" << std::endl
-            << std::endl;
+  return true;
+}
+
+bool CAssignment5::InitCLContext() {
+  if (!SelectCLDevice()) return false;
+
+  PrintCLDeviceInfo();
 
   cl_int clError;
 
@@ -190,7 +218,8 @@ bool CAssignment5::InitCLContext() {
   // from the CPU into this queue. This way the host program can continue the execution until some results
   // from that device are needed.
 
-  m_CLCommandQueue = clCreateCommandQueue(m_CLContext, m_CLDevice, 0, &clError);
+  // Profiling is enabled so that CLUtil::ProfileKernel() can use device timestamps.
+  m_CLCommandQueue = clCreateCommandQueue(m_CLContext, m_CLDevice, CL_QUEUE_PROFILING_ENABLE, &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create the command queue in the context");
 
   return true;
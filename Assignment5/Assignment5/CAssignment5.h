@@ -38,6 +38,9 @@ public:
 	virtual bool EnterMainLoop(int argc, char** argv);
 	
 	virtual bool DoCompute();
+
+	//! Measures headless tasks in a plain context, see CAssignmentBase::ParseDeviceOptions()
+	virtual bool DoBenchmarkSweep();
 	
 	virtual bool InitGL(int argc, char** argv);
 
@@ -60,6 +63,9 @@ protected:
 	// for OpenCL - OpenGL interop
 	virtual bool InitCLContext();
 
+	//! Runs m_HeadlessSteps simulation steps without a window, see CAssignmentBase::ParseDeviceOptions()
+	virtual bool RunHeadless();
+
 	virtual void Render();
 
 	virtual void OnKeyboard(GLFWwindow* pWindow, int Key, int ScanCode, int Action, int Mods);
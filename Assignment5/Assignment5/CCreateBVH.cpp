@@ -5,7 +5,13 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CCreateBVH.h"
 
+#include "../Common/CBenchmark.h"
+#include "../Common/CCounterRNG.h"
+#include "../Common/CDeviceCaps.h"
 #include "../Common/CLUtil.h"
+#include "../Common/CLaunchRecording.h"
+#include "../Common/CMemoryTracker.h"
+#include "../Common/CProgramBuilder.h"
 #include "../Common/CTimer.h"
 
 #ifdef min // these macros are defined under windows, but collide with our math utility
@@ -29,7 +35,6 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CL/cl_gl.h"
 
 #define NUM_FORCE_LINES 4096
-#define NUM_BANKS 32
 
 using namespace std;
 using namespace hlsl;
@@ -76,14 +81,33 @@ CCreateBVH::~CCreateBVH() {
 bool CCreateBVH::InitResources(cl_device_id Device, cl_context Context, cl_command_queue CommandQueue) {
   (void)CommandQueue;
 
+  // Start all program builds first, each one is waited for where its kernels are created.
+  // The GL resources and buffers are set up in the meantime.
+  CProgramBuilder builder;
+  string programCode;
+  CLUtil::LoadProgramSourceToMemory("PrepAABBs.cl", programCode);
+  const size_t prepAABBsBuild = builder.Add(Device, Context, programCode);
+  CLUtil::LoadProgramSourceToMemory("MortonCodes.cl", programCode);
+  const size_t mortonCodesBuild = builder.Add(Device, Context, programCode);
+  CLUtil::LoadProgramSourceToMemory("BVHNodes.cl", programCode);
+  const size_t bvhNodesBuild = builder.Add(Device, Context, programCode);
+  CLUtil::LoadProgramSourceToMemory("Scan.cl", programCode);
+  CLDefines scanDefines;
+  CDeviceCaps::Get(Device).AddDefines(scanDefines);
+  const size_t scanBuild = builder.AddVariant(Device, Context, programCode, scanDefines);
+  CLUtil::LoadProgramSourceToMemory("RadixSort.cl", programCode);
+  const size_t radixSortBuild = builder.Add(Device, Context, programCode);
 
-  if (!InitGL()) return false;
-
+  if (!m_Headless && !InitGL()) return false;
 
-  srand(time(0));
+  // the scene is reproducible, set GPUC_SEED for a different one
+  CCounterRNG rng;
 
   cl_int clError;
-  string programCode;
+
+  // the allocations below are accounted to this task, see CMemoryTracker::PrintStatistics()
+  CMemoryTracker& memory = CMemoryTracker::GetInstance();
+  CMemoryTracker::TaskScope memoryScope(GetName());
 
   //
   //
@@ -93,29 +117,31 @@ bool CCreateBVH::InitResources(cl_device_id Device, cl_context Context, cl_comma
   //  ### PREP KERNELS (CREATE AABBs, ADVANCE POSITIONS) ###
   // ########################################################
   // Buffer for center positions with radius of leaf node AABBs
-  m_clPositions = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_float4) * m_nElements, NULL, &clError);
+  m_clPositions = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_float4) * m_nElements, NULL, &clError, "BVH/Positions");
   V_RETURN_FALSE_CL(clError, "Failed to create positions buffer.");
   // Initialize with random values
   std::vector<cl_float4> initpos(m_nElements);
-  for (auto& p : initpos) {
-    p.s[0] = (float(rand()) / float(RAND_MAX) * 10.0f - 5.0f);
-    p.s[1] = (float(rand()) / float(RAND_MAX) * 10.0f - 5.0f);
-    p.s[2] = (float(rand()) / float(RAND_MAX) * 10.0f - 5.0f);
-    p.s[3] = (float(rand()) / float(RAND_MAX) * 0.1 + 0.1f);
+  for (size_t i = 0; i < initpos.size(); i++) {
+    cl_float4& p = initpos[i];
+    p.s[0] = (rng.GetFloat(0, 4 * i) * 10.0f - 5.0f);
+    p.s[1] = (rng.GetFloat(0, 4 * i + 1) * 10.0f - 5.0f);
+    p.s[2] = (rng.GetFloat(0, 4 * i + 2) * 10.0f - 5.0f);
+    p.s[3] = (rng.GetFloat(0, 4 * i + 3) * 0.1f + 0.1f);
   }
   V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_clPositions, CL_FALSE, 0, m_nElements * sizeof(cl_float4), initpos.data(), 0, NULL, NULL),
                     "Error writing positions to cl memory!");
 
 
   // Buffer for velocity of each leaf node AABB center point
-  m_clVelocities = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_float4) * m_nElements, NULL, &clError);
+  m_clVelocities = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_float4) * m_nElements, NULL, &clError, "BVH/Velocities");
   V_RETURN_FALSE_CL(clError, "Failed to create positions buffer.");
   // Initialize with random values
   std::vector<cl_float4> initvel(m_nElements);
-  for (auto& p : initvel) {
-    p.s[0] = (float(rand()) / float(RAND_MAX) * 0.0025f - 0.00125f);
-    p.s[1] = (float(rand()) / float(RAND_MAX) * 0.0025f - 0.00125f);
-    p.s[2] = (float(rand()) / float(RAND_MAX) * 0.0025f - 0.00125f);
+  for (size_t i = 0; i < initvel.size(); i++) {
+    cl_float4& p = initvel[i];
+    p.s[0] = (rng.GetFloat(1, 4 * i) * 0.0025f - 0.00125f);
+    p.s[1] = (rng.GetFloat(1, 4 * i + 1) * 0.0025f - 0.00125f);
+    p.s[2] = (rng.GetFloat(1, 4 * i + 2) * 0.0025f - 0.00125f);
   }
   V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_clVelocities, CL_FALSE, 0, m_nElements * sizeof(cl_float4), initvel.data(), 0, NULL, NULL),
                     "Error writing positions to cl memory!");
@@ -123,26 +149,37 @@ bool CCreateBVH::InitResources(cl_device_id Device, cl_context Context, cl_comma
 
 
   // Create buffers for AABB leafs and inner nodes from open gl buffers
-  m_clAABBs[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glAABBsBuf[0], &clError);
-  m_clAABBs[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glAABBsBuf[1], &clError);
+  if (m_Headless) {
+    m_clAABBs[0] = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, 2 * m_nElements * sizeof(cl_float4), NULL, &clError, "BVH/AABBs");
+    m_clAABBs[1] = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, 2 * m_nElements * sizeof(cl_float4), NULL, &clError, "BVH/AABBs");
+  } else {
+    m_clAABBs[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glAABBsBuf[0], &clError);
+    m_clAABBs[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glAABBsBuf[1], &clError);
+    memory.Track(m_clAABBs[0], "BVH/AABBs (GL)");
+    memory.Track(m_clAABBs[1], "BVH/AABBs (GL)");
+  }
   V_RETURN_FALSE_CL(clError, "Failed to create AABBs buffer.");
 
-  m_clMortonAABB = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_float4) * 2, NULL, &clError);
+  m_clMortonAABB = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_float4) * 2, NULL, &clError, "BVH/Morton AABB");
   V_RETURN_FALSE_CL(clError, "Failed to create MortonAABB buffer.");
 
   // Create buffers for internal node's children and parents indices
-  m_clNodeChildren = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint2) * m_nElements, NULL, &clError);
-  m_clNodeChildrenGL = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glNodeChildrenGLBuf, &clError);
-  m_clNodeParents = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_nElements * 2, NULL, &clError);
+  m_clNodeChildren = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint2) * m_nElements, NULL, &clError, "BVH/Node children");
+  if (m_Headless) {
+    m_clNodeChildrenGL = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, m_nElements * sizeof(cl_float2), NULL, &clError, "BVH/Node children (GL layout)");
+  } else {
+    m_clNodeChildrenGL = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glNodeChildrenGLBuf, &clError);
+    memory.Track(m_clNodeChildrenGL, "BVH/Node children (GL)");
+  }
+  m_clNodeParents = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_nElements * 2, NULL, &clError, "BVH/Node parents");
 
-  m_clInnerAABBFlags = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_int) * m_nElements, NULL, &clError);
+  m_clInnerAABBFlags = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_int) * m_nElements, NULL, &clError, "BVH/Inner AABB flags");
   V_RETURN_FALSE_CL(clError, "Failed to create internal nodes buffer.");
 
 
 
   // Kernel for building the leaf node AABBs from the center position and radius
-  CLUtil::LoadProgramSourceToMemory("PrepAABBs.cl", programCode);
-  m_PrepAABBsProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+  m_PrepAABBsProgram = builder.Get(prepAABBsBuild);
   if (!m_PrepAABBsProgram) return false;
 
   m_AdvancePositionsKernel = clCreateKernel(m_PrepAABBsProgram, "AdvancePositions", &clError);
@@ -152,8 +189,7 @@ bool CCreateBVH::InitResources(cl_device_id Device, cl_context Context, cl_comma
 
 
   // Kernel for calculating morton codes
-  CLUtil::LoadProgramSourceToMemory("MortonCodes.cl", programCode);
-  m_MortonCodesProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+  m_MortonCodesProgram = builder.Get(mortonCodesBuild);
   if (!m_MortonCodesProgram) return false;
 
   m_ReduceAABBminKernel = clCreateKernel(m_MortonCodesProgram, "ReduceAABBmin", &clError);
@@ -168,8 +204,7 @@ bool CCreateBVH::InitResources(cl_device_id Device, cl_context Context, cl_comma
 
 
   // Kernel for calculating internal nodes
-  CLUtil::LoadProgramSourceToMemory("BVHNodes.cl", programCode);
-  m_BVHNodesProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+  m_BVHNodesProgram = builder.Get(bvhNodesBuild);
   if (!m_BVHNodesProgram) return false;
 
   m_NodesHierarchyKernel = clCreateKernel(m_BVHNodesProgram, "NodesHierarchy", &clError);
@@ -191,13 +226,12 @@ bool CCreateBVH::InitResources(cl_device_id Device, cl_context Context, cl_comma
   // Levels for radix sort scan
   // Do not create a buffer for the first level, since we will create separate buffers as inputs
   for (size_t l = 1; l < m_clScanLevels.size(); ++l) {
-    m_clScanLevels[l].first = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[l].second, NULL, &clError);
+    m_clScanLevels[l].first = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[l].second, NULL, &clError, "BVH/Scan levels");
     V_RETURN_FALSE_CL(clError, "Error allocating device arrays");
   }
 
   // Scan kernels
-  CLUtil::LoadProgramSourceToMemory("Scan.cl", programCode);
-  m_ScanProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+  m_ScanProgram = builder.Get(scanBuild);
   if (!m_ScanProgram) return false;
 
   m_ScanKernel = clCreateKernel(m_ScanProgram, "Scan", &clError);
@@ -208,23 +242,22 @@ bool CCreateBVH::InitResources(cl_device_id Device, cl_context Context, cl_comma
 
 
   // Morton code for each bounding volume
-  m_clMortonCodes = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError);
-  m_clSortPermutation = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError);
+  m_clMortonCodes = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError, "BVH/Morton codes");
+  m_clSortPermutation = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError, "BVH/Sort permutation");
   // Ping-pong buffers for reorder
-  m_clRadixKeysPong = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError);
-  m_clRadixPermutationPong = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError);
+  m_clRadixKeysPong = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError, "BVH/Radix keys pong");
+  m_clRadixPermutationPong = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError, "BVH/Radix permutation pong");
   // Radix bit buffers
   // Buffers that holds the flags where the bit of the current radix is zero/one
-  m_clRadixZeroBit = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError);
-  m_clRadixOneBit = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError);
+  m_clRadixZeroBit = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError, "BVH/Radix zero bits");
+  m_clRadixOneBit = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_clScanLevels[0].second, NULL, &clError, "BVH/Radix one bits");
   // Temp buffer for the permute kernel to reorder positions and velocities
-  m_clPermuteTemp = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_float4) * m_nElements, NULL, &clError);
+  m_clPermuteTemp = memory.CreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_float4) * m_nElements, NULL, &clError, "BVH/Permute temp");
 
 
   // Sort kernels
-  CLUtil::LoadProgramSourceToMemory("RadixSort.cl", programCode);
-  m_RadixSortProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
-  if (!m_ScanProgram) return false;
+  m_RadixSortProgram = builder.Get(radixSortBuild);
+  if (!m_RadixSortProgram) return false;
 
   m_SelectBitflagKernel = clCreateKernel(m_RadixSortProgram, "SelectBitflag", &clError);
   V_RETURN_FALSE_CL(clError, "Failed to create SelectBitflag kernel.");
@@ -319,6 +352,7 @@ bool CCreateBVH::InitGL() {
 }
 
 void CCreateBVH::ReleaseResources() {
+  m_RadixSortLaunches.Release();
   SAFE_RELEASE_MEMOBJECT(m_clPositions);
   SAFE_RELEASE_MEMOBJECT(m_clVelocities);
   SAFE_RELEASE_MEMOBJECT(m_clAABBs[0]);
@@ -327,12 +361,12 @@ void CCreateBVH::ReleaseResources() {
 
   SAFE_RELEASE_GL_BUFFER(m_glAABBsBuf[0]);
   SAFE_RELEASE_GL_BUFFER(m_glAABBsBuf[1]);
-  glDeleteTextures(2, m_glAABBsTB);
+  if (!m_Headless) glDeleteTextures(2, m_glAABBsTB);
 
   SAFE_RELEASE_MEMOBJECT(m_clNodeChildren);
   SAFE_RELEASE_MEMOBJECT(m_clNodeChildrenGL);
   SAFE_RELEASE_GL_BUFFER(m_glNodeChildrenGLBuf);
-  glDeleteTextures(1, &m_glNodeChildrenGLTB);
+  if (!m_Headless) glDeleteTextures(1, &m_glNodeChildrenGLTB);
 
   SAFE_RELEASE_MEMOBJECT(m_clNodeParents);
   SAFE_RELEASE_MEMOBJECT(m_clInnerAABBFlags);
@@ -388,39 +422,51 @@ void CCreateBVH::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, s
   (void)LocalWorkSize;
 
 
-  glFinish();
-  V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clAABBs[0], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
-  V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clAABBs[1], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+  if (!m_Headless) {
+    glFinish();
+    V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clAABBs[0], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+    V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clAABBs[1], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
 
-  V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clNodeChildrenGL, 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+    V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clNodeChildrenGL, 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+  }
+  BeginStages(CommandQueue);
 
   // DO THE CL STUFF HERE
 
   // move the center points
   AdvancePositions(Context, CommandQueue, m_clPositions, m_clVelocities);
+  EndStage(CommandQueue, "AdvancePositions");
 
   // Creates leaf node AABBs, reduces them to morton AABB, calculates Morton Codes from the morton AABB
   MortonCodes(Context, CommandQueue, m_clMortonCodes, m_clMortonAABB, m_clAABBs, m_clPositions);
+  EndStage(CommandQueue, "MortonCodes");
   // Sort morton codes and create permutation array
   RadixSort(Context, CommandQueue, m_clMortonCodes, m_clSortPermutation);
+  EndStage(CommandQueue, "RadixSort");
   // Permute the center positions and velocities using the permutation from radix sort
   Permute(Context, CommandQueue, &m_clPositions, m_clSortPermutation);
   Permute(Context, CommandQueue, &m_clVelocities, m_clSortPermutation);
+  EndStage(CommandQueue, "Permute");
 
   CreateHierarchy(Context, CommandQueue, m_clNodeChildren, m_clNodeParents, m_clMortonCodes);
+  EndStage(CommandQueue, "CreateHierarchy");
 
   // Create leaf node AABBs again (their memory was used as temp memory during the morton AABB reduction)
   CreateLeafAABBs(Context, CommandQueue, m_clAABBs, m_clPositions, m_nElements);
   InnerNodeAABBs(Context, CommandQueue, m_clAABBs, m_clNodeChildren, m_clNodeParents, m_clInnerAABBFlags);
+  EndStage(CommandQueue, "NodeAABBs");
 
   CopyChildnodes(Context, CommandQueue, m_clNodeChildrenGL, m_clNodeChildren);
+  EndStage(CommandQueue, "CopyChildnodes");
 
 
 
-  V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clAABBs[0], 0, NULL, NULL), "Error releasing OpenGL buffer.");
-  V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clAABBs[1], 0, NULL, NULL), "Error releasing OpenGL buffer.");
+  if (!m_Headless) {
+    V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clAABBs[0], 0, NULL, NULL), "Error releasing OpenGL buffer.");
+    V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clAABBs[1], 0, NULL, NULL), "Error releasing OpenGL buffer.");
 
-  V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clNodeChildrenGL, 0, NULL, NULL), "Error releasing OpenGL buffer.");
+    V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clNodeChildrenGL, 0, NULL, NULL), "Error releasing OpenGL buffer.");
+  }
 
   clFinish(CommandQueue);
 }
@@ -587,11 +633,9 @@ void CCreateBVH::TestPerformance(cl_context Context, cl_command_queue CommandQue
     timecpu = timer.GetElapsedMilliseconds();
 
     // Time for GPU
-    timer.Start();
-    for (size_t i = 0; i < 100; ++i) CreateLeafAABBs(Context, CommandQueue, m_clAABBs, m_clPositions, 0);
-    clFinish(CommandQueue);
-    timer.Stop();
-    timegpu = timer.GetElapsedMilliseconds() / 100.0;
+    timegpu = CBenchmark::GetInstance().Measure("BVH/CreateLeafAABBs", CommandQueue, [&]() {
+      CreateLeafAABBs(Context, CommandQueue, m_clAABBs, m_clPositions, 0);
+    }).MedianMs;
 
     V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_clAABBs[0], CL_TRUE, 0, m_nElements * sizeof(cl_float4), leafaabbmin.data(), 0, NULL, NULL),
                 "Error reading data from device!");
@@ -638,11 +682,9 @@ void CCreateBVH::TestPerformance(cl_context Context, cl_command_queue CommandQue
     timecpu = timer.GetElapsedMilliseconds();
 
     // Time for GPU
-    timer.Start();
-    for (size_t i = 0; i < 100; ++i) MortonCodeAABB(Context, CommandQueue, m_clMortonAABB, m_clAABBs, m_clPositions);
-    clFinish(CommandQueue);
-    timer.Stop();
-    timegpu = timer.GetElapsedMilliseconds() / 100.0;
+    timegpu = CBenchmark::GetInstance().Measure("BVH/MortonCodeAABB", CommandQueue, [&]() {
+      MortonCodeAABB(Context, CommandQueue, m_clMortonAABB, m_clAABBs, m_clPositions);
+    }).MedianMs;
 
     // Verify results
     MortonCodeAABB(Context, CommandQueue, m_clMortonAABB, m_clAABBs, m_clPositions);
@@ -683,11 +725,9 @@ void CCreateBVH::TestPerformance(cl_context Context, cl_command_queue CommandQue
     timecpu = timer.GetElapsedMilliseconds();
 
     // Time for GPU
-    timer.Start();
-    for (size_t i = 0; i < 100; ++i) MortonCodes(Context, CommandQueue, m_clMortonCodes, m_clMortonAABB, m_clAABBs, m_clPositions);
-    clFinish(CommandQueue);
-    timer.Stop();
-    timegpu = timer.GetElapsedMilliseconds() / 100.0;
+    timegpu = CBenchmark::GetInstance().Measure("BVH/MortonCodes", CommandQueue, [&]() {
+      MortonCodes(Context, CommandQueue, m_clMortonCodes, m_clMortonAABB, m_clAABBs, m_clPositions);
+    }).MedianMs;
 
 
 
@@ -740,11 +780,9 @@ void CCreateBVH::TestPerformance(cl_context Context, cl_command_queue CommandQue
     timecpu = timer.GetElapsedMilliseconds();
 
     // Time for GPU
-    timer.Start();
-    for (size_t i = 0; i < 100; ++i) PermutationIdentity(Context, CommandQueue, m_clSortPermutation);
-    clFinish(CommandQueue);
-    timer.Stop();
-    timegpu = timer.GetElapsedMilliseconds() / 100.0;
+    timegpu = CBenchmark::GetInstance().Measure("BVH/PermutationIdentity", CommandQueue, [&]() {
+      PermutationIdentity(Context, CommandQueue, m_clSortPermutation);
+    }).MedianMs;
 
     // Validate correctness
     PermutationIdentity(Context, CommandQueue, m_clSortPermutation);
@@ -783,11 +821,9 @@ void CCreateBVH::TestPerformance(cl_context Context, cl_command_queue CommandQue
     // Time for GPU
     MortonCodes(Context, CommandQueue, m_clMortonCodes, m_clMortonAABB, m_clAABBs, m_clPositions);
 
-    timer.Start();
-    for (size_t i = 0; i < 100; ++i) SelectBitflag(Context, CommandQueue, m_clRadixZeroBit, m_clRadixOneBit, m_clMortonCodes, 0x0001);
-    clFinish(CommandQueue);
-    timer.Stop();
-    timegpu = timer.GetElapsedMilliseconds() / 100.0;
+    timegpu = CBenchmark::GetInstance().Measure("BVH/SelectBitflag", CommandQueue, [&]() {
+      SelectBitflag(Context, CommandQueue, m_clRadixZeroBit, m_clRadixOneBit, m_clMortonCodes, 0x0001);
+    }).MedianMs;
 
     // Validate correctness
     MortonCodes(Context, CommandQueue, m_clMortonCodes, m_clMortonAABB, m_clAABBs, m_clPositions);
@@ -834,11 +870,7 @@ void CCreateBVH::TestPerformance(cl_context Context, cl_command_queue CommandQue
     MortonCodes(Context, CommandQueue, m_clMortonCodes, m_clMortonAABB, m_clAABBs, m_clPositions);
     SelectBitflag(Context, CommandQueue, m_clRadixZeroBit, m_clRadixOneBit, m_clMortonCodes, 0x0001);
 
-    timer.Start();
-    for (size_t i = 0; i < 100; ++i) Scan(Context, CommandQueue, m_clRadixZeroBit);
-    clFinish(CommandQueue);
-    timer.Stop();
-    timegpu = timer.GetElapsedMilliseconds() / 100.0;
+    timegpu = CBenchmark::GetInstance().Measure("BVH/Scan", CommandQueue, [&]() { Scan(Context, CommandQueue, m_clRadixZeroBit); }).MedianMs;
 
 
     // Validate correctness
@@ -916,13 +948,9 @@ void CCreateBVH::TestPerformance(cl_context Context, cl_command_queue CommandQue
     SelectBitflag(Context, CommandQueue, m_clRadixZeroBit, m_clRadixOneBit, m_clMortonCodes, 0x0001);
     Scan(Context, CommandQueue, m_clRadixZeroBit);
     Scan(Context, CommandQueue, m_clRadixOneBit);
-    timer.Start();
-    for (size_t i = 0; i < 100; ++i)
-      ReorderKeys(
-          Context, CommandQueue, m_clRadixKeysPong, m_clRadixPermutationPong, m_clMortonCodes, m_clSortPermutation, m_clRadixZeroBit, m_clRadixOneBit, 0x0001);
-    clFinish(CommandQueue);
-    timer.Stop();
-    timegpu = timer.GetElapsedMilliseconds() / 100.0;
+    timegpu = CBenchmark::GetInstance().Measure("BVH/ReorderKeys", CommandQueue, [&]() {
+      ReorderKeys(Context, CommandQueue, m_clRadixKeysPong, m_clRadixPermutationPong, m_clMortonCodes, m_clSortPermutation, m_clRadixZeroBit, m_clRadixOneBit, 0x0001);
+    }).MedianMs;
 
 
     // Validate correctness
@@ -1011,11 +1039,9 @@ void CCreateBVH::TestPerformance(cl_context Context, cl_command_queue CommandQue
     timer.Stop();
     timecpu = timer.GetElapsedMilliseconds();
 
-    timer.Start();
-    for (size_t i = 0; i < 100; ++i) Permute(Context, CommandQueue, &m_clPositions, m_clSortPermutation);
-    clFinish(CommandQueue);
-    timer.Stop();
-    timegpu = timer.GetElapsedMilliseconds() / 100.0;
+    timegpu = CBenchmark::GetInstance().Measure("BVH/Permute", CommandQueue, [&]() {
+      Permute(Context, CommandQueue, &m_clPositions, m_clSortPermutation);
+    }).MedianMs;
 
 
     MortonCodes(Context, CommandQueue, m_clMortonCodes, m_clMortonAABB, m_clAABBs, m_clPositions);
@@ -1047,11 +1073,9 @@ void CCreateBVH::TestPerformance(cl_context Context, cl_command_queue CommandQue
     timer.Stop();
     timecpu = timer.GetElapsedMilliseconds();
 
-    timer.Start();
-    for (size_t i = 0; i < 100; ++i) CreateHierarchy(Context, CommandQueue, m_clNodeChildren, m_clNodeParents, m_clMortonCodes);
-    clFinish(CommandQueue);
-    timer.Stop();
-    timegpu = timer.GetElapsedMilliseconds() / 100.0;
+    timegpu = CBenchmark::GetInstance().Measure("BVH/CreateHierarchy", CommandQueue, [&]() {
+      CreateHierarchy(Context, CommandQueue, m_clNodeChildren, m_clNodeParents, m_clMortonCodes);
+    }).MedianMs;
 
 
     MortonCodes(Context, CommandQueue, m_clMortonCodes, m_clMortonAABB, m_clAABBs, m_clPositions);
@@ -1173,10 +1197,7 @@ void CCreateBVH::PermutationIdentity(cl_context Context, cl_command_queue Comman
   // We need as many work items as elements
   size_t globalWorkSize = CLUtil::GetGlobalWorkSize(m_nElements, m_ScanLocalWorkSize[0]);
 
-  clErr = clSetKernelArg(m_PermutationIdentityKernel, 0, sizeof(cl_mem), (void*)&permutation);
-  V_RETURN_CL(clErr, "Error setting kernel arguments.");
-
-  clErr = clEnqueueNDRangeKernel(CommandQueue, m_PermutationIdentityKernel, 1, NULL, &globalWorkSize, m_ScanLocalWorkSize, 0, NULL, NULL);
+  clErr = m_RadixSortLaunches.Launch(CommandQueue, m_PermutationIdentityKernel, 1, &globalWorkSize, m_ScanLocalWorkSize, {permutation});
   V_RETURN_CL(clErr, "Error when enqueuing kernel.");
 }
 void CCreateBVH::SelectBitflag(cl_context Context, cl_command_queue CommandQueue, cl_mem flagnotset, cl_mem flagset, cl_mem keys, cl_uint mask) {
@@ -1184,20 +1205,19 @@ void CCreateBVH::SelectBitflag(cl_context Context, cl_command_queue CommandQueue
   // We need as many work items as elements
   size_t globalWorkSize = CLUtil::GetGlobalWorkSize(m_nElements, m_ScanLocalWorkSize[0]);
 
-  clErr = clSetKernelArg(m_SelectBitflagKernel, 0, sizeof(cl_mem), (void*)&flagnotset);
-  clErr |= clSetKernelArg(m_SelectBitflagKernel, 1, sizeof(cl_mem), (void*)&flagset);
-  clErr |= clSetKernelArg(m_SelectBitflagKernel, 2, sizeof(cl_mem), (void*)&keys);
-  clErr |= clSetKernelArg(m_SelectBitflagKernel, 3, sizeof(cl_uint), (void*)&mask);
-  clErr |= clSetKernelArg(m_SelectBitflagKernel, 4, sizeof(cl_uint), (void*)&m_nElements);
-  V_RETURN_CL(clErr, "Error setting kernel arguments.");
+  cl_uint nElements = (cl_uint)m_nElements;
 
-  clErr = clEnqueueNDRangeKernel(CommandQueue, m_SelectBitflagKernel, 1, NULL, &globalWorkSize, m_ScanLocalWorkSize, 0, NULL, NULL);
+  clErr = m_RadixSortLaunches.Launch(CommandQueue, m_SelectBitflagKernel, 1, &globalWorkSize, m_ScanLocalWorkSize,
+                                     {flagnotset, flagset, keys, mask, nElements});
   V_RETURN_CL(clErr, "Error when enqueuing kernel.");
 }
 void CCreateBVH::Scan(cl_context Context, cl_command_queue CommandQueue, cl_mem inoutbuffer) {
   cl_int clErr;
   size_t globalWorkSize;
-  size_t localMemSize = sizeof(cl_uint) * (m_ScanLocalWorkSize[0] * 2 + m_ScanLocalWorkSize[0] / NUM_BANKS);
+  // padded by the number of local memory banks of the device, as in the Scan variant built for it
+  cl_device_id device;
+  clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+  size_t localMemSize = sizeof(cl_uint) * CDeviceCaps::Get(device).GetPaddedLocalElements(m_ScanLocalWorkSize[0] * 2);
 
   // Set the input as level zero
   m_clScanLevels[0].first = inoutbuffer;
@@ -1209,12 +1229,8 @@ void CCreateBVH::Scan(cl_context Context, cl_command_queue CommandQueue, cl_mem
 
     // level is the array read from, and storing the local PPS results
     // level+1 is the array storing the reduction result of each local PPS
-    clErr = clSetKernelArg(m_ScanKernel, 0, sizeof(cl_mem), (void*)&m_clScanLevels[level].first);
-    clErr |= clSetKernelArg(m_ScanKernel, 1, sizeof(cl_mem), (void*)&m_clScanLevels[level + 1].first);
-    clErr |= clSetKernelArg(m_ScanKernel, 2, localMemSize, NULL);
-    V_RETURN_CL(clErr, "Error setting scan kernel arguments.");
-
-    clErr = clEnqueueNDRangeKernel(CommandQueue, m_ScanKernel, 1, NULL, &globalWorkSize, m_ScanLocalWorkSize, 0, NULL, NULL);
+    clErr = m_RadixSortLaunches.Launch(CommandQueue, m_ScanKernel, 1, &globalWorkSize, m_ScanLocalWorkSize,
+                                       {m_clScanLevels[level].first, m_clScanLevels[level + 1].first, CLaunchRecording::Arg::Local(localMemSize)});
     V_RETURN_CL(clErr, "Error when enqueuing scan kernel.");
   }
 
@@ -1223,11 +1239,8 @@ void CCreateBVH::Scan(cl_context Context, cl_command_queue CommandQueue, cl_mem
     // We need as many work items as elements (exept for the first block)
     globalWorkSize = CLUtil::GetGlobalWorkSize(m_clScanLevels[level - 1].second - m_ScanLocalWorkSize[0] * 2, m_ScanLocalWorkSize[0]);
 
-    clErr = clSetKernelArg(m_ScanAddKernel, 0, sizeof(cl_mem), (void*)&m_clScanLevels[level].first);
-    clErr |= clSetKernelArg(m_ScanAddKernel, 1, sizeof(cl_mem), (void*)&m_clScanLevels[level - 1].first);
-    V_RETURN_CL(clErr, "Error setting kernel arguments.");
-
-    clErr = clEnqueueNDRangeKernel(CommandQueue, m_ScanAddKernel, 1, NULL, &globalWorkSize, m_ScanLocalWorkSize, 0, NULL, NULL);
+    clErr = m_RadixSortLaunches.Launch(CommandQueue, m_ScanAddKernel, 1, &globalWorkSize, m_ScanLocalWorkSize,
+                                       {m_clScanLevels[level].first, m_clScanLevels[level - 1].first});
     V_RETURN_CL(clErr, "Error when enqueuing kernel.");
   }
 
@@ -1247,52 +1260,57 @@ void CCreateBVH::ReorderKeys(cl_context Context,
   // We need as many work items as elements
   size_t globalWorkSize = CLUtil::GetGlobalWorkSize(m_nElements, m_ScanLocalWorkSize[0]);
 
-  clErr = clSetKernelArg(m_ReorderKeysKernel, 0, sizeof(cl_mem), (void*)&keysout);
-  clErr |= clSetKernelArg(m_ReorderKeysKernel, 1, sizeof(cl_mem), (void*)&permutationout);
-  clErr |= clSetKernelArg(m_ReorderKeysKernel, 2, sizeof(cl_mem), (void*)&keysin);
-  clErr |= clSetKernelArg(m_ReorderKeysKernel, 3, sizeof(cl_mem), (void*)&permutationin);
-  clErr |= clSetKernelArg(m_ReorderKeysKernel, 4, sizeof(cl_mem), (void*)&indexzerobits);
-  clErr |= clSetKernelArg(m_ReorderKeysKernel, 5, sizeof(cl_mem), (void*)&indexonebits);
-  clErr |= clSetKernelArg(m_ReorderKeysKernel, 6, sizeof(cl_uint), (void*)&mask);
-  clErr |= clSetKernelArg(m_ReorderKeysKernel, 7, sizeof(cl_uint), (void*)&m_nElements);
-  V_RETURN_CL(clErr, "Error setting kernel arguments.");
+  cl_uint nElements = (cl_uint)m_nElements;
 
-  clErr = clEnqueueNDRangeKernel(CommandQueue, m_ReorderKeysKernel, 1, NULL, &globalWorkSize, m_ScanLocalWorkSize, 0, NULL, NULL);
+  clErr = m_RadixSortLaunches.Launch(CommandQueue, m_ReorderKeysKernel, 1, &globalWorkSize, m_ScanLocalWorkSize,
+                                     {keysout, permutationout, keysin, permutationin, indexzerobits, indexonebits, mask, nElements});
   V_RETURN_CL(clErr, "Error when enqueuing kernel.");
 }
 void CCreateBVH::RadixSort(cl_context Context, cl_command_queue CommandQueue, cl_mem keys, cl_mem permutation) {
-  PermutationIdentity(Context, CommandQueue, permutation);
-
-  cl_mem keyspingpong[2] = {keys, m_clRadixKeysPong};
-  cl_mem permutationpingpong[2] = {permutation, m_clRadixPermutationPong};
-
-  // Initialize the first source permutation to the ascending numbers from 0 to m_nElements
-  PermutationIdentity(Context, CommandQueue, permutationpingpong[0]);
-
-  // For each bit stable sort
-  for (size_t i = 0; i < 32; ++i) {
-    // Start with least important bit
-    cl_uint mask = 1 << i;
-    // Indices for source and destination of ping-pong buffers.
-    int src = i % 2;
-    int dst = (i + 1) % 2;
+  // The 32 passes are the same every frame. After an even number of passes the sorted keys are
+  // back in keys, so the launches are recorded once for the buffers and replayed.
+  if (!m_RadixSortLaunches.IsRecorded(CommandQueue) || m_RadixSortKeys != keys || m_RadixSortPermutation != permutation) {
+    m_RadixSortLaunches.Begin(CommandQueue);
+
+    PermutationIdentity(Context, CommandQueue, permutation);
+
+    cl_mem keyspingpong[2] = {keys, m_clRadixKeysPong};
+    cl_mem permutationpingpong[2] = {permutation, m_clRadixPermutationPong};
+
+    // Initialize the first source permutation to the ascending numbers from 0 to m_nElements
+    PermutationIdentity(Context, CommandQueue, permutationpingpong[0]);
+
+    // For each bit stable sort
+    for (size_t i = 0; i < 32; ++i) {
+      // Start with least important bit
+      cl_uint mask = 1 << i;
+      // Indices for source and destination of ping-pong buffers.
+      int src = i % 2;
+      int dst = (i + 1) % 2;
+
+      // Extract the flags for the current bit.
+      SelectBitflag(Context, CommandQueue, m_clRadixZeroBit, m_clRadixOneBit, keyspingpong[src], mask);
+      // Scan on each buffer of flags
+      Scan(Context, CommandQueue, m_clRadixZeroBit);
+      Scan(Context, CommandQueue, m_clRadixOneBit);
+      // Reorder
+      ReorderKeys(Context,
+                  CommandQueue,
+                  keyspingpong[dst],
+                  permutationpingpong[dst],
+                  keyspingpong[src],
+                  permutationpingpong[src],
+                  m_clRadixZeroBit,
+                  m_clRadixOneBit,
+                  mask);
+    }
 
-    // Extract the flags for the current bit.
-    SelectBitflag(Context, CommandQueue, m_clRadixZeroBit, m_clRadixOneBit, keyspingpong[src], mask);
-    // Scan on each buffer of flags
-    Scan(Context, CommandQueue, m_clRadixZeroBit);
-    Scan(Context, CommandQueue, m_clRadixOneBit);
-    // Reorder
-    ReorderKeys(Context,
-                CommandQueue,
-                keyspingpong[dst],
-                permutationpingpong[dst],
-                keyspingpong[src],
-                permutationpingpong[src],
-                m_clRadixZeroBit,
-                m_clRadixOneBit,
-                mask);
+    m_RadixSortLaunches.End();
+    m_RadixSortKeys = keys;
+    m_RadixSortPermutation = permutation;
   }
+
+  V_RETURN_CL(m_RadixSortLaunches.Replay(), "Error when replaying the radix sort.");
 }
 void CCreateBVH::Permute(cl_context Context, cl_command_queue CommandQueue, cl_mem* target, cl_mem permutation) {
   cl_int clErr;
@@ -1445,6 +1463,9 @@ void CCreateBVH::OnMouseMove(int X, int Y) {
 }
 
 void CCreateBVH::OnIdle(double, float ElapsedTime) {
+  // only the camera and the displayed level change here
+  if (m_Headless) return;
+
   // move camera?
   if (m_KeyboardMask[GLFW_KEY_W]) m_TranslateZ += 10.f * ElapsedTime;
   if (m_KeyboardMask[GLFW_KEY_S]) m_TranslateZ -= 10.f * ElapsedTime;
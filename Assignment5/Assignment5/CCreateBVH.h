@@ -21,6 +21,7 @@
 #define CPARTICLESYSTEMTASK_H_80VXUHBT
 
 
+#include "../Common/CLaunchRecording.h"
 #include "../Common/IGUIEnabledComputeTask.h"
 
 #include "CTriMesh.h"
@@ -78,6 +79,8 @@ public:
     return false;
   };
 
+  virtual std::string GetName() const { return "CCreateBVH"; }
+
   // IGUIEnabledComputeTask
   virtual void Render();
 
@@ -159,6 +162,11 @@ protected:
   cl_kernel m_ReorderKeysKernel = nullptr;
   cl_kernel m_PermutationIdentityKernel = nullptr;
   cl_kernel m_PermuteKernel = nullptr;
+  // The launches of RadixSort() for the keys and permutation buffers it was recorded with.
+  // The helpers launch through it, directly when it is not recording.
+  CLaunchRecording m_RadixSortLaunches;
+  cl_mem m_RadixSortKeys = nullptr;
+  cl_mem m_RadixSortPermutation = nullptr;
   
   // PARALLEL SCAN FOR RADIX SORT
   // Arrays for each level of the work-efficient scan
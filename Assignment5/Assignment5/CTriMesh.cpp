@@ -411,4 +411,16 @@ void CTriMesh::GetTriangleSoup(float** ppPositionBuffer, unsigned int* pNumTrian
 	}
 }
 
+void CTriMesh::GetVertexData(std::vector<float4>& Positions, std::vector<float4>& Normals) const
+{
+	Positions.resize(m_Vertices.size());
+	Normals.resize(m_Vertices.size());
+
+	for(size_t iVert = 0; iVert < m_Vertices.size(); iVert++)
+	{
+		Positions[iVert] = float4(m_Vertices[iVert].Pos, 1.0f);
+		Normals[iVert] = float4(m_Vertices[iVert].Norm, 0.0f);
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -89,6 +89,9 @@ public:
 	//the float array will contain triplets of vertices, each vertex having 4 floats as world coordinate (float4)
 	void GetTriangleSoup(float** ppPositionBuffer, unsigned int* pNumVertices);
 
+	//returns the vertex positions and normals in the layout of the GL vertex and normal buffer
+	void GetVertexData(std::vector<hlsl::float4>& Positions, std::vector<hlsl::float4>& Normals) const;
+
 	//renders the triangles using the current OpenGL program
 	void DrawGL(GLenum mode);
 };
@@ -1,8 +1,11 @@
 
 
 
+// The host passes the values of the device (see CDeviceCaps), these are the defaults
+#ifndef NUM_BANKS
 #define NUM_BANKS 32
 #define NUM_BANKS_LOG 5
+#endif
 
 // Bank conflicts
 #define AVOID_BANK_CONFLICTS
@@ -0,0 +1,125 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CBENCHMARK_H
+#define _CBENCHMARK_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! Measures the time of a piece of work with statistics that hold up against noise
+/*!
+	Measure() runs the work repeatedly, waiting for the command queue after each
+	batch:
+	- Runs that are too short for the host timer are batched, so that every sample
+	  takes at least MinSampleMs.
+	- Warm-up continues until the medians of two consecutive windows of samples
+	  differ by less than WarmupTolerance.
+	- Samples are taken until the 95% confidence interval of the median, from a
+	  bootstrap, is narrower than +-TargetPrecision, or until MaxSamples or
+	  MaxSeconds are reached.
+	- Samples further than OutlierMADs median absolute deviations from the median
+	  are rejected before the statistics are computed.
+
+	All results of a run are kept. Finish(), called by the assignments at the end,
+	writes them to GPUC_BENCH_OUT (JSON) and compares them to the baseline file in
+	GPUC_BENCH_BASELINE, which is an earlier output. A benchmark has regressed if
+	its confidence interval lies completely above the one of the baseline and its
+	median is more than GPUC_BENCH_THRESHOLD percent (default 10) slower; differences
+	between two processes are often larger than the interval of one.
+	The executables then return a non-zero exit code.
+*/
+class CBenchmark
+{
+public:
+	struct Settings
+	{
+		double		MinSampleMs = 1.0;
+		double		WarmupTolerance = 0.05;
+		int			MaxWarmupSamples = 50;
+		double		TargetPrecision = 0.02;
+		int			MinSamples = 20;
+		int			MaxSamples = 200;
+		double		MaxSeconds = 2.0;
+		double		OutlierMADs = 3.0;
+	};
+
+	//! Statistics of one benchmark, all times per run of the work in milliseconds
+	struct Result
+	{
+		std::string		Name;
+		int				NSamples = 0;
+		int				NOutliers = 0;
+		//! Runs of the work per sample
+		int				BatchSize = 1;
+		double			MedianMs = 0.0;
+		double			MeanMs = 0.0;
+		double			StdDevMs = 0.0;
+		//! 95% confidence interval of the median
+		double			CILowMs = 0.0;
+		double			CIHighMs = 0.0;
+	};
+
+	static CBenchmark& GetInstance();
+
+	Settings& GetSettings() { return m_Settings; }
+
+	//! Measures Work, which enqueues its commands to CommandQueue (NULL for work on the host), and prints the result
+	Result Measure(const std::string& Name, cl_command_queue CommandQueue, const std::function<void()>& Work);
+
+	const std::vector<Result>& GetResults() const { return m_Results; }
+
+	static void PrintResult(const Result& R);
+
+	//! Writes the results to GPUC_BENCH_OUT and checks them against GPUC_BENCH_BASELINE. Returns false on regressions.
+	bool Finish();
+
+	bool WriteJSON(const std::string& Path) const;
+
+	static bool ReadJSON(const std::string& Path, std::vector<Result>& Results);
+
+	//! Removes the samples further than MADs median absolute deviations from the median, returns the number removed
+	static int RejectOutliers(std::vector<double>& Samples, double MADs);
+
+	//! Bootstrap 95% confidence interval of the median
+	static void BootstrapMedianCI(const std::vector<double>& Samples, double& Low, double& High);
+
+	static double Median(std::vector<double> Samples);
+
+protected:
+	CBenchmark() {}
+
+	Settings				m_Settings;
+
+	std::mutex				m_Mutex;
+	std::vector<Result>		m_Results;
+};
+
+#endif // _CBENCHMARK_H
@@ -0,0 +1,123 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CBENCHMARK_SWEEP_H
+#define _CBENCHMARK_SWEEP_H
+
+#include "IComputeTask.h"
+
+#include "CommonDefs.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+//! Parameter sweep over problem sizes, local work sizes and task variants
+/*!
+	Usage: describe the axes of the sweep, then pass it to
+	CAssignmentBase::RunBenchmarkSweep(). Every point of the grid is run
+	through RunComputeTask(), first for the warm-up iterations, then for the
+	measured ones. Afterwards the results can be written as CSV or JSON.
+	The assignments define their sweep in DoBenchmarkSweep(), which runs
+	instead of DoCompute() with --sweep (GPUC_SWEEP=1).
+
+	RunComputeTask() measures one complete ComputeGPU() call on the host, so
+	the element and byte counts reported by the task factory must refer to
+	one ComputeGPU() call as well (including transfers and repeated launches).
+*/
+class CBenchmarkSweep
+{
+public:
+	//! One point of the parameter grid
+	struct Configuration
+	{
+		size_t			ProblemSize;
+		size_t			LocalWorkSize[3];
+		std::string		Variant;
+	};
+
+	//! Measurement of one configuration
+	struct Result
+	{
+		Configuration	Config;
+		size_t			Elements;
+		size_t			Bytes;
+		bool			Valid;
+		int				NMeasured;
+		double			MeanMs;
+		double			MinMs;
+		double			ElementsPerSecond;
+		double			GBPerSecond;
+	};
+
+	//! Creates the task for a configuration and reports the elements and bytes processed by one ComputeGPU() call
+	typedef std::function<IComputeTask*(const Configuration& Config, size_t& Elements, size_t& Bytes)> TaskFactory;
+
+	CBenchmarkSweep(const std::string& Name, TaskFactory Factory);
+
+	void AddProblemSize(size_t ProblemSize);
+
+	void AddLocalWorkSize(size_t X, size_t Y = 1, size_t Z = 1);
+
+	//! Variants are passed to the factory unchanged, e.g. the name of a kernel. Without variants the sweep runs once with "".
+	void AddVariant(const std::string& Variant);
+
+	void SetIterations(int NWarmup, int NMeasured);
+
+	//! For tasks without a CPU reference: their results are not validated, and a run does not stop the configuration
+	void SetValidated(bool Validated) { m_Validated = Validated; }
+
+	bool IsValidated() const { return m_Validated; }
+
+	int GetWarmupIterations() const { return m_NWarmup; }
+
+	int GetMeasuredIterations() const { return m_NMeasured; }
+
+	//! All combinations of the axes. Empty if no problem size or no local work size was added.
+	std::vector<Configuration> GetConfigurations() const;
+
+	IComputeTask* CreateTask(const Configuration& Config, size_t& Elements, size_t& Bytes) const;
+
+	//! Stores the measurement of one configuration, TimesMs holds the ComputeGPU() times of the measured runs (empty if no device work ran)
+	void AddResult(const Configuration& Config, size_t Elements, size_t Bytes, bool Valid, const std::vector<double>& TimesMs);
+
+	const std::vector<Result>& GetResults() const { return m_Results; }
+
+	void PrintResults() const;
+
+	bool WriteCSV(const std::string& Path) const;
+
+	bool WriteJSON(const std::string& Path) const;
+
+protected:
+	std::string					m_Name;
+	TaskFactory					m_Factory;
+
+	std::vector<size_t>			m_ProblemSizes;
+	std::vector<size_t>			m_LocalWorkSizes;	// 3 entries per local work size
+	std::vector<std::string>	m_Variants;
+
+	int							m_NWarmup;
+	int							m_NMeasured;
+	bool						m_Validated;
+
+	std::vector<Result>			m_Results;
+};
+
+#endif // _CBENCHMARK_SWEEP_H
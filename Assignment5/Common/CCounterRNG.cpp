@@ -0,0 +1,273 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CCounterRNG.h"
+
+#include "CLUtil.h"
+#include "CThreadPool.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+
+// The same generator in OpenCL C. The element index is split into the block
+// counter (index / 4) and the word within the block (index % 4), as on the host.
+static const char* g_PhiloxSource =
+	"#pragma OPENCL FP_CONTRACT OFF\n"
+	"uint4 Philox(ulong Counter, uint Stream0, uint Stream1, uint Key0, uint Key1)\n"
+	"{\n"
+	"	uint4 c = (uint4)((uint)Counter, (uint)(Counter >> 32), Stream0, Stream1);\n"
+	"	for (int r = 0; r < 10; r++)\n"
+	"	{\n"
+	"		uint hi0 = mul_hi(0xD2511F53u, c.x), lo0 = 0xD2511F53u * c.x;\n"
+	"		uint hi1 = mul_hi(0xCD9E8D57u, c.z), lo1 = 0xCD9E8D57u * c.z;\n"
+	"		c = (uint4)(hi1 ^ c.y ^ Key0, lo1, hi0 ^ c.w ^ Key1, lo0);\n"
+	"		Key0 += 0x9E3779B9u;\n"
+	"		Key1 += 0xBB67AE85u;\n"
+	"	}\n"
+	"	return c;\n"
+	"}\n"
+	"uint PhiloxWord(ulong Index, uint Stream0, uint Stream1, uint Key0, uint Key1)\n"
+	"{\n"
+	"	uint4 block = Philox(Index / 4, Stream0, Stream1, Key0, Key1);\n"
+	"	uint w = (uint)(Index % 4);\n"
+	"	return w == 0 ? block.x : (w == 1 ? block.y : (w == 2 ? block.z : block.w));\n"
+	"}\n"
+	"__kernel void PhiloxFillUInt(__global uint* Data, ulong N, uint Bound, uint Stream0, uint Stream1, uint Key0, uint Key1)\n"
+	"{\n"
+	"	ulong i = get_global_id(0);\n"
+	"	if (i >= N) return;\n"
+	"	uint x = PhiloxWord(i, Stream0, Stream1, Key0, Key1);\n"
+	"	Data[i] = Bound == 0 ? x : (uint)(((ulong)x * Bound) >> 32);\n"
+	"}\n"
+	"__kernel void PhiloxFillFloat(__global float* Data, ulong N, float2 Range, uint Stream0, uint Stream1, uint Key0, uint Key1)\n"
+	"{\n"
+	"	ulong i = get_global_id(0);\n"
+	"	if (i >= N) return;\n"
+	"	float u = (float)(PhiloxWord(i, Stream0, Stream1, Key0, Key1) >> 8) * (1.0f / 16777216.0f);\n"
+	"	Data[i] = Range.x + u * (Range.y - Range.x);\n"
+	"}\n"
+	"__kernel void PhiloxKnownAnswers(__global const uint* Inputs, __global uint4* Blocks)\n"
+	"{\n"
+	"	__global const uint* in = Inputs + 6 * get_global_id(0);\n"
+	"	Blocks[get_global_id(0)] = Philox(in[0] | ((ulong)in[1] << 32), in[2], in[3], in[4], in[5]);\n"
+	"}\n";
+
+static inline void MulHiLo(uint32_t A, uint32_t B, uint32_t& Hi, uint32_t& Lo)
+{
+	uint64_t product = (uint64_t)A * (uint64_t)B;
+	Hi = (uint32_t)(product >> 32);
+	Lo = (uint32_t)product;
+}
+
+static inline uint32_t ScaleToBound(uint32_t X, uint32_t Bound)
+{
+	return Bound == 0 ? X : (uint32_t)(((uint64_t)X * Bound) >> 32);
+}
+
+static inline float ToUnitFloat(uint32_t X)
+{
+	return (float)(X >> 8) * (1.0f / 16777216.0f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CCounterRNG
+
+CCounterRNG::CCounterRNG(uint64_t Seed)
+{
+	m_Key[0] = (uint32_t)Seed;
+	m_Key[1] = (uint32_t)(Seed >> 32);
+}
+
+uint64_t CCounterRNG::GetDefaultSeed()
+{
+	const char* env = getenv("GPUC_SEED");
+	return env != NULL ? strtoull(env, NULL, 0) : 0x2016C0FFEEULL;
+}
+
+void CCounterRNG::GenerateBlock(uint64_t Stream, uint64_t Counter, uint32_t Result[4]) const
+{
+	uint32_t c[4] = { (uint32_t)Counter, (uint32_t)(Counter >> 32), (uint32_t)Stream, (uint32_t)(Stream >> 32) };
+	uint32_t key[2] = { m_Key[0], m_Key[1] };
+
+	for (int r = 0; r < 10; r++)
+	{
+		uint32_t hi0, lo0, hi1, lo1;
+		MulHiLo(PHILOX_M0, c[0], hi0, lo0);
+		MulHiLo(PHILOX_M1, c[2], hi1, lo1);
+		uint32_t next[4] = { hi1 ^ c[1] ^ key[0], lo1, hi0 ^ c[3] ^ key[1], lo0 };
+		for (int i = 0; i < 4; i++)
+			c[i] = next[i];
+		key[0] += PHILOX_W0;
+		key[1] += PHILOX_W1;
+	}
+
+	for (int i = 0; i < 4; i++)
+		Result[i] = c[i];
+}
+
+uint32_t CCounterRNG::GetUInt(uint64_t Stream, uint64_t Index) const
+{
+	uint32_t block[4];
+	GenerateBlock(Stream, Index / 4, block);
+	return block[Index % 4];
+}
+
+float CCounterRNG::GetFloat(uint64_t Stream, uint64_t Index) const
+{
+	return ToUnitFloat(GetUInt(Stream, Index));
+}
+
+void CCounterRNG::FillUInt(unsigned int* pData, size_t N, uint32_t Bound, uint64_t Stream) const
+{
+	// chunks of whole blocks, so that every block is generated once
+	CThreadPool::GetInstance().ParallelFor(0, (N + 3) / 4, 0, [&](size_t Begin, size_t End) {
+		for (size_t b = Begin; b < End; b++)
+		{
+			uint32_t block[4];
+			GenerateBlock(Stream, b, block);
+			for (size_t w = 0; w < 4 && 4 * b + w < N; w++)
+				pData[4 * b + w] = ScaleToBound(block[w], Bound);
+		}
+	});
+}
+
+void CCounterRNG::FillInt(int* pData, size_t N, uint32_t Bound, uint64_t Stream) const
+{
+	FillUInt(reinterpret_cast<unsigned int*>(pData), N, Bound, Stream);
+}
+
+void CCounterRNG::FillFloat(float* pData, size_t N, float Min, float Max, uint64_t Stream) const
+{
+	CThreadPool::GetInstance().ParallelFor(0, (N + 3) / 4, 0, [&](size_t Begin, size_t End) {
+		for (size_t b = Begin; b < End; b++)
+		{
+			uint32_t block[4];
+			GenerateBlock(Stream, b, block);
+			for (size_t w = 0; w < 4 && 4 * b + w < N; w++)
+			{
+				// two separate roundings, like the kernel without FP contraction
+				volatile float scaled = ToUnitFloat(block[w]) * (Max - Min);
+				pData[4 * b + w] = Min + scaled;
+			}
+		}
+	});
+}
+
+bool CCounterRNG::FillDevice(cl_command_queue CommandQueue, const char* KernelName, cl_mem Buffer, size_t N,
+	const void* pArgs, size_t ArgSize, uint64_t Stream) const
+{
+	cl_context context;
+	cl_device_id device;
+	V_RETURN_FALSE_CL(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_CONTEXT, sizeof(cl_context), &context, NULL), "Failed to query the queue context.");
+	V_RETURN_FALSE_CL(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL), "Failed to query the queue device.");
+
+	cl_program program = CLUtil::BuildProgramVariant(device, context, g_PhiloxSource, CLDefines());
+	if (program == nullptr)
+		return false;
+
+	cl_int clError;
+	cl_kernel kernel = clCreateKernel(program, KernelName, &clError);
+	SAFE_RELEASE_PROGRAM(program);
+	V_RETURN_FALSE_CL(clError, "Failed to create the random fill kernel.");
+
+	cl_ulong n = N;
+	cl_uint stream[2] = { (cl_uint)Stream, (cl_uint)(Stream >> 32) };
+	clError = clSetKernelArg(kernel, 0, sizeof(cl_mem), &Buffer);
+	clError |= clSetKernelArg(kernel, 1, sizeof(cl_ulong), &n);
+	clError |= clSetKernelArg(kernel, 2, ArgSize, pArgs);
+	clError |= clSetKernelArg(kernel, 3, sizeof(cl_uint), &stream[0]);
+	clError |= clSetKernelArg(kernel, 4, sizeof(cl_uint), &stream[1]);
+	clError |= clSetKernelArg(kernel, 5, sizeof(cl_uint), &m_Key[0]);
+	clError |= clSetKernelArg(kernel, 6, sizeof(cl_uint), &m_Key[1]);
+	if (clError == CL_SUCCESS)
+	{
+		size_t localWorkSize = 256;
+		size_t globalWorkSize = CLUtil::GetGlobalWorkSize(N, localWorkSize);
+		clError = clEnqueueNDRangeKernel(CommandQueue, kernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
+	}
+	SAFE_RELEASE_KERNEL(kernel);
+	V_RETURN_FALSE_CL(clError, "Failed to enqueue the random fill kernel.");
+
+	return true;
+}
+
+bool CCounterRNG::CheckDevice(cl_command_queue CommandQueue)
+{
+	// the counter, the key and the result of the Philox4x32-10 vectors in kat_vectors of Random123
+	static const cl_uint s_Vectors[3][10] = {
+		{ 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+		{ 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd },
+		{ 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, 0xa4093822, 0x299f31d0, 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 }
+	};
+	const size_t nVectors = ARRAYLEN(s_Vectors);
+
+	cl_context context;
+	cl_device_id device;
+	V_RETURN_FALSE_CL(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_CONTEXT, sizeof(cl_context), &context, NULL), "Failed to query the queue context.");
+	V_RETURN_FALSE_CL(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL), "Failed to query the queue device.");
+
+	cl_program program = CLUtil::BuildProgramVariant(device, context, g_PhiloxSource, CLDefines());
+	if (program == nullptr)
+		return false;
+
+	cl_int clError, clError2;
+	cl_kernel kernel = clCreateKernel(program, "PhiloxKnownAnswers", &clError);
+	SAFE_RELEASE_PROGRAM(program);
+	V_RETURN_FALSE_CL(clError, "Failed to create the known-answer kernel.");
+
+	cl_uint inputs[nVectors][6];
+	for (size_t v = 0; v < nVectors; v++)
+		for (int i = 0; i < 6; i++)
+			inputs[v][i] = s_Vectors[v][i];
+	cl_uint blocks[nVectors][4] = {};
+
+	cl_mem dInputs = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(inputs), inputs, &clError);
+	cl_mem dBlocks = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(blocks), NULL, &clError2);
+	clError |= clError2;
+	if (clError == CL_SUCCESS)
+	{
+		clError = clSetKernelArg(kernel, 0, sizeof(cl_mem), &dInputs);
+		clError |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &dBlocks);
+	}
+	if (clError == CL_SUCCESS)
+	{
+		size_t globalWorkSize = nVectors;
+		clError = clEnqueueNDRangeKernel(CommandQueue, kernel, 1, NULL, &globalWorkSize, NULL, 0, NULL, NULL);
+		clError |= clEnqueueReadBuffer(CommandQueue, dBlocks, CL_TRUE, 0, sizeof(blocks), blocks, 0, NULL, NULL);
+	}
+	SAFE_RELEASE_MEMOBJECT(dInputs);
+	SAFE_RELEASE_MEMOBJECT(dBlocks);
+	SAFE_RELEASE_KERNEL(kernel);
+	V_RETURN_FALSE_CL(clError, "Failed to run the known-answer kernel.");
+
+	for (size_t v = 0; v < nVectors; v++)
+		for (int i = 0; i < 4; i++)
+			if (blocks[v][i] != s_Vectors[v][6 + i])
+				return false;
+	return true;
+}
+
+bool CCounterRNG::FillDeviceUInt(cl_command_queue CommandQueue, cl_mem Buffer, size_t N, uint32_t Bound, uint64_t Stream) const
+{
+	cl_uint bound = Bound;
+	return FillDevice(CommandQueue, "PhiloxFillUInt", Buffer, N, &bound, sizeof(cl_uint), Stream);
+}
+
+bool CCounterRNG::FillDeviceFloat(cl_command_queue CommandQueue, cl_mem Buffer, size_t N, float Min, float Max, uint64_t Stream) const
+{
+	cl_float range[2] = { Min, Max };
+	return FillDevice(CommandQueue, "PhiloxFillFloat", Buffer, N, range, sizeof(range), Stream);
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,193 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CDeviceCaps.h"
+#include "CLUtil.h"
+
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// vendor extensions, not every cl_ext.h has them
+#define GPUC_DEVICE_COMPUTE_CAPABILITY_MAJOR_NV		0x4000
+#define GPUC_DEVICE_WARP_SIZE_NV					0x4003
+#define GPUC_DEVICE_WAVEFRONT_WIDTH_AMD				0x4043
+#define GPUC_DEVICE_SUB_GROUP_SIZES_INTEL			0x4108
+
+static string GetDeviceString(cl_device_id Device, cl_device_info Param)
+{
+	size_t size = 0;
+	if (CL_SUCCESS != clGetDeviceInfo(Device, Param, 0, NULL, &size) || size == 0)
+		return "";
+	string value(size, '\0');
+	clGetDeviceInfo(Device, Param, size, &value[0], NULL);
+	return value.c_str();
+}
+
+static bool HasExtension(const string& Extensions, const string& Name)
+{
+	// the names are separated by spaces, avoid matching a prefix of a longer name
+	return (" " + Extensions + " ").find(" " + Name + " ") != string::npos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CDeviceCaps
+
+const CDeviceCaps& CDeviceCaps::Get(cl_device_id Device)
+{
+	static mutex s_Mutex;
+	static map<cl_device_id, CDeviceCaps> s_Caps;
+
+	lock_guard<mutex> lock(s_Mutex);
+	map<cl_device_id, CDeviceCaps>::iterator it = s_Caps.find(Device);
+	if (it == s_Caps.end())
+	{
+		it = s_Caps.insert(make_pair(Device, CDeviceCaps())).first;
+		if (Device != nullptr)
+			it->second.Query(Device);
+	}
+	return it->second;
+}
+
+void CDeviceCaps::Query(cl_device_id Device)
+{
+	Name = GetDeviceString(Device, CL_DEVICE_NAME);
+	Vendor = GetDeviceString(Device, CL_DEVICE_VENDOR);
+	const string extensions = GetDeviceString(Device, CL_DEVICE_EXTENSIONS);
+
+	cl_device_type type = 0;
+	clGetDeviceInfo(Device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+	IsGPU = (type & CL_DEVICE_TYPE_GPU) != 0;
+
+	cl_device_local_mem_type localMemType = CL_GLOBAL;
+	clGetDeviceInfo(Device, CL_DEVICE_LOCAL_MEM_TYPE, sizeof(localMemType), &localMemType, NULL);
+	HasLocalMemory = localMemType == CL_LOCAL;
+	clGetDeviceInfo(Device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(LocalMemSize), &LocalMemSize, NULL);
+	clGetDeviceInfo(Device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(MaxWorkGroupSize), &MaxWorkGroupSize, NULL);
+	clGetDeviceInfo(Device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(ComputeUnits), &ComputeUnits, NULL);
+	clGetDeviceInfo(Device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(VectorWidthFloat), &VectorWidthFloat, NULL);
+	clGetDeviceInfo(Device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT, sizeof(VectorWidthInt), &VectorWidthInt, NULL);
+	VectorWidthFloat = max(VectorWidthFloat, 1u);
+	VectorWidthInt = max(VectorWidthInt, 1u);
+
+	HasFP16 = HasExtension(extensions, "cl_khr_fp16");
+	HasFP64 = HasExtension(extensions, "cl_khr_fp64");
+	HasInt64Atomics = HasExtension(extensions, "cl_khr_int64_base_atomics");
+	HasCommandBuffer = HasExtension(extensions, "cl_khr_command_buffer");
+
+	// cl_khr_subgroups needs OpenCL C 2.0, OpenCL 3.0 devices may report an older C version though
+	const string deviceVersion = GetDeviceString(Device, CL_DEVICE_VERSION);
+	const string cVersion = GetDeviceString(Device, CL_DEVICE_OPENCL_C_VERSION);
+	if (HasExtension(extensions, "cl_khr_subgroups"))
+	{
+		if (deviceVersion.compare(0, 9, "OpenCL 3.") == 0)
+			SubgroupOptions = "-cl-std=CL3.0";
+		else if (cVersion.compare(0, 11, "OpenCL C 2.") == 0)
+			SubgroupOptions = "-cl-std=CL2.0";
+		HasSubgroups = !SubgroupOptions.empty();
+	}
+	// the same functions, available in OpenCL C 1.2
+	if (!HasSubgroups && HasExtension(extensions, "cl_intel_subgroups"))
+		HasSubgroups = true;
+
+	// SIMD width from the vendor, the probe kernel otherwise
+	SimdWidth = 0;
+	if (HasExtension(extensions, "cl_nv_device_attribute_query"))
+	{
+		cl_uint warpSize = 0, major = 0;
+		clGetDeviceInfo(Device, GPUC_DEVICE_WARP_SIZE_NV, sizeof(warpSize), &warpSize, NULL);
+		clGetDeviceInfo(Device, GPUC_DEVICE_COMPUTE_CAPABILITY_MAJOR_NV, sizeof(major), &major, NULL);
+		SimdWidth = warpSize;
+		// Volta schedules the threads of a warp independently
+		if (major > 0 && major < 7)
+			LockstepWidth = warpSize;
+	}
+	else if (HasExtension(extensions, "cl_amd_device_attribute_query") && IsGPU)
+	{
+		cl_uint wavefrontWidth = 0;
+		clGetDeviceInfo(Device, GPUC_DEVICE_WAVEFRONT_WIDTH_AMD, sizeof(wavefrontWidth), &wavefrontWidth, NULL);
+		SimdWidth = wavefrontWidth;
+		LockstepWidth = wavefrontWidth;
+	}
+	else if (HasExtension(extensions, "cl_intel_required_subgroup_size"))
+	{
+		// the compiler picks one of these per kernel, the largest is the upper bound
+		size_t size = 0;
+		if (CL_SUCCESS == clGetDeviceInfo(Device, GPUC_DEVICE_SUB_GROUP_SIZES_INTEL, 0, NULL, &size) && size >= sizeof(size_t))
+		{
+			vector<size_t> sizes(size / sizeof(size_t));
+			clGetDeviceInfo(Device, GPUC_DEVICE_SUB_GROUP_SIZES_INTEL, size, &sizes[0], NULL);
+			for (size_t i = 0; i < sizes.size(); i++)
+				SimdWidth = max(SimdWidth, (unsigned int)sizes[i]);
+		}
+	}
+	if (SimdWidth == 0)
+		SimdWidth = ProbeSimdWidth(Device);
+	SimdWidth = max(SimdWidth, 1u);
+	LockstepWidth = max(LockstepWidth, 1u);
+
+	if (IsGPU && Vendor.find("Intel") != string::npos)
+		NumLocalBanks = 16;
+}
+
+unsigned int CDeviceCaps::ProbeSimdWidth(cl_device_id Device)
+{
+	cl_int clError;
+	cl_context context = clCreateContext(NULL, 1, &Device, NULL, NULL, &clError);
+	if (clError != CL_SUCCESS)
+		return 0;
+
+	// built directly, the probe should neither show up in the build log nor in the cache
+	const char* src = "__kernel void Probe(__global float* p) { p[get_global_id(0)] *= 2.0f; }";
+	cl_program program = clCreateProgramWithSource(context, 1, &src, NULL, &clError);
+	cl_kernel kernel = nullptr;
+	size_t multiple = 0;
+	if (clError == CL_SUCCESS && clBuildProgram(program, 1, &Device, NULL, NULL, NULL) == CL_SUCCESS)
+	{
+		kernel = clCreateKernel(program, "Probe", &clError);
+		if (clError == CL_SUCCESS)
+			clGetKernelWorkGroupInfo(kernel, Device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(multiple), &multiple, NULL);
+	}
+
+	SAFE_RELEASE_KERNEL(kernel);
+	SAFE_RELEASE_PROGRAM(program);
+	clReleaseContext(context);
+	return (unsigned int)multiple;
+}
+
+void CDeviceCaps::AddDefines(CLDefines& Defines) const
+{
+	unsigned int banksLog = 0;
+	while ((1u << (banksLog + 1)) <= NumLocalBanks)
+		banksLog++;
+
+	Defines.Set("SIMD_WIDTH", SimdWidth)
+		.Set("LOCKSTEP_WIDTH", LockstepWidth)
+		.Set("NUM_BANKS", NumLocalBanks)
+		.Set("NUM_BANKS_LOG", banksLog)
+		.Set("VECTOR_WIDTH_FLOAT", VectorWidthFloat)
+		.Set("VECTOR_WIDTH_INT", VectorWidthInt);
+	if (HasFP16)
+		Defines.Define("HAS_FP16");
+	if (HasFP64)
+		Defines.Define("HAS_FP64");
+	if (HasInt64Atomics)
+		Defines.Define("HAS_INT64_ATOMICS");
+	if (HasSubgroups)
+		Defines.Define("HAS_SUBGROUPS");
+}
+
+void CDeviceCaps::Print() const
+{
+	cout << "SIMD width: " << SimdWidth << " (lockstep: " << LockstepWidth << ")" << endl;
+	cout << "Local memory: " << (HasLocalMemory ? "dedicated" : "emulated") << ", " << NumLocalBanks << " banks" << endl;
+	cout << "Preferred vector width: float" << VectorWidthFloat << ", int" << VectorWidthInt << endl;
+	cout << "Optional features:" << (HasFP16 ? " fp16" : "") << (HasFP64 ? " fp64" : "")
+		<< (HasInt64Atomics ? " int64-atomics" : "") << (HasSubgroups ? " subgroups" : "")
+		<< (HasCommandBuffer ? " command-buffer" : "") << endl;
+}
@@ -4,13 +4,198 @@ GPU Computing / GPGPU Praktikum source code.
 ******************************************************************************/
 
 #include "CLUtil.h"
+#include "CRoofline.h"
 #include "CTimer.h"
+#include "CTraceRecorder.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <mutex>
 #include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+///////////////////////////////////////////////////////////////////////////////
+// Program binary cache
+
+static string GetDeviceInfoString(cl_device_id Device, cl_device_info Param)
+{
+	size_t size = 0;
+	clGetDeviceInfo(Device, Param, 0, NULL, &size);
+	string info(size, '\0');
+	if (size > 0)
+		clGetDeviceInfo(Device, Param, size, &info[0], NULL);
+	return info;
+}
+
+static bool IsProgramCacheEnabled()
+{
+	const char* env = getenv("GPUC_CL_CACHE");
+	return env == NULL || atoi(env) != 0;
+}
+
+static string GetProgramCacheDir()
+{
+	const char* env = getenv("GPUC_CL_CACHE_DIR");
+	return env != NULL ? env : "CLCache";
+}
+
+//! Everything that influences the compiled binary goes into the key (64 bit FNV-1a)
+static string GetProgramCachePath(cl_device_id Device, const std::string& SourceCode, const std::string& CompileOptions)
+{
+	string key = SourceCode + '\0' + CompileOptions + '\0' +
+		GetDeviceInfoString(Device, CL_DEVICE_NAME) + '\0' + GetDeviceInfoString(Device, CL_DRIVER_VERSION);
+
+	cl_ulong hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < key.size(); i++)
+	{
+		hash ^= (unsigned char)key[i];
+		hash *= 1099511628211ULL;
+	}
+
+	ostringstream path;
+	path << GetProgramCacheDir() << "/" << hex << setw(16) << setfill('0') << hash << ".bin";
+	return path.str();
+}
+
+static cl_program LoadProgramBinary(cl_device_id Device, cl_context Context, const string& Path, const char* pCompileOptions)
+{
+	ifstream file(Path.c_str(), ios::binary);
+	if (!file.is_open())
+		return nullptr;
+
+	vector<unsigned char> binary((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	if (binary.empty())
+		return nullptr;
+
+	const unsigned char* pBinary = &binary[0];
+	size_t length = binary.size();
+	cl_int binaryStatus = CL_SUCCESS;
+	cl_int clError;
+	cl_program prog = clCreateProgramWithBinary(Context, 1, &Device, &length, &pBinary, &binaryStatus, &clError);
+	if (CL_SUCCESS != clError || CL_SUCCESS != binaryStatus)
+	{
+		SAFE_RELEASE_PROGRAM(prog);
+		return nullptr;
+	}
+
+	// binaries still have to be built before kernels can be created from them
+	if (CL_SUCCESS != clBuildProgram(prog, 1, &Device, pCompileOptions, NULL, NULL))
+	{
+		SAFE_RELEASE_PROGRAM(prog);
+		return nullptr;
+	}
+
+	return prog;
+}
+
+static void StoreProgramBinary(cl_program Program, const string& Path)
+{
+	size_t binarySize = 0;
+	if (CL_SUCCESS != clGetProgramInfo(Program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, NULL) || binarySize == 0)
+		return;
+
+	vector<unsigned char> binary(binarySize);
+	unsigned char* pBinary = &binary[0];
+	if (CL_SUCCESS != clGetProgramInfo(Program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &pBinary, NULL))
+		return;
+
+#ifdef _WIN32
+	_mkdir(GetProgramCacheDir().c_str());
+#else
+	mkdir(GetProgramCacheDir().c_str(), 0755);
+#endif
+
+	// write to a temporary file first, so that a concurrent run never reads a partial binary.
+	// The name is unique per process and thread, concurrent writers must not share it.
+	stringstream tmpName;
+	tmpName << Path << "." << getpid() << "." << hash<thread::id>()(this_thread::get_id()) << ".tmp";
+	string tmpPath = tmpName.str();
+	{
+		ofstream file(tmpPath.c_str(), ios::binary);
+		if (!file.is_open())
+			return;
+		file.write((const char*)pBinary, binarySize);
+		if (!file.good())
+		{
+			file.close();
+			remove(tmpPath.c_str());
+			return;
+		}
+	}
+	remove(Path.c_str());
+	// another writer may have renamed its copy in between, which is just as good
+	if (rename(tmpPath.c_str(), Path.c_str()) != 0)
+		remove(tmpPath.c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Embedded kernel sources
+
+static vector<const CLUtil::EmbeddedSource*>& GetEmbeddedSources()
+{
+	// filled during the static initialization of the executable
+	static vector<const CLUtil::EmbeddedSource*> sources;
+	return sources;
+}
+
+static bool IsILEnabled()
+{
+	const char* env = getenv("GPUC_CL_IL");
+	return env == NULL || atoi(env) != 0;
+}
+
+typedef cl_program (CL_API_CALL *CreateProgramWithILFunc)(cl_context, const void*, size_t, cl_int*);
+
+//! Creates a program from the SPIR-V embedded with this source, nullptr if there is none or the device does not take it
+static cl_program CreateProgramFromEmbeddedIL(cl_device_id Device, cl_context Context, const string& SourceCode, const string& CompileOptions)
+{
+	// the IL was compiled without options, defines have to go through the source
+	if (!CompileOptions.empty() || !IsILEnabled())
+		return nullptr;
+
+	const CLUtil::EmbeddedSource* pEmbedded = nullptr;
+	for (const CLUtil::EmbeddedSource* pSource : GetEmbeddedSources())
+		if (pSource->ILSize > 0 && SourceCode.compare(0, string::npos, pSource->Source, pSource->SourceSize) == 0)
+			pEmbedded = pSource;
+	if (!pEmbedded)
+		return nullptr;
+
+	if (GetDeviceInfoString(Device, CL_DEVICE_EXTENSIONS).find("cl_khr_il_program") == string::npos)
+		return nullptr;
+
+	cl_platform_id platform;
+	if (clGetDeviceInfo(Device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, NULL) != CL_SUCCESS)
+		return nullptr;
+
+	CreateProgramWithILFunc createProgramWithIL =
+		(CreateProgramWithILFunc)clGetExtensionFunctionAddressForPlatform(platform, "clCreateProgramWithILKHR");
+	if (!createProgramWithIL)
+		return nullptr;
+
+	cl_int clError;
+	cl_program prog = createProgramWithIL(Context, pEmbedded->IL, pEmbedded->ILSize, &clError);
+	return clError == CL_SUCCESS ? prog : nullptr;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // CLUtil
 
@@ -25,12 +210,24 @@ size_t CLUtil::GetGlobalWorkSize(size_t DataElemCount, size_t LocalWorkSize)
 
 bool CLUtil::LoadProgramSourceToMemory(const std::string& Path, std::string& SourceCode)
 {
+	const char* sourceDir = getenv("GPUC_CL_SOURCE_DIR");
+	if (sourceDir == NULL)
+	{
+		const EmbeddedSource* pEmbedded = FindEmbeddedSource(Path);
+		if (pEmbedded)
+		{
+			SourceCode.assign(pEmbedded->Source, pEmbedded->SourceSize);
+			return true;
+		}
+	}
+	string filePath = sourceDir != NULL ? string(sourceDir) + "/" + Path : Path;
+
 	ifstream sourceFile;
 	
-	sourceFile.open(Path.c_str());
+	sourceFile.open(filePath.c_str());
 	if (!sourceFile.is_open())
 	{
-		cerr << "Failed to open file '" << Path << "'." << endl;
+		cerr << "Failed to open file '" << filePath << "'." << endl;
 		return false;
 	}
 
@@ -46,14 +243,50 @@ bool CLUtil::LoadProgramSourceToMemory(const std::string& Path, std::string& Sou
 	return true;
 }
 
+bool CLUtil::RegisterEmbeddedSources(const EmbeddedSource* pSources, size_t Count)
+{
+	for (size_t i = 0; i < Count; i++)
+		GetEmbeddedSources().push_back(&pSources[i]);
+	return true;
+}
+
+const CLUtil::EmbeddedSource* CLUtil::FindEmbeddedSource(const std::string& Path)
+{
+	for (const EmbeddedSource* pSource : GetEmbeddedSources())
+		if (Path == pSource->Path)
+			return pSource;
+	return nullptr;
+}
+
 cl_program CLUtil::BuildCLProgramFromMemory(cl_device_id Device, cl_context Context, const std::string& SourceCode, const std::string& CompileOptions)
 {
-	
-	// Ignore the last parameter CompileOptions in assignment 1
-	// This may be used later to pass flags and macro definitions to the OpenCL compiler
 
 	cl_program prog = nullptr;
 
+	const char* pCompileOptions = CompileOptions.size() > 0 ? CompileOptions.c_str() : nullptr;
+
+	// Try the binary cache first. A missing, stale or rejected binary falls back to the source.
+	string cachePath;
+	if (IsProgramCacheEnabled())
+	{
+		cachePath = GetProgramCachePath(Device, SourceCode, CompileOptions);
+		prog = LoadProgramBinary(Device, Context, cachePath, pCompileOptions);
+		if (prog)
+			return prog;
+	}
+
+	// Precompiled SPIR-V skips the compiler front end; if the driver rejects it, the source is built
+	prog = CreateProgramFromEmbeddedIL(Device, Context, SourceCode, CompileOptions);
+	if (prog)
+	{
+		if (clBuildProgram(prog, 1, &Device, pCompileOptions, NULL, NULL) == CL_SUCCESS)
+		{
+			if (!cachePath.empty())
+				StoreProgramBinary(prog, cachePath);
+			return prog;
+		}
+		SAFE_RELEASE_PROGRAM(prog);
+	}
 
 		string srcSolution = SourceCode;
 
@@ -69,7 +302,6 @@ cl_program CLUtil::BuildCLProgramFromMemory(cl_device_id Device, cl_context Cont
 	}
 
 	// program created, now build it:
-	const char* pCompileOptions = CompileOptions.size() > 0 ? CompileOptions.c_str() : nullptr;
 	clError = clBuildProgram(prog, 1, &Device, pCompileOptions, NULL, NULL);
 	PrintBuildLog(prog, Device);
 	if(CL_SUCCESS != clError)
@@ -79,10 +311,147 @@ cl_program CLUtil::BuildCLProgramFromMemory(cl_device_id Device, cl_context Cont
 		return nullptr;
 	}
 
+	if (!cachePath.empty())
+		StoreProgramBinary(prog, cachePath);
+
+	return prog;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Program variants
+
+CLDefines& CLDefines::Set(const std::string& Name, float Value)
+{
+	// OpenCL C has no nanf / inff literals, but the NAN and INFINITY macros
+	if (std::isnan(Value))
+		return SetRaw(Name, "NAN");
+	if (std::isinf(Value))
+		return SetRaw(Name, Value < 0 ? "(-INFINITY)" : "INFINITY");
+	ostringstream value;
+	value << setprecision(9) << Value;
+	// OpenCL C needs a decimal point or an exponent before the suffix
+	string literal = value.str();
+	if (literal.find_first_of(".eE") == string::npos)
+		literal += ".0";
+	return SetRaw(Name, literal + "f");
+}
+
+CLDefines& CLDefines::Set(const std::string& Name, double Value)
+{
+	if (std::isnan(Value))
+		return SetRaw(Name, "((double)NAN)");
+	if (std::isinf(Value))
+		return SetRaw(Name, Value < 0 ? "(-(double)INFINITY)" : "((double)INFINITY)");
+	ostringstream value;
+	value << setprecision(17) << Value;
+	string literal = value.str();
+	if (literal.find_first_of(".eE") == string::npos)
+		literal += ".0";
+	return SetRaw(Name, literal);
+}
+
+CLDefines& CLDefines::SetRaw(const std::string& Name, const std::string& Value)
+{
+	m_Defines[Name] = Value;
+	return *this;
+}
+
+string CLDefines::GetOptions() const
+{
+	string options;
+	for (map<string, string>::const_iterator it = m_Defines.begin(); it != m_Defines.end(); ++it)
+	{
+		options += (options.empty() ? "-D " : " -D ") + it->first;
+		if (!it->second.empty())
+			options += "=" + it->second;
+	}
+	return options;
+}
+
+//! Built variants per context, device and complete option string + source
+struct ProgramVariantKey
+{
+	cl_context		Context;
+	cl_device_id	Device;
+	string			OptionsAndSource;
+
+	bool operator<(const ProgramVariantKey& Other) const
+	{
+		if (Context != Other.Context)
+			return Context < Other.Context;
+		if (Device != Other.Device)
+			return Device < Other.Device;
+		return OptionsAndSource < Other.OptionsAndSource;
+	}
+};
+
+static mutex s_ProgramVariantsMutex;
+static map<ProgramVariantKey, cl_program> s_ProgramVariants;
+
+cl_program CLUtil::BuildProgramVariant(cl_device_id Device, cl_context Context, const std::string& SourceCode,
+	const CLDefines& Defines, const std::string& CompileOptions)
+{
+	string options = CompileOptions;
+	string defineOptions = Defines.GetOptions();
+	if (!defineOptions.empty())
+		options += (options.empty() ? "" : " ") + defineOptions;
+
+	ProgramVariantKey key;
+	key.Context = Context;
+	key.Device = Device;
+	key.OptionsAndSource = options + '\0' + SourceCode;
+
+	{
+		lock_guard<mutex> lock(s_ProgramVariantsMutex);
+		map<ProgramVariantKey, cl_program>::iterator it = s_ProgramVariants.find(key);
+		if (it != s_ProgramVariants.end())
+		{
+			clRetainProgram(it->second);
+			return it->second;
+		}
+	}
+
+	// build without holding the lock, so that different variants can be built concurrently
+	cl_program prog = BuildCLProgramFromMemory(Device, Context, SourceCode, options);
+	if (prog == nullptr)
+		return nullptr;
+
+	lock_guard<mutex> lock(s_ProgramVariantsMutex);
+	// another thread may have built the same variant in the meantime, keep the first one
+	map<ProgramVariantKey, cl_program>::iterator it = s_ProgramVariants.find(key);
+	if (it != s_ProgramVariants.end())
+	{
+		clReleaseProgram(prog);
+		clRetainProgram(it->second);
+		return it->second;
+	}
 
+	// one reference for the cache, one for the caller
+	clRetainProgram(prog);
+	s_ProgramVariants[key] = prog;
 	return prog;
 }
 
+void CLUtil::ReleaseProgramVariants(cl_context Context)
+{
+	lock_guard<mutex> lock(s_ProgramVariantsMutex);
+
+	map<ProgramVariantKey, cl_program>::iterator it = s_ProgramVariants.begin();
+	while (it != s_ProgramVariants.end())
+	{
+		if (it->first.Context == Context)
+		{
+			clReleaseProgram(it->second);
+			s_ProgramVariants.erase(it++);
+		}
+		else
+			++it;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CLUtil
+
 void CLUtil::PrintBuildLog(cl_program Program, cl_device_id Device)
 {
 	cl_build_status buildStatus;
@@ -100,6 +469,9 @@ void CLUtil::PrintBuildLog(cl_program Program, cl_device_id Device)
 	clGetProgramBuildInfo(Program, Device, CL_PROGRAM_BUILD_LOG, logSize, &buildLog[0], NULL);
 	buildLog[logSize] = '\0';
 
+	// programs may be built on several threads, print each log in one piece
+	static mutex s_LogMutex;
+	lock_guard<mutex> lock(s_LogMutex);
 	if(buildStatus != CL_SUCCESS)
 		cout<<"There were build errors!"<<endl;
 	cout<<"Build log:"<<endl;
@@ -107,8 +479,19 @@ void CLUtil::PrintBuildLog(cl_program Program, cl_device_id Device)
 }
 
 double CLUtil::ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions, 
-		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations)
+		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations, bool ReportRoofline)
 {
+	// prefer the device timestamps if the queue records them
+	cl_command_queue_properties properties = 0;
+	clGetCommandQueueInfo(CommandQueue, CL_QUEUE_PROPERTIES, sizeof(cl_command_queue_properties), &properties, NULL);
+	if (properties & CL_QUEUE_PROFILING_ENABLE)
+	{
+		KernelProfile profile;
+		if (!ProfileKernel(CommandQueue, Kernel, Dimensions, pGlobalWorkSize, pLocalWorkSize, NIterations, profile, ReportRoofline))
+			return -1;
+		return profile.Mean;
+	}
+
 	CTimer timer;
 	cl_int clErr;
 
@@ -132,9 +515,124 @@ double CLUtil::ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl
 	{
 		string errorString = GetCLErrorString(clErr);
 		cerr<<"Kernel execution failure: "<<errorString<<endl;
+		return -1;
+	}
+
+	double ms = timer.GetElapsedMilliseconds() / double(NIterations);
+	if (ReportRoofline)
+		CRoofline::ReportKernel(CommandQueue, Kernel, Dimensions, pGlobalWorkSize, ms);
+	return ms;
+}
+
+bool CLUtil::ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions, 
+		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations, KernelProfile& Profile,
+		bool ReportRoofline)
+{
+	Profile = KernelProfile();
+
+	cl_command_queue_properties properties = 0;
+	clGetCommandQueueInfo(CommandQueue, CL_QUEUE_PROPERTIES, sizeof(cl_command_queue_properties), &properties, NULL);
+	if (!(properties & CL_QUEUE_PROFILING_ENABLE))
+	{
+		cerr<<"Kernel profiling requires a command queue created with CL_QUEUE_PROFILING_ENABLE."<<endl;
+		return false;
 	}
 
-	return timer.GetElapsedMilliseconds() / double(NIterations);
+	// wait until the command queue is empty...
+	cl_int clErr = clFinish(CommandQueue);
+
+	// every launch gets its own event, so the timestamps come from the device
+	vector<cl_event> events;
+	vector<double> enqueueUs;
+	events.reserve(NIterations);
+	for(int i = 0; i < NIterations && clErr == CL_SUCCESS; i++)
+	{
+		cl_event event = NULL;
+		// aligns the device clock with the host clock in the trace
+		double hostUs = CTraceRecorder::GetTimeMicroseconds();
+		clErr = clEnqueueNDRangeKernel(CommandQueue, Kernel, Dimensions, NULL, pGlobalWorkSize, pLocalWorkSize, 0, NULL, &event);
+		if (event)
+		{
+			events.push_back(event);
+			enqueueUs.push_back(hostUs);
+		}
+	}
+	cl_int clFinishErr = clFinish(CommandQueue);
+	if (clErr == CL_SUCCESS)
+		clErr = clFinishErr;
+
+	// merge the launches into the trace, if one is recorded
+	string kernelName = "kernel";
+	if (CTraceRecorder::GetInstance().IsEnabled())
+	{
+		char name[256] = "";
+		if (clGetKernelInfo(Kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name), name, NULL) == CL_SUCCESS)
+			kernelName = name;
+	}
+
+	vector<double> times;
+	double launchLatency = 0.0;
+	cl_ulong previousEnd = 0;
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		cl_ulong queued = 0, start = 0, end = 0;
+		if (clErr == CL_SUCCESS)
+		{
+			clErr = clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, NULL);
+			clErr |= clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+			clErr |= clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+
+			// timestamps are in nanoseconds
+			times.push_back((end - start) * 1.0e-6);
+			// without the wait for the previous launch in the in-order queue
+			cl_ulong ready = max(queued, previousEnd);
+			launchLatency += (start > ready ? start - ready : 0) * 1.0e-6;
+			previousEnd = end;
+		}
+		if (clErr == CL_SUCCESS)
+			CTraceRecorder::GetInstance().AddDeviceEvent(kernelName, events[i], enqueueUs[i]);
+		clReleaseEvent(events[i]);
+	}
+
+	if(clErr != CL_SUCCESS || times.empty())
+	{
+		cerr<<"Kernel execution failure: "<<GetCLErrorString(clErr)<<endl;
+		return false;
+	}
+
+	size_t n = times.size();
+	double sum = 0.0;
+	for (size_t i = 0; i < n; i++)
+		sum += times[i];
+	double mean = sum / n;
+
+	double sqDiffSum = 0.0;
+	for (size_t i = 0; i < n; i++)
+		sqDiffSum += (times[i] - mean) * (times[i] - mean);
+
+	// nearest-rank percentiles
+	sort(times.begin(), times.end());
+	Profile.NIterations = (int)n;
+	Profile.Mean = mean;
+	Profile.Min = times[0];
+	Profile.Median = (n % 2 == 1) ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+	Profile.P95 = times[(size_t)ceil(0.95 * n) - 1];
+	Profile.P99 = times[(size_t)ceil(0.99 * n) - 1];
+	Profile.StdDev = n > 1 ? sqrt(sqDiffSum / (n - 1)) : 0.0;
+	Profile.LaunchLatency = launchLatency / n;
+
+	// Achieved bandwidth and throughput, if the task declared the cost of the kernel
+	if (ReportRoofline)
+		CRoofline::ReportKernel(CommandQueue, Kernel, Dimensions, pGlobalWorkSize, Profile.Mean);
+
+	return true;
+}
+
+void CLUtil::PrintKernelProfile(const KernelProfile& Profile)
+{
+	cout<<"  "<<Profile.NIterations<<" launches: mean "<<Profile.Mean<<" ms, min "<<Profile.Min
+		<<" ms, median "<<Profile.Median<<" ms, p95 "<<Profile.P95<<" ms, p99 "<<Profile.P99
+		<<" ms, stddev "<<Profile.StdDev<<" ms, launch latency "<<Profile.LaunchLatency<<" ms"<<endl;
 }
 
 #define CL_ERROR(x) case (x): return #x;
@@ -34,6 +34,43 @@
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <map>
+#include <sstream>
+
+//! Compile-time constants of a program variant, passed to the compiler as -D NAME=VALUE
+/*!
+	Floating-point values are written with enough digits to survive the round trip
+	(and an f suffix for float). The defines are sorted by name, so the same set
+	always gives the same options.
+*/
+class CLDefines
+{
+public:
+	template<typename T>
+	CLDefines& Set(const std::string& Name, T Value)
+	{
+		std::ostringstream value;
+		value << Value;
+		return SetRaw(Name, value.str());
+	}
+
+	CLDefines& Set(const std::string& Name, float Value);
+
+	CLDefines& Set(const std::string& Name, double Value);
+
+	CLDefines& Set(const std::string& Name, bool Value) { return SetRaw(Name, Value ? "1" : "0"); }
+
+	//! A define without a value, for #ifdef
+	CLDefines& Define(const std::string& Name) { return SetRaw(Name, ""); }
+
+	//! Takes the value literally, e.g. an expression or a type name
+	CLDefines& SetRaw(const std::string& Name, const std::string& Value);
+
+	std::string GetOptions() const;
+
+protected:
+	std::map<std::string, std::string>	m_Defines;
+};
 
 //! Utility class for frequently-needed OpenCL tasks
 // TO DO: replace this with a nicer OpenCL wrapper
@@ -43,21 +80,101 @@ public:
 	//! Determines the OpenCL global work size given the number of data elements and threads per workgroup
 	static size_t GetGlobalWorkSize(size_t DataElemCount, size_t LocalWorkSize);
 
+	//! A kernel source compiled into the executable by cmake/EmbedCLSources.cmake
+	struct EmbeddedSource
+	{
+		const char*				Path;
+		const char*				Source;
+		size_t					SourceSize;
+		//! Precompiled SPIR-V of the source, nullptr if there is none
+		const unsigned char*	IL;
+		size_t					ILSize;
+	};
+
 	//! Loads a program source to memory as a string
+	/*!
+		Sources embedded into the executable are returned without touching the disk,
+		other paths are read relative to the working directory. GPUC_CL_SOURCE_DIR
+		ignores the embedded sources and reads all of them from that directory,
+		e.g. to try changes to a kernel without rebuilding.
+	*/
 	static bool LoadProgramSourceToMemory(const std::string& Path, std::string& SourceCode);
 
+	//! Makes a table of embedded sources known to LoadProgramSourceToMemory(); called by the generated table itself
+	static bool RegisterEmbeddedSources(const EmbeddedSource* pSources, size_t Count);
+
+	//! Returns the embedded source with the given path, or nullptr
+	static const EmbeddedSource* FindEmbeddedSource(const std::string& Path);
+
 	//! Builds a CL program
+	/*!
+		Built programs are cached on disk as device binaries, keyed by the source,
+		the compile options, the device name and the driver version. A missing or
+		rejected binary falls back to building from source.
+		The cache is kept in GPUC_CL_CACHE_DIR (default: CLCache), GPUC_CL_CACHE=0 disables it.
+
+		Without compile options, the precompiled SPIR-V of an embedded source is
+		used on devices with cl_khr_il_program. GPUC_CL_IL=0 always builds from source.
+	*/
 	static cl_program BuildCLProgramFromMemory(cl_device_id Device, cl_context Context, const std::string& SourceCode, const std::string& CompileOptions = "");
 
+	//! Builds a variant of a program with the given compile-time constants, or returns the one built before
+	/*!
+		Variants are cached in memory per context, device, source and options, so
+		tasks can instantiate constant-folded kernels at run time cheaply. The caller
+		owns the returned program and releases it as usual, the cache keeps a reference
+		of its own until ReleaseProgramVariants(). Different variants can be built
+		concurrently from several threads.
+	*/
+	static cl_program BuildProgramVariant(cl_device_id Device, cl_context Context, const std::string& SourceCode,
+		const CLDefines& Defines, const std::string& CompileOptions = "");
+
+	//! Releases the cached variants of a context
+	static void ReleaseProgramVariants(cl_context Context);
+
 	static void PrintBuildLog(cl_program Program, cl_device_id Device);
 
+	//! Device-side timing statistics of a profiled kernel, all times in milliseconds
+	struct KernelProfile
+	{
+		int		NIterations;
+		double	Mean;
+		double	Min;
+		double	Median;
+		double	P95;
+		double	P99;
+		double	StdDev;
+		//! Average launch latency: START - max(QUEUED, END of the previous launch)
+		double	LaunchLatency;
+	};
+
 	//! Measures the execution time of a kernel by executing it N times and returning the average time in milliseconds.
 	/*!
 		The scheduling cost of the kernel can be amortized if we enqueue
 		the kernel multiple times. If your kernel is simple and fast, use a high number of iterations!		
+
+		If the command queue was created with CL_QUEUE_PROFILING_ENABLE, the average
+		of the device timestamps is returned, otherwise the host timer is used.
+		A negative time is returned if the kernel failed, its roofline is not reported then.
+		Kernels with a declared cost also report their roofline figures (see CRoofline),
+		unless ReportRoofline is false, e.g. while CWorkGroupTuner times its candidates.
 	*/
 	static double ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions, 
-		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations);
+		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations, bool ReportRoofline = true);
+
+	//! Profiles N launches of a kernel with events and gathers the statistics of their START/END timestamps.
+	/*!
+		Requires a command queue created with CL_QUEUE_PROFILING_ENABLE.
+		All launches are enqueued at once, so they wait for their predecessors in
+		the in-order queue. LaunchLatency therefore measures from the later of the
+		QUEUED timestamp and the END of the previous launch, i.e. from the moment
+		the launch could have started, not from QUEUED.
+	*/
+	static bool ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions, 
+		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations, KernelProfile& Profile,
+		bool ReportRoofline = true);
+
+	static void PrintKernelProfile(const KernelProfile& Profile);
 
 	static const char* GetCLErrorString(cl_int CLErrorCode);
 };
@@ -0,0 +1,145 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CLAUNCH_RECORDING_H
+#define _CLAUNCH_RECORDING_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <vector>
+
+struct _cl_command_buffer_khr;
+
+//! Records a sequence of kernel launches once and replays it without setting the arguments again
+/*!
+	Multi-pass algorithms enqueue many small launches, and at small problem sizes
+	the host spends more time in clSetKernelArg / clEnqueueNDRangeKernel than the
+	device in the kernels. Launches between Begin() and End() are recorded with
+	all of their arguments, Replay() enqueues the whole sequence again:
+
+		if (!m_Launches.IsRecorded(CommandQueue))
+		{
+			m_Launches.Begin(CommandQueue);
+			for (...)
+				m_Launches.Launch(CommandQueue, kernel, 1, &global, &local, {buffer, stride, n});
+			m_Launches.End();
+		}
+		m_Launches.Replay();
+
+	Outside of Begin() / End(), Launch() sets the arguments and enqueues right
+	away, so helper functions can be shared by recorded and direct code paths.
+
+	Every distinct set of arguments of a kernel gets its own kernel object with
+	the arguments baked in. If the device supports cl_khr_command_buffer, End()
+	records these into a command buffer and Replay() is a single enqueue,
+	otherwise Replay() enqueues the baked kernels one by one.
+	GPUC_COMMAND_BUFFER=0 forces the second path.
+
+	The recording holds on to the values of the arguments, buffers included. It
+	has to be recorded again when any of them changes, and released before the
+	buffers are.
+*/
+class CLaunchRecording
+{
+public:
+	//! Value of a kernel argument, e.g. a cl_mem or a cl_uint
+	struct Arg
+	{
+		template<typename T>
+		Arg(const T& Value) : Size(sizeof(T)), pValue(&Value) {}
+
+		//! __local memory of Size bytes
+		static Arg Local(size_t Size) { return Arg(Size, NULL); }
+
+		size_t			Size;
+		const void*		pValue;
+
+	private:
+		Arg(size_t Size, const void* pValue) : Size(Size), pValue(pValue) {}
+	};
+
+	CLaunchRecording();
+	~CLaunchRecording();
+
+	//! Starts a new recording for the queue, the previous one is released
+	void Begin(cl_command_queue Queue);
+
+	//! Records a launch of Kernel with all of its arguments, or enqueues it right away outside of a recording
+	cl_int Launch(cl_command_queue Queue, cl_kernel Kernel, cl_uint WorkDim, const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize,
+		std::initializer_list<Arg> Args);
+
+	//! Finishes the recording. If a launch failed to record, nothing is recorded.
+	void End();
+
+	//! Enqueues the recorded launches on the queue of the recording
+	cl_int Replay();
+
+	bool IsRecorded(cl_command_queue Queue) const { return m_Recorded && m_Queue == Queue; }
+	bool UsesCommandBuffer() const { return m_CommandBuffer != NULL; }
+	size_t GetNumLaunches() const { return m_Launches.size(); }
+
+	void Release();
+
+protected:
+	CLaunchRecording(const CLaunchRecording&);
+	CLaunchRecording& operator=(const CLaunchRecording&);
+
+	struct Baked
+	{
+		cl_kernel	Kernel;
+		cl_uint		WorkDim;
+		size_t		GlobalWorkSize[3];
+		size_t		LocalWorkSize[3];
+		bool		HasLocalWorkSize;
+	};
+
+	//! Kernel object with the arguments set, shared by the launches with the same arguments
+	cl_kernel GetBakedKernel(cl_kernel Kernel, std::initializer_list<Arg> Args, cl_int* pErrorCode);
+
+	//! Records the baked launches into a command buffer, false if the device cannot
+	bool RecordCommandBuffer();
+
+	typedef cl_int (CL_API_CALL *EnqueueCommandBufferFunc)(cl_uint, cl_command_queue*, _cl_command_buffer_khr*, cl_uint, const cl_event*, cl_event*);
+	typedef cl_int (CL_API_CALL *ReleaseCommandBufferFunc)(_cl_command_buffer_khr*);
+
+	cl_command_queue						m_Queue;
+	bool									m_Recording;
+	bool									m_Failed;
+	bool									m_Recorded;
+	std::vector<Baked>						m_Launches;
+	//! kernel and argument values -> baked kernel
+	std::map<std::pair<cl_kernel, std::string>, cl_kernel>	m_BakedKernels;
+
+	_cl_command_buffer_khr*					m_CommandBuffer;
+	cl_event								m_LastReplay;
+	EnqueueCommandBufferFunc				m_EnqueueCommandBuffer;
+	ReleaseCommandBufferFunc				m_ReleaseCommandBuffer;
+};
+
+#endif // _CLAUNCH_RECORDING_H
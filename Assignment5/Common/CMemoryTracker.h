@@ -0,0 +1,135 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CMEMORY_TRACKER_H
+#define _CMEMORY_TRACKER_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <map>
+#include <mutex>
+#include <string>
+
+//! Accounts the device memory of the tasks: live and peak bytes against the global memory of the device
+/*!
+	Allocations go through CreateBuffer() (or are registered with Track() after
+	clCreateImage*() / clCreateFromGLBuffer()) and are recorded with a tag, e.g.
+	"BVH/Morton codes". The record is removed by a destructor callback of the
+	memory object, so they are released with SAFE_RELEASE_MEMOBJECT as usual.
+	CBufferPool registers the buffers it creates as well.
+
+	Each allocation is charged to the task that is current on the calling
+	thread, see TaskScope; CAssignmentBase::RunComputeTask() and CTaskScheduler
+	open one with IComputeTask::GetName() around the task. Buffers cached by
+	CBufferPool are charged to "Buffer pool (cached)" until a task takes them
+	out again, see Recharge(). PrintStatistics() lists the live and peak bytes of
+	every task and its largest allocations, relative to CL_DEVICE_GLOBAL_MEM_SIZE.
+
+	Before an allocation, CheckAllocation() warns if the size exceeds
+	CL_DEVICE_MAX_MEM_ALLOC_SIZE (often only a quarter of the global memory),
+	or if the tracked allocations of the context would not fit into the global
+	memory anymore. Problem sizes that are too large show up this way instead
+	of as a CL_MEM_OBJECT_ALLOCATION_FAILURE somewhere in the first kernel.
+*/
+class CMemoryTracker
+{
+public:
+	static CMemoryTracker& GetInstance();
+
+	//! Charges all allocations of the current thread to a task while in scope (scopes nest)
+	class TaskScope
+	{
+	public:
+		explicit TaskScope(const std::string& Task);
+		~TaskScope();
+
+	private:
+		TaskScope(const TaskScope&);
+		TaskScope& operator=(const TaskScope&);
+
+		std::string		m_PreviousTask;
+	};
+
+	//! clCreateBuffer(), checked and recorded under Tag
+	cl_mem CreateBuffer(cl_context Context, cl_mem_flags Flags, size_t Size, void* pHostPtr, cl_int* pErrorCode, const std::string& Tag);
+
+	//! Records a memory object that was created elsewhere (images, GL buffers), ignores NULL
+	void Track(cl_mem MemObject, const std::string& Tag);
+
+	//! Moves a tracked memory object to Task, or to the current task of the calling thread if Task is empty
+	void Recharge(cl_mem MemObject, const std::string& Task = std::string());
+
+	//! Warns if an allocation of Size bytes would exceed the limits of the devices in the context, returns false then
+	bool CheckAllocation(cl_context Context, size_t Size, const std::string& Tag);
+
+	//! Tracked bytes of the context that are currently allocated
+	size_t GetLiveBytes(cl_context Context) const;
+
+	size_t GetPeakBytes(const std::string& Task) const;
+
+	void PrintStatistics() const;
+
+protected:
+	CMemoryTracker();
+
+	struct Allocation
+	{
+		cl_context		Context;
+		size_t			Size;
+		std::string		Tag;
+		std::string		Task;
+	};
+
+	struct TaskStatistics
+	{
+		size_t		LiveBytes = 0;
+		size_t		PeakBytes = 0;
+		size_t		NAllocations = 0;
+		cl_ulong	GlobalMemSize = 0;
+		//! largest allocation per tag
+		std::map<std::string, size_t>	Tags;
+	};
+
+	struct DeviceLimits
+	{
+		cl_ulong	MaxAllocSize = 0;
+		cl_ulong	GlobalMemSize = 0;
+		std::string	DeviceName;
+	};
+
+	//! Smallest limits of all devices in the context
+	static DeviceLimits GetLimits(cl_context Context);
+
+	static void CL_CALLBACK OnDestroyed(cl_mem MemObject, void* pUserData);
+	void Forget(cl_mem MemObject);
+
+	mutable std::mutex						m_Mutex;
+	std::map<cl_mem, Allocation>			m_Allocations;
+	std::map<cl_context, size_t>			m_LiveBytes;
+	std::map<std::string, TaskStatistics>	m_Tasks;
+};
+
+#endif // _CMEMORY_TRACKER_H
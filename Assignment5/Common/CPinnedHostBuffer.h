@@ -0,0 +1,84 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CPINNED_HOST_BUFFER_H
+#define _CPINNED_HOST_BUFFER_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <cstddef>
+
+//! Host memory that the device can access directly, as a replacement for new[] of task I/O arrays
+/*!
+	The memory is a CL_MEM_ALLOC_HOST_PTR buffer that stays mapped for its whole
+	lifetime. clEnqueueWrite/ReadBuffer from or to it can then use DMA without
+	an intermediate copy into a driver-owned staging buffer (pinned transfers).
+	If the driver refuses, page-aligned memory is wrapped with CL_MEM_USE_HOST_PTR.
+
+	On devices with unified host memory (CPUs, integrated GPUs) GetBuffer() can
+	be bound to kernels directly, which avoids the transfers entirely (zero-copy).
+	The buffer then has to be unmapped while kernels use it, see Unmap() / Map().
+*/
+class CPinnedHostBuffer
+{
+public:
+	CPinnedHostBuffer();
+
+	virtual ~CPinnedHostBuffer();
+
+	//! Allocates Size bytes and maps them, uses a queue of its own to map and unmap
+	bool Allocate(cl_context Context, cl_device_id Device, size_t Size, cl_mem_flags DeviceAccess = CL_MEM_READ_WRITE);
+
+	void Release();
+
+	//! Hands the memory to the device, the host pointer is invalid until Map()
+	bool Unmap();
+
+	//! Makes the memory accessible to the host again
+	bool Map();
+
+	void* GetHostPtr() const { return m_pHostPtr; }
+
+	template<typename T>
+	T* Get() const { return static_cast<T*>(m_pHostPtr); }
+
+	//! The underlying buffer object, can be used as a kernel argument for zero-copy access
+	cl_mem GetBuffer() const { return m_Buffer; }
+
+	size_t GetSize() const { return m_Size; }
+
+	//! True if the device shares the physical memory with the host
+	static bool IsZeroCopyDevice(cl_device_id Device);
+
+protected:
+	cl_command_queue		m_CommandQueue;
+	cl_mem					m_Buffer;
+	void*					m_pHostPtr;
+	void*					m_pAlignedAlloc;	//!< only used by the CL_MEM_USE_HOST_PTR fallback
+	size_t					m_Size;
+};
+
+#endif // _CPINNED_HOST_BUFFER_H
@@ -0,0 +1,191 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CResultValidator.h"
+
+#include "CThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CResultValidator
+
+//! Maps a float to an integer whose order matches the order of the floats
+static int64_t OrderedBits(float Value)
+{
+	int32_t bits;
+	memcpy(&bits, &Value, sizeof(bits));
+	return bits < 0 ? (int64_t)INT32_MIN - bits : (int64_t)bits;
+}
+
+static uint64_t ULPDistance(float A, float B)
+{
+	int64_t a = OrderedBits(A), b = OrderedBits(B);
+	return (uint64_t)(a > b ? a - b : b - a);
+}
+
+static uint64_t ULPDistance(int A, int B)
+{
+	int64_t d = (int64_t)A - (int64_t)B;
+	return (uint64_t)(d < 0 ? -d : d);
+}
+
+static uint64_t ULPDistance(unsigned int A, unsigned int B)
+{
+	return A > B ? A - B : B - A;
+}
+
+//! NaN in either value counts as the largest possible error
+static bool IsNaN(float Value) { return Value != Value; }
+static bool IsNaN(int) { return false; }
+static bool IsNaN(unsigned int) { return false; }
+
+template<typename T>
+static CResultValidator::Report CompareGeneric(const T* pReference, const T* pResult, size_t Width, size_t Height, size_t Pitch,
+	const CResultValidator::Tolerance& Tol, double PeakValue, float* pSquaredError)
+{
+	CResultValidator::Report empty;
+	empty.NElements = 0;
+	empty.NMismatches = 0;
+	empty.MaxAbsError = 0.0;
+	empty.MaxRelError = 0.0;
+	empty.MaxULP = 0;
+	empty.MSE = 0.0;
+	empty.PSNR = numeric_limits<double>::infinity();
+
+	// chunks of the region in row-major order, so that the first mismatches stay in order when merged
+	CResultValidator::Report report = CThreadPool::GetInstance().ParallelReduce(size_t(0), Width * Height, 0, empty,
+		[&](size_t Begin, size_t End) {
+			CResultValidator::Report partial = empty;
+			partial.NElements = End - Begin;
+			double squaredErrorSum = 0.0;
+
+			size_t x = Begin % Width, y = Begin / Width;
+			for (size_t i = Begin; i < End; i++)
+			{
+				size_t offset = y * Pitch + x;
+				T reference = pReference[offset];
+				T result = pResult[offset];
+
+				double absError = fabs((double)reference - (double)result);
+				double relError = reference != 0 ? absError / fabs((double)reference) : absError;
+				uint64_t ulp = ULPDistance(reference, result);
+				if (IsNaN(reference) || IsNaN(result))
+				{
+					// NaN only matches NaN
+					bool bothNaN = IsNaN(reference) && IsNaN(result);
+					absError = relError = bothNaN ? 0.0 : numeric_limits<double>::infinity();
+					ulp = bothNaN ? 0 : numeric_limits<uint64_t>::max();
+				}
+
+				partial.MaxAbsError = max(partial.MaxAbsError, absError);
+				partial.MaxRelError = max(partial.MaxRelError, relError);
+				partial.MaxULP = max(partial.MaxULP, ulp);
+				squaredErrorSum += absError * absError;
+				if (pSquaredError)
+					pSquaredError[offset] = (float)(absError * absError);
+
+				if (absError > Tol.Abs && relError > Tol.Rel && ulp > Tol.ULP)
+				{
+					if (partial.FirstMismatches.size() < CResultValidator::MaxRecordedMismatches)
+					{
+						CResultValidator::Mismatch mismatch = { x, y, (double)reference, (double)result };
+						partial.FirstMismatches.push_back(mismatch);
+					}
+					partial.NMismatches++;
+				}
+
+				if (++x == Width)
+				{
+					x = 0;
+					y++;
+				}
+			}
+			partial.MSE = squaredErrorSum / partial.NElements;
+			return partial;
+		},
+		[](const CResultValidator::Report& A, const CResultValidator::Report& B) {
+			vector<CResultValidator::Report> reports;
+			reports.push_back(A);
+			reports.push_back(B);
+			return CResultValidator::Merge(reports);
+		});
+
+	report.PSNR = report.MSE > 0.0 ? 10.0 * log10(PeakValue * PeakValue / report.MSE) : numeric_limits<double>::infinity();
+	return report;
+}
+
+CResultValidator::Report CResultValidator::Compare(const float* pReference, const float* pResult, size_t Width, size_t Height, size_t Pitch,
+	const Tolerance& Tol, double PeakValue, float* pSquaredError)
+{
+	return CompareGeneric(pReference, pResult, Width, Height, Pitch, Tol, PeakValue, pSquaredError);
+}
+
+CResultValidator::Report CResultValidator::Compare(const int* pReference, const int* pResult, size_t Width, size_t Height, size_t Pitch,
+	const Tolerance& Tol, double PeakValue)
+{
+	return CompareGeneric(pReference, pResult, Width, Height, Pitch, Tol, PeakValue, NULL);
+}
+
+CResultValidator::Report CResultValidator::Compare(const unsigned int* pReference, const unsigned int* pResult, size_t Width, size_t Height, size_t Pitch,
+	const Tolerance& Tol, double PeakValue)
+{
+	return CompareGeneric(pReference, pResult, Width, Height, Pitch, Tol, PeakValue, NULL);
+}
+
+CResultValidator::Report CResultValidator::Merge(const vector<Report>& Reports)
+{
+	// the MSE is weighted by the number of elements, the PSNR is the one of the worst report
+	Report merged;
+	merged.NElements = 0;
+	merged.NMismatches = 0;
+	merged.MaxAbsError = 0.0;
+	merged.MaxRelError = 0.0;
+	merged.MaxULP = 0;
+	merged.MSE = 0.0;
+	merged.PSNR = numeric_limits<double>::infinity();
+
+	double weightedMSE = 0.0;
+	for (size_t i = 0; i < Reports.size(); i++)
+	{
+		const Report& r = Reports[i];
+		merged.NElements += r.NElements;
+		merged.NMismatches += r.NMismatches;
+		merged.MaxAbsError = max(merged.MaxAbsError, r.MaxAbsError);
+		merged.MaxRelError = max(merged.MaxRelError, r.MaxRelError);
+		merged.MaxULP = max(merged.MaxULP, r.MaxULP);
+		merged.PSNR = min(merged.PSNR, r.PSNR);
+		weightedMSE += r.MSE * r.NElements;
+		for (size_t m = 0; m < r.FirstMismatches.size() && merged.FirstMismatches.size() < MaxRecordedMismatches; m++)
+			merged.FirstMismatches.push_back(r.FirstMismatches[m]);
+	}
+	merged.MSE = merged.NElements > 0 ? weightedMSE / merged.NElements : 0.0;
+
+	return merged;
+}
+
+void CResultValidator::PrintReport(const Report& ValidationReport, const string& Name, bool Verbose)
+{
+	const Report& r = ValidationReport;
+	if (r.Passed() && !Verbose)
+		return;
+
+	cout << Name << ": " << r.NMismatches << " of " << r.NElements << " elements differ" << endl;
+	cout << "  max abs error " << r.MaxAbsError << ", max rel error " << r.MaxRelError << ", max ULP " << r.MaxULP
+		<< ", MSE " << r.MSE << ", PSNR " << r.PSNR << " dB" << endl;
+	for (size_t i = 0; i < r.FirstMismatches.size(); i++)
+	{
+		const Mismatch& m = r.FirstMismatches[i];
+		cout << "  (" << m.X << ", " << m.Y << "): expected " << m.Reference << ", got " << m.Result << endl;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
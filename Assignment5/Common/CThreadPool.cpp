@@ -0,0 +1,179 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CThreadPool.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CThreadPool
+
+// the pool and worker index of the current thread, index -1 for threads that are no workers
+static thread_local CThreadPool* t_pPool = NULL;
+static thread_local int t_WorkerIndex = -1;
+
+CThreadPool& CThreadPool::GetInstance()
+{
+	static CThreadPool* pInstance = NULL;
+	static once_flag created;
+	call_once(created, []() {
+		unsigned int nThreads = thread::hardware_concurrency();
+		const char* env = getenv("GPUC_CPU_THREADS");
+		if (env != NULL && atoi(env) > 0)
+			nThreads = (unsigned int)atoi(env);
+		// never destroyed, the workers may outlive other static objects
+		pInstance = new CThreadPool(max(nThreads, 1u));
+	});
+	return *pInstance;
+}
+
+CThreadPool::CThreadPool(unsigned int NThreads)
+	: m_NPending(0), m_NextQueue(0), m_Stop(false)
+{
+	unsigned int nWorkers = NThreads > 1 ? NThreads - 1 : 0;
+	for (unsigned int i = 0; i < nWorkers; i++)
+		m_Queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+	for (unsigned int i = 0; i < nWorkers; i++)
+		m_Workers.push_back(thread(&CThreadPool::WorkerLoop, this, (int)i));
+}
+
+CThreadPool::~CThreadPool()
+{
+	{
+		lock_guard<mutex> lock(m_SleepMutex);
+		m_Stop = true;
+	}
+	m_WakeUp.notify_all();
+	for (size_t i = 0; i < m_Workers.size(); i++)
+		m_Workers[i].join();
+}
+
+size_t CThreadPool::GetDefaultGrain(size_t NElements) const
+{
+	// a few chunks per thread balance the load, stealing handles the rest
+	size_t nChunks = 4 * (size_t)GetNumThreads();
+	return max<size_t>(1, (NElements + nChunks - 1) / nChunks);
+}
+
+void CThreadPool::Submit(const Job& NewJob)
+{
+	if (m_Queues.empty())
+	{
+		NewJob();
+		return;
+	}
+
+	// workers keep their jobs, everybody else distributes them round robin
+	size_t queue = (t_pPool == this && t_WorkerIndex >= 0) ? (size_t)t_WorkerIndex : m_NextQueue++ % m_Queues.size();
+	{
+		lock_guard<mutex> lock(m_Queues[queue]->Mutex);
+		m_Queues[queue]->Jobs.push_back(NewJob);
+	}
+	m_NPending++;
+
+	{
+		lock_guard<mutex> lock(m_SleepMutex);
+	}
+	m_WakeUp.notify_one();
+}
+
+bool CThreadPool::TryRunOne(int Preferred)
+{
+	Job job;
+	size_t nQueues = m_Queues.size();
+
+	if (Preferred >= 0)
+	{
+		WorkQueue& own = *m_Queues[Preferred];
+		lock_guard<mutex> lock(own.Mutex);
+		if (!own.Jobs.empty())
+		{
+			job = own.Jobs.back();
+			own.Jobs.pop_back();
+		}
+	}
+
+	// steal the oldest job of another queue
+	for (size_t i = 0; !job && i < nQueues; i++)
+	{
+		size_t victim = (Preferred + 1 + i) % nQueues;
+		if ((int)victim == Preferred)
+			continue;
+		WorkQueue& other = *m_Queues[victim];
+		lock_guard<mutex> lock(other.Mutex);
+		if (!other.Jobs.empty())
+		{
+			job = other.Jobs.front();
+			other.Jobs.pop_front();
+		}
+	}
+
+	if (!job)
+		return false;
+
+	m_NPending--;
+	job();
+	return true;
+}
+
+void CThreadPool::WorkerLoop(int Index)
+{
+	t_pPool = this;
+	t_WorkerIndex = Index;
+
+	for (;;)
+	{
+		if (TryRunOne(Index))
+			continue;
+
+		unique_lock<mutex> lock(m_SleepMutex);
+		m_WakeUp.wait(lock, [this]() { return m_Stop || m_NPending > 0; });
+		if (m_Stop && m_NPending == 0)
+			return;
+	}
+}
+
+void CThreadPool::ParallelFor(size_t Begin, size_t End, size_t Grain, const function<void(size_t, size_t)>& Body)
+{
+	if (End <= Begin)
+		return;
+	if (Grain == 0)
+		Grain = GetDefaultGrain(End - Begin);
+
+	size_t nChunks = (End - Begin + Grain - 1) / Grain;
+	if (nChunks == 1 || m_Queues.empty())
+	{
+		Body(Begin, End);
+		return;
+	}
+
+	// the counter lives until the last chunk is done, because we wait for it below
+	atomic<size_t> remaining(nChunks);
+	for (size_t c = 1; c < nChunks; c++)
+	{
+		size_t chunkBegin = Begin + c * Grain;
+		size_t chunkEnd = min(chunkBegin + Grain, End);
+		Submit([&Body, &remaining, chunkBegin, chunkEnd]() {
+			Body(chunkBegin, chunkEnd);
+			remaining--;
+		});
+	}
+
+	Body(Begin, min(Begin + Grain, End));
+	remaining--;
+
+	// help instead of blocking, this also keeps nested loops from deadlocking
+	int self = (t_pPool == this) ? t_WorkerIndex : -1;
+	while (remaining > 0)
+	{
+		if (!TryRunOne(self))
+			this_thread::yield();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
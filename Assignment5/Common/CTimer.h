@@ -26,35 +26,22 @@
 // We reverted from std::chrono, because that timer implementation seems to be very imprecise
 // (at least under windows)
 
-#ifdef _WIN32
-
-#include <Windows.h>
-
-#elif defined (__APPLE__) || defined(MACOSX)
-
-#include <sys/time.h>
-
-#else
-
-#include <sys/time.h>
-#include <time.h>
-
-#endif
-
 //! Simple wrapper class for the measurement of time intervals
 /*!
 	Use this timer to measure elapsed time on the HOST side.
 	Not suitable for measuring the execution of DEVICE code
 	without synchronization with the HOST.
 
-	NOTE: This class is not thread-safe (like most other classes in these
-	examples), but we are not doing CPU multithreading in the praktikum...
+	The timer reads the monotonic clock of CTraceRecorder::GetTimeMicroseconds(),
+	so its intervals match the trace and are not affected by changes of the
+	wall clock. The clock can be read from any thread; a CTimer object itself
+	belongs to the thread that starts and stops it.
 */
 class CTimer
 {
 public:
 
-	CTimer(){};
+	CTimer() : m_StartUs(0.0), m_EndUs(0.0) {};
 
 	~CTimer(){};
 
@@ -67,13 +54,8 @@ public:
 
 protected:
 
-#ifdef WIN32
-	LARGE_INTEGER		m_StartTime;
-	LARGE_INTEGER		m_EndTime;
-#else
-	struct timeval		m_StartTime;
-	struct timeval		m_EndTime;
-#endif
+	double				m_StartUs;
+	double				m_EndUs;
 };
 
 #endif // _CTIMER_H
@@ -0,0 +1,103 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CTRANSFER_PIPELINE_H
+#define _CTRANSFER_PIPELINE_H
+
+// All OpenCL headers
+#if defined(WIN32)
+    #include <CL/opencl.h>
+#elif defined (__APPLE__) || defined(MACOSX)
+    #include <OpenCL/opencl.h>
+#else
+    #include <CL/cl.h>
+#endif 
+
+#include <functional>
+#include <vector>
+
+//! Overlaps host<->device transfers with kernel execution by splitting the work into chunks
+/*!
+	Uploads, kernels and downloads run on three command queues that are linked
+	by events: upload of chunk i+1 and download of chunk i-1 overlap the kernel
+	on chunk i. The upload and download queues are created on the context and
+	device of the compute queue. If the compute queue is out-of-order, all stages
+	are enqueued to it and only the events order them.
+
+	Chunks are distributed over NBuffers slots (Chunk::Slot), so a task can
+	stream through NBuffers chunk-sized device buffers (double buffering with
+	NBuffers = 2). The pipeline then waits until the kernel of chunk i - NBuffers
+	has consumed its input before uploading chunk i into the same slot, and until
+	chunk i - NBuffers has been downloaded before the kernel of chunk i overwrites
+	its output. With NBuffers = 0 every chunk has its own region of a
+	full-size buffer and no slot is reused.
+
+	Each stage callback enqueues its commands waiting for the given events and
+	returns the event of its last command. On an in-order queue this is enough,
+	on an out-of-order queue a stage with several commands has to combine them
+	(e.g. with clEnqueueMarkerWithWaitList).
+*/
+class CTransferPipeline
+{
+public:
+	//! What ComputeGPU() measures in the tasks that use the pipeline
+	enum Mode
+	{
+		ProfileKernels,		//!< the kernels alone, over repeated launches
+		Serialized,			//!< one write -> kernel -> read round trip
+		Pipelined			//!< the same round trip in chunks whose transfers overlap the kernel
+	};
+
+	struct Chunk
+	{
+		size_t			Index;
+		size_t			Slot;		//!< Index % NBuffers, 0 if NBuffers is 0
+		size_t			Offset;		//!< first element of the chunk
+		size_t			Count;		//!< number of elements in the chunk
+	};
+
+	typedef std::function<cl_int(cl_command_queue Queue, const Chunk& CurrentChunk,
+		cl_uint NWaitEvents, const cl_event* pWaitEvents, cl_event* pEvent)> Stage;
+
+	CTransferPipeline();
+
+	virtual ~CTransferPipeline();
+
+	//! Creates the copy queues for the compute queue
+	bool Init(cl_command_queue ComputeQueue);
+
+	void Release();
+
+	//! Processes NElements elements in chunks of ChunkElements and blocks until all downloads have finished
+	bool Run(size_t NElements, size_t ChunkElements, unsigned int NBuffers,
+		const Stage& Upload, const Stage& Compute, const Stage& Download);
+
+	cl_command_queue GetUploadQueue() const { return m_UploadQueue; }
+	cl_command_queue GetComputeQueue() const { return m_ComputeQueue; }
+	cl_command_queue GetDownloadQueue() const { return m_DownloadQueue; }
+
+protected:
+	static void ReleaseEvents(std::vector<cl_event>& Events);
+
+	cl_command_queue			m_ComputeQueue;
+	cl_command_queue			m_UploadQueue;
+	cl_command_queue			m_DownloadQueue;
+};
+
+#endif // _CTRANSFER_PIPELINE_H
@@ -31,6 +31,10 @@
 
 #include "CommonDefs.h"
 
+#include <string>
+
+class CMultiDevice;
+
 //! Common interface for the tasks within the assignment.
 /*!
 	Inherit a new class for each computing task.
@@ -42,6 +46,14 @@ public:
 
 	virtual ~IComputeTask() {};
 	
+	//! Optionally starts building the programs of the task before InitResources() is called
+	/*!
+		CAssignmentBase::RunComputeTasks() calls this for all of its tasks first,
+		so that the builds of later tasks overlap with the earlier ones (see
+		CProgramBuilder). InitResources() then waits for the program.
+	*/
+	virtual void StartProgramBuilds(cl_device_id Device, cl_context Context) {}
+
 	//! Init any resources specific to the current task
 	virtual bool InitResources(cl_device_id Device, cl_context Context, cl_command_queue CommandQueue) = 0;
 
@@ -56,6 +68,40 @@ public:
 
 	//! Compare the GPU solution to the "golden" solution
 	virtual bool ValidateResults() = 0;
+
+	//! Prepares ComputeGPU() on the queue it will run on, e.g. tunes its local work sizes
+	/*!
+		Called after InitResources(), before the GPU time is taken. The task keeps
+		what it prepared; LocalWorkSize is the one ComputeGPU() will be called with.
+		With TuneLocalWorkSize the task should prefer the local work size found by
+		CWorkGroupTuner over the given one (see --force-lws), a local work size of
+		0 asks for the tuned one in any case.
+	*/
+	virtual void PrepareComputeGPU(cl_command_queue CommandQueue, const size_t LocalWorkSize[3], bool TuneLocalWorkSize) {}
+
+	//! Builds the kernels of all devices and calibrates the split for ComputeMultiDevice()
+	/*!
+		Called before the GPU time is taken. Returns false if the task has no
+		multi-device implementation, or if it failed; ComputeGPU() is used instead then.
+	*/
+	virtual bool PrepareMultiDevice(CMultiDevice& Devices) { return false; }
+
+	//! Perform the calculations split across all devices, into the same results as ComputeGPU()
+	/*!
+		Only called after PrepareMultiDevice() succeeded. Returns false if it
+		failed; ComputeGPU() is used instead then.
+	*/
+	virtual bool ComputeMultiDevice(CMultiDevice& Devices) { return false; }
+
+	//! Name of the task in summaries such as CTaskScheduler::PrintResults(), empty if it has none
+	virtual std::string GetName() const { return std::string(); }
+
+	//! Estimated device memory allocated by InitResources(), 0 if unknown
+	/*!
+		Called before InitResources(). CTaskScheduler only starts the task while
+		this fits into its memory budget next to the tasks already running.
+	*/
+	virtual size_t GetDeviceBytes() const { return 0; }
 };
 
 #endif // _ICOMPUTE_TASK_H
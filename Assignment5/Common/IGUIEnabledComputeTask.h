@@ -21,11 +21,23 @@
 #define _IGUI_ENABLED_COMPUTE_TASK_H
 
 #include "IComputeTask.h"
+#include "CTraceRecorder.h"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
 
 //! Common interface for task that have and OpenGL UI
 /*!
 	Currently we only use this interface in Assignment4
 	to perform GL rendering and respond to user input with keyboard and mouse.
+
+	In headless mode (see SetHeadless()) the task creates no GL resources and
+	uses plain OpenCL buffers instead of shared ones, so it runs without a window
+	or a GL context. Render() and the input callbacks must not be called then.
+	The stages of ComputeGPU() are timed between BeginStages() and EndStage(),
+	which synchronize with the queue in headless mode only.
 */
 class IGUIEnabledComputeTask : public IComputeTask
 {
@@ -45,6 +57,69 @@ public:
 	virtual void OnIdle(double Time, float ElapsedTime) = 0;
 
 	virtual void OnWindowResized(int Width, int Height) = 0;
+
+	//! Skips all OpenGL resources; must be set before InitResources()
+	void SetHeadless(bool Headless) { m_Headless = Headless; }
+
+	bool IsHeadless() const { return m_Headless; }
+
+	void ResetStageTimes()
+	{
+		m_StageNames.clear();
+		m_StageMs.clear();
+	}
+
+	//! Prints the mean time per step of each stage recorded since ResetStageTimes()
+	void PrintStageTimes(unsigned int NSteps) const
+	{
+		double total = 0.0;
+		std::cout << "Stage times, mean of " << NSteps << " steps:" << std::endl;
+		for (size_t i = 0; i < m_StageNames.size(); i++)
+		{
+			std::cout << "  " << std::left << std::setw(24) << m_StageNames[i] << std::right
+				<< std::fixed << std::setprecision(4) << m_StageMs[i] / NSteps << " ms" << std::endl;
+			total += m_StageMs[i];
+		}
+		std::cout << "  " << std::left << std::setw(24) << "total" << std::right
+			<< std::fixed << std::setprecision(4) << total / NSteps << " ms" << std::endl;
+		std::cout.unsetf(std::ios::floatfield);
+	}
+
+protected:
+	void BeginStages(cl_command_queue CommandQueue)
+	{
+		if (!m_Headless)
+			return;
+		clFinish(CommandQueue);
+		m_StageStartUs = CTraceRecorder::GetTimeMicroseconds();
+	}
+
+	//! Waits for the queue and adds the time since the previous mark to the stage Name
+	void EndStage(cl_command_queue CommandQueue, const std::string& Name)
+	{
+		if (!m_Headless)
+			return;
+		clFinish(CommandQueue);
+		double now = CTraceRecorder::GetTimeMicroseconds();
+
+		size_t i = 0;
+		while (i < m_StageNames.size() && m_StageNames[i] != Name)
+			i++;
+		if (i == m_StageNames.size())
+		{
+			m_StageNames.push_back(Name);
+			m_StageMs.push_back(0.0);
+		}
+		m_StageMs[i] += (now - m_StageStartUs) * 0.001;
+		m_StageStartUs = now;
+	}
+
+	bool						m_Headless = false;
+
+	// accumulated stage times in ms, in the order of their first occurrence
+	std::vector<std::string>	m_StageNames;
+	std::vector<double>			m_StageMs;
+	double						m_StageStartUs = 0.0;
 };
 
 